@@ -3,7 +3,7 @@
 //! Target: < 1ns per comparison
 
 use criterion::{black_box, criterion_group, criterion_main, Criterion};
-use flywheel::{Cell, Modifiers, Rgb};
+use flywheel::{Buffer, Cell, Modifiers, Rgb};
 
 fn cell_equality_same(c: &mut Criterion) {
     let cell_a = Cell::new('A')
@@ -45,11 +45,26 @@ fn cell_from_char(c: &mut Criterion) {
     });
 }
 
+fn buffer_set_str(c: &mut Criterion) {
+    let mut buffer = Buffer::new(200, 1);
+    let ascii = "The quick brown fox jumps over the lazy dog. ".repeat(4);
+    let mixed = "Größe 日本語 naïve café — résumé ".repeat(4);
+
+    c.bench_function("buffer_set_str_ascii", |b| {
+        b.iter(|| buffer.set_str(0, 0, black_box(&ascii), Rgb::DEFAULT_FG, Rgb::DEFAULT_BG))
+    });
+
+    c.bench_function("buffer_set_str_mixed", |b| {
+        b.iter(|| buffer.set_str(0, 0, black_box(&mixed), Rgb::DEFAULT_FG, Rgb::DEFAULT_BG))
+    });
+}
+
 criterion_group!(
     benches,
     cell_equality_same,
     cell_equality_different_grapheme,
     cell_equality_different_color,
     cell_from_char,
+    buffer_set_str,
 );
 criterion_main!(benches);
@@ -3,8 +3,11 @@
 //! Target: < 500µs for 200×50 buffer
 
 use criterion::{black_box, criterion_group, criterion_main, Criterion, BenchmarkId};
-use flywheel::{Buffer, Cell, Rgb};
-use flywheel::buffer::diff::{render_full_diff, render_full, DiffState};
+use flywheel::{Buffer, Cell, ColorMode, Rect, Rgb};
+use flywheel::buffer::compact::{render_compact_diff, CompactBuffer, CompactDiffState, StyleTable};
+use flywheel::buffer::diff::{render_diff, render_full_diff, render_full, DiffState};
+use flywheel::buffer::parallel::ParallelDiff;
+use flywheel::buffer::planar::{render_planar_diff, PlanarBuffer};
 
 /// Create a buffer with random-ish content for benchmarking.
 fn create_test_buffer(width: u16, height: u16, seed: u8) -> Buffer {
@@ -109,7 +112,7 @@ fn full_render(c: &mut Criterion) {
     c.bench_function("render_full_200x50", |b| {
         b.iter(|| {
             let mut output = Vec::with_capacity(65536);
-            render_full(black_box(&buffer), &mut output)
+            render_full(black_box(&buffer), &mut output, ColorMode::TrueColor)
         })
     });
 }
@@ -123,7 +126,7 @@ fn diff_various_sizes(c: &mut Criterion) {
         
         group.bench_with_input(
             BenchmarkId::new("full_change", format!("{}x{}", width, height)),
-            &(buffer_a, buffer_b),
+            &(&buffer_a, &buffer_b),
             |b, (a, bb)| {
                 b.iter(|| {
                     let mut output = Vec::with_capacity(65536);
@@ -132,11 +135,175 @@ fn diff_various_sizes(c: &mut Criterion) {
                 })
             },
         );
+
+        // Same frames as planes, including loading the next frame
+        let mut planar_a = PlanarBuffer::new(width, height);
+        let mut planar_b = PlanarBuffer::new(width, height);
+        planar_a.load(&buffer_a);
+        group.bench_with_input(
+            BenchmarkId::new("planar_full_change", format!("{}x{}", width, height)),
+            &buffer_b,
+            |b, bb| {
+                b.iter(|| {
+                    let mut output = Vec::with_capacity(65536);
+                    let mut state = DiffState::new();
+                    planar_b.load(black_box(bb));
+                    render_planar_diff(&planar_a, &planar_b, &[], &mut output, &mut state)
+                })
+            },
+        );
+
+        // A text-only change to one row: colors compare equal per row
+        let mut text_b = buffer_a.clone();
+        for x in 0..width {
+            let cell = *buffer_a.get(x, height / 2).unwrap();
+            text_b.set(x, height / 2, Cell::new('*').with_fg(cell.fg()).with_bg(cell.bg()));
+        }
+        group.bench_with_input(
+            BenchmarkId::new("text_change", format!("{}x{}", width, height)),
+            &(&buffer_a, &text_b),
+            |b, (a, bb)| {
+                b.iter(|| {
+                    let mut output = Vec::with_capacity(4096);
+                    let mut state = DiffState::new();
+                    render_full_diff(black_box(a), black_box(bb), &mut output, &mut state)
+                })
+            },
+        );
+        group.bench_with_input(
+            BenchmarkId::new("planar_text_change", format!("{}x{}", width, height)),
+            &text_b,
+            |b, bb| {
+                b.iter(|| {
+                    let mut output = Vec::with_capacity(4096);
+                    let mut state = DiffState::new();
+                    planar_b.load(black_box(bb));
+                    render_planar_diff(&planar_a, &planar_b, &[], &mut output, &mut state)
+                })
+            },
+        );
     }
     
     group.finish();
 }
 
+/// Create a buffer drawn with a small palette of styles, like a typical UI.
+fn create_styled_buffer(width: u16, height: u16, seed: u8) -> Buffer {
+    let mut buffer = Buffer::new(width, height);
+    for y in 0..height {
+        for x in 0..width {
+            let c = ((x + y + seed as u16) % 26 + 65) as u8 as char;
+            let style = ((x / 8 + y + seed as u16) % 16) as u8;
+            buffer.set(x, y, Cell::new(c).with_fg(Rgb::from_ansi_index(style)));
+        }
+    }
+    buffer
+}
+
+fn diff_compact_cells(c: &mut Criterion) {
+    let mut group = c.benchmark_group("diff_compact");
+
+    for (width, height) in [(200, 50), (300, 80)] {
+        let buffer_a = create_styled_buffer(width, height, 0);
+        let buffer_b = create_styled_buffer(width, height, 1);
+        let size = format!("{}x{}", width, height);
+
+        group.bench_with_input(
+            BenchmarkId::new("full_cells", &size),
+            &(&buffer_a, &buffer_b),
+            |b, (a, bb)| {
+                b.iter(|| {
+                    let mut output = Vec::with_capacity(65536);
+                    let mut state = DiffState::new();
+                    render_full_diff(black_box(a), black_box(bb), &mut output, &mut state)
+                })
+            },
+        );
+
+        let mut compact_a = CompactBuffer::new(width, height);
+        let mut compact_b = CompactBuffer::new(width, height);
+        compact_a.pack(&buffer_a, &StyleTable::new());
+        compact_b.pack(&buffer_b, compact_a.styles());
+        let mut state = CompactDiffState::default();
+        group.bench_with_input(
+            BenchmarkId::new("compact_cells", &size),
+            &(&compact_a, &compact_b),
+            |b, (a, bb)| {
+                b.iter(|| {
+                    let mut output = Vec::with_capacity(65536);
+                    state.reset();
+                    render_compact_diff(black_box(a), black_box(bb), &[], &mut output, &mut state)
+                })
+            },
+        );
+
+        // Packing is paid once per frame in compact cell mode
+        group.bench_with_input(
+            BenchmarkId::new("pack", &size),
+            &buffer_b,
+            |b, buffer| {
+                b.iter(|| compact_b.pack(black_box(buffer), compact_a.styles()))
+            },
+        );
+    }
+
+    group.finish();
+}
+
+fn diff_parallel_bands(c: &mut Criterion) {
+    let mut group = c.benchmark_group("diff_parallel");
+
+    for (width, height) in [(200, 50), (300, 80), (500, 150), (750, 225), (1000, 300)] {
+        let buffer_a = create_test_buffer(width, height, 0);
+        let buffer_b = create_test_buffer(width, height, 1);
+        let size = format!("{}x{}", width, height);
+        let rects = [Rect::from_size(width, height)];
+
+        for (name, next) in [("full_change", &buffer_b), ("identical", &buffer_a)] {
+            group.bench_with_input(
+                BenchmarkId::new(format!("{name}_serial"), &size),
+                &(&buffer_a, next),
+                |b, (a, bb)| {
+                    b.iter(|| {
+                        let mut output = Vec::with_capacity(65536);
+                        let mut state = DiffState::new();
+                        render_diff(black_box(a), black_box(bb), &rects, &mut output, &mut state)
+                    })
+                },
+            );
+
+            let mut parallel = ParallelDiff::new();
+            group.bench_with_input(
+                BenchmarkId::new(format!("{name}_bands"), &size),
+                &(&buffer_a, next),
+                |b, (a, bb)| {
+                    b.iter(|| {
+                        let mut output = Vec::with_capacity(65536);
+                        let mut state = DiffState::new();
+                        parallel.render_bands(black_box(a), black_box(bb), &rects, &mut output, &mut state)
+                    })
+                },
+            );
+
+            // Auto-tuned: bands only above the measured crossover
+            let mut parallel = ParallelDiff::new();
+            group.bench_with_input(
+                BenchmarkId::new(format!("{name}_auto"), &size),
+                &(&buffer_a, next),
+                |b, (a, bb)| {
+                    b.iter(|| {
+                        let mut output = Vec::with_capacity(65536);
+                        let mut state = DiffState::new();
+                        parallel.render(black_box(a), black_box(bb), &rects, &mut output, &mut state)
+                    })
+                },
+            );
+        }
+    }
+
+    group.finish();
+}
+
 criterion_group!(
     benches,
     diff_identical_buffers,
@@ -145,5 +312,7 @@ criterion_group!(
     diff_line_change,
     full_render,
     diff_various_sizes,
+    diff_compact_cells,
+    diff_parallel_bands,
 );
 criterion_main!(benches);
@@ -3,7 +3,7 @@
 //! Target: < 1µs per append, efficient at scale
 
 use criterion::{black_box, criterion_group, criterion_main, Criterion, BenchmarkId};
-use flywheel::{Cell, RopeBuffer, ChunkedLine, Rgb};
+use flywheel::{Cell, RopeBuffer, ChunkedLine, Rgb, SearchQuery};
 
 fn rope_append_single(c: &mut Criterion) {
     c.bench_function("rope_append_char", |b| {
@@ -115,6 +115,99 @@ fn rope_memory_stats(c: &mut Criterion) {
     });
 }
 
+fn rope_search(c: &mut Criterion) {
+    let mut buffer = RopeBuffer::new(100_000);
+    for i in 0..100_000 {
+        let line = format!("[{i:06}] worker {} processed request ok", i % 8);
+        buffer.append(line.chars().map(Cell::from_char));
+        buffer.newline();
+    }
+    let rare = SearchQuery::substring("[054321]");
+    let common = SearchQuery::regex(r"worker 3 processed").unwrap();
+
+    let mut group = c.benchmark_group("rope_search_100k");
+    group.bench_function("rare_substring", |b| {
+        b.iter(|| black_box(buffer.search(&rare)))
+    });
+    group.bench_function("common_regex", |b| {
+        b.iter(|| black_box(buffer.search(&common)))
+    });
+    group.finish();
+}
+
+/// Build a deterministic agent transcript: tool-call frames, build logs
+/// with repeated warnings, progress spam, code listings and blank lines.
+fn transcript(lines: usize) -> Vec<String> {
+    let border = "─".repeat(78);
+    let code = [
+        "fn main() {",
+        "    let config = Config::load()?;",
+        "    run(config)",
+        "}",
+    ];
+    let mut out = Vec::with_capacity(lines);
+    let mut i = 0usize;
+    while out.len() < lines {
+        out.push(format!("╭{border}╮"));
+        out.push(format!("│ Tool call #{i}: cargo build{}│", " ".repeat(57 - i.to_string().len())));
+        out.push(format!("╰{border}╯"));
+        for step in 0..20 {
+            out.push(format!("   Compiling crate-{} v0.{}.0", (i * 7 + step) % 40, step % 5));
+            if step % 4 == 0 {
+                out.push("warning: unused variable: `ctx`".to_string());
+                out.push("  --> src/agent.rs:42:9".to_string());
+            }
+        }
+        for pct in (0..=100).step_by(10) {
+            out.push(format!("Downloading [{:<20}] {pct}%", "=".repeat(pct / 5)));
+        }
+        out.push(String::new());
+        out.extend(code.iter().map(|line| (*line).to_string()));
+        out.push(String::new());
+        out.push(format!("Agent: step {i} finished, {} files changed.", i % 9));
+        out.push(String::new());
+        i += 1;
+    }
+    out.truncate(lines);
+    out
+}
+
+/// Least ratio of unshared to interned transcript size.
+const MIN_SHARING_RATIO: usize = 3;
+
+fn rope_transcript_memory(c: &mut Criterion) {
+    let corpus = transcript(100_000);
+    let fill = |buffer: &mut RopeBuffer| {
+        for line in &corpus {
+            buffer.append(line.chars().map(Cell::from_char));
+            buffer.newline();
+        }
+    };
+
+    // Measure the interned size once, and name the benchmark after it
+    let mut buffer = RopeBuffer::unbounded();
+    fill(&mut buffer);
+    let stats = buffer.memory_stats();
+    let unshared = stats.lines * std::mem::size_of::<ChunkedLine>()
+        + stats.cells * std::mem::size_of::<Cell>();
+    assert!(
+        unshared >= MIN_SHARING_RATIO * stats.bytes_estimated,
+        "interning saves too little: {} KiB vs {} KiB unshared",
+        stats.bytes_estimated / 1024,
+        unshared / 1024,
+    );
+    let id = format!("{}KiB_vs_{}KiB_unshared", stats.bytes_estimated / 1024, unshared / 1024);
+    drop(buffer);
+
+    c.bench_with_input(BenchmarkId::new("rope_transcript_100k", id), &corpus, |b, _| {
+        b.iter(|| {
+            let mut buffer = RopeBuffer::unbounded();
+            fill(&mut buffer);
+            black_box(buffer.len())
+        });
+    });
+}
+
 criterion_group!(
     benches,
     rope_append_single,
@@ -125,5 +218,7 @@ criterion_group!(
     rope_visible_lines,
     rope_scale_comparison,
     rope_memory_stats,
+    rope_search,
+    rope_transcript_memory,
 );
 criterion_main!(benches);
@@ -0,0 +1,72 @@
+//! VT benchmark: Measure terminal emulator throughput.
+//!
+//! Target: > 200 MB/s on plain text
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion, Throughput};
+use flywheel::Vt;
+
+/// Build about `size` bytes of output by repeating `line`.
+fn output(line: &str, size: usize) -> Vec<u8> {
+    line.as_bytes().iter().copied().cycle().take(size).collect()
+}
+
+fn vt_plain_text(c: &mut Criterion) {
+    let data = output(
+        "Compiling flywheel-compositor v0.1.0 (/src/flywheel) with a long enough line\r\n",
+        1 << 20,
+    );
+    let mut vt = Vt::new(200, 50);
+
+    let mut group = c.benchmark_group("vt");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("plain_text", |b| b.iter(|| vt.feed(black_box(&data))));
+    group.finish();
+}
+
+fn vt_colored_text(c: &mut Criterion) {
+    let data = output(
+        "\x1b[1;32m   Compiling\x1b[0m flywheel v0.1.0 \x1b[33mwarning\x1b[0m: unused\r\n",
+        1 << 20,
+    );
+    let mut vt = Vt::new(200, 50);
+
+    let mut group = c.benchmark_group("vt");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("colored_text", |b| b.iter(|| vt.feed(black_box(&data))));
+    group.finish();
+}
+
+fn vt_unicode_text(c: &mut Criterion) {
+    let data = output("Größe 日本語 naïve café — résumé ✓\r\n", 1 << 20);
+    let mut vt = Vt::new(200, 50);
+
+    let mut group = c.benchmark_group("vt");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("unicode_text", |b| b.iter(|| vt.feed(black_box(&data))));
+    group.finish();
+}
+
+fn vt_full_screen_redraw(c: &mut Criterion) {
+    // An editor repainting every row with cursor moves and erases
+    let mut frame = String::new();
+    for row in 1..=50 {
+        frame.push_str(&format!("\x1b[{row};1H\x1b[2K\x1b[38;5;{row}m{:>4} ", row));
+        frame.push_str(&"fn main() { println!(\"hello\"); } ".repeat(5));
+    }
+    let data = output(&frame, 1 << 20);
+    let mut vt = Vt::new(200, 50);
+
+    let mut group = c.benchmark_group("vt");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("full_screen_redraw", |b| b.iter(|| vt.feed(black_box(&data))));
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    vt_plain_text,
+    vt_colored_text,
+    vt_unicode_text,
+    vt_full_screen_redraw,
+);
+criterion_main!(benches);
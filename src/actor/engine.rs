@@ -6,7 +6,8 @@
 
 use super::messages::{InputEvent, RenderCommand};
 use super::{InputActor, RendererActor};
-use crate::buffer::{Buffer, Cell, Rgb};
+use crate::buffer::text::str_width;
+use crate::buffer::{Buffer, Cell, ColorMode, Rgb};
 use crate::layout::Rect;
 use crossbeam_channel::{bounded, Receiver, Sender, TryRecvError};
 use crossterm::{
@@ -17,6 +18,7 @@ use crossterm::{
 };
 use std::io::{self};
 use std::time::{Duration, Instant};
+use unicode_segmentation::UnicodeSegmentation;
 
 /// Configuration for the Engine.
 #[derive(Debug, Clone)]
@@ -29,6 +31,23 @@ pub struct EngineConfig {
     pub enable_mouse: bool,
     /// Whether to use alternate screen buffer.
     pub alternate_screen: bool,
+    /// Rows of the inline live region.
+    ///
+    /// When set, the engine draws only this many rows below the cursor
+    /// instead of taking over the screen, and `alternate_screen` is
+    /// ignored. Finished output goes above the region through
+    /// [`Engine::commit`] and lives on in the terminal's own scrollback.
+    pub inline_height: Option<u16>,
+    /// Colors the terminal can show.
+    ///
+    /// Defaults to true color. Palette colors are always written as short
+    /// indexed codes; in the palette modes true colors are quantized too.
+    pub color_mode: ColorMode,
+    /// Whether the renderer diffs frames as 8-byte compact cells with
+    /// interned styles instead of full 16-byte cells.
+    ///
+    /// Saves memory bandwidth on large screens with few distinct styles.
+    pub compact_cells: bool,
 }
 
 impl Default for EngineConfig {
@@ -38,6 +57,9 @@ impl Default for EngineConfig {
             input_poll_timeout: Duration::from_millis(10),
             enable_mouse: false,
             alternate_screen: true,
+            inline_height: None,
+            color_mode: ColorMode::TrueColor,
+            compact_cells: false,
         }
     }
 }
@@ -56,13 +78,12 @@ pub struct Engine {
     /// Input actor handle.
     input_actor: Option<InputActor>,
     /// Renderer actor handle.
-    #[allow(dead_code)]
     renderer_actor: Option<RendererActor>,
     /// Application buffer (for modifications).
     buffer: Buffer,
     /// Terminal width.
     width: u16,
-    /// Terminal height.
+    /// Terminal height (live region height in inline mode).
     height: u16,
     /// Frame timing.
     frame_start: Instant,
@@ -94,8 +115,15 @@ impl Engine {
         // Enter raw mode and alternate screen
         terminal::enable_raw_mode()?;
 
+        // The cursor has to be queried before the input actor starts
+        // reading terminal responses
+        let cursor = match config.inline_height {
+            Some(_) => cursor::position()?,
+            None => (0, 0),
+        };
+
         let mut stdout = io::stdout();
-        if config.alternate_screen {
+        if config.alternate_screen && config.inline_height.is_none() {
             execute!(stdout, EnterAlternateScreen)?;
         }
         if config.enable_mouse {
@@ -109,7 +137,27 @@ impl Engine {
 
         // Spawn actors
         let input_actor = InputActor::spawn(input_tx, config.input_poll_timeout);
-        let renderer_actor = RendererActor::spawn(render_rx, width, height);
+        let (renderer_actor, height) = if let Some(rows) = config.inline_height {
+            let actor = RendererActor::spawn_inline(
+                render_rx,
+                width,
+                height,
+                rows,
+                cursor,
+                config.color_mode,
+                config.compact_cells,
+            );
+            (actor, region_height(rows, height))
+        } else {
+            let actor = RendererActor::spawn(
+                render_rx,
+                width,
+                height,
+                config.color_mode,
+                config.compact_cells,
+            );
+            (actor, height)
+        };
 
         let frame_duration = Duration::from_secs(1) / config.target_fps;
 
@@ -135,10 +183,20 @@ impl Engine {
     }
 
     /// Get the terminal height.
+    ///
+    /// In inline mode this is the height of the live region.
     pub const fn height(&self) -> u16 {
         self.height
     }
 
+    /// Get the colors the terminal can show.
+    ///
+    /// Widgets that write escape sequences directly use it to match the
+    /// renderer.
+    pub const fn color_mode(&self) -> ColorMode {
+        self.config.color_mode
+    }
+
     /// Get a reference to the buffer.
     pub const fn buffer(&self) -> &Buffer {
         &self.buffer
@@ -154,6 +212,12 @@ impl Engine {
         &self.input_rx
     }
 
+    /// Check if the engine renders an inline live region rather than the
+    /// whole screen.
+    pub const fn is_inline(&self) -> bool {
+        self.config.inline_height.is_some()
+    }
+
     /// Check if the engine is still running.
     pub const fn is_running(&self) -> bool {
         self.running
@@ -211,11 +275,35 @@ impl Engine {
         let _ = self.render_tx.send(RenderCommand::RawOutput { bytes });
     }
 
+    /// Commit finished rows above the inline live region.
+    ///
+    /// The rows are written once and handed to the terminal's scrollback;
+    /// the engine keeps no copy, so memory and per-frame work don't grow
+    /// with the transcript. Rows should be no wider than [`width`](Self::width).
+    /// Does nothing in full-screen mode.
+    pub fn commit(&self, rows: Buffer) {
+        if self.is_inline() {
+            let _ = self.render_tx.send(RenderCommand::Commit(Box::new(rows)));
+        }
+    }
+
+    /// Commit lines of text above the inline live region.
+    ///
+    /// Lines are split on `\n` and wrapped at the terminal width.
+    pub fn commit_text(&self, text: &str, fg: Rgb, bg: Rgb) {
+        if self.is_inline() {
+            self.commit(layout_lines(text, self.width, fg, bg));
+        }
+    }
+
     /// Handle a resize event.
     pub fn handle_resize(&mut self, width: u16, height: u16) {
         self.width = width;
-        self.height = height;
-        self.buffer.resize(width, height);
+        self.height = self
+            .config
+            .inline_height
+            .map_or(height, |rows| region_height(rows, height));
+        self.buffer.resize(width, self.height);
         let _ = self.render_tx.send(RenderCommand::Resize { width, height });
     }
 
@@ -271,15 +359,7 @@ impl Engine {
     ///
     /// Returns the number of columns used.
     pub fn draw_text(&mut self, x: u16, y: u16, text: &str, fg: Rgb, bg: Rgb) -> u16 {
-        let mut col = x;
-        for grapheme in unicode_segmentation::UnicodeSegmentation::graphemes(text, true) {
-            if col >= self.width {
-                break;
-            }
-            let width = self.buffer.set_grapheme(col, y, grapheme, fg, bg);
-            col += u16::from(width);
-        }
-        col - x
+        self.buffer.set_str(x, y, text, fg, bg)
     }
 }
 
@@ -291,6 +371,10 @@ impl Drop for Engine {
         }
 
         let _ = self.render_tx.send(RenderCommand::Shutdown);
+        // The renderer releases the inline region on its way out
+        if let Some(actor) = self.renderer_actor.take() {
+            actor.join();
+        }
 
         // Restore terminal state
         let mut stdout = io::stdout();
@@ -298,9 +382,63 @@ impl Drop for Engine {
         if self.config.enable_mouse {
             let _ = execute!(stdout, crossterm::event::DisableMouseCapture);
         }
-        if self.config.alternate_screen {
+        if self.config.alternate_screen && !self.is_inline() {
             let _ = execute!(stdout, LeaveAlternateScreen);
         }
         let _ = terminal::disable_raw_mode();
     }
 }
+
+/// Rows of the live region for a terminal `terminal_height` rows tall.
+fn region_height(rows: u16, terminal_height: u16) -> u16 {
+    rows.clamp(1, terminal_height.max(1))
+}
+
+/// Lay out lines of text in rows `width` columns wide, wrapping long lines.
+fn layout_lines(text: &str, width: u16, fg: Rgb, bg: Rgb) -> Buffer {
+    let width = width.max(1);
+    let mut placed: Vec<(u16, u16, &str)> = Vec::new();
+    let mut row = 0u16;
+    for line in text.split('\n') {
+        let mut col = 0u16;
+        for grapheme in line.trim_end_matches('\r').graphemes(true) {
+            let grapheme_width = u16::try_from(str_width(grapheme)).unwrap_or(1);
+            if grapheme_width == 0 {
+                continue;
+            }
+            if col + grapheme_width > width {
+                row = row.saturating_add(1);
+                col = 0;
+            }
+            placed.push((col, row, grapheme));
+            col += grapheme_width;
+        }
+        row = row.saturating_add(1);
+    }
+
+    let mut buffer = Buffer::new(width, row);
+    for (x, y, grapheme) in placed {
+        buffer.set_grapheme(x, y, grapheme, fg, bg);
+    }
+    buffer
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_layout_lines_wraps() {
+        let fg = Rgb::new(255, 255, 255);
+        let bg = Rgb::new(0, 0, 0);
+        let buffer = layout_lines("abcdef\nxy\n世界", 4, fg, bg);
+
+        assert_eq!(buffer.height(), 4);
+        assert_eq!(buffer.get_grapheme(3, 0), Some("d"));
+        assert_eq!(buffer.get_grapheme(0, 1), Some("e"));
+        assert_eq!(buffer.get_grapheme(0, 2), Some("x"));
+        assert_eq!(buffer.get_grapheme(2, 3), Some("界"));
+        assert_eq!(region_height(8, 5), 5);
+        assert_eq!(region_height(0, 24), 1);
+    }
+}
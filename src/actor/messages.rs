@@ -196,6 +196,12 @@ pub enum RenderCommand {
         bytes: Vec<u8>,
     },
 
+    /// Write finished rows above the inline live region, once, into the
+    /// terminal's native scrollback.
+    ///
+    /// Ignored in full-screen mode.
+    Commit(Box<Buffer>),
+
     /// Shutdown the render thread.
     Shutdown,
 }
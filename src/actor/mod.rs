@@ -4,6 +4,7 @@
 //! - **Input Actor**: Polls terminal events, forwards to main loop
 //! - **Render Actor**: Receives render commands, diffs and flushes
 //! - **Ticker Actor**: Generates regular timing events for frame pacing
+//! - **Token Router**: Batches agent output from many threads into stream widgets
 //! - **Main Loop**: Coordinates between actors, handles application logic
 //!
 //! # Architecture
@@ -32,9 +33,11 @@ mod input;
 mod renderer;
 mod engine;
 mod ticker;
+mod router;
 
 pub use messages::{InputEvent, RenderCommand, AgentEvent, KeyCode, KeyModifiers, MouseButton, MouseEvent};
 pub use input::InputActor;
 pub use renderer::RendererActor;
 pub use engine::{Engine, EngineConfig};
 pub use ticker::{TickerActor, Tick};
+pub use router::{TokenRouter, RoutedFrame, FrameOutput};
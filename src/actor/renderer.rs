@@ -3,10 +3,33 @@
 //! This actor owns the terminal and double buffers. It receives render
 //! commands from the main loop and performs the actual diffing and
 //! output flushing.
+//!
+//! In inline mode the renderer owns only a live region at the bottom of
+//! the terminal. The region is pinned with a scroll margin and origin
+//! mode, so diffs, fast-path writes and cursor moves address it from its
+//! own top-left corner. Committed lines are written once above it and left
+//! to the terminal's native scrollback:
+//!
+//! ```text
+//! ┌──────────────────────────┐
+//! │ committed line 1         │  terminal scrollback (never redrawn)
+//! │ committed line 2         │
+//! ├──────────────────────────┤  ← origin
+//! │ streaming line           │  live region (diffed every frame)
+//! │ > input bar              │
+//! └──────────────────────────┘
+//! ```
 
 use super::messages::RenderCommand;
-use crate::buffer::diff::{render_diff, render_full, DiffState};
-use crate::buffer::Buffer;
+use crate::buffer::compact::{render_compact_diff, CompactBuffer, CompactDiffState, Packed};
+use crate::buffer::diff::{render_full, render_lines, render_region, DiffResult, DiffState};
+#[cfg(not(any(feature = "planar", feature = "parallel")))]
+use crate::buffer::diff::render_diff;
+#[cfg(all(feature = "parallel", not(feature = "planar")))]
+use crate::buffer::parallel::ParallelDiff;
+#[cfg(feature = "planar")]
+use crate::buffer::planar::{render_planar_diff, PlanarBuffer};
+use crate::buffer::{Buffer, ColorMode};
 use crate::layout::Rect;
 use crossbeam_channel::Receiver;
 use std::io::{self, Stdout, Write};
@@ -39,10 +62,185 @@ pub struct RenderStats {
     pub last_render_us: u64,
 }
 
-/// Internal renderer state.
-struct Renderer {
+/// Placement of the live region in inline mode.
+#[derive(Debug, Clone, Copy)]
+struct Inline {
+    /// Rows requested for the live region.
+    rows: u16,
+    /// Terminal row where the region starts, or the row it should start
+    /// at before it has been placed.
+    origin: u16,
+    /// Terminal height in rows.
+    terminal_height: u16,
+    /// Whether the terminal has been scrolled to make room for the region.
+    placed: bool,
+}
+
+impl Inline {
+    /// Rows the region actually has, given the terminal height.
+    fn height(self) -> u16 {
+        self.rows.clamp(1, self.terminal_height.max(1))
+    }
+
+    /// Make room for the region from `row` down, scrolling the terminal
+    /// when it doesn't fit, and move the region there.
+    ///
+    /// `row` may be one past the last terminal row, meaning everything on
+    /// screen has to scroll up once more.
+    fn place(&mut self, row: u16, output: &mut Vec<u8>) {
+        let height = self.height();
+        let last = self.terminal_height.saturating_sub(1);
+        let _ = write!(output, "\x1b[{}H", row.min(last) + 1);
+        let newlines = (row - row.min(last)) + height - 1;
+        output.extend(std::iter::repeat_n(b'\n', usize::from(newlines)));
+        self.origin = row.min(self.terminal_height.saturating_sub(height));
+        self.placed = true;
+    }
+
+    /// Pin the scroll margin and origin mode to the region.
+    fn enter(self, output: &mut Vec<u8>) {
+        let top = self.origin + 1;
+        let bottom = self.origin + self.height();
+        let _ = write!(output, "\x1b[{top};{bottom}r\x1b[?6h");
+    }
+
+    /// Release the scroll margin and origin mode.
+    fn leave(output: &mut Vec<u8>) {
+        output.extend_from_slice(b"\x1b[?6l\x1b[r");
+    }
+}
+
+/// Compact copies of the frames, diffed instead of the full-cell buffers.
+struct CompactFrames {
+    /// What's on screen.
+    current: CompactBuffer,
+    /// The frame being rendered.
+    next: CompactBuffer,
+    /// Diff state for cursor/style tracking.
+    state: CompactDiffState,
+}
+
+// Row bands are only split for full-cell frames, so with both features
+// `parallel` would silently do nothing.
+#[cfg(all(feature = "planar", feature = "parallel"))]
+compile_error!("the `planar` and `parallel` features are mutually exclusive");
+
+/// The renderer's copy of the frame on screen, which the next frame is
+/// diffed against.
+///
+/// Full cells by default. With the `planar` feature the frames are kept as
+/// planar copies and diffed plane by plane. With the `parallel` feature
+/// full-cell frames large enough to pay off are diffed in row bands.
+#[cfg(not(feature = "planar"))]
+struct Retained {
     /// Current (visible) buffer.
     current: Buffer,
+    /// Splits large diffs into row bands.
+    #[cfg(feature = "parallel")]
+    parallel: ParallelDiff,
+}
+
+#[cfg(not(feature = "planar"))]
+impl Retained {
+    /// Create an empty copy.
+    fn new(width: u16, height: u16) -> Self {
+        Self {
+            current: Buffer::new(width, height),
+            #[cfg(feature = "parallel")]
+            parallel: ParallelDiff::new(),
+        }
+    }
+
+    /// Diff `next` against the frame on screen.
+    #[cfg(not(feature = "parallel"))]
+    #[allow(clippy::needless_pass_by_ref_mut)]
+    fn diff(
+        &mut self,
+        next: &Buffer,
+        dirty_rects: &[Rect],
+        output: &mut Vec<u8>,
+        state: &mut DiffState,
+    ) -> DiffResult {
+        render_diff(&self.current, next, dirty_rects, output, state)
+    }
+
+    /// Diff `next` against the frame on screen, in row bands if it is
+    /// large enough.
+    #[cfg(feature = "parallel")]
+    fn diff(
+        &mut self,
+        next: &Buffer,
+        dirty_rects: &[Rect],
+        output: &mut Vec<u8>,
+        state: &mut DiffState,
+    ) -> DiffResult {
+        self.parallel.render(&self.current, next, dirty_rects, output, state)
+    }
+
+    /// Keep `next` as the frame on screen.
+    fn keep(&mut self, next: &Buffer) {
+        self.current.copy_from(next);
+    }
+
+    /// Resize the copy.
+    fn resize(&mut self, width: u16, height: u16) {
+        self.current.resize(width, height);
+    }
+}
+
+#[cfg(feature = "planar")]
+struct Retained {
+    /// Current (visible) frame.
+    current: PlanarBuffer,
+    /// The last frame diffed, if it hasn't been kept yet.
+    next: PlanarBuffer,
+    /// Whether `next` holds the frame being rendered.
+    loaded: bool,
+}
+
+#[cfg(feature = "planar")]
+impl Retained {
+    /// Create an empty copy.
+    fn new(width: u16, height: u16) -> Self {
+        Self {
+            current: PlanarBuffer::new(width, height),
+            next: PlanarBuffer::new(width, height),
+            loaded: false,
+        }
+    }
+
+    /// Diff `next` against the frame on screen.
+    fn diff(
+        &mut self,
+        next: &Buffer,
+        dirty_rects: &[Rect],
+        output: &mut Vec<u8>,
+        state: &mut DiffState,
+    ) -> DiffResult {
+        self.next.load(next);
+        self.loaded = true;
+        render_planar_diff(&self.current, &self.next, dirty_rects, output, state)
+    }
+
+    /// Keep `next` as the frame on screen.
+    fn keep(&mut self, next: &Buffer) {
+        if std::mem::take(&mut self.loaded) {
+            self.current.swap(&mut self.next);
+        } else {
+            self.current.load(next);
+        }
+    }
+
+    /// Resize the copy.
+    fn resize(&mut self, width: u16, height: u16) {
+        *self = Self::new(width, height);
+    }
+}
+
+/// Internal renderer state.
+struct Renderer {
+    /// Copy of the visible frame.
+    current: Retained,
     /// Next (being drawn) buffer.
     next: Buffer,
     /// Diff state for cursor/color tracking.
@@ -60,18 +258,23 @@ struct Renderer {
     /// Cursor position (None = hidden).
     cursor_x: Option<u16>,
     cursor_y: u16,
+    /// Live region placement (None = full-screen mode).
+    inline: Option<Inline>,
+    /// Compact frames, in compact cell mode.
+    compact: Option<CompactFrames>,
 }
 
 impl Renderer {
-    /// Create a new renderer with the given dimensions.
-    fn new(width: u16, height: u16) -> Self {
-        let current = Buffer::new(width, height);
+    /// Create a new renderer with the given dimensions, writing colors for
+    /// `color_mode`, and diffing compact cells if `compact_cells` is set.
+    fn new(width: u16, height: u16, color_mode: ColorMode, compact_cells: bool) -> Self {
+        let current = Retained::new(width, height);
         let next = Buffer::new(width, height);
 
         Self {
             current,
             next,
-            diff_state: DiffState::new(),
+            diff_state: DiffState::with_color_mode(color_mode),
             output: Vec::with_capacity(65536),
             stdout: io::stdout(),
             stats: RenderStats::default(),
@@ -79,9 +282,39 @@ impl Renderer {
             needs_full_redraw: true,
             cursor_x: None,
             cursor_y: 0,
+            inline: None,
+            compact: compact_cells.then(|| CompactFrames {
+                current: CompactBuffer::new(width, height),
+                next: CompactBuffer::new(width, height),
+                state: CompactDiffState::new(color_mode),
+            }),
         }
     }
 
+    /// Create a renderer for an inline live region of `rows` rows.
+    ///
+    /// The region starts on `cursor_row`, the terminal row the cursor is
+    /// on, or one below it when the cursor isn't at the start of the line.
+    fn new_inline(
+        width: u16,
+        terminal_height: u16,
+        rows: u16,
+        cursor: (u16, u16),
+        color_mode: ColorMode,
+        compact_cells: bool,
+    ) -> Self {
+        let (col, row) = cursor;
+        let inline = Inline {
+            rows,
+            origin: row + u16::from(col > 0),
+            terminal_height,
+            placed: false,
+        };
+        let mut renderer = Self::new(width, inline.height(), color_mode, compact_cells);
+        renderer.inline = Some(inline);
+        renderer
+    }
+
     /// Get a mutable reference to the next buffer.
     #[allow(dead_code)]
     pub const fn buffer_mut(&mut self) -> &mut Buffer {
@@ -99,20 +332,67 @@ impl Renderer {
         self.dirty_rects.push(rect);
     }
 
+    /// Forget the terminal state the diff states track.
+    const fn reset_diff_state(&mut self) {
+        self.diff_state.reset();
+        if let Some(compact) = self.compact.as_mut() {
+            compact.state.reset();
+        }
+    }
+
+    /// Pack the next frame into compact cells, in compact cell mode.
+    ///
+    /// Frames whose style ids can't be compared with the last one are
+    /// redrawn in full. Frames with more styles than a table can hold turn
+    /// compact cell mode off.
+    fn pack_next(&mut self) {
+        let Some(compact) = self.compact.as_mut() else {
+            return;
+        };
+        match compact.next.pack(&self.next, compact.current.styles()) {
+            Packed::Comparable => {}
+            Packed::Renumbered => self.needs_full_redraw = true,
+            Packed::TooManyStyles => {
+                self.compact = None;
+                self.needs_full_redraw = true;
+            }
+        }
+    }
+
     /// Perform a render cycle.
     fn render(&mut self) -> io::Result<()> {
         let start = Instant::now();
         self.output.clear();
+        self.pack_next();
 
-        if self.needs_full_redraw {
+        if let Some(inline) = self.inline.as_mut().filter(|_| self.needs_full_redraw) {
+            // Repaint only the live region; the rows above belong to the
+            // terminal's scrollback
+            Inline::leave(&mut self.output);
+            if !inline.placed {
+                inline.place(inline.origin, &mut self.output);
+            }
+            inline.enter(&mut self.output);
+            render_region(&self.next, &mut self.output, self.diff_state.color_mode());
+            self.needs_full_redraw = false;
+            self.reset_diff_state();
+        } else if self.needs_full_redraw {
             // Full redraw
-            render_full(&self.next, &mut self.output);
+            render_full(&self.next, &mut self.output, self.diff_state.color_mode());
             self.needs_full_redraw = false;
-            self.diff_state.reset();
+            self.reset_diff_state();
+        } else if let Some(compact) = self.compact.as_mut() {
+            // Diff-based update over compact cells
+            let _result = render_compact_diff(
+                &compact.current,
+                &compact.next,
+                &self.dirty_rects,
+                &mut self.output,
+                &mut compact.state,
+            );
         } else {
             // Diff-based update
-            let _result = render_diff(
-                &self.current,
+            let _result = self.current.diff(
                 &self.next,
                 &self.dirty_rects,
                 &mut self.output,
@@ -143,7 +423,10 @@ impl Renderer {
         }
 
         // Swap buffers
-        self.current.copy_from(&self.next);
+        match self.compact.as_mut() {
+            Some(compact) => compact.current.swap(&mut compact.next),
+            None => self.current.keep(&self.next),
+        }
 
         // Update stats
         let elapsed = start.elapsed();
@@ -179,13 +462,75 @@ impl Renderer {
         // followed by more Fast Path writes. Mixing Fast and Slow requires
         // a full redraw to resync.
         self.needs_full_redraw = true;
-        self.diff_state.reset();
+        self.reset_diff_state();
         
         Ok(())
     }
 
+    /// Write finished rows above the live region and hand them to the
+    /// terminal's scrollback.
+    ///
+    /// The live region moves down by the number of rows written until it
+    /// reaches the bottom of the terminal, after which the terminal scrolls
+    /// instead. The region is then repainted from the last frame. Rows
+    /// wider than the terminal are clipped by the terminal's autowrap, so
+    /// callers should commit buffers no wider than the region.
+    fn commit(&mut self, rows: &Buffer) -> io::Result<()> {
+        let Some(inline) = self.inline.as_mut() else {
+            // Full-screen mode has no scrollback to commit to
+            return Ok(());
+        };
+        if rows.height() == 0 {
+            return Ok(());
+        }
+
+        self.output.clear();
+        Inline::leave(&mut self.output);
+        if !inline.placed {
+            inline.place(inline.origin, &mut self.output);
+        }
+        let _ = write!(self.output, "\x1b[{}H\x1b[J", inline.origin + 1);
+        render_lines(rows, &mut self.output, self.diff_state.color_mode());
+
+        // The last committed row ends on the row before this one
+        let next_row = (inline.origin + rows.height()).min(inline.terminal_height);
+        inline.place(next_row, &mut self.output);
+        self.stdout.write_all(&self.output)?;
+        self.stats.bytes_written += self.output.len() as u64;
+
+        self.mark_full_dirty();
+        self.render()
+    }
+
+    /// Release the live region, leaving the cursor below it so whatever
+    /// runs next continues the transcript.
+    fn finish_inline(&mut self) -> io::Result<()> {
+        let Some(inline) = self.inline else {
+            return Ok(());
+        };
+        self.output.clear();
+        Inline::leave(&mut self.output);
+        if inline.placed {
+            let bottom = inline.origin + inline.height();
+            let _ = write!(self.output, "\x1b[{bottom}H\x1b[0m\r\n");
+        }
+        self.stdout.write_all(&self.output)?;
+        self.stdout.flush()
+    }
+
     /// Resize buffers.
+    ///
+    /// In inline mode `height` is the terminal height; the buffers keep
+    /// the live region's height, shrunk to fit if the terminal is smaller.
     fn resize(&mut self, width: u16, height: u16) {
+        let height = match self.inline.as_mut() {
+            Some(inline) => {
+                inline.terminal_height = height;
+                inline.origin = inline.origin.min(height.saturating_sub(inline.height()));
+                inline.height()
+            },
+            None => height,
+        };
         self.current.resize(width, height);
         self.next.resize(width, height);
         self.mark_full_dirty();
@@ -206,19 +551,62 @@ impl RendererActor {
     /// * `receiver` - Channel to receive render commands from.
     /// * `width` - Initial terminal width.
     /// * `height` - Initial terminal height.
+    /// * `color_mode` - Colors the terminal can show.
+    /// * `compact_cells` - Whether to diff frames as compact cells.
+    ///
+    /// # Returns
+    ///
+    /// The renderer actor handle.
+    pub fn spawn(
+        receiver: Receiver<RenderCommand>,
+        width: u16,
+        height: u16,
+        color_mode: ColorMode,
+        compact_cells: bool,
+    ) -> Self {
+        Self::spawn_renderer(receiver, Renderer::new(width, height, color_mode, compact_cells))
+    }
+
+    /// Spawn a renderer that owns only an inline live region.
+    ///
+    /// # Arguments
+    ///
+    /// * `receiver` - Channel to receive render commands from.
+    /// * `width` - Initial terminal width.
+    /// * `terminal_height` - Initial terminal height.
+    /// * `rows` - Height of the live region.
+    /// * `cursor` - Terminal cursor position (column, row) at startup; the
+    ///   region is placed from there down.
+    /// * `color_mode` - Colors the terminal can show.
+    /// * `compact_cells` - Whether to diff frames as compact cells.
     ///
     /// # Returns
     ///
     /// The renderer actor handle.
+    pub fn spawn_inline(
+        receiver: Receiver<RenderCommand>,
+        width: u16,
+        terminal_height: u16,
+        rows: u16,
+        cursor: (u16, u16),
+        color_mode: ColorMode,
+        compact_cells: bool,
+    ) -> Self {
+        let renderer =
+            Renderer::new_inline(width, terminal_height, rows, cursor, color_mode, compact_cells);
+        Self::spawn_renderer(receiver, renderer)
+    }
+
+    /// Run `renderer` on a new render thread.
     #[allow(clippy::missing_panics_doc)]
-    pub fn spawn(receiver: Receiver<RenderCommand>, width: u16, height: u16) -> Self {
+    fn spawn_renderer(receiver: Receiver<RenderCommand>, renderer: Renderer) -> Self {
         let shutdown = Arc::new(AtomicBool::new(false));
         let shutdown_clone = shutdown.clone();
 
         let handle = thread::Builder::new()
             .name("flywheel-render".to_string())
             .spawn(move || {
-                if let Err(e) = Self::run_loop(&receiver, &shutdown_clone, width, height) {
+                if let Err(e) = Self::run_loop(&receiver, &shutdown_clone, renderer) {
                     eprintln!("Render thread error: {e}");
                 }
             })
@@ -246,10 +634,8 @@ impl RendererActor {
     fn run_loop(
         receiver: &Receiver<RenderCommand>,
         shutdown: &Arc<AtomicBool>,
-        width: u16,
-        height: u16,
+        mut renderer: Renderer,
     ) -> io::Result<()> {
-        let mut renderer = Renderer::new(width, height);
 
         loop {
             // Check for shutdown
@@ -278,6 +664,9 @@ impl RendererActor {
                     RenderCommand::RawOutput { bytes } => {
                         renderer.write_raw(&bytes)?;
                     }
+                    RenderCommand::Commit(rows) => {
+                        renderer.commit(&rows)?;
+                    }
                     RenderCommand::Shutdown => {
                         break;
                     }
@@ -288,6 +677,37 @@ impl RendererActor {
             }
         }
 
-        Ok(())
+        renderer.finish_inline()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_inline_region_placement() {
+        let mut inline = Inline {
+            rows: 3,
+            origin: 0,
+            terminal_height: 10,
+            placed: false,
+        };
+        let mut output = Vec::new();
+
+        // Room below the cursor: nothing scrolls
+        inline.place(2, &mut output);
+        assert_eq!(inline.origin, 2);
+        assert_eq!(output, b"\x1b[3H\n\n");
+
+        // Committing past the bottom pins the region there
+        output.clear();
+        inline.place(10, &mut output);
+        assert_eq!(inline.origin, 7);
+        assert_eq!(output, b"\x1b[10H\n\n\n");
+
+        output.clear();
+        inline.enter(&mut output);
+        assert_eq!(output, b"\x1b[8;10r\x1b[?6h");
     }
 }
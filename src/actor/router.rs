@@ -0,0 +1,295 @@
+//! Token Router: Fans agent output from many threads into stream widgets.
+//!
+//! Producers (agent connections, sub-agent threads) send [`AgentEvent`]s
+//! into one lock-free channel. The UI thread drains it once per frame,
+//! groups the tokens by `source_id` and hands each [`StreamWidget`] a
+//! single batch, so the cost of a cross-thread handoff and of an append
+//! pass is paid per frame rather than per token:
+//!
+//! ```text
+//! ┌─────────┐
+//! │ Agent 1 │ ──┐  AgentEvent  ┌─────────────┐  append_batch  ┌──────────────┐
+//! └─────────┘   ├────────────▶ │ TokenRouter │ ─────────────▶ │ StreamWidget │ ×N
+//! ┌─────────┐   │              └─────────────┘                └──────────────┘
+//! │ Agent 2 │ ──┘                     │
+//! └─────────┘                         ▼ one RawOutput or Update per frame
+//! ```
+
+use super::engine::Engine;
+use super::messages::AgentEvent;
+use crate::buffer::{Buffer, ColorMode};
+use crate::widget::{AppendResult, StreamWidget};
+use crossbeam_channel::{bounded, Receiver, Sender};
+use std::collections::HashMap;
+
+/// Events buffered between producers and the UI thread by default.
+const DEFAULT_CAPACITY: usize = 4096;
+
+/// How a drained frame should reach the terminal.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum FrameOutput {
+    /// Nothing changed on screen.
+    None,
+    /// Every stream took its fast path; write these bytes as they are.
+    Raw(Vec<u8>),
+    /// At least one stream needs repainting; render the updated streams.
+    Render,
+}
+
+/// Result of draining one frame's worth of events.
+#[derive(Debug, Clone)]
+pub struct RoutedFrame {
+    /// Number of token events appended to streams.
+    pub tokens: usize,
+    /// Sources whose streams received text, in first-arrival order.
+    pub updated: Vec<u32>,
+    /// Sources whose final token chunk arrived.
+    pub finished: Vec<u32>,
+    /// Events that weren't routed to a stream, in arrival order: every
+    /// non-token event, and tokens for sources without a stream.
+    pub events: Vec<AgentEvent>,
+    /// How the frame should reach the terminal.
+    pub output: FrameOutput,
+}
+
+/// Routes [`AgentEvent`]s from many producer threads to per-source
+/// [`StreamWidget`]s.
+///
+/// Producers get a [`Sender`] from [`sender`](Self::sender); the UI thread
+/// calls [`pump`](Self::pump) (or [`drain`](Self::drain)) once per frame.
+pub struct TokenRouter {
+    /// Sending side, cloned out to producers.
+    tx: Sender<AgentEvent>,
+    /// Receiving side, drained by the UI thread.
+    rx: Receiver<AgentEvent>,
+    /// Stream for each source.
+    streams: HashMap<u32, StreamWidget>,
+    /// Most events taken from the channel per frame.
+    max_events_per_frame: usize,
+}
+
+impl TokenRouter {
+    /// Create a router with the default channel capacity.
+    pub fn new() -> Self {
+        Self::with_capacity(DEFAULT_CAPACITY)
+    }
+
+    /// Create a router whose channel holds up to `capacity` events.
+    ///
+    /// Producers block when the channel is full, so a stalled UI thread
+    /// applies backpressure instead of buffering without limit.
+    pub fn with_capacity(capacity: usize) -> Self {
+        let (tx, rx) = bounded(capacity.max(1));
+        Self {
+            tx,
+            rx,
+            streams: HashMap::new(),
+            max_events_per_frame: capacity.max(1),
+        }
+    }
+
+    /// Get a sender for a producer thread.
+    pub fn sender(&self) -> Sender<AgentEvent> {
+        self.tx.clone()
+    }
+
+    /// Route tokens from `source_id` to `stream`.
+    ///
+    /// # Returns
+    /// The stream previously routed for that source, if any.
+    pub fn add_stream(&mut self, source_id: u32, stream: StreamWidget) -> Option<StreamWidget> {
+        self.streams.insert(source_id, stream)
+    }
+
+    /// Stop routing `source_id`, returning its stream.
+    pub fn remove_stream(&mut self, source_id: u32) -> Option<StreamWidget> {
+        self.streams.remove(&source_id)
+    }
+
+    /// Get the stream for a source.
+    pub fn stream(&self, source_id: u32) -> Option<&StreamWidget> {
+        self.streams.get(&source_id)
+    }
+
+    /// Get the stream for a source mutably.
+    pub fn stream_mut(&mut self, source_id: u32) -> Option<&mut StreamWidget> {
+        self.streams.get_mut(&source_id)
+    }
+
+    /// Limit how many events one frame takes from the channel.
+    ///
+    /// Anything beyond the limit waits for the next frame, so a flood from
+    /// one producer can't stall input handling.
+    pub fn set_max_events_per_frame(&mut self, max: usize) {
+        self.max_events_per_frame = max.max(1);
+    }
+
+    /// Take the events waiting in the channel and append them to streams.
+    ///
+    /// Tokens for each source are appended as one batch, in the order
+    /// they arrived. Fast-path output is written for `color_mode`. Streams
+    /// must not be rendered between this call and acting on the returned
+    /// [`FrameOutput`].
+    pub fn drain(&mut self, color_mode: ColorMode) -> RoutedFrame {
+        let mut batches: Vec<(u32, Vec<String>)> = Vec::new();
+        let mut slots: HashMap<u32, usize> = HashMap::new();
+        let mut frame = RoutedFrame {
+            tokens: 0,
+            updated: Vec::new(),
+            finished: Vec::new(),
+            events: Vec::new(),
+            output: FrameOutput::None,
+        };
+
+        for event in self.rx.try_iter().take(self.max_events_per_frame) {
+            match event {
+                AgentEvent::Tokens {
+                    content,
+                    source_id,
+                    is_final,
+                } if self.streams.contains_key(&source_id) => {
+                    let slot = *slots.entry(source_id).or_insert_with(|| {
+                        batches.push((source_id, Vec::new()));
+                        batches.len() - 1
+                    });
+                    batches[slot].1.push(content);
+                    frame.tokens += 1;
+                    if is_final {
+                        frame.finished.push(source_id);
+                    }
+                },
+                event => frame.events.push(event),
+            }
+        }
+
+        let mut raw = Vec::new();
+        let mut fast = true;
+        for (source_id, tokens) in &batches {
+            let Some(stream) = self.streams.get_mut(source_id) else {
+                continue;
+            };
+            match stream.append_batch(tokens) {
+                AppendResult::Empty => continue,
+                result @ AppendResult::FastPath { .. } => {
+                    stream.write_fast_path_batch(result, tokens, color_mode, &mut raw);
+                },
+                AppendResult::SlowPath { .. } => fast = false,
+            }
+            frame.updated.push(*source_id);
+        }
+
+        frame.output = match (frame.updated.is_empty(), fast) {
+            (true, _) => FrameOutput::None,
+            (false, true) => FrameOutput::Raw(raw),
+            (false, false) => FrameOutput::Render,
+        };
+        frame
+    }
+
+    /// Render the streams updated in `frame` into `buffer`.
+    ///
+    /// Streams that took the fast path are repainted too, since their rows
+    /// were not written directly.
+    pub fn render_updated(&mut self, frame: &RoutedFrame, buffer: &mut Buffer) {
+        for source_id in &frame.updated {
+            if let Some(stream) = self.streams.get_mut(source_id) {
+                stream.render(buffer);
+            }
+        }
+    }
+
+    /// Drain one frame's events and send a single render request for them.
+    ///
+    /// Fast-path output from every stream goes out as one raw write;
+    /// otherwise the updated streams are rendered into the engine's buffer
+    /// and one diff update is requested.
+    ///
+    /// # Returns
+    /// The drained frame, whose [`events`](RoutedFrame::events) the
+    /// application still has to handle.
+    pub fn pump(&mut self, engine: &mut Engine) -> RoutedFrame {
+        let mut frame = self.drain(engine.color_mode());
+        match std::mem::replace(&mut frame.output, FrameOutput::Render) {
+            FrameOutput::None => frame.output = FrameOutput::None,
+            FrameOutput::Raw(bytes) => engine.write_raw(bytes),
+            FrameOutput::Render => {
+                self.render_updated(&frame, engine.buffer_mut());
+                engine.request_update();
+            },
+        }
+        frame
+    }
+}
+
+impl Default for TokenRouter {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::layout::Rect;
+    use std::thread;
+
+    #[test]
+    fn test_router_coalesces_sources() {
+        let mut router = TokenRouter::with_capacity(10_000);
+        for source_id in 0..4 {
+            router.add_stream(source_id, StreamWidget::new(Rect::new(0, 0, 40, 10)));
+        }
+
+        let producers: Vec<_> = (0..4)
+            .map(|source_id| {
+                let tx = router.sender();
+                thread::spawn(move || {
+                    let _ = tx.send(AgentEvent::ResponseStart { source_id });
+                    for i in 0..1000 {
+                        let content = format!("token {i}\n");
+                        let _ = tx.send(AgentEvent::Tokens {
+                            content,
+                            source_id,
+                            is_final: i == 999,
+                        });
+                    }
+                })
+            })
+            .collect();
+        for producer in producers {
+            producer.join().unwrap();
+        }
+        let tx = router.sender();
+        tx.send(AgentEvent::Tokens {
+            content: "lost".into(),
+            source_id: 9,
+            is_final: false,
+        })
+        .unwrap();
+
+        let frame = router.drain(ColorMode::TrueColor);
+        assert_eq!(frame.tokens, 4000);
+        assert_eq!(frame.updated.len(), 4);
+        assert_eq!(frame.finished.len(), 4);
+        assert_eq!(frame.output, FrameOutput::Render);
+        // Four response starts and the unrouted token
+        assert_eq!(frame.events.len(), 5);
+        for source_id in 0..4 {
+            assert_eq!(router.stream(source_id).unwrap().line_count(), 1001);
+        }
+
+        // Same-line tokens from every source go out as one raw write
+        for source_id in 0..2 {
+            let content = "ok".to_string();
+            tx.send(AgentEvent::Tokens {
+                content,
+                source_id,
+                is_final: false,
+            })
+            .unwrap();
+        }
+        let frame = router.drain(ColorMode::TrueColor);
+        assert!(matches!(frame.output, FrameOutput::Raw(bytes) if !bytes.is_empty()));
+        assert_eq!(router.drain(ColorMode::TrueColor).output, FrameOutput::None);
+    }
+}
@@ -4,6 +4,25 @@
 //! Cells are stored in row-major order.
 
 use super::cell::{Cell, CellFlags, Rgb};
+use super::graphemes;
+use super::text::{self, Segment};
+use crate::layout::Rect;
+use std::collections::hash_map::Entry;
+use std::collections::HashMap;
+use std::ops::Range;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+
+/// Number of held graphemes below which unused ones are never swept.
+const MIN_SWEEP_LEN: usize = 64;
+
+/// Source of held grapheme set versions, unique across buffers.
+static NEXT_GRAPHEMES_VERSION: AtomicU64 = AtomicU64::new(1);
+
+/// Get a version for a held grapheme set that just changed.
+fn next_graphemes_version() -> u64 {
+    NEXT_GRAPHEMES_VERSION.fetch_add(1, Ordering::Relaxed)
+}
 
 /// A grid of cells representing the terminal screen.
 ///
@@ -12,9 +31,11 @@ use super::cell::{Cell, CellFlags, Rgb};
 ///
 /// # Overflow Storage
 ///
-/// Complex graphemes (>4 bytes) are stored in a separate arena (`Vec`).
-/// The cell contains an index into this overflow storage when the
-/// `OVERFLOW` flag is set.
+/// Complex graphemes (>4 bytes) are interned in the shared
+/// [grapheme table](super::graphemes). The cell holds the grapheme's id
+/// when the `OVERFLOW` flag is set, and the buffer holds a reference to
+/// each grapheme its cells use. Graphemes no cell uses any more are let go
+/// whenever the held set has doubled since the last sweep.
 #[derive(Clone)]
 pub struct Buffer {
     /// Contiguous cell storage (row-major order).
@@ -23,8 +44,13 @@ pub struct Buffer {
     width: u16,
     /// Terminal height in rows.
     height: u16,
-    /// Overflow arena for complex graphemes (O(1) indexed access).
-    overflow: Vec<String>,
+    /// Interned graphemes used by overflow cells, by id.
+    graphemes: HashMap<u32, Arc<str>>,
+    /// Version of `graphemes`: sets with the same version hold the same
+    /// graphemes. 0 is the empty set.
+    graphemes_version: u64,
+    /// Number of held graphemes that triggers the next sweep.
+    sweep_at: usize,
 }
 
 impl Buffer {
@@ -41,7 +67,9 @@ impl Buffer {
             cells: vec![Cell::EMPTY; size],
             width,
             height,
-            overflow: Vec::new(),
+            graphemes: HashMap::new(),
+            graphemes_version: 0,
+            sweep_at: MIN_SWEEP_LEN,
         }
     }
 
@@ -146,19 +174,21 @@ impl Buffer {
             return 0;
         };
 
-        let width = u8::try_from(unicode_width::UnicodeWidthStr::width(grapheme)).unwrap_or(1);
+        let width = u8::try_from(text::str_width(grapheme)).unwrap_or(1);
 
         // Try to create an inline cell
         let cell = if let Some(mut cell) = Cell::from_grapheme(grapheme) {
             cell.set_fg(fg).set_bg(bg);
             cell
         } else {
-            // Overflow: store in arena (simple Vec indexing)
-            // Safety: Overflow arena is capped at u32::MAX entries (4 billion graphemes)
-            #[allow(clippy::cast_possible_truncation)]
-            let overflow_idx = self.overflow.len() as u32;
-            self.overflow.push(grapheme.to_string());
-            Cell::overflow(overflow_idx, width).with_fg(fg).with_bg(bg)
+            // Overflow: intern it and hold on to it while this buffer lives
+            let (id, text) = graphemes::intern(grapheme);
+            self.sweep_graphemes();
+            if let Entry::Vacant(entry) = self.graphemes.entry(id) {
+                entry.insert(text);
+                self.graphemes_version = next_graphemes_version();
+            }
+            Cell::overflow(id, width).with_fg(fg).with_bg(bg)
         };
 
         self.cells[idx] = cell;
@@ -173,6 +203,43 @@ impl Buffer {
         width
     }
 
+    /// Write a string starting at (x, y), clipped to the end of the row.
+    ///
+    /// Printable ASCII runs are written straight into the row; other text
+    /// is placed one grapheme cluster at a time via
+    /// [`set_grapheme`](Self::set_grapheme). Control characters are skipped.
+    ///
+    /// # Returns
+    /// The number of columns written.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn set_str(&mut self, x: u16, y: u16, s: &str, fg: Rgb, bg: Rgb) -> u16 {
+        if y >= self.height {
+            return 0;
+        }
+
+        let mut col = x;
+        for segment in text::segments(s) {
+            if col >= self.width {
+                break;
+            }
+            match segment {
+                Segment::Ascii(run) => {
+                    let n = run.len().min(usize::from(self.width - col));
+                    let start = y as usize * self.width as usize + col as usize;
+                    for (cell, &b) in self.cells[start..start + n].iter_mut().zip(run) {
+                        *cell = Cell::new(b as char).with_fg(fg).with_bg(bg);
+                    }
+                    col += n as u16;
+                }
+                Segment::Grapheme(grapheme) => {
+                    col += u16::from(self.set_grapheme(col, y, grapheme, fg, bg));
+                }
+                Segment::Control(_) => {}
+            }
+        }
+        col - x
+    }
+
     /// Get the grapheme at (x, y), including overflow lookup.
     ///
     /// Returns `None` if out of bounds or if it's a continuation cell.
@@ -184,36 +251,251 @@ impl Buffer {
         }
 
         if cell.flags().contains(CellFlags::OVERFLOW) {
-            let idx = cell.overflow_index()?;
-            self.overflow.get(idx as usize).map(String::as_str)
+            self.get_overflow(cell.overflow_index()?)
         } else {
             cell.grapheme()
         }
     }
 
-    /// Get an overflow grapheme by its index.
+    /// Get an overflow grapheme by its id.
     ///
     /// This is used by the diffing engine when rendering overflow cells.
+    /// Only graphemes this buffer holds are found: cells copied in raw from
+    /// another buffer need [`hold_graphemes`](Self::hold_graphemes).
     #[inline]
     pub fn get_overflow(&self, index: u32) -> Option<&str> {
-        self.overflow.get(index as usize).map(String::as_str)
+        self.graphemes.get(&index).map(AsRef::as_ref)
+    }
+
+    /// Hold every grapheme `other` holds, so its overflow cells can be
+    /// copied into this buffer as they are.
+    pub fn hold_graphemes(&mut self, other: &Self) {
+        self.sweep_graphemes();
+        if self.graphemes_version == other.graphemes_version {
+            return;
+        }
+        let held = self.graphemes.len();
+        for (&id, text) in &other.graphemes {
+            self.graphemes.entry(id).or_insert_with(|| Arc::clone(text));
+        }
+        if self.graphemes.len() != held {
+            self.graphemes_version = next_graphemes_version();
+        }
+    }
+
+    /// Let go of graphemes no cell uses any more, once the held set has
+    /// doubled since the last sweep.
+    ///
+    /// Runs before graphemes are added, so graphemes held for cells about to
+    /// be copied in are never swept before the copy.
+    fn sweep_graphemes(&mut self) {
+        if self.graphemes.len() < self.sweep_at {
+            return;
+        }
+        let mut used = HashMap::with_capacity(self.graphemes.len());
+        for cell in self.cells.iter().filter(|cell| cell.is_overflow()) {
+            if let Some((id, text)) = cell
+                .overflow_index()
+                .and_then(|id| self.graphemes.get_key_value(&id))
+            {
+                used.entry(*id).or_insert_with(|| Arc::clone(text));
+            }
+        }
+        if used.len() != self.graphemes.len() {
+            self.graphemes = used;
+            self.graphemes_version = next_graphemes_version();
+        }
+        self.sweep_at = (self.graphemes.len() * 2).max(MIN_SWEEP_LEN);
+    }
+
+    /// Get the graphemes held by this buffer, by id.
+    #[inline]
+    pub(crate) const fn graphemes(&self) -> &HashMap<u32, Arc<str>> {
+        &self.graphemes
+    }
+
+    /// Get the version of the held graphemes, which changes whenever they
+    /// do, so copies of them can be skipped while it stays the same.
+    #[inline]
+    pub(crate) const fn graphemes_version(&self) -> u64 {
+        self.graphemes_version
+    }
+
+    /// Get the cells from column `x` to the end of row `y`, or `None` if
+    /// the position is outside the buffer.
+    fn row_from_mut(&mut self, x: u16, y: u16) -> Option<&mut [Cell]> {
+        let start = self.index_of(x, y)?;
+        let end = start + usize::from(self.width - x);
+        Some(&mut self.cells[start..end])
+    }
+
+    /// Write a run of cells into row `y` from column `x`, clipped to the
+    /// row. Returns the number of cells written.
+    ///
+    /// The run is clipped once and copied as one block. Cells are copied as
+    /// they are, so overflow cells must come from a buffer whose graphemes
+    /// this one [holds](Self::hold_graphemes). A wide cell whose
+    /// continuation is clipped off is written as a blank.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn write_row_span(&mut self, x: u16, y: u16, cells: &[Cell]) -> u16 {
+        let Some(row) = self.row_from_mut(x, y) else { return 0 };
+        let len = row.len().min(cells.len());
+        row[..len].copy_from_slice(&cells[..len]);
+        if len > 0 && cells.get(len).is_some_and(Cell::is_wide_continuation) {
+            blank_split(&mut row[len - 1]);
+        }
+        len as u16
+    }
+
+    /// Write cells from an iterator into row `y` from column `x`, clipped
+    /// to the row. Returns the number of cells written.
+    ///
+    /// Like [`write_row_span`](Self::write_row_span), for cells made on the
+    /// fly: they are written straight into the row, with no intermediate
+    /// collection.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn write_row_span_iter(&mut self, x: u16, y: u16, cells: impl IntoIterator<Item = Cell>) -> u16 {
+        let Some(row) = self.row_from_mut(x, y) else { return 0 };
+        let mut cells = cells.into_iter().peekable();
+        let mut len = 0;
+        for (slot, cell) in row.iter_mut().zip(&mut cells) {
+            *slot = cell;
+            len += 1;
+        }
+        if len > 0 && cells.peek().is_some_and(Cell::is_wide_continuation) {
+            blank_split(&mut row[len - 1]);
+        }
+        len as u16
+    }
+
+    /// Write a line stored one cell per grapheme into row `y` from column
+    /// `x`, using at most `width` columns. Returns the columns used.
+    ///
+    /// Runs of single-width cells are copied as blocks. A wide cell is set
+    /// on its own with a continuation after it, or as a blank if only one
+    /// column is left for it.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn write_cells(&mut self, x: u16, y: u16, width: u16, mut cells: &[Cell]) -> u16 {
+        let mut col = 0;
+        while col < width && !cells.is_empty() {
+            let run = cells
+                .iter()
+                .position(|cell| cell.display_width() != 1)
+                .unwrap_or(cells.len())
+                .min(usize::from(width - col));
+            if run == 0 {
+                let mut cell = cells[0];
+                if cell.display_width() == 2 {
+                    if col + 1 < width && x + col + 1 < self.width {
+                        self.set(x + col + 1, y, Cell::wide_continuation().with_bg(cell.bg()));
+                    } else {
+                        blank_split(&mut cell);
+                    }
+                }
+                self.set(x + col, y, cell);
+                col += u16::from(cell.display_width());
+                cells = &cells[1..];
+            } else {
+                self.write_row_span(x + col, y, &cells[..run]);
+                col += run as u16;
+                cells = &cells[run..];
+            }
+        }
+        col.min(width)
+    }
+
+    /// Fill `width` cells of row `y` from column `x` with a cell, clipped to
+    /// the row. Returns the number of cells filled.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn fill_row_span(&mut self, x: u16, y: u16, width: u16, cell: Cell) -> u16 {
+        let Some(row) = self.row_from_mut(x, y) else { return 0 };
+        let len = row.len().min(usize::from(width));
+        row[..len].fill(cell);
+        len as u16
     }
 
     /// Fill a rectangular region with a cell.
     pub fn fill_rect(&mut self, x: u16, y: u16, width: u16, height: u16, cell: Cell) {
-        for row in y..(y + height).min(self.height) {
-            for col in x..(x + width).min(self.width) {
-                if let Some(idx) = self.index_of(col, row) {
-                    self.cells[idx] = cell;
+        for row in y..y.saturating_add(height).min(self.height) {
+            self.fill_row_span(x, row, width, cell);
+        }
+    }
+
+    /// Copy the `src_rect` region of `src` to column `x`, row `y`, clipped
+    /// to both buffers.
+    ///
+    /// Each row is copied as one block. Graphemes of copied overflow cells
+    /// are shared with `src`, not interned again, and only those are held.
+    /// Wide cells split by the region's left or right edge are written as
+    /// blanks.
+    pub fn blit(&mut self, src: &Self, src_rect: Rect, x: u16, y: u16) {
+        let width = src_rect
+            .width
+            .min(src.width.saturating_sub(src_rect.x))
+            .min(self.width.saturating_sub(x));
+        let height = src_rect
+            .height
+            .min(src.height.saturating_sub(src_rect.y))
+            .min(self.height.saturating_sub(y));
+        if width == 0 || height == 0 {
+            return;
+        }
+
+        self.sweep_graphemes();
+        let mut held = false;
+        for row in 0..height {
+            let from = usize::from(src_rect.y + row) * usize::from(src.width)
+                + usize::from(src_rect.x);
+            let to = usize::from(y + row) * usize::from(self.width) + usize::from(x);
+            let span = &mut self.cells[to..][..usize::from(width)];
+            span.copy_from_slice(&src.cells[from..][..usize::from(width)]);
+
+            if span[0].is_wide_continuation() {
+                blank_split(&mut span[0]);
+            }
+            let next = src_rect.x + width;
+            if next < src.width && src.cells[from + usize::from(width)].is_wide_continuation() {
+                blank_split(&mut span[usize::from(width) - 1]);
+            }
+
+            for id in span.iter().filter_map(Cell::overflow_index) {
+                let Some(text) = src.graphemes.get(&id) else { continue };
+                if let Entry::Vacant(entry) = self.graphemes.entry(id) {
+                    entry.insert(Arc::clone(text));
+                    held = true;
                 }
             }
         }
+        if held {
+            self.graphemes_version = next_graphemes_version();
+        }
+    }
+
+    /// Copy the rows in `rows` so they start at row `y`, as when scrolling
+    /// a region. The ranges may overlap; rows that would land outside the
+    /// buffer are dropped.
+    pub fn copy_rows_within(&mut self, rows: Range<u16>, y: u16) {
+        let count = rows
+            .end
+            .min(self.height)
+            .saturating_sub(rows.start)
+            .min(self.height.saturating_sub(y));
+        if count == 0 {
+            return;
+        }
+
+        let width = usize::from(self.width);
+        let start = usize::from(rows.start) * width;
+        self.cells
+            .copy_within(start..start + usize::from(count) * width, usize::from(y) * width);
     }
 
     /// Clear the entire buffer (fill with empty cells).
     pub fn clear(&mut self) {
         self.cells.fill(Cell::EMPTY);
-        self.overflow.clear();
+        self.graphemes.clear();
+        self.graphemes_version = 0;
+        self.sweep_at = MIN_SWEEP_LEN;
     }
 
     /// Clear a rectangular region.
@@ -250,12 +532,17 @@ impl Buffer {
 
     /// Copy content from another buffer.
     ///
-    /// The buffers must have the same dimensions.
+    /// The buffers must have the same dimensions. Graphemes are shared,
+    /// not copied, and the held set is only replaced if it differs.
     pub fn copy_from(&mut self, other: &Self) {
         debug_assert_eq!(self.width, other.width);
         debug_assert_eq!(self.height, other.height);
         self.cells.copy_from_slice(&other.cells);
-        self.overflow.clone_from(&other.overflow);
+        if self.graphemes_version != other.graphemes_version {
+            self.graphemes.clone_from(&other.graphemes);
+            self.graphemes_version = other.graphemes_version;
+        }
+        self.sweep_at = other.sweep_at;
     }
 
     /// Swap the contents of two buffers.
@@ -265,7 +552,9 @@ impl Buffer {
         std::mem::swap(&mut self.cells, &mut other.cells);
         std::mem::swap(&mut self.width, &mut other.width);
         std::mem::swap(&mut self.height, &mut other.height);
-        std::mem::swap(&mut self.overflow, &mut other.overflow);
+        std::mem::swap(&mut self.graphemes, &mut other.graphemes);
+        std::mem::swap(&mut self.graphemes_version, &mut other.graphemes_version);
+        std::mem::swap(&mut self.sweep_at, &mut other.sweep_at);
     }
 
     /// Get an iterator over rows.
@@ -281,8 +570,9 @@ impl Buffer {
     /// Get memory usage in bytes (approximate).
     pub fn memory_usage(&self) -> usize {
         let cells_size = self.cells.len() * std::mem::size_of::<Cell>();
-        let overflow_size: usize = self.overflow.iter().map(|s| s.len() + 32).sum();
-        cells_size + overflow_size + std::mem::size_of::<Self>()
+        let graphemes_size =
+            self.graphemes.capacity() * std::mem::size_of::<(u32, Arc<str>)>();
+        cells_size + graphemes_size + std::mem::size_of::<Self>()
     }
 }
 
@@ -291,12 +581,22 @@ impl std::fmt::Debug for Buffer {
         f.debug_struct("Buffer")
             .field("width", &self.width)
             .field("height", &self.height)
-            .field("overflow_count", &self.overflow.len())
+            .field("grapheme_count", &self.graphemes.len())
             .field("memory_bytes", &self.memory_usage())
             .finish_non_exhaustive()
     }
 }
 
+/// Replace half of a wide cell cut off by a clip edge with a blank in the
+/// same style, so the row never holds a lead without its continuation or
+/// the reverse.
+fn blank_split(cell: &mut Cell) {
+    *cell = Cell::new(' ')
+        .with_fg(cell.fg())
+        .with_bg(cell.bg())
+        .with_modifiers(cell.modifiers());
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -365,6 +665,41 @@ mod tests {
         assert!(width > 0);
         assert!(buffer.get(0, 0).unwrap().is_overflow());
         assert_eq!(buffer.get_grapheme(0, 0), Some(emoji));
+
+        // The same grapheme has the same id in every buffer and frame
+        let mut other = Buffer::new(80, 24);
+        other.set_grapheme(0, 0, emoji, Rgb::WHITE, Rgb::BLACK);
+        buffer.set_grapheme(0, 1, emoji, Rgb::WHITE, Rgb::BLACK);
+        assert_eq!(other.get(0, 0), buffer.get(0, 0));
+        assert_eq!(buffer.get(0, 1), buffer.get(0, 0));
+
+        // Raw copies work once the graphemes are held
+        let mut copy = Buffer::new(80, 24);
+        copy.cells_mut()[0] = buffer.cells()[0];
+        assert_eq!(copy.get_grapheme(0, 0), None);
+        copy.hold_graphemes(&buffer);
+        assert_eq!(copy.get_grapheme(0, 0), Some(emoji));
+
+        // Overwritten graphemes are let go
+        for i in 0..10 * MIN_SWEEP_LEN {
+            buffer.set_grapheme(1, 0, &format!("{emoji}{i}"), Rgb::WHITE, Rgb::BLACK);
+        }
+        assert!(buffer.graphemes().len() <= 2 * MIN_SWEEP_LEN);
+        assert_eq!(buffer.get_grapheme(0, 1), Some(emoji));
+        let last = format!("{emoji}{}", 10 * MIN_SWEEP_LEN - 1);
+        assert_eq!(buffer.get_grapheme(1, 0), Some(last.as_str()));
+
+        // Frame copies take the held set only when it changed
+        let mut frame = Buffer::new(80, 24);
+        frame.copy_from(&buffer);
+        assert_eq!(frame.graphemes_version(), buffer.graphemes_version());
+        let version = buffer.graphemes_version();
+        buffer.set_grapheme(2, 0, emoji, Rgb::WHITE, Rgb::BLACK);
+        assert_eq!(buffer.graphemes_version(), version);
+        buffer.set_grapheme(2, 0, "🏳️‍🌈", Rgb::WHITE, Rgb::BLACK);
+        assert_ne!(buffer.graphemes_version(), version);
+        frame.copy_from(&buffer);
+        assert_eq!(frame.get_grapheme(2, 0), Some("🏳️‍🌈"));
     }
 
     #[test]
@@ -380,6 +715,78 @@ mod tests {
         assert_eq!(buffer.get(9, 5).unwrap().grapheme(), Some(" ")); // Outside rect
     }
 
+    #[test]
+    fn test_buffer_row_spans() {
+        let mut buffer = Buffer::new(10, 3);
+        let cells = [Cell::new('a'), Cell::new('b'), Cell::new('c')];
+        assert_eq!(buffer.write_row_span(8, 1, &cells), 2); // Clipped to the row
+        assert_eq!(buffer.get_grapheme(9, 1), Some("b"));
+        assert_eq!(buffer.get_grapheme(0, 2), Some(" "));
+        assert_eq!(buffer.write_row_span(10, 1, &cells), 0);
+
+        assert_eq!(buffer.fill_row_span(4, 0, 100, Cell::new('-')), 6);
+        assert_eq!(buffer.get_grapheme(3, 0), Some(" "));
+        assert_eq!(buffer.get_grapheme(9, 0), Some("-"));
+        assert_eq!(buffer.fill_row_span(0, 3, 5, Cell::new('-')), 0);
+
+        let letters = "xyz".chars().map(Cell::new);
+        assert_eq!(buffer.write_row_span_iter(8, 2, letters), 2);
+        assert_eq!(buffer.get_grapheme(9, 2), Some("y"));
+
+        // A wide cell cut off at the edge is blanked, not left half-drawn
+        let wide = [Cell::new('a'), Cell::from_char('字'), Cell::wide_continuation()];
+        assert_eq!(buffer.write_row_span(8, 1, &wide), 2);
+        assert_eq!(buffer.get_grapheme(9, 1), Some(" "));
+        assert_eq!(buffer.write_row_span_iter(8, 2, wide), 2);
+        assert_eq!(buffer.get_grapheme(9, 2), Some(" "));
+
+        // Lines stored one cell per grapheme get continuations written
+        let bg = Rgb::new(0, 0, 80);
+        let line = [Cell::new('a'), Cell::from_char('字').with_bg(bg), Cell::from_char('字')];
+        assert_eq!(buffer.write_cells(0, 0, 4, &line), 4);
+        assert_eq!(buffer.get_grapheme(1, 0), Some("字"));
+        assert!(buffer.get(2, 0).unwrap().is_wide_continuation());
+        assert_eq!(buffer.get(2, 0).unwrap().bg(), bg);
+        assert_eq!(buffer.get_grapheme(3, 0), Some(" "));
+        assert_eq!(buffer.get(3, 0).unwrap().bg(), Cell::from_char('字').bg());
+    }
+
+    #[test]
+    fn test_buffer_blit_and_copy_rows() {
+        let emoji = "👨‍👩‍👧‍👦";
+        let mut src = Buffer::new(6, 4);
+        src.set_str(0, 1, "hello", Rgb::WHITE, Rgb::BLACK);
+        src.set_grapheme(3, 2, emoji, Rgb::WHITE, Rgb::BLACK);
+
+        // Clipped to both buffers; overflow graphemes come along
+        let mut dst = Buffer::new(5, 3);
+        dst.blit(&src, Rect::new(1, 1, 10, 10), 1, 0);
+        assert_eq!(dst.get_grapheme(1, 0), Some("e"));
+        assert_eq!(dst.get_grapheme(4, 0), Some("o"));
+        assert_eq!(dst.get_grapheme(0, 0), Some(" "));
+        assert_eq!(dst.get_grapheme(3, 1), Some(emoji));
+
+        // Only graphemes of copied cells are held
+        src.set_grapheme(0, 3, "🏳️‍🌈", Rgb::WHITE, Rgb::BLACK);
+        let mut part = Buffer::new(5, 3);
+        part.blit(&src, Rect::new(0, 0, 6, 3), 0, 0);
+        assert_eq!(part.graphemes().len(), 1);
+
+        // Scroll rows up by one, overlapping
+        dst.copy_rows_within(1..3, 0);
+        assert_eq!(dst.get_grapheme(3, 0), Some(emoji));
+        assert_eq!(dst.get_grapheme(3, 1), dst.get_grapheme(3, 2));
+        dst.copy_rows_within(0..3, 2);
+        assert_eq!(dst.get_grapheme(3, 2), Some(emoji));
+
+        // Wide cells split by either edge of the region are blanked
+        let mut dst = Buffer::new(5, 3);
+        dst.blit(&src, Rect::new(3, 2, 1, 1), 0, 0);
+        assert_eq!(dst.get_grapheme(0, 0), Some(" "));
+        dst.blit(&src, Rect::new(4, 2, 2, 1), 0, 1);
+        assert!(!dst.get(0, 1).unwrap().is_wide_continuation());
+    }
+
     #[test]
     fn test_buffer_clear() {
         let mut buffer = Buffer::new(80, 24);
@@ -425,4 +832,21 @@ mod tests {
         assert!(usage >= 160_000);
         assert!(usage < 200_000); // Shouldn't be too much more
     }
+
+    #[test]
+    fn test_buffer_set_str() {
+        let mut buffer = Buffer::new(8, 2);
+        let fg = Rgb::new(1, 2, 3);
+
+        let cols = buffer.set_str(0, 0, "ab漢e\u{301}", fg, Rgb::DEFAULT_BG);
+        assert_eq!(cols, 5);
+        assert_eq!(buffer.get(1, 0).unwrap().fg(), fg);
+        assert_eq!(buffer.get_grapheme(2, 0), Some("漢"));
+        assert!(buffer.get(3, 0).unwrap().is_wide_continuation());
+        assert_eq!(buffer.get_grapheme(4, 0), Some("e\u{301}"));
+
+        // Clipped at the end of the row
+        assert_eq!(buffer.set_str(5, 1, "overflow", fg, Rgb::DEFAULT_BG), 3);
+        assert_eq!(buffer.get_grapheme(7, 1), Some("e"));
+    }
 }
@@ -8,15 +8,16 @@
 //! - Complex graphemes (emoji ZWJ sequences) spill to an external `HashMap`
 //!
 //! ```text
-//! ┌───────────────────────────────────────────────────────────────────────────┐
-//! │  Cell Layout (16 bytes)                                                   │
-//! ├─────────────┬─────────────┬───────────┬───────────┬─────┬───────┬─────────┤
-//! │  grapheme   │  len + width│    fg     │    bg     │ mod │ flags │ padding │
-//! │  [u8; 4]    │  u8 + u8    │  [u8; 3]  │  [u8; 3]  │ u8  │  u8   │ [u8; 2] │
-//! │  4 bytes    │  2 bytes    │  3 bytes  │  3 bytes  │ 1b  │  1b   │  2 b    │
-//! └─────────────┴─────────────┴───────────┴───────────┴─────┴───────┴─────────┘
+//! ┌─────────────────────────────────────────────────────────────────┐
+//! │  Cell Layout (16 bytes)                                         │
+//! ├─────────────┬─────────────┬───────────┬───────────┬─────┬───────┤
+//! │  grapheme   │  len + width│    fg     │    bg     │ mod │ flags │
+//! │  [u8; 4]    │  u8 + u8    │  [u8; 4]  │  [u8; 4]  │ u8  │  u8   │
+//! │  4 bytes    │  2 bytes    │  4 bytes  │  4 bytes  │ 1b  │  1b   │
+//! └─────────────┴─────────────┴───────────┴───────────┴─────┴───────┘
 //! ```
 
+use super::palette::PALETTE;
 use bitflags::bitflags;
 use std::hash::{Hash, Hasher};
 
@@ -24,8 +25,18 @@ use std::hash::{Hash, Hasher};
 ///
 /// Uses 3 bytes for 24-bit color depth, supporting 16.7 million colors.
 /// This is essential for precise brand colors in commercial applications.
+///
+/// A fourth byte remembers the palette index of colors made with
+/// [`from_ansi_index`](Self::from_ansi_index), so they can be written back
+/// as short indexed codes (see [`palette`](super::palette)). True colors
+/// store one fixed index whose palette color differs from their channels,
+/// so every index fits in the byte.
+///
+/// Equality and hashing compare all four bytes: an indexed color and the
+/// true color with the same channels are written differently (and the
+/// terminal may theme the first), so they are different colors.
 #[repr(C)]
-#[derive(Clone, Copy, PartialEq, Eq, Default, Hash)]
+#[derive(Clone, Copy, PartialEq, Eq, Hash)]
 pub struct Rgb {
     /// Red channel (0-255)
     pub r: u8,
@@ -33,13 +44,23 @@ pub struct Rgb {
     pub g: u8,
     /// Blue channel (0-255)
     pub b: u8,
+    /// Palette index, if its palette color equals the channels.
+    slot: u8,
+}
+
+impl Default for Rgb {
+    fn default() -> Self {
+        Self::BLACK
+    }
 }
 
 impl Rgb {
     /// Create a new RGB color.
     #[inline]
     pub const fn new(r: u8, g: u8, b: u8) -> Self {
-        Self { r, g, b }
+        // Palette color 0 is black, color 1 is not
+        let slot = if r == 0 && g == 0 && b == 0 { 1 } else { 0 };
+        Self { r, g, b, slot }
     }
 
     /// Black (0, 0, 0)
@@ -51,6 +72,47 @@ impl Rgb {
     /// Default background (black)
     pub const DEFAULT_BG: Self = Self::BLACK;
 
+    /// Create from an xterm 256-color palette index.
+    ///
+    /// Indices 0-15 are the standard and bright colors, 16-231 the 6x6x6
+    /// color cube and 232-255 the grayscale ramp. The index is kept.
+    #[inline]
+    pub const fn from_ansi_index(idx: u8) -> Self {
+        let [r, g, b] = PALETTE[idx as usize];
+        Self { r, g, b, slot: idx }
+    }
+
+    /// Get the palette index this color was made from, if any.
+    #[inline]
+    pub const fn index(self) -> Option<u8> {
+        let [r, g, b] = PALETTE[self.slot as usize];
+        if r == self.r && g == self.g && b == self.b {
+            Some(self.slot)
+        } else {
+            None
+        }
+    }
+
+    /// Get the color as raw bytes: the channels and the palette slot.
+    #[inline]
+    pub(crate) const fn to_bytes(self) -> [u8; 4] {
+        [self.r, self.g, self.b, self.slot]
+    }
+
+    /// Rebuild a color from [`to_bytes`](Self::to_bytes).
+    ///
+    /// A slot that isn't the color's index is replaced by the fixed one, so
+    /// equal true colors stay equal.
+    #[inline]
+    pub(crate) const fn from_bytes([r, g, b, slot]: [u8; 4]) -> Self {
+        let color = Self { r, g, b, slot };
+        if color.index().is_some() {
+            color
+        } else {
+            Self::new(r, g, b)
+        }
+    }
+
     /// Create from a 24-bit hex color (e.g., 0xFF5500).
     #[inline]
     pub const fn from_u32(hex: u32) -> Self {
@@ -64,7 +126,8 @@ impl Rgb {
 
 impl std::fmt::Debug for Rgb {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
-        write!(f, "#{:02x}{:02x}{:02x}", self.r, self.g, self.b)
+        write!(f, "#{:02x}{:02x}{:02x}", self.r, self.g, self.b)?;
+        self.index().map_or(Ok(()), |index| write!(f, "[{index}]"))
     }
 }
 
@@ -128,7 +191,7 @@ bitflags! {
     /// Cell-level flags for special states.
     #[derive(Clone, Copy, PartialEq, Eq, Hash, Default)]
     pub struct CellFlags: u8 {
-        /// Grapheme overflows inline storage; check overflow HashMap
+        /// Grapheme overflows inline storage; check the grapheme table
         const OVERFLOW = 0b0000_0001;
         /// Cell has been modified since last render
         const DIRTY = 0b0000_0010;
@@ -155,17 +218,16 @@ impl std::fmt::Debug for CellFlags {
 /// The struct is carefully laid out to be exactly 16 bytes:
 /// - 4 bytes for inline grapheme storage
 /// - 2 bytes for grapheme metadata (length + display width)
-/// - 6 bytes for colors (3 bytes fg + 3 bytes bg)
+/// - 8 bytes for colors (4 bytes fg + 4 bytes bg, each with a palette slot)
 /// - 1 byte for modifiers
 /// - 1 byte for flags
-/// - 2 bytes padding (power-of-2 alignment)
 ///
 /// # Grapheme Handling
 ///
 /// Most characters (ASCII, Latin, CJK) fit within the 4-byte inline storage.
 /// For complex graphemes like emoji ZWJ sequences (👨‍👩‍👧‍👦), we set the
-/// `OVERFLOW` flag and store an index in the grapheme bytes that points
-/// to an external overflow storage.
+/// `OVERFLOW` flag and store the grapheme's id in the shared
+/// [grapheme table](super::graphemes) in the grapheme bytes.
 #[repr(C)]
 #[derive(Clone, Copy)]
 pub struct Cell {
@@ -184,8 +246,6 @@ pub struct Cell {
     modifiers: Modifiers,
     /// Cell flags (overflow, dirty, etc.).
     flags: CellFlags,
-    /// Padding to reach 16 bytes (power of 2, cache-friendly).
-    _padding: [u8; 2],
 }
 
 // Compile-time assertion: Cell must be exactly 16 bytes
@@ -210,7 +270,6 @@ impl Cell {
         bg: Rgb::DEFAULT_BG,
         modifiers: Modifiers::empty(),
         flags: CellFlags::empty(),
-        _padding: [0, 0],
     };
 
     /// Create a new cell with a single ASCII character.
@@ -228,7 +287,6 @@ impl Cell {
             bg: Rgb::DEFAULT_BG,
             modifiers: Modifiers::empty(),
             flags: CellFlags::empty(),
-            _padding: [0, 0],
         }
     }
 
@@ -243,7 +301,7 @@ impl Cell {
         let mut grapheme = [0u8; 4];
         let s = c.encode_utf8(&mut grapheme);
         let len = u8::try_from(s.len()).unwrap();
-        let width = u8::try_from(unicode_width::UnicodeWidthChar::width(c).unwrap_or(0)).unwrap();
+        let width = super::text::char_width(c);
 
         Self {
             grapheme,
@@ -253,7 +311,6 @@ impl Cell {
             bg: Rgb::DEFAULT_BG,
             modifiers: Modifiers::empty(),
             flags: CellFlags::empty(),
-            _padding: [0, 0],
         }
     }
 
@@ -272,7 +329,7 @@ impl Cell {
 
         let mut grapheme = [0u8; 4];
         grapheme[..bytes.len()].copy_from_slice(bytes);
-        let width = u8::try_from(unicode_width::UnicodeWidthStr::width(s)).unwrap_or(1);
+        let width = u8::try_from(super::text::str_width(s)).unwrap_or(1);
 
         Some(Self {
             grapheme,
@@ -282,7 +339,6 @@ impl Cell {
             bg: Rgb::DEFAULT_BG,
             modifiers: Modifiers::empty(),
             flags: CellFlags::empty(),
-            _padding: [0, 0],
         })
     }
 
@@ -299,7 +355,6 @@ impl Cell {
             bg: Rgb::DEFAULT_BG,
             modifiers: Modifiers::empty(),
             flags: CellFlags::OVERFLOW,
-            _padding: [0, 0],
         }
     }
 
@@ -316,7 +371,6 @@ impl Cell {
             bg: Rgb::DEFAULT_BG,
             modifiers: Modifiers::empty(),
             flags: CellFlags::WIDE_CONTINUATION,
-            _padding: [0, 0],
         }
     }
 
@@ -385,6 +439,47 @@ impl Cell {
         self.flags
     }
 
+    /// Get the raw grapheme storage, its length and the display width.
+    ///
+    /// With the colors, modifiers and flags this fully describes the cell,
+    /// for serialization.
+    #[inline]
+    pub(crate) const fn raw_grapheme(&self) -> ([u8; 4], u8, u8) {
+        (self.grapheme, self.grapheme_len, self.display_width)
+    }
+
+    /// Rebuild a cell from the parts returned by
+    /// [`raw_grapheme`](Self::raw_grapheme), with default colors.
+    #[inline]
+    pub(crate) const fn from_raw(
+        grapheme: [u8; 4],
+        grapheme_len: u8,
+        display_width: u8,
+        flags: CellFlags,
+    ) -> Self {
+        Self {
+            grapheme,
+            grapheme_len,
+            display_width,
+            fg: Rgb::DEFAULT_FG,
+            bg: Rgb::DEFAULT_BG,
+            modifiers: Modifiers::empty(),
+            flags,
+        }
+    }
+
+    /// Replace the grapheme with a printable ASCII byte, keeping the style.
+    ///
+    /// Used by bulk writers that stamp one styled template per byte.
+    #[inline]
+    pub(crate) const fn with_ascii(mut self, b: u8) -> Self {
+        self.grapheme = [b, 0, 0, 0];
+        self.grapheme_len = 1;
+        self.display_width = 1;
+        self.flags = CellFlags::empty();
+        self
+    }
+
     /// Set the foreground color.
     #[inline]
     pub const fn set_fg(&mut self, fg: Rgb) -> &mut Self {
@@ -510,6 +605,25 @@ mod tests {
         assert_eq!(rgb.b, 0);
     }
 
+    #[test]
+    fn test_rgb_index_slot() {
+        assert_eq!(Rgb::from_ansi_index(0).index(), Some(0));
+        assert_eq!(Rgb::from_ansi_index(255).index(), Some(255));
+        assert_eq!(Rgb::new(0, 0, 0).index(), None);
+        assert_eq!(Rgb::new(128, 0, 0).index(), None);
+
+        // An index change is a change, even with the same channels
+        assert_ne!(Rgb::new(128, 0, 0), Rgb::from_ansi_index(1));
+        assert_ne!(Rgb::from_ansi_index(9), Rgb::from_ansi_index(196));
+        let a = Cell::new('A').with_fg(Rgb::new(128, 0, 0));
+        let b = Cell::new('A').with_fg(Rgb::from_ansi_index(1));
+        assert_ne!(a, b);
+
+        // True colors have one encoding
+        assert_eq!(Rgb::from_bytes([128, 0, 0, 7]), Rgb::new(128, 0, 0));
+        assert_eq!(Rgb::from_bytes(Rgb::from_ansi_index(9).to_bytes()).index(), Some(9));
+    }
+
     #[test]
     fn test_cell_new_ascii() {
         let cell = Cell::new('A');
@@ -0,0 +1,392 @@
+//! Cold Storage: Compact copies of rope chunks that left the hot set.
+//!
+//! Sealed chunks far from the viewport are frozen: encoded into a compact
+//! byte format, compressed with the [`lz`](super::lz) codec, and then kept
+//! in memory or written to a per-buffer segment file. A spilled chunk is
+//! addressed by its [`Extent`] and read back with a single positioned read
+//! when it scrolls into view. Extents of chunks that were dropped or
+//! changed are released and reused, so the file tracks the live chunks
+//! rather than growing for the whole session.
+//!
+//! # Encoding
+//!
+//! A chunk is its line count followed by each line's header (cell count and
+//! wrap flag) and cells. Cells are delta-encoded against the previous
+//! cell's style:
+//! - A single-byte, single-column ASCII cell in the same style is one byte
+//! - Any other cell is a tag byte (`0x80` | style changed | width | length),
+//!   then the new style if it changed, then the grapheme bytes
+
+use std::collections::BTreeMap;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
+use std::process;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use super::lz;
+use super::rope::ChunkedLine;
+use super::{Cell, CellFlags, Modifiers, Rgb};
+
+/// Tag bit marking a cell that isn't plain same-style ASCII.
+const TAG: u8 = 0x80;
+
+/// Tag bit marking a style change.
+const TAG_STYLE: u8 = 0x40;
+
+/// Location of an encoded chunk in a spill file.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Extent {
+    /// Byte offset of the chunk.
+    offset: u64,
+    /// Length in bytes.
+    len: u32,
+}
+
+impl Extent {
+    /// Get the length in bytes.
+    pub const fn len(self) -> usize {
+        self.len as usize
+    }
+}
+
+/// Segment file holding spilled chunks.
+///
+/// Chunks are written into the first released extent they fit in, or
+/// appended. The file is created with a unique name and removed when
+/// dropped.
+#[derive(Debug)]
+pub struct SpillFile {
+    /// The open segment file.
+    file: File,
+    /// Path of the segment file, for removal.
+    path: PathBuf,
+    /// Length of the file.
+    len: u64,
+    /// Released extents as offset and length, with neighbours merged.
+    free: BTreeMap<u64, u64>,
+}
+
+impl SpillFile {
+    /// Create a new spill file in the given directory.
+    pub fn create(dir: &Path) -> io::Result<Self> {
+        static NEXT_ID: AtomicUsize = AtomicUsize::new(0);
+
+        let id = NEXT_ID.fetch_add(1, Ordering::Relaxed);
+        let path = dir.join(format!("flywheel-{}-{id}.spill", process::id()));
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create_new(true)
+            .open(&path)?;
+
+        Ok(Self {
+            file,
+            path,
+            len: 0,
+            free: BTreeMap::new(),
+        })
+    }
+
+    /// Get the length of the file in bytes, counting released extents not
+    /// yet reused.
+    pub const fn len(&self) -> u64 {
+        self.len
+    }
+
+    /// Write bytes into a released extent they fit in, or at the end.
+    ///
+    /// # Returns
+    /// Where the bytes were written, for [`read`](Self::read).
+    pub fn write(&mut self, bytes: &[u8]) -> io::Result<Extent> {
+        let len = u32::try_from(bytes.len())
+            .map_err(|_| io::Error::new(io::ErrorKind::InvalidInput, "chunk too large to spill"))?;
+
+        let fit = self
+            .free
+            .iter()
+            .find(|&(_, &free)| free >= u64::from(len))
+            .map(|(&offset, &free)| (offset, free));
+        let offset = match fit {
+            Some((offset, free)) => {
+                self.free.remove(&offset);
+                if free > u64::from(len) {
+                    self.free.insert(offset + u64::from(len), free - u64::from(len));
+                }
+                offset
+            },
+            None => self.len,
+        };
+
+        self.file.seek(SeekFrom::Start(offset))?;
+        self.file.write_all(bytes)?;
+        self.len = self.len.max(offset + u64::from(len));
+        Ok(Extent { offset, len })
+    }
+
+    /// Read back bytes written by [`write`](Self::write).
+    ///
+    /// Uses a positioned read, so concurrent reads don't race on the file
+    /// position.
+    pub fn read(&self, extent: Extent) -> io::Result<Vec<u8>> {
+        let mut bytes = vec![0u8; extent.len()];
+        read_exact_at(&self.file, &mut bytes, extent.offset)?;
+        Ok(bytes)
+    }
+
+    /// Release an extent whose chunk was dropped or changed, for reuse.
+    ///
+    /// Free space at the end of the file is cut off.
+    pub fn release(&mut self, extent: Extent) {
+        let (mut offset, mut len) = (extent.offset, u64::from(extent.len));
+        if len == 0 {
+            return;
+        }
+        if let Some((&before, &before_len)) = self.free.range(..offset).next_back() {
+            if before + before_len == offset {
+                self.free.remove(&before);
+                offset = before;
+                len += before_len;
+            }
+        }
+        if let Some(after_len) = self.free.remove(&(offset + len)) {
+            len += after_len;
+        }
+
+        if offset + len == self.len {
+            self.len = offset;
+            let _ = self.file.set_len(offset);
+        } else {
+            self.free.insert(offset, len);
+        }
+    }
+}
+
+/// Fill `buf` from `file` at `offset` without moving the file position.
+#[cfg(unix)]
+fn read_exact_at(file: &File, buf: &mut [u8], offset: u64) -> io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.read_exact_at(buf, offset)
+}
+
+/// Fill `buf` from `file` at `offset` with positioned reads.
+#[cfg(windows)]
+fn read_exact_at(file: &File, mut buf: &mut [u8], mut offset: u64) -> io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    while !buf.is_empty() {
+        match file.seek_read(buf, offset)? {
+            0 => return Err(io::ErrorKind::UnexpectedEof.into()),
+            n => {
+                buf = &mut buf[n..];
+                offset += n as u64;
+            },
+        }
+    }
+    Ok(())
+}
+
+impl Drop for SpillFile {
+    fn drop(&mut self) {
+        let _ = fs::remove_file(&self.path);
+    }
+}
+
+/// Encode and compress lines.
+pub fn freeze(lines: &[ChunkedLine]) -> Vec<u8> {
+    let mut encoded = Vec::new();
+    encode_lines(lines, &mut encoded);
+    lz::compress(&encoded)
+}
+
+/// Decompress and decode lines produced by [`freeze`].
+pub fn thaw(bytes: &[u8]) -> io::Result<Vec<ChunkedLine>> {
+    decode_lines(&lz::decompress(bytes)?)
+}
+
+/// The style part of a cell.
+type Style = (Rgb, Rgb, Modifiers, CellFlags);
+
+/// Get the style of a cell.
+const fn style_of(cell: &Cell) -> Style {
+    (cell.fg(), cell.bg(), cell.modifiers(), cell.flags())
+}
+
+/// Number of grapheme bytes stored for a cell.
+///
+/// Overflow cells keep an index in all four bytes.
+const fn stored_len(grapheme_len: u8, flags: CellFlags) -> usize {
+    if flags.contains(CellFlags::OVERFLOW) {
+        4
+    } else {
+        grapheme_len as usize
+    }
+}
+
+/// Encode lines into `out`.
+#[allow(clippy::cast_possible_truncation)]
+fn encode_lines(lines: &[ChunkedLine], out: &mut Vec<u8>) {
+    out.extend_from_slice(&(lines.len() as u32).to_le_bytes());
+
+    let mut style = style_of(&Cell::EMPTY);
+    for line in lines {
+        let header = (line.content.len() as u32) << 1 | u32::from(line.wrapped);
+        out.extend_from_slice(&header.to_le_bytes());
+
+        for cell in &line.content {
+            let (grapheme, len, width) = cell.raw_grapheme();
+            let cell_style = style_of(cell);
+            let changed = cell_style != style;
+            if !changed && len == 1 && width == 1 && grapheme[0] < TAG {
+                out.push(grapheme[0]);
+                continue;
+            }
+
+            out.push(TAG | if changed { TAG_STYLE } else { 0 } | (width & 0b11) << 3 | len);
+            if changed {
+                let (fg, bg, modifiers, flags) = cell_style;
+                out.extend_from_slice(&fg.to_bytes());
+                out.extend_from_slice(&bg.to_bytes());
+                out.extend_from_slice(&[modifiers.bits(), flags.bits()]);
+                style = cell_style;
+            }
+            out.extend_from_slice(&grapheme[..stored_len(len, cell_style.3)]);
+        }
+    }
+}
+
+/// Cursor over encoded bytes.
+struct Reader<'a> {
+    /// Remaining input.
+    bytes: &'a [u8],
+}
+
+impl<'a> Reader<'a> {
+    /// Take the next `n` bytes.
+    fn take(&mut self, n: usize) -> io::Result<&'a [u8]> {
+        if n > self.bytes.len() {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "truncated spill chunk",
+            ));
+        }
+        let (head, tail) = self.bytes.split_at(n);
+        self.bytes = tail;
+        Ok(head)
+    }
+
+    /// Take a little-endian `u32`.
+    fn u32(&mut self) -> io::Result<u32> {
+        let bytes = self.take(4)?;
+        Ok(u32::from_le_bytes([bytes[0], bytes[1], bytes[2], bytes[3]]))
+    }
+}
+
+/// Decode lines encoded by [`encode_lines`].
+fn decode_lines(bytes: &[u8]) -> io::Result<Vec<ChunkedLine>> {
+    let mut reader = Reader { bytes };
+    let count = reader.u32()? as usize;
+
+    let mut style = style_of(&Cell::EMPTY);
+    let mut lines = Vec::with_capacity(count.min(bytes.len()));
+    for _ in 0..count {
+        let header = reader.u32()?;
+        let len = (header >> 1) as usize;
+        let mut content = Vec::with_capacity(len.min(reader.bytes.len()));
+
+        for _ in 0..len {
+            let tag = reader.take(1)?[0];
+            let (grapheme, grapheme_len, width) = if tag < TAG {
+                ([tag, 0, 0, 0], 1, 1)
+            } else {
+                if tag & TAG_STYLE != 0 {
+                    let raw = reader.take(10)?;
+                    style = (
+                        Rgb::from_bytes([raw[0], raw[1], raw[2], raw[3]]),
+                        Rgb::from_bytes([raw[4], raw[5], raw[6], raw[7]]),
+                        Modifiers::from_bits_retain(raw[8]),
+                        CellFlags::from_bits_retain(raw[9]),
+                    );
+                }
+                let grapheme_len = (tag & 0b111).min(4);
+                let mut grapheme = [0u8; 4];
+                let stored = stored_len(grapheme_len, style.3);
+                grapheme[..stored].copy_from_slice(reader.take(stored)?);
+                (grapheme, grapheme_len, tag >> 3 & 0b11)
+            };
+
+            let (fg, bg, modifiers, flags) = style;
+            content.push(
+                Cell::from_raw(grapheme, grapheme_len, width, flags)
+                    .with_fg(fg)
+                    .with_bg(bg)
+                    .with_modifiers(modifiers),
+            );
+        }
+        lines.push(ChunkedLine::new(content, header & 1 != 0));
+    }
+
+    Ok(lines)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_cold_round_trip() {
+        let red = Rgb::new(255, 0, 0);
+        let lines = vec![
+            ChunkedLine::new("plain ascii".chars().map(Cell::from_char).collect(), true),
+            ChunkedLine::new(
+                vec![
+                    Cell::from_char('漢').with_fg(red),
+                    Cell::wide_continuation().with_fg(red),
+                    Cell::from_grapheme("e\u{301}")
+                        .unwrap()
+                        .with_modifiers(Modifiers::BOLD),
+                    Cell::overflow(7, 2),
+                    Cell::new('x').with_bg(Rgb::from_ansi_index(4)),
+                ],
+                false,
+            ),
+            ChunkedLine::empty(),
+        ];
+
+        // Plain ASCII costs one byte per cell
+        let mut encoded = Vec::new();
+        encode_lines(&lines[..1], &mut encoded);
+        assert_eq!(encoded.len(), 4 + 4 + 11);
+
+        let dir = std::env::temp_dir();
+        let mut file = SpillFile::create(&dir).unwrap();
+        let first = file.write(&freeze(&lines)).unwrap();
+        let second = file.write(&freeze(&lines[..1])).unwrap();
+
+        let decoded = thaw(&file.read(first).unwrap()).unwrap();
+        assert_eq!(decoded.len(), 3);
+        for (a, b) in decoded.iter().zip(&lines) {
+            assert_eq!(a.wrapped, b.wrapped);
+            assert_eq!(a.content, b.content);
+        }
+        assert_eq!(
+            thaw(&file.read(second).unwrap()).unwrap()[0].content,
+            lines[0].content
+        );
+
+        // Released extents are merged and reused; free space at the end
+        // is cut off
+        let end = file.len();
+        file.release(first);
+        let third = file.write(&freeze(&lines[..1])).unwrap();
+        assert_eq!(third.offset, first.offset);
+        assert_eq!(file.len(), end);
+        file.release(second);
+        file.release(third);
+        assert_eq!(file.len(), 0);
+        assert_eq!(file.file.metadata().unwrap().len(), 0);
+
+        let path = file.path.clone();
+        drop(file);
+        assert!(!path.exists());
+    }
+}
@@ -0,0 +1,646 @@
+//! Compact Cells: 8-byte cells with styles interned in a per-buffer table.
+//!
+//! A screen rarely uses more than a few dozen distinct styles, yet every
+//! [`Cell`] carries its colors and modifiers inline. A [`CompactBuffer`]
+//! interns each style into a [`StyleTable`] and stores a `u16` style id per
+//! cell, halving the cell to 8 bytes: eight cells per cache line.
+//!
+//! ```text
+//! ┌─────────────┬──────────────┬───────┬──────────┐
+//! │  grapheme   │ len + width  │ flags │ style id │
+//! │  [u8; 4]    │ u8 (3+2 bit) │  u8   │   u16    │
+//! └─────────────┴──────────────┴───────┴──────────┘
+//! ```
+//!
+//! Widgets keep drawing into a [`Buffer`]; the renderer packs each frame
+//! into a compact copy and diffs compact copies, comparing one 8-byte value
+//! per cell. A style change is written from SGR sequences encoded once per
+//! pair of style ids and cached in the [`CompactDiffState`].
+
+use super::diff::{emit_cursor_move, emit_modifiers, DiffResult};
+use super::palette::{self, ColorMode};
+use super::{Buffer, Cell, CellFlags, Modifiers, Rgb};
+use crate::layout::Rect;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU32, Ordering};
+use std::sync::Arc;
+
+/// Styles a table may hold before packing starts over with a fresh one.
+///
+/// Styles are never removed individually, so this bounds the table on
+/// screens whose colors keep changing (gradients, animations).
+pub const STYLE_LIMIT: usize = 4096;
+
+/// Style id meaning "unknown terminal style" in a transition key. Tables
+/// stop one short of it.
+const NO_STYLE: u16 = u16::MAX;
+
+/// Source of table epochs.
+static EPOCH: AtomicU32 = AtomicU32::new(0);
+
+/// The colors and modifiers of a cell.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Style {
+    /// Foreground color.
+    pub fg: Rgb,
+    /// Background color.
+    pub bg: Rgb,
+    /// Text modifiers.
+    pub modifiers: Modifiers,
+}
+
+impl Style {
+    /// The style of [`Cell::EMPTY`], id 0 in every table.
+    pub const DEFAULT: Self = Self::of(&Cell::EMPTY);
+
+    /// Get the style of a cell.
+    #[inline]
+    pub const fn of(cell: &Cell) -> Self {
+        Self {
+            fg: cell.fg(),
+            bg: cell.bg(),
+            modifiers: cell.modifiers(),
+        }
+    }
+}
+
+/// Styles interned to `u16` ids.
+///
+/// Ids are handed out in order and never reused, so a table that only
+/// grew from another one (same epoch) agrees with it on every id the
+/// other knows.
+#[derive(Debug, Clone)]
+pub struct StyleTable {
+    /// Styles by id.
+    styles: Vec<Style>,
+    /// Ids by style.
+    ids: HashMap<Style, u16>,
+    /// Lineage of the table; changes whenever ids are renumbered.
+    epoch: u32,
+}
+
+impl Default for StyleTable {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl StyleTable {
+    /// Create a table holding only [`Style::DEFAULT`].
+    pub fn new() -> Self {
+        Self {
+            styles: vec![Style::DEFAULT],
+            ids: HashMap::from([(Style::DEFAULT, 0)]),
+            epoch: EPOCH.fetch_add(1, Ordering::Relaxed),
+        }
+    }
+
+    /// Get the id of a style, adding it if needed.
+    ///
+    /// Returns `None` when the table is full.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn intern(&mut self, style: Style) -> Option<u16> {
+        if let Some(&id) = self.ids.get(&style) {
+            return Some(id);
+        }
+        if self.styles.len() >= usize::from(NO_STYLE) {
+            return None;
+        }
+        let id = self.styles.len() as u16;
+        self.styles.push(style);
+        self.ids.insert(style, id);
+        Some(id)
+    }
+
+    /// Get the style with the given id.
+    #[inline]
+    pub fn get(&self, id: u16) -> Style {
+        self.styles.get(usize::from(id)).copied().unwrap_or(Style::DEFAULT)
+    }
+
+    /// Get the number of styles.
+    #[inline]
+    pub const fn len(&self) -> usize {
+        self.styles.len()
+    }
+
+    /// Check if the table holds only the default style.
+    #[inline]
+    pub const fn is_empty(&self) -> bool {
+        self.styles.len() <= 1
+    }
+
+    /// Drop every style but the default one, renumbering from scratch.
+    pub fn clear(&mut self) {
+        self.styles.truncate(1);
+        self.ids.clear();
+        self.ids.insert(Style::DEFAULT, 0);
+        self.epoch = EPOCH.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Make this table agree with `base` on all of its ids.
+    ///
+    /// A table `base` grew from only needs the new styles appended.
+    /// Returns `false` if `base` is over [`STYLE_LIMIT`] and the table was
+    /// cleared instead, so its ids can't be compared with `base`'s.
+    #[allow(clippy::cast_possible_truncation)]
+    fn follow(&mut self, base: &Self) -> bool {
+        if base.styles.len() > STYLE_LIMIT {
+            self.clear();
+            return false;
+        }
+        if self.epoch == base.epoch && self.styles.len() <= base.styles.len() {
+            for style in &base.styles[self.styles.len()..] {
+                self.ids.insert(*style, self.styles.len() as u16);
+                self.styles.push(*style);
+            }
+        } else {
+            self.clone_from(base);
+        }
+        true
+    }
+}
+
+/// An 8-byte cell whose colors and modifiers live in a [`StyleTable`].
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct CompactCell {
+    /// Inline grapheme bytes, or the overflow index.
+    grapheme: [u8; 4],
+    /// Grapheme length (bits 0-2) and display width (bits 3-4).
+    meta: u8,
+    /// Cell flags.
+    flags: CellFlags,
+    /// Style id.
+    style: u16,
+}
+
+const _: () = assert!(std::mem::size_of::<CompactCell>() == 8);
+
+impl CompactCell {
+    /// The compact form of [`Cell::EMPTY`].
+    pub const EMPTY: Self = Self::pack(&Cell::EMPTY, 0);
+
+    /// Pack a cell whose style has id `style`.
+    #[inline]
+    pub const fn pack(cell: &Cell, style: u16) -> Self {
+        let (grapheme, len, width) = cell.raw_grapheme();
+        Self {
+            grapheme,
+            meta: len & 0b111 | (width & 0b11) << 3,
+            flags: cell.flags(),
+            style,
+        }
+    }
+
+    /// Unpack into a full cell with the given style.
+    #[inline]
+    pub const fn unpack(self, style: Style) -> Cell {
+        Cell::from_raw(self.grapheme, self.meta & 0b111, self.meta >> 3, self.flags)
+            .with_fg(style.fg)
+            .with_bg(style.bg)
+            .with_modifiers(style.modifiers)
+    }
+
+    /// Get the style id.
+    #[inline]
+    pub const fn style(self) -> u16 {
+        self.style
+    }
+
+    /// Get the display width (0, 1, or 2).
+    #[inline]
+    pub const fn display_width(self) -> u8 {
+        self.meta >> 3
+    }
+
+    /// Check if this is a wide-character continuation.
+    #[inline]
+    pub const fn is_wide_continuation(self) -> bool {
+        self.flags.contains(CellFlags::WIDE_CONTINUATION)
+    }
+}
+
+/// Outcome of [`CompactBuffer::pack`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Packed {
+    /// Style ids agree with the base table; the buffers can be diffed.
+    Comparable,
+    /// The table was started over; ids only make sense in this buffer.
+    Renumbered,
+    /// The frame has more styles than a table can hold. The buffer is
+    /// unusable until the next successful pack.
+    TooManyStyles,
+}
+
+/// A grid of [`CompactCell`]s with its own [`StyleTable`].
+#[derive(Clone)]
+pub struct CompactBuffer {
+    /// Cell storage (row-major order).
+    cells: Vec<CompactCell>,
+    /// Width in columns.
+    width: u16,
+    /// Height in rows.
+    height: u16,
+    /// Graphemes held by the source buffer, by id.
+    graphemes: HashMap<u32, Arc<str>>,
+    /// Version of the source buffer's graphemes when they were copied.
+    graphemes_version: u64,
+    /// Styles of the cells.
+    styles: StyleTable,
+}
+
+impl CompactBuffer {
+    /// Create an empty compact buffer.
+    pub fn new(width: u16, height: u16) -> Self {
+        Self {
+            cells: vec![CompactCell::EMPTY; usize::from(width) * usize::from(height)],
+            width,
+            height,
+            graphemes: HashMap::new(),
+            graphemes_version: 0,
+            styles: StyleTable::new(),
+        }
+    }
+
+    /// Get the width.
+    #[inline]
+    pub const fn width(&self) -> u16 {
+        self.width
+    }
+
+    /// Get the height.
+    #[inline]
+    pub const fn height(&self) -> u16 {
+        self.height
+    }
+
+    /// Get the cells.
+    #[inline]
+    pub fn cells(&self) -> &[CompactCell] {
+        &self.cells
+    }
+
+    /// Get the style table.
+    #[inline]
+    pub const fn styles(&self) -> &StyleTable {
+        &self.styles
+    }
+
+    /// Get the full cell at (x, y).
+    pub fn get(&self, x: u16, y: u16) -> Option<Cell> {
+        if x >= self.width || y >= self.height {
+            return None;
+        }
+        let cell = self.cells[usize::from(y) * usize::from(self.width) + usize::from(x)];
+        Some(cell.unpack(self.styles.get(cell.style)))
+    }
+
+    /// Get an overflow grapheme by its id.
+    #[inline]
+    pub fn get_overflow(&self, index: u32) -> Option<&str> {
+        self.graphemes.get(&index).map(AsRef::as_ref)
+    }
+
+    /// Replace the contents with `buffer`, taking the size along.
+    ///
+    /// The style table first catches up with `base`, usually the table of
+    /// the buffer this one will be diffed against, so both agree on ids.
+    pub fn pack(&mut self, buffer: &Buffer, base: &StyleTable) -> Packed {
+        let size = buffer.len();
+        self.width = buffer.width();
+        self.height = buffer.height();
+        self.cells.resize(size, CompactCell::EMPTY);
+        if self.graphemes_version != buffer.graphemes_version() {
+            self.graphemes.clone_from(buffer.graphemes());
+            self.graphemes_version = buffer.graphemes_version();
+        }
+
+        let comparable = self.styles.follow(base);
+        if self.pack_cells(buffer) {
+            return if comparable { Packed::Comparable } else { Packed::Renumbered };
+        }
+        // Out of ids: retry with only this frame's styles
+        self.styles.clear();
+        if self.pack_cells(buffer) {
+            Packed::Renumbered
+        } else {
+            Packed::TooManyStyles
+        }
+    }
+
+    /// Pack the cells of `buffer`, or return `false` if the table filled.
+    fn pack_cells(&mut self, buffer: &Buffer) -> bool {
+        // Neighbouring cells mostly share a style: skip the table for runs
+        let mut last = (Style::DEFAULT, 0);
+        for (slot, cell) in self.cells.iter_mut().zip(buffer.cells()) {
+            let style = Style::of(cell);
+            if style != last.0 {
+                let Some(id) = self.styles.intern(style) else {
+                    return false;
+                };
+                last = (style, id);
+            }
+            *slot = CompactCell::pack(cell, last.1);
+        }
+        true
+    }
+
+    /// Swap the contents of two buffers.
+    pub const fn swap(&mut self, other: &mut Self) {
+        std::mem::swap(self, other);
+    }
+
+    /// Get memory usage in bytes (approximate).
+    pub fn memory_usage(&self) -> usize {
+        let cells = self.cells.len() * std::mem::size_of::<CompactCell>();
+        let graphemes = self.graphemes.capacity() * std::mem::size_of::<(u32, Arc<str>)>();
+        let styles = self.styles.len() * (std::mem::size_of::<Style>() * 2 + 8);
+        cells + graphemes + styles + std::mem::size_of::<Self>()
+    }
+}
+
+impl std::fmt::Debug for CompactBuffer {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("CompactBuffer")
+            .field("width", &self.width)
+            .field("height", &self.height)
+            .field("styles", &self.styles.len())
+            .field("memory_bytes", &self.memory_usage())
+            .finish_non_exhaustive()
+    }
+}
+
+/// Cached SGR bytes for a change of style.
+#[derive(Debug, Clone, Copy)]
+struct Transition {
+    /// Start of the bytes in the arena.
+    start: u32,
+    /// End of the bytes in the arena.
+    end: u32,
+    /// Color sequences among them.
+    colors: u8,
+    /// Whether they change the modifiers.
+    modifiers: bool,
+}
+
+/// Terminal state tracked while diffing compact buffers.
+#[derive(Debug, Clone)]
+pub struct CompactDiffState {
+    /// Last known cursor X position (0-indexed).
+    cursor_x: u16,
+    /// Last known cursor Y position (0-indexed).
+    cursor_y: u16,
+    /// Id of the last written style.
+    style: Option<u16>,
+    /// How colors are written.
+    color_mode: ColorMode,
+    /// Epoch of the table the cached transitions were encoded for.
+    epoch: u32,
+    /// Transitions by `from << 16 | to`.
+    transitions: HashMap<u32, Transition>,
+    /// Encoded transition bytes.
+    sgr: Vec<u8>,
+}
+
+impl Default for CompactDiffState {
+    fn default() -> Self {
+        Self::new(ColorMode::TrueColor)
+    }
+}
+
+impl CompactDiffState {
+    /// Create a diff state writing colors for `color_mode`.
+    pub fn new(color_mode: ColorMode) -> Self {
+        Self {
+            cursor_x: 0,
+            cursor_y: 0,
+            style: None,
+            color_mode,
+            epoch: u32::MAX,
+            transitions: HashMap::new(),
+            sgr: Vec::new(),
+        }
+    }
+
+    /// Forget the terminal state (e.g., after a full screen clear). Cached
+    /// transitions are kept.
+    pub const fn reset(&mut self) {
+        self.style = None;
+        self.cursor_x = u16::MAX;
+        self.cursor_y = u16::MAX;
+    }
+
+    /// Write the change to style `to`, encoding it on first use.
+    fn transition(&mut self, styles: &StyleTable, to: u16, output: &mut Vec<u8>) -> Transition {
+        if self.epoch != styles.epoch || self.sgr.len() > u32::MAX as usize / 2 {
+            self.epoch = styles.epoch;
+            self.transitions.clear();
+            self.sgr.clear();
+        }
+        let from = self.style.unwrap_or(NO_STYLE);
+        let key = u32::from(from) << 16 | u32::from(to);
+        let transition = if let Some(&transition) = self.transitions.get(&key) {
+            transition
+        } else {
+            let old = (from != NO_STYLE).then(|| styles.get(from));
+            let transition = encode(&mut self.sgr, old, styles.get(to), self.color_mode);
+            self.transitions.insert(key, transition);
+            transition
+        };
+        output.extend_from_slice(&self.sgr[transition.start as usize..transition.end as usize]);
+        self.style = Some(to);
+        transition
+    }
+}
+
+/// Encode the change from style `old` (unknown if `None`) to `new`.
+#[allow(clippy::cast_possible_truncation)]
+fn encode(sgr: &mut Vec<u8>, old: Option<Style>, new: Style, mode: ColorMode) -> Transition {
+    let start = sgr.len() as u32;
+    let (mut fg, mut bg, mut modifiers) = old.map_or((None, None, None), |old| {
+        (Some(old.fg), Some(old.bg), Some(old.modifiers))
+    });
+
+    // Dropping a modifier takes a full reset, which also clears colors
+    if !modifiers.unwrap_or(Modifiers::empty()).difference(new.modifiers).is_empty() {
+        sgr.extend_from_slice(b"\x1b[0m");
+        (fg, bg, modifiers) = (None, None, None);
+    }
+
+    let mut colors = 0;
+    if fg != Some(new.fg) {
+        palette::write_fg(sgr, new.fg, mode);
+        colors += 1;
+    }
+    if bg != Some(new.bg) {
+        palette::write_bg(sgr, new.bg, mode);
+        colors += 1;
+    }
+    let changed = modifiers != Some(new.modifiers);
+    if changed {
+        emit_modifiers(sgr, new.modifiers, modifiers);
+    }
+
+    Transition {
+        start,
+        end: sgr.len() as u32,
+        colors,
+        modifiers: changed,
+    }
+}
+
+/// Render the difference between two compact buffers.
+///
+/// Like [`render_diff`](super::diff::render_diff), but cells are compared
+/// as single 8-byte values. `next`'s style table must agree with
+/// `current`'s, as after [`Packed::Comparable`].
+pub fn render_compact_diff(
+    current: &CompactBuffer,
+    next: &CompactBuffer,
+    dirty_rects: &[Rect],
+    output: &mut Vec<u8>,
+    state: &mut CompactDiffState,
+) -> DiffResult {
+    debug_assert_eq!(current.width(), next.width());
+    debug_assert_eq!(current.height(), next.height());
+
+    let mut result = DiffResult::default();
+    let width = next.width();
+    let full_rect = Rect::from_size(width, next.height());
+    let rects: &[Rect] = if dirty_rects.is_empty() {
+        std::slice::from_ref(&full_rect)
+    } else {
+        dirty_rects
+    };
+
+    for rect in rects {
+        let x_end = (rect.x + rect.width).min(width);
+        let y_end = (rect.y + rect.height).min(next.height());
+        for y in rect.y..y_end {
+            let row = usize::from(y) * usize::from(width);
+            for x in rect.x..x_end {
+                let idx = row + usize::from(x);
+                let cell = next.cells[idx];
+                if current.cells[idx] == cell || cell.is_wide_continuation() {
+                    continue;
+                }
+                result.cells_changed += 1;
+
+                if state.cursor_y != y || state.cursor_x != x {
+                    emit_cursor_move(output, x, y);
+                    state.cursor_x = x;
+                    state.cursor_y = y;
+                    result.cursor_moves += 1;
+                }
+
+                if state.style != Some(cell.style) {
+                    let transition = state.transition(&next.styles, cell.style, output);
+                    result.color_changes += usize::from(transition.colors);
+                    result.modifier_changes += usize::from(transition.modifiers);
+                }
+
+                emit_grapheme(output, cell, next);
+                state.cursor_x += u16::from(cell.display_width().max(1));
+            }
+        }
+    }
+
+    result
+}
+
+/// Write the grapheme of a compact cell.
+#[inline]
+fn emit_grapheme(output: &mut Vec<u8>, cell: CompactCell, buffer: &CompactBuffer) {
+    if cell.flags.contains(CellFlags::OVERFLOW) {
+        match buffer.get_overflow(u32::from_le_bytes(cell.grapheme)) {
+            Some(grapheme) => output.extend_from_slice(grapheme.as_bytes()),
+            None => output.extend_from_slice("�".as_bytes()),
+        }
+    } else {
+        match usize::from(cell.meta & 0b111) {
+            0 => output.push(b' '),
+            len => output.extend_from_slice(&cell.grapheme[..len.min(4)]),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::buffer::diff::{render_diff, DiffState};
+
+    #[test]
+    fn test_compact_pack_round_trip() {
+        let mut buffer = Buffer::new(8, 2);
+        let fg = Rgb::from_ansi_index(3);
+        buffer.set_str(0, 0, "ab漢", fg, Rgb::DEFAULT_BG);
+        buffer.set_grapheme(0, 1, "👨‍👩‍👧‍👦", fg, Rgb::new(1, 2, 3));
+        buffer.set(5, 1, Cell::new('x').with_modifiers(Modifiers::BOLD));
+
+        let mut compact = CompactBuffer::new(1, 1);
+        assert_eq!(compact.pack(&buffer, &StyleTable::new()), Packed::Comparable);
+        // Default, yellow, yellow on blue-ish, its wide continuation, bold
+        assert_eq!(compact.styles().len(), 5);
+        for y in 0..2 {
+            for x in 0..8 {
+                assert_eq!(compact.get(x, y).as_ref(), buffer.get(x, y));
+            }
+        }
+        let id = buffer.get(0, 1).and_then(Cell::overflow_index).unwrap();
+        assert_eq!(compact.get_overflow(id), buffer.get_grapheme(0, 1));
+    }
+
+    #[test]
+    fn test_compact_diff_matches_full_cells() {
+        let red = Rgb::new(255, 0, 0);
+        let mut before = Buffer::new(10, 3);
+        before.set_str(0, 0, "hello", red, Rgb::DEFAULT_BG);
+        let mut after = before.clone();
+        after.set_str(2, 0, "LL", Rgb::from_ansi_index(4), red);
+        after.set(9, 2, Cell::new('!').with_modifiers(Modifiers::ITALIC));
+        after.set_str(0, 1, "漢字", red, Rgb::DEFAULT_BG);
+
+        let mut expected = Vec::new();
+        let full = render_diff(&before, &after, &[], &mut expected, &mut DiffState::new());
+
+        let mut current = CompactBuffer::new(10, 3);
+        let mut next = CompactBuffer::new(10, 3);
+        let _ = current.pack(&before, &StyleTable::new());
+        assert_eq!(next.pack(&after, current.styles()), Packed::Comparable);
+        let mut output = Vec::new();
+        let mut state = CompactDiffState::default();
+        let compact = render_compact_diff(&current, &next, &[], &mut output, &mut state);
+
+        assert_eq!(String::from_utf8_lossy(&output), String::from_utf8_lossy(&expected));
+        assert_eq!(compact.cells_changed, full.cells_changed);
+        assert_eq!(compact.color_changes, full.color_changes);
+        assert_eq!(compact.modifier_changes, full.modifier_changes);
+    }
+
+    #[test]
+    fn test_compact_styles_follow_and_renumber() {
+        let mut buffer = Buffer::new(4, 1);
+        let mut current = CompactBuffer::new(4, 1);
+        let mut next = CompactBuffer::new(4, 1);
+        let _ = current.pack(&buffer, &StyleTable::new());
+
+        // New styles extend the table; old ids keep their meaning
+        buffer.set(0, 0, Cell::new('a').with_fg(Rgb::new(9, 9, 9)));
+        assert_eq!(next.pack(&buffer, current.styles()), Packed::Comparable);
+        current.swap(&mut next);
+        buffer.set(1, 0, Cell::new('b').with_bg(Rgb::new(9, 9, 9)));
+        assert_eq!(next.pack(&buffer, current.styles()), Packed::Comparable);
+        assert_eq!(next.styles().len(), 3);
+        assert_eq!(next.cells()[0].style(), current.cells()[0].style());
+
+        // A table over the limit is started over
+        let mut big = StyleTable::new();
+        for i in 0..=u16::try_from(STYLE_LIMIT).unwrap() {
+            let [g, b] = i.to_be_bytes();
+            let _ = big.intern(Style { fg: Rgb::new(0, g, b), ..Style::DEFAULT });
+        }
+        assert_eq!(next.pack(&buffer, &big), Packed::Renumbered);
+        assert_eq!(next.styles().len(), 3);
+    }
+}
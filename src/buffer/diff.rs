@@ -6,11 +6,17 @@
 //! 3. Optimize cursor movements (skip if adjacent)
 //! 4. Track color state to avoid redundant SGR sequences
 //!
+//! Colors are written for the terminal's [`ColorMode`]: palette colors as
+//! short indexed codes, true colors as 24-bit codes or quantized.
+//!
 //! All output is accumulated in a single buffer and flushed with one syscall.
 
+use super::palette::{self, ColorMode};
 use super::{Buffer, Cell, CellFlags, Modifiers, Rgb};
 use crate::layout::Rect;
+use std::collections::HashMap;
 use std::io::Write;
+use std::sync::Arc;
 
 /// State tracker for the diffing algorithm.
 ///
@@ -28,6 +34,8 @@ pub struct DiffState {
     bg: Option<Rgb>,
     /// Last emitted modifiers.
     modifiers: Option<Modifiers>,
+    /// How colors are written.
+    color_mode: ColorMode,
 }
 
 impl Default for DiffState {
@@ -39,15 +47,26 @@ impl Default for DiffState {
 impl DiffState {
     /// Create a new diff state with unknown terminal state.
     pub const fn new() -> Self {
+        Self::with_color_mode(ColorMode::TrueColor)
+    }
+
+    /// Create a diff state writing colors for `color_mode`.
+    pub const fn with_color_mode(color_mode: ColorMode) -> Self {
         Self {
             cursor_x: 0,
             cursor_y: 0,
             fg: None,
             bg: None,
             modifiers: None,
+            color_mode,
         }
     }
 
+    /// Get how colors are written.
+    pub const fn color_mode(&self) -> ColorMode {
+        self.color_mode
+    }
+
     /// Reset the state (e.g., after a full screen clear).
     pub const fn reset(&mut self) {
         self.fg = None;
@@ -155,60 +174,76 @@ fn diff_rect(
                 continue;
             }
 
-            result.cells_changed += 1;
-
-            // Emit cursor move if not adjacent to last position
-            if state.cursor_y != y || state.cursor_x != x {
-                emit_cursor_move(output, x, y);
-                state.cursor_x = x;
-                state.cursor_y = y;
-                result.cursor_moves += 1;
-            }
+            emit_changed_cell(output, state, result, x, y, next_cell, next.graphemes());
+        }
+    }
+}
 
-            // Handle modifier resets first
-            // If we need to disable any modifiers, we must emit a full reset (\x1b[0m)
-            // which also clears colors.
-            let next_mods = next_cell.modifiers();
-            let current_mods = state.modifiers.unwrap_or(Modifiers::empty());
-            let removed_mods = current_mods.difference(next_mods);
-
-            if !removed_mods.is_empty() {
-                output.extend_from_slice(b"\x1b[0m");
-                state.fg = None;
-                state.bg = None;
-                state.modifiers = None;
-            }
+/// Write a changed cell at (x, y), moving the cursor and changing the
+/// style only as needed.
+///
+/// `graphemes` resolves overflow cells.
+pub(super) fn emit_changed_cell(
+    output: &mut Vec<u8>,
+    state: &mut DiffState,
+    result: &mut DiffResult,
+    x: u16,
+    y: u16,
+    cell: &Cell,
+    graphemes: &HashMap<u32, Arc<str>>,
+) {
+    result.cells_changed += 1;
+
+    // Emit cursor move if not adjacent to last position
+    if state.cursor_y != y || state.cursor_x != x {
+        emit_cursor_move(output, x, y);
+        state.cursor_x = x;
+        state.cursor_y = y;
+        result.cursor_moves += 1;
+    }
 
-            // Emit color changes if needed
-            if state.fg != Some(next_cell.fg()) {
-                emit_fg_color(output, next_cell.fg());
-                state.fg = Some(next_cell.fg());
-                result.color_changes += 1;
-            }
+    // Handle modifier resets first
+    // If we need to disable any modifiers, we must emit a full reset (\x1b[0m)
+    // which also clears colors.
+    let next_mods = cell.modifiers();
+    let current_mods = state.modifiers.unwrap_or(Modifiers::empty());
+    let removed_mods = current_mods.difference(next_mods);
 
-            if state.bg != Some(next_cell.bg()) {
-                emit_bg_color(output, next_cell.bg());
-                state.bg = Some(next_cell.bg());
-                result.color_changes += 1;
-            }
+    if !removed_mods.is_empty() {
+        output.extend_from_slice(b"\x1b[0m");
+        state.fg = None;
+        state.bg = None;
+        state.modifiers = None;
+    }
 
-            // Emit modifier additions if needed
-            if state.modifiers != Some(next_mods) {
-                // Logic here only handles additions because we already handled removals
-                // (if any removal occurred, we reset state.modifiers to None)
-                emit_modifiers(output, next_mods, state.modifiers);
-                state.modifiers = Some(next_mods);
-                result.modifier_changes += 1;
-            }
+    // Emit color changes if needed
+    if state.fg != Some(cell.fg()) {
+        emit_fg_color(output, cell.fg(), state.color_mode);
+        state.fg = Some(cell.fg());
+        result.color_changes += 1;
+    }
 
-            // Emit the grapheme
-            emit_grapheme(output, next_cell, next);
+    if state.bg != Some(cell.bg()) {
+        emit_bg_color(output, cell.bg(), state.color_mode);
+        state.bg = Some(cell.bg());
+        result.color_changes += 1;
+    }
 
-            // Update cursor position (advances by display width)
-            let advance = u16::from(next_cell.display_width().max(1));
-            state.cursor_x += advance;
-        }
+    // Emit modifier additions if needed
+    if state.modifiers != Some(next_mods) {
+        // Logic here only handles additions because we already handled removals
+        // (if any removal occurred, we reset state.modifiers to None)
+        emit_modifiers(output, next_mods, state.modifiers);
+        state.modifiers = Some(next_mods);
+        result.modifier_changes += 1;
     }
+
+    // Emit the grapheme
+    emit_grapheme(output, cell, graphemes);
+
+    // Update cursor position (advances by display width)
+    let advance = u16::from(cell.display_width().max(1));
+    state.cursor_x += advance;
 }
 
 /// Emit a cursor move sequence.
@@ -217,7 +252,7 @@ fn diff_rect(
 /// - `\x1b[H` for home (1,1)
 /// - `\x1b[{row};{col}H` for absolute positioning
 #[inline]
-fn emit_cursor_move(output: &mut Vec<u8>, x: u16, y: u16) {
+pub(super) fn emit_cursor_move(output: &mut Vec<u8>, x: u16, y: u16) {
     // ANSI uses 1-indexed positions
     let row = y + 1;
     let col = x + 1;
@@ -232,23 +267,23 @@ fn emit_cursor_move(output: &mut Vec<u8>, x: u16, y: u16) {
     }
 }
 
-/// Emit a foreground color sequence (true color).
+/// Emit a foreground color sequence.
 #[inline]
-fn emit_fg_color(output: &mut Vec<u8>, color: Rgb) {
-    let _ = write!(output, "\x1b[38;2;{};{};{}m", color.r, color.g, color.b);
+fn emit_fg_color(output: &mut Vec<u8>, color: Rgb, mode: ColorMode) {
+    palette::write_fg(output, color, mode);
 }
 
-/// Emit a background color sequence (true color).
+/// Emit a background color sequence.
 #[inline]
-fn emit_bg_color(output: &mut Vec<u8>, color: Rgb) {
-    let _ = write!(output, "\x1b[48;2;{};{};{}m", color.r, color.g, color.b);
+fn emit_bg_color(output: &mut Vec<u8>, color: Rgb, mode: ColorMode) {
+    palette::write_bg(output, color, mode);
 }
 
 /// Emit modifier change sequences.
 ///
 /// This handles the transition from one set of modifiers to another,
 /// emitting reset + set sequences as needed.
-fn emit_modifiers(output: &mut Vec<u8>, new: Modifiers, old: Option<Modifiers>) {
+pub(super) fn emit_modifiers(output: &mut Vec<u8>, new: Modifiers, old: Option<Modifiers>) {
     let old = old.unwrap_or(Modifiers::empty());
 
     // If we're removing modifiers, we need to reset first
@@ -296,10 +331,10 @@ fn emit_modifier_set(output: &mut Vec<u8>, modifiers: Modifiers) {
 
 /// Emit a grapheme to the output buffer.
 #[inline]
-fn emit_grapheme(output: &mut Vec<u8>, cell: &Cell, buffer: &Buffer) {
+fn emit_grapheme(output: &mut Vec<u8>, cell: &Cell, graphemes: &HashMap<u32, Arc<str>>) {
     if cell.flags().contains(CellFlags::OVERFLOW) {
-        // Look up in overflow storage
-        if let Some(grapheme) = cell.overflow_index().and_then(|idx| buffer.get_overflow(idx)) {
+        // Look up in the graphemes held by the buffer
+        if let Some(grapheme) = cell.overflow_index().and_then(|id| graphemes.get(&id)) {
             output.extend_from_slice(grapheme.as_bytes());
             return;
         }
@@ -328,10 +363,7 @@ pub fn render_full_diff(
 /// Generate a full redraw sequence (no diffing).
 ///
 /// This is used for initial render or when the terminal state is unknown.
-pub fn render_full(buffer: &Buffer, output: &mut Vec<u8>) {
-    let width = buffer.width();
-    let height = buffer.height();
-
+pub fn render_full(buffer: &Buffer, output: &mut Vec<u8>, mode: ColorMode) {
     // Hide cursor during redraw
     output.extend_from_slice(b"\x1b[?25l");
 
@@ -341,45 +373,96 @@ pub fn render_full(buffer: &Buffer, output: &mut Vec<u8>) {
     // Move to home
     output.extend_from_slice(b"\x1b[H");
 
+    emit_rows(buffer, output, mode);
+
+    // Reset attributes and show cursor
+    output.extend_from_slice(b"\x1b[0m\x1b[?25h");
+}
+
+/// Generate a full redraw of an inline live region.
+///
+/// Unlike [`render_full`] this leaves the rows above the cursor alone: the
+/// region is cleared from the home position to the end of the screen, so
+/// with origin mode on (`\x1b[?6h`) only the region is repainted.
+pub fn render_region(buffer: &Buffer, output: &mut Vec<u8>, mode: ColorMode) {
+    output.extend_from_slice(b"\x1b[?25l\x1b[H\x1b[J");
+    emit_rows(buffer, output, mode);
+    output.extend_from_slice(b"\x1b[0m\x1b[?25h");
+}
+
+/// Generate finished lines for the terminal's own scrollback.
+///
+/// Each row is written once, from the cursor's row downwards, with
+/// trailing blank cells trimmed. Rows are separated by `\r\n`; the last
+/// one is left unterminated so the caller decides where the cursor goes.
+pub fn render_lines(buffer: &Buffer, output: &mut Vec<u8>, mode: ColorMode) {
     let mut last_fg: Option<Rgb> = None;
     let mut last_bg: Option<Rgb> = None;
     let mut last_mods: Option<Modifiers> = None;
 
-    for y in 0..height {
+    for (y, row) in buffer.rows().enumerate() {
         if y > 0 {
-            // Move to start of next line
-            output.extend_from_slice(b"\r\n");
+            // End the line on default colors so the background doesn't
+            // bleed into the rest of the row
+            output.extend_from_slice(b"\x1b[0m\r\n");
+            (last_fg, last_bg, last_mods) = (None, None, None);
         }
+        let len = row.iter().rposition(|cell| *cell != Cell::default()).map_or(0, |i| i + 1);
+        for cell in &row[..len] {
+            emit_cell(output, cell, buffer, mode, &mut last_fg, &mut last_bg, &mut last_mods);
+        }
+    }
+    output.extend_from_slice(b"\x1b[0m");
+}
 
-        for x in 0..width {
-            let idx = (y as usize) * (width as usize) + (x as usize);
-            let cell = &buffer.cells()[idx];
+/// Write every row of `buffer`, starting at the cursor, with `\r\n`
+/// between rows.
+fn emit_rows(buffer: &Buffer, output: &mut Vec<u8>, mode: ColorMode) {
+    let mut last_fg: Option<Rgb> = None;
+    let mut last_bg: Option<Rgb> = None;
+    let mut last_mods: Option<Modifiers> = None;
 
-            // Skip continuation cells
-            if cell.is_wide_continuation() {
-                continue;
-            }
+    for (y, row) in buffer.rows().enumerate() {
+        if y > 0 {
+            // Move to start of next line
+            output.extend_from_slice(b"\r\n");
+        }
+        for cell in row {
+            emit_cell(output, cell, buffer, mode, &mut last_fg, &mut last_bg, &mut last_mods);
+        }
+    }
+}
 
-            // Emit colors if changed
-            if last_fg != Some(cell.fg()) {
-                emit_fg_color(output, cell.fg());
-                last_fg = Some(cell.fg());
-            }
-            if last_bg != Some(cell.bg()) {
-                emit_bg_color(output, cell.bg());
-                last_bg = Some(cell.bg());
-            }
-            if last_mods != Some(cell.modifiers()) {
-                emit_modifiers(output, cell.modifiers(), last_mods);
-                last_mods = Some(cell.modifiers());
-            }
+/// Write one cell, emitting only the style changes since the last one.
+fn emit_cell(
+    output: &mut Vec<u8>,
+    cell: &Cell,
+    buffer: &Buffer,
+    mode: ColorMode,
+    last_fg: &mut Option<Rgb>,
+    last_bg: &mut Option<Rgb>,
+    last_mods: &mut Option<Modifiers>,
+) {
+    // Skip continuation cells
+    if cell.is_wide_continuation() {
+        return;
+    }
 
-            emit_grapheme(output, cell, buffer);
-        }
+    // Emit colors if changed
+    if *last_fg != Some(cell.fg()) {
+        emit_fg_color(output, cell.fg(), mode);
+        *last_fg = Some(cell.fg());
+    }
+    if *last_bg != Some(cell.bg()) {
+        emit_bg_color(output, cell.bg(), mode);
+        *last_bg = Some(cell.bg());
+    }
+    if *last_mods != Some(cell.modifiers()) {
+        emit_modifiers(output, cell.modifiers(), *last_mods);
+        *last_mods = Some(cell.modifiers());
     }
 
-    // Reset attributes and show cursor
-    output.extend_from_slice(b"\x1b[0m\x1b[?25h");
+    emit_grapheme(output, cell, buffer.graphemes());
 }
 
 #[cfg(test)]
@@ -508,7 +591,7 @@ mod tests {
         buffer.set(2, 0, Cell::new('C'));
 
         let mut output = Vec::new();
-        render_full(&buffer, &mut output);
+        render_full(&buffer, &mut output, ColorMode::TrueColor);
 
         let output_str = String::from_utf8_lossy(&output);
         // Should start with hide cursor, clear screen, and home
@@ -520,4 +603,23 @@ mod tests {
         // Should end with reset and show cursor
         assert!(output_str.ends_with("\x1b[0m\x1b[?25h"));
     }
+
+    #[test]
+    fn test_render_lines() {
+        let mut buffer = Buffer::new(6, 2);
+        buffer.set_str(0, 0, "one", Rgb::new(255, 255, 255), Rgb::new(0, 0, 0));
+        buffer.set_str(0, 1, "two", Rgb::new(255, 255, 255), Rgb::new(0, 0, 0));
+
+        let mut output = Vec::new();
+        render_lines(&buffer, &mut output, ColorMode::TrueColor);
+
+        let output_str = String::from_utf8_lossy(&output);
+        // No screen clearing or cursor addressing: the lines go where the
+        // cursor is and scroll into the terminal's history from there
+        assert!(!output_str.contains("\x1b[2J"));
+        assert!(!output_str.contains('H'));
+        assert_eq!(output_str.matches("\r\n").count(), 1);
+        assert!(output_str.contains("one\x1b[0m\r\n"));
+        assert!(output_str.ends_with("two\x1b[0m"));
+    }
 }
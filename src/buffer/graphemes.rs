@@ -0,0 +1,108 @@
+//! Grapheme Interning: Shared storage for graphemes too long for a cell.
+//!
+//! ZWJ emoji and long combining sequences don't fit in a cell's four
+//! grapheme bytes. They are interned once in a process-wide table and
+//! cells store the grapheme's id, which is the same in every buffer and
+//! every frame. Equal cells therefore hold equal ids, and copying a buffer
+//! copies ids instead of strings.
+//!
+//! Each buffer holds a reference to the graphemes it uses. Graphemes no
+//! buffer refers to any more are dropped from the table the next time it is
+//! purged, and their ids are never handed out again, so a stale id can go
+//! missing but never names a different grapheme.
+
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex, PoisonError};
+
+/// Table size below which the table is never purged.
+const MIN_PURGE_LEN: usize = 256;
+
+/// The process-wide grapheme table.
+static TABLE: Mutex<GraphemeTable> = Mutex::new(GraphemeTable::new());
+
+/// Interned graphemes and their ids.
+///
+/// Each grapheme is held once by the table and once per buffer using it,
+/// so a strong count of one means no buffer uses it. Such graphemes are
+/// purged whenever the table has doubled since the last purge.
+#[derive(Debug)]
+struct GraphemeTable {
+    /// Ids by grapheme. `None` until the first grapheme is interned.
+    ids: Option<HashMap<Arc<str>, u32>>,
+    /// Id of the next new grapheme.
+    next_id: u32,
+    /// Table size that triggers the next purge.
+    purge_at: usize,
+}
+
+impl GraphemeTable {
+    /// Create an empty table.
+    const fn new() -> Self {
+        Self {
+            ids: None,
+            next_id: 0,
+            purge_at: MIN_PURGE_LEN,
+        }
+    }
+
+    /// Get the id of `grapheme` and a reference keeping it interned.
+    fn intern(&mut self, grapheme: &str) -> (u32, Arc<str>) {
+        let ids = self.ids.get_or_insert_with(HashMap::new);
+        if let Some((text, &id)) = ids.get_key_value(grapheme) {
+            return (id, Arc::clone(text));
+        }
+
+        let id = self.next_id;
+        self.next_id = self.next_id.wrapping_add(1);
+        let text: Arc<str> = grapheme.into();
+        ids.insert(Arc::clone(&text), id);
+        if ids.len() >= self.purge_at {
+            ids.retain(|text, _| Arc::strong_count(text) > 1);
+            self.purge_at = (ids.len() * 2).max(MIN_PURGE_LEN);
+        }
+        (id, text)
+    }
+
+    /// Get the number of interned graphemes.
+    fn len(&self) -> usize {
+        self.ids.as_ref().map_or(0, HashMap::len)
+    }
+}
+
+/// Intern `grapheme`, returning its id and a reference to hold while any
+/// cell uses the id.
+pub fn intern(grapheme: &str) -> (u32, Arc<str>) {
+    TABLE
+        .lock()
+        .unwrap_or_else(PoisonError::into_inner)
+        .intern(grapheme)
+}
+
+/// Get the number of interned graphemes, including unused ones not purged
+/// yet.
+pub fn len() -> usize {
+    TABLE.lock().unwrap_or_else(PoisonError::into_inner).len()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_graphemes_are_shared_and_purged() {
+        let mut table = GraphemeTable::new();
+        let (id, family) = table.intern("👨‍👩‍👧‍👦");
+        let (again, _) = table.intern("👨‍👩‍👧‍👦");
+        assert_eq!(id, again);
+        assert_eq!(&*family, "👨‍👩‍👧‍👦");
+
+        // Unused graphemes go at the next purge; ids are not reused
+        drop(family);
+        for i in 0..MIN_PURGE_LEN {
+            let _ = table.intern(&format!("e\u{301}{i}"));
+        }
+        assert!(table.len() < MIN_PURGE_LEN);
+        let (new_id, _) = table.intern("👨‍👩‍👧‍👦");
+        assert_ne!(new_id, id);
+    }
+}
@@ -0,0 +1,244 @@
+//! Line Interning: Shared storage for repeated scrollback lines.
+//!
+//! Agent transcripts and build logs repeat whole lines constantly: blank
+//! separators, box borders, progress bars, identical warnings. Once a line
+//! is finished, the rope buffer looks its cells up in a table of shared
+//! payloads, so every copy after the first costs a pointer instead of its
+//! own cells.
+//!
+//! Shared payloads are immutable. Writing to an interned line copies it
+//! back into an owned vector first, and payloads no longer used by any
+//! line are dropped from the table the next time it is purged.
+
+use std::collections::HashSet;
+use std::fmt;
+use std::ops::{Deref, DerefMut};
+use std::sync::Arc;
+
+use crate::buffer::Cell;
+
+/// Table size below which the interner is never purged.
+const MIN_PURGE_LEN: usize = 1024;
+
+/// Cells of a rope line: owned while being written, shared once interned.
+///
+/// Dereferences to a slice of cells. Mutable access to a shared line
+/// copies its cells first.
+#[derive(Clone, PartialEq, Eq)]
+pub struct LineCells(Repr);
+
+/// Storage of a line's cells.
+#[derive(Clone, PartialEq, Eq)]
+enum Repr {
+    /// Cells owned by the line.
+    Owned(Vec<Cell>),
+    /// Cells shared through the interner.
+    Shared(Arc<[Cell]>),
+}
+
+impl LineCells {
+    /// Create an empty line.
+    pub const fn new() -> Self {
+        Self(Repr::Owned(Vec::new()))
+    }
+
+    /// Get the cells as a slice.
+    pub fn as_slice(&self) -> &[Cell] {
+        self
+    }
+
+    /// Check if the cells are shared with other lines.
+    pub const fn is_shared(&self) -> bool {
+        matches!(self.0, Repr::Shared(_))
+    }
+
+    /// Get the cells for writing, copying them if they are shared.
+    #[allow(clippy::missing_panics_doc)]
+    pub fn to_mut(&mut self) -> &mut Vec<Cell> {
+        if let Repr::Shared(cells) = &self.0 {
+            self.0 = Repr::Owned(cells.to_vec());
+        }
+        match &mut self.0 {
+            Repr::Owned(cells) => cells,
+            Repr::Shared(_) => unreachable!("shared cells were just copied"),
+        }
+    }
+
+    /// Append a cell, copying the line first if it is shared.
+    pub fn push(&mut self, cell: Cell) {
+        self.to_mut().push(cell);
+    }
+
+    /// Get the heap memory owned by this line alone, in bytes.
+    ///
+    /// Shared cells belong to the interner and count as zero.
+    pub const fn owned_bytes(&self) -> usize {
+        match &self.0 {
+            Repr::Owned(cells) => cells.len() * std::mem::size_of::<Cell>(),
+            Repr::Shared(_) => 0,
+        }
+    }
+
+    /// Share the cells through `interner`.
+    ///
+    /// Empty lines are left alone, since they own no memory.
+    pub(crate) fn intern(&mut self, interner: &mut LineInterner) {
+        if let Repr::Owned(cells) = &mut self.0 {
+            if !cells.is_empty() {
+                self.0 = Repr::Shared(interner.intern(std::mem::take(cells)));
+            }
+        }
+    }
+}
+
+impl Default for LineCells {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Deref for LineCells {
+    type Target = [Cell];
+
+    fn deref(&self) -> &[Cell] {
+        match &self.0 {
+            Repr::Owned(cells) => cells,
+            Repr::Shared(cells) => cells,
+        }
+    }
+}
+
+impl DerefMut for LineCells {
+    fn deref_mut(&mut self) -> &mut [Cell] {
+        self.to_mut()
+    }
+}
+
+impl fmt::Debug for LineCells {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_list().entries(self.iter()).finish()
+    }
+}
+
+impl From<Vec<Cell>> for LineCells {
+    fn from(cells: Vec<Cell>) -> Self {
+        Self(Repr::Owned(cells))
+    }
+}
+
+impl FromIterator<Cell> for LineCells {
+    fn from_iter<I: IntoIterator<Item = Cell>>(iter: I) -> Self {
+        Self(Repr::Owned(iter.into_iter().collect()))
+    }
+}
+
+impl Extend<Cell> for LineCells {
+    fn extend<I: IntoIterator<Item = Cell>>(&mut self, iter: I) {
+        self.to_mut().extend(iter);
+    }
+}
+
+impl<'a> IntoIterator for &'a LineCells {
+    type Item = &'a Cell;
+    type IntoIter = std::slice::Iter<'a, Cell>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.iter()
+    }
+}
+
+/// Table of shared line payloads.
+///
+/// Each payload is held once by the table and once per line using it, so a
+/// strong count of one means every line using it has been evicted, frozen
+/// or rewritten. Such payloads are purged whenever the table has doubled
+/// since the last purge, keeping the cost amortized O(1) per line.
+#[derive(Debug, Default)]
+pub struct LineInterner {
+    /// Shared payloads, keyed by their cells.
+    lines: HashSet<Arc<[Cell]>>,
+    /// Table size that triggers the next purge.
+    purge_at: usize,
+}
+
+impl LineInterner {
+    /// Create an empty interner.
+    pub fn new() -> Self {
+        Self {
+            lines: HashSet::new(),
+            purge_at: MIN_PURGE_LEN,
+        }
+    }
+
+    /// Get the shared payload for `cells`, adding it if it is new.
+    pub fn intern(&mut self, cells: Vec<Cell>) -> Arc<[Cell]> {
+        if let Some(shared) = self.lines.get(cells.as_slice()) {
+            return Arc::clone(shared);
+        }
+        let shared: Arc<[Cell]> = cells.into();
+        self.lines.insert(Arc::clone(&shared));
+        if self.lines.len() >= self.purge_at {
+            self.purge();
+        }
+        shared
+    }
+
+    /// Drop payloads no line uses any more.
+    pub fn purge(&mut self) {
+        self.lines.retain(|cells| Arc::strong_count(cells) > 1);
+        self.purge_at = (self.lines.len() * 2).max(MIN_PURGE_LEN);
+    }
+
+    /// Drop every payload.
+    ///
+    /// Lines keep their cells; they are just no longer shared with lines
+    /// interned later.
+    pub fn clear(&mut self) {
+        self.lines.clear();
+        self.purge_at = MIN_PURGE_LEN;
+    }
+
+    /// Get the number of payloads.
+    #[allow(dead_code)]
+    pub fn len(&self) -> usize {
+        self.lines.len()
+    }
+
+    /// Get the memory used by the table and its payloads, in bytes.
+    pub fn memory_usage(&self) -> usize {
+        let payloads: usize = self.lines.iter().map(|cells| cells.len()).sum();
+        self.lines.capacity() * std::mem::size_of::<Arc<[Cell]>>()
+            + payloads * std::mem::size_of::<Cell>()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn cells(text: &str) -> Vec<Cell> {
+        text.chars().map(Cell::from_char).collect()
+    }
+
+    #[test]
+    fn test_interned_lines_share_cells() {
+        let mut interner = LineInterner::new();
+        let mut a = LineCells::from(cells("────────"));
+        let mut b = LineCells::from(cells("────────"));
+        a.intern(&mut interner);
+        b.intern(&mut interner);
+
+        assert!(a.is_shared() && b.is_shared());
+        assert_eq!(interner.len(), 1);
+        assert_eq!(a.owned_bytes(), 0);
+
+        // Writing copies the line and leaves the other one alone
+        b[0] = Cell::from_char('x');
+        assert!(!b.is_shared());
+        assert_eq!(a[0], Cell::from_char('─'));
+
+        drop(a);
+        interner.purge();
+        assert_eq!(interner.len(), 0);
+    }
+}
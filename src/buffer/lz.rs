@@ -0,0 +1,211 @@
+//! LZ Codec: Small byte-oriented LZ77 compressor for cold rope chunks.
+//!
+//! Encoded chunks of terminal output repeat themselves heavily (log
+//! prefixes, indentation, style runs), so a greedy single-probe matcher
+//! gets most of the available ratio while staying fast to decode.
+//!
+//! # Format
+//!
+//! The compressed data starts with the decompressed length as a `u32`,
+//! followed by LZ4-style sequences: a token byte (high nibble literal
+//! count, low nibble match length minus 4; 15 means more length bytes
+//! follow, each 255 continuing), the literals, then the match offset as a
+//! little-endian `u16`. The last sequence has literals only.
+
+use std::io;
+
+/// Shortest match worth encoding.
+const MIN_MATCH: usize = 4;
+
+/// Bits of the match finder's hash table.
+const HASH_BITS: u32 = 12;
+
+/// Farthest a match can reach back.
+const MAX_OFFSET: usize = u16::MAX as usize;
+
+/// Token nibble meaning "length continues in extra bytes".
+const NIBBLE_MAX: usize = 15;
+
+/// Read four bytes at `pos` as a little-endian `u32`.
+fn read_u32(bytes: &[u8], pos: usize) -> u32 {
+    u32::from_le_bytes([bytes[pos], bytes[pos + 1], bytes[pos + 2], bytes[pos + 3]])
+}
+
+/// Hash four bytes into a table slot.
+const fn hash(seq: u32) -> usize {
+    (seq.wrapping_mul(0x9E37_79B1) >> (32 - HASH_BITS)) as usize
+}
+
+/// Compress bytes.
+#[allow(clippy::cast_possible_truncation)]
+pub fn compress(input: &[u8]) -> Vec<u8> {
+    let mut out = Vec::with_capacity(input.len() / 2 + 8);
+    out.extend_from_slice(&(input.len() as u32).to_le_bytes());
+
+    // Most recent position + 1 of each hashed 4-byte sequence (0 = none)
+    let mut table = vec![0u32; 1 << HASH_BITS];
+    let mut anchor = 0;
+    let mut pos = 0;
+    while pos + MIN_MATCH <= input.len() {
+        let seq = read_u32(input, pos);
+        let slot = hash(seq);
+        let candidate = table[slot] as usize;
+        table[slot] = pos as u32 + 1;
+
+        let Some(start) = candidate.checked_sub(1) else {
+            pos += 1;
+            continue;
+        };
+        if pos - start > MAX_OFFSET || read_u32(input, start) != seq {
+            pos += 1;
+            continue;
+        }
+
+        let len = MIN_MATCH
+            + input[pos + MIN_MATCH..]
+                .iter()
+                .zip(&input[start + MIN_MATCH..])
+                .take_while(|(a, b)| a == b)
+                .count();
+        emit_sequence(&mut out, &input[anchor..pos], Some((pos - start, len)));
+        pos += len;
+        anchor = pos;
+    }
+    emit_sequence(&mut out, &input[anchor..], None);
+
+    out
+}
+
+/// Append one sequence: literals, then an optional (offset, length) match.
+#[allow(clippy::cast_possible_truncation)]
+fn emit_sequence(out: &mut Vec<u8>, literals: &[u8], matched: Option<(usize, usize)>) {
+    let match_len = matched.map_or(0, |(_, len)| len - MIN_MATCH);
+    out.push((literals.len().min(NIBBLE_MAX) << 4 | match_len.min(NIBBLE_MAX)) as u8);
+    if literals.len() >= NIBBLE_MAX {
+        push_length(out, literals.len() - NIBBLE_MAX);
+    }
+    out.extend_from_slice(literals);
+
+    if let Some((offset, _)) = matched {
+        out.extend_from_slice(&(offset as u16).to_le_bytes());
+        if match_len >= NIBBLE_MAX {
+            push_length(out, match_len - NIBBLE_MAX);
+        }
+    }
+}
+
+/// Append the extra bytes of a length.
+#[allow(clippy::cast_possible_truncation)]
+fn push_length(out: &mut Vec<u8>, mut len: usize) {
+    while len >= 255 {
+        out.push(255);
+        len -= 255;
+    }
+    out.push(len as u8);
+}
+
+/// Error for malformed input.
+fn corrupt() -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, "corrupt compressed chunk")
+}
+
+/// Read the extra bytes of a length.
+fn read_length(input: &[u8], pos: &mut usize) -> io::Result<usize> {
+    let mut len = 0;
+    loop {
+        let byte = *input.get(*pos).ok_or_else(corrupt)?;
+        *pos += 1;
+        len += usize::from(byte);
+        if byte != 255 {
+            return Ok(len);
+        }
+    }
+}
+
+/// Decompress bytes produced by [`compress`].
+///
+/// # Errors
+/// Returns [`io::ErrorKind::InvalidData`] if the input is malformed.
+pub fn decompress(input: &[u8]) -> io::Result<Vec<u8>> {
+    let header = input.get(..4).ok_or_else(corrupt)?;
+    let len = u32::from_le_bytes([header[0], header[1], header[2], header[3]]) as usize;
+    // Each input byte expands to at most 255 output bytes
+    let mut out = Vec::with_capacity(len.min(input.len().saturating_mul(255)));
+
+    let mut pos = 4;
+    loop {
+        let token = *input.get(pos).ok_or_else(corrupt)?;
+        pos += 1;
+
+        let mut literals = usize::from(token >> 4);
+        if literals == NIBBLE_MAX {
+            literals += read_length(input, &mut pos)?;
+        }
+        out.extend_from_slice(input.get(pos..pos + literals).ok_or_else(corrupt)?);
+        pos += literals;
+        if pos == input.len() {
+            break;
+        }
+
+        let offset = input.get(pos..pos + 2).ok_or_else(corrupt)?;
+        let offset = usize::from(u16::from_le_bytes([offset[0], offset[1]]));
+        pos += 2;
+        let mut match_len = usize::from(token & 0x0F);
+        if match_len == NIBBLE_MAX {
+            match_len += read_length(input, &mut pos)?;
+        }
+        match_len += MIN_MATCH;
+
+        if offset == 0 || offset > out.len() || out.len() + match_len > len {
+            return Err(corrupt());
+        }
+        let start = out.len() - offset;
+        if offset >= match_len {
+            out.extend_from_within(start..start + match_len);
+        } else {
+            // Overlapping match: repeats the last `offset` bytes
+            for i in start..start + match_len {
+                out.push(out[i]);
+            }
+        }
+    }
+
+    if out.len() == len {
+        Ok(out)
+    } else {
+        Err(corrupt())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lz_round_trip() {
+        let log: Vec<u8> = (0..500)
+            .flat_map(|i| {
+                format!("2024-01-01T00:00:{:02} INFO worker={} ok\n", i % 60, i % 4).into_bytes()
+            })
+            .collect();
+        let noise: Vec<u8> = (0u32..5000)
+            .map(|i| (i.wrapping_mul(2_654_435_761) >> 13) as u8)
+            .collect();
+        let runs = vec![b'x'; 1000];
+
+        for input in [&log[..], &noise[..], &runs[..], b"", b"abc"] {
+            let compressed = compress(input);
+            assert_eq!(decompress(&compressed).unwrap(), input);
+        }
+        assert!(compress(&log).len() * 5 < log.len());
+        assert!(compress(&runs).len() < 20);
+    }
+
+    #[test]
+    fn test_lz_rejects_corrupt_input() {
+        let compressed = compress(b"hello hello hello hello");
+        assert!(decompress(&compressed[..compressed.len() - 1]).is_err());
+        assert!(decompress(&[0xFF, 0, 0, 0, 0x0F, 0, 0]).is_err());
+        assert!(decompress(&[]).is_err());
+    }
+}
@@ -6,15 +6,36 @@
 //! - [`Rgb`]: True-color representation
 //! - [`Modifiers`]: Text style bitflags
 //! - [`diff`]: Diffing engine for generating minimal ANSI sequences
+//! - [`compact`]: 8-byte cells with interned styles, for cheaper diffs
+//! - [`graphemes`]: Shared table of graphemes too long for a cell
+//! - [`palette`]: The 256-color palette and color output modes
+//! - [`parallel`]: Row-band diffing on worker threads for very large frames
+//! - [`planar`]: Structure-of-arrays buffer copies for plane-wise diffs
+//! - [`LineCells`]: Line cells shared between identical scrollback lines
 //! - [`rope`]: Rope-based buffer for efficient large document storage
+//! - [`search`]: Trigram-indexed search over rope chunks
+//! - [`text`]: Text ingestion with an ASCII fast lane and width tables
 
 mod cell;
 #[allow(clippy::module_inception)]
 mod buffer;
+mod cold;
+pub mod compact;
 pub mod diff;
+pub mod graphemes;
+mod intern;
+mod lz;
+pub mod palette;
+pub mod parallel;
+pub mod planar;
 pub mod rope;
+pub mod search;
+pub mod text;
 
 pub use cell::{Cell, CellFlags, Modifiers, Rgb};
 pub use buffer::Buffer;
+pub use intern::LineCells;
+pub use palette::ColorMode;
 pub use rope::{RopeBuffer, ChunkedLine, RopeMemoryStats};
+pub use search::{SearchMatch, SearchQuery};
 
@@ -0,0 +1,233 @@
+//! Palette: xterm's 256-color palette and color output modes.
+//!
+//! Colors made with [`Rgb::from_ansi_index`] remember their palette index,
+//! so they are written as short `3n`/`9n` or `38;5;n` codes, and a terminal
+//! theme still applies to the 16 base colors. True colors are written as
+//! `38;2;r;g;b`, or quantized to the palette for terminals without true
+//! color, such as many tmux and screen setups.
+//!
+//! Quantization goes through lookup tables over a 5-bit-per-channel cube
+//! (32K entries each), built on first use, so mapping a color costs one
+//! load instead of a nearest-color search.
+
+use super::Rgb;
+use std::io::Write;
+use std::sync::OnceLock;
+
+/// Colors the terminal can show, which decides how colors are written.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum ColorMode {
+    /// 24-bit color. True colors are written as `38;2;r;g;b`.
+    #[default]
+    TrueColor,
+    /// The 256-color palette. True colors are quantized to the color cube
+    /// or the grayscale ramp.
+    Palette256,
+    /// The 16 base colors, written as `30`-`37` and `90`-`97`. Everything
+    /// else is quantized to them.
+    Ansi16,
+}
+
+/// xterm's 256-color palette, as RGB.
+pub(crate) const PALETTE: [[u8; 3]; 256] = build_palette();
+
+/// Channel levels of the 6x6x6 color cube.
+const CUBE_LEVELS: [u8; 6] = [0, 95, 135, 175, 215, 255];
+
+/// Entries in a quantization table: 5 bits per channel.
+const LUT_SIZE: usize = 1 << 15;
+
+/// Build the palette: 16 base colors, the color cube and the gray ramp.
+#[allow(clippy::cast_possible_truncation)]
+const fn build_palette() -> [[u8; 3]; 256] {
+    const BASE: [[u8; 3]; 16] = [
+        [0, 0, 0],
+        [128, 0, 0],
+        [0, 128, 0],
+        [128, 128, 0],
+        [0, 0, 128],
+        [128, 0, 128],
+        [0, 128, 128],
+        [192, 192, 192],
+        [128, 128, 128],
+        [255, 0, 0],
+        [0, 255, 0],
+        [255, 255, 0],
+        [0, 0, 255],
+        [255, 0, 255],
+        [0, 255, 255],
+        [255, 255, 255],
+    ];
+    let mut palette = [[0; 3]; 256];
+    let mut i = 0;
+    while i < 256 {
+        palette[i] = if i < 16 {
+            BASE[i]
+        } else if i < 232 {
+            let n = i - 16;
+            [CUBE_LEVELS[n / 36], CUBE_LEVELS[n / 6 % 6], CUBE_LEVELS[n % 6]]
+        } else {
+            let v = ((i - 232) * 10 + 8) as u8;
+            [v, v, v]
+        };
+        i += 1;
+    }
+    palette
+}
+
+/// Squared distance between two colors.
+const fn distance(a: [u8; 3], b: [u8; 3]) -> u32 {
+    let mut sum = 0;
+    let mut i = 0;
+    while i < 3 {
+        let d = a[i].abs_diff(b[i]) as u32;
+        sum += d * d;
+        i += 1;
+    }
+    sum
+}
+
+/// Index of the cube level nearest to a channel value.
+#[allow(clippy::cast_possible_truncation)]
+fn nearest_level(v: u8) -> u8 {
+    (0..6u8)
+        .min_by_key(|&i| CUBE_LEVELS[usize::from(i)].abs_diff(v))
+        .unwrap_or(0)
+}
+
+/// Nearest palette color in `16..=255`, leaving out the themeable base
+/// colors.
+#[allow(clippy::cast_possible_truncation)]
+fn nearest_256(rgb: [u8; 3]) -> u8 {
+    let [r, g, b] = rgb.map(nearest_level);
+    let cube = 16 + 36 * r + 6 * g + b;
+
+    let average = (u32::from(rgb[0]) + u32::from(rgb[1]) + u32::from(rgb[2])) / 3;
+    let gray = 232 + (average.saturating_sub(3) / 10).min(23) as u8;
+
+    let palette = |i: u8| PALETTE[usize::from(i)];
+    if distance(rgb, palette(gray)) < distance(rgb, palette(cube)) {
+        gray
+    } else {
+        cube
+    }
+}
+
+/// Nearest of the 16 base colors.
+#[allow(clippy::cast_possible_truncation)]
+fn nearest_16(rgb: [u8; 3]) -> u8 {
+    (0..16u8)
+        .min_by_key(|&i| distance(rgb, PALETTE[usize::from(i)]))
+        .unwrap_or(0)
+}
+
+/// Build a quantization table, sampling each cell of the 5-bit cube at
+/// its center.
+#[allow(clippy::cast_possible_truncation)]
+fn build_lut(nearest: fn([u8; 3]) -> u8) -> Box<[u8]> {
+    let mut lut = vec![0; LUT_SIZE].into_boxed_slice();
+    for (i, slot) in lut.iter_mut().enumerate() {
+        let channel = |shift: usize| ((i >> shift) as u8 & 0x1F) << 3 | 4;
+        *slot = nearest([channel(10), channel(5), channel(0)]);
+    }
+    lut
+}
+
+/// Index of a color in a quantization table.
+const fn lut_index(color: Rgb) -> usize {
+    (color.r as usize >> 3) << 10 | (color.g as usize >> 3) << 5 | color.b as usize >> 3
+}
+
+/// Quantize a color to the 256-color palette, outside the base colors.
+pub fn quantize_256(color: Rgb) -> u8 {
+    static LUT: OnceLock<Box<[u8]>> = OnceLock::new();
+    LUT.get_or_init(|| build_lut(nearest_256))[lut_index(color)]
+}
+
+/// Quantize a color to the 16 base colors.
+pub fn quantize_16(color: Rgb) -> u8 {
+    static LUT: OnceLock<Box<[u8]>> = OnceLock::new();
+    LUT.get_or_init(|| build_lut(nearest_16))[lut_index(color)]
+}
+
+/// Get the palette index a color is written as in `mode`, or `None` to
+/// write it as a true color.
+pub fn index_for(color: Rgb, mode: ColorMode) -> Option<u8> {
+    match (mode, color.index()) {
+        (ColorMode::Ansi16, Some(index)) if index < 16 => Some(index),
+        (ColorMode::Ansi16, _) => Some(quantize_16(color)),
+        (_, Some(index)) => Some(index),
+        (ColorMode::Palette256, None) => Some(quantize_256(color)),
+        (ColorMode::TrueColor, None) => None,
+    }
+}
+
+/// Append the SGR parameters selecting a color, without `ESC [` or `m`.
+///
+/// `base` is 30 for the foreground and 40 for the background.
+pub(crate) fn push_params(output: &mut Vec<u8>, color: Rgb, mode: ColorMode, base: u8) {
+    let _ = match index_for(color, mode) {
+        Some(index @ 0..=7) => write!(output, "{}", base + index),
+        Some(index @ 8..=15) => write!(output, "{}", base + 60 + index - 8),
+        Some(index) => write!(output, "{};5;{index}", base + 8),
+        None => write!(output, "{};2;{};{};{}", base + 8, color.r, color.g, color.b),
+    };
+}
+
+/// Write the sequence setting the foreground color.
+#[inline]
+pub fn write_fg(output: &mut Vec<u8>, color: Rgb, mode: ColorMode) {
+    output.extend_from_slice(b"\x1b[");
+    push_params(output, color, mode, 30);
+    output.push(b'm');
+}
+
+/// Write the sequence setting the background color.
+#[inline]
+pub fn write_bg(output: &mut Vec<u8>, color: Rgb, mode: ColorMode) {
+    output.extend_from_slice(b"\x1b[");
+    push_params(output, color, mode, 40);
+    output.push(b'm');
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Format a foreground color.
+    fn fg(color: Rgb, mode: ColorMode) -> String {
+        let mut output = Vec::new();
+        write_fg(&mut output, color, mode);
+        String::from_utf8(output).unwrap_or_default()
+    }
+
+    #[test]
+    fn test_palette_indices_survive_every_mode() {
+        let red = Rgb::from_ansi_index(1);
+        assert_eq!(red.index(), Some(1));
+        assert_eq!((red.r, red.g, red.b), (128, 0, 0));
+        assert_eq!(fg(red, ColorMode::TrueColor), "\x1b[31m");
+        assert_eq!(fg(Rgb::from_ansi_index(12), ColorMode::Palette256), "\x1b[94m");
+        assert_eq!(fg(Rgb::from_ansi_index(196), ColorMode::TrueColor), "\x1b[38;5;196m");
+
+        let mut output = Vec::new();
+        write_bg(&mut output, Rgb::from_ansi_index(4), ColorMode::Ansi16);
+        assert_eq!(output, b"\x1b[44m");
+    }
+
+    #[test]
+    fn test_true_colors_are_quantized() {
+        let orange = Rgb::new(255, 135, 0);
+        assert_eq!(fg(orange, ColorMode::TrueColor), "\x1b[38;2;255;135;0m");
+        assert_eq!(fg(orange, ColorMode::Palette256), "\x1b[38;5;208m");
+        assert_eq!(fg(Rgb::new(250, 10, 10), ColorMode::Ansi16), "\x1b[91m");
+
+        // Grays land on the ramp, not the cube
+        assert_eq!(quantize_256(Rgb::new(118, 118, 118)), 243);
+        // Cube colors map to themselves
+        for index in 16..=231u8 {
+            let [r, g, b] = PALETTE[usize::from(index)];
+            assert_eq!(PALETTE[usize::from(quantize_256(Rgb::new(r, g, b)))], [r, g, b]);
+        }
+    }
+}
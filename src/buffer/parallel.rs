@@ -0,0 +1,364 @@
+//! Parallel Diff: Row-band diffing for very large frames.
+//!
+//! Diffing is linear in the cells compared, so on very large terminals
+//! (500x150 and up) a frame is split into bands of rows diffed on separate
+//! threads. Each band writes its own output segment with its own
+//! [`DiffState`] that starts from an unknown terminal state: the segment
+//! opens with an SGR reset, and its first cell moves the cursor and sets
+//! colors explicitly. Segments therefore concatenate into one write however
+//! the frame was split. The first band continues the caller's state and
+//! writes straight into the output.
+//!
+//! Starting the band threads costs more than diffing a small frame, so
+//! [`ParallelDiff`] times its diffs and only splits frames above the size
+//! at which bands have paid off so far.
+
+use super::diff::{render_diff, DiffResult, DiffState};
+use super::Buffer;
+use crate::layout::Rect;
+use std::num::NonZeroUsize;
+use std::thread;
+use std::time::Instant;
+
+/// Frames with fewer cells to compare are always diffed serially.
+const MIN_PARALLEL_CELLS: usize = 16 * 1024;
+
+/// Fewest rows in a band.
+const MIN_BAND_ROWS: u16 = 16;
+
+/// Timed diffs between tries of the mode not currently chosen.
+const PROBE_INTERVAL: u32 = 64;
+
+/// Starting estimate of the serial diff cost, in picoseconds per cell.
+const INITIAL_CELL_COST: u64 = 1_000;
+
+/// Starting estimate of the fixed cost of a split diff, in nanoseconds.
+const INITIAL_OVERHEAD: u64 = 50_000;
+
+/// Diffs frames serially or in row bands, whichever is faster at their
+/// size.
+///
+/// The crossover is tuned from the diffs themselves: serial diffs measure
+/// the cost per cell, split diffs the fixed cost of starting the bands,
+/// and frames are split once the time saved outweighs that fixed cost.
+/// Every [`PROBE_INTERVAL`] timed diffs the other mode is tried once, so the
+/// estimates follow changes in load and content.
+#[derive(Debug)]
+pub struct ParallelDiff {
+    /// Most bands a frame is split into.
+    workers: usize,
+    /// Output segments of the bands after the first, reused across frames.
+    segments: Vec<Vec<u8>>,
+    /// Serial diff cost in picoseconds per cell (moving average).
+    cell_cost: u64,
+    /// Fixed cost of a split diff in nanoseconds (moving average).
+    overhead: u64,
+    /// Cells compared from which split diffs are expected to be faster.
+    threshold: usize,
+    /// Timed diffs since the other mode was last tried.
+    since_probe: u32,
+}
+
+impl Default for ParallelDiff {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl ParallelDiff {
+    /// Create a differ using up to one band per available core.
+    pub fn new() -> Self {
+        Self::with_workers(thread::available_parallelism().map_or(1, NonZeroUsize::get))
+    }
+
+    /// Create a differ splitting frames into at most `workers` bands.
+    pub fn with_workers(workers: usize) -> Self {
+        let mut diff = Self {
+            workers: workers.max(1),
+            segments: Vec::new(),
+            cell_cost: INITIAL_CELL_COST,
+            overhead: INITIAL_OVERHEAD,
+            threshold: usize::MAX,
+            since_probe: 0,
+        };
+        diff.retune();
+        diff
+    }
+
+    /// Get the number of cells compared from which frames are split.
+    pub const fn threshold(&self) -> usize {
+        self.threshold
+    }
+
+    /// Render the difference between two buffers, like [`render_diff`],
+    /// splitting large frames into row bands.
+    pub fn render(
+        &mut self,
+        current: &Buffer,
+        next: &Buffer,
+        dirty_rects: &[Rect],
+        output: &mut Vec<u8>,
+        state: &mut DiffState,
+    ) -> DiffResult {
+        let full_rect = Rect::from_size(next.width(), next.height());
+        let rects: &[Rect] = if dirty_rects.is_empty() {
+            std::slice::from_ref(&full_rect)
+        } else {
+            dirty_rects
+        };
+
+        let cells = rects.iter().map(|rect| clipped_area(*rect, next)).sum();
+        if self.workers < 2 || cells < MIN_PARALLEL_CELLS {
+            return render_diff(current, next, rects, output, state);
+        }
+
+        self.since_probe += 1;
+        let probe = self.since_probe >= PROBE_INTERVAL;
+        if probe {
+            self.since_probe = 0;
+        }
+
+        let start = Instant::now();
+        let (result, bands) = if (cells >= self.threshold) == probe {
+            (render_diff(current, next, rects, output, state), 1)
+        } else {
+            self.render_bands(current, next, rects, output, state)
+        };
+        let nanos = u64::try_from(start.elapsed().as_nanos()).unwrap_or(u64::MAX);
+        self.record(cells, bands, nanos);
+        result
+    }
+
+    /// Render the difference in row bands regardless of frame size.
+    ///
+    /// Returns the diff statistics and the number of bands used, which is
+    /// one when the rows to diff are too few to split.
+    pub fn render_bands(
+        &mut self,
+        current: &Buffer,
+        next: &Buffer,
+        dirty_rects: &[Rect],
+        output: &mut Vec<u8>,
+        state: &mut DiffState,
+    ) -> (DiffResult, usize) {
+        let full_rect = Rect::from_size(next.width(), next.height());
+        let dirty_rects: &[Rect] = if dirty_rects.is_empty() {
+            std::slice::from_ref(&full_rect)
+        } else {
+            dirty_rects
+        };
+
+        let top = dirty_rects.iter().map(|rect| rect.y).min().unwrap_or(0);
+        let bottom = dirty_rects
+            .iter()
+            .map(|rect| rect.bottom().min(next.height()))
+            .max()
+            .unwrap_or(0);
+        let rows = bottom.saturating_sub(top);
+        let bands = self.workers.min(usize::from(rows / MIN_BAND_ROWS));
+        if bands < 2 {
+            return (render_diff(current, next, dirty_rects, output, state), 1);
+        }
+
+        #[allow(clippy::cast_possible_truncation)]
+        let band_rows = rows.div_ceil(bands as u16);
+        #[allow(clippy::cast_possible_truncation)]
+        let band = |i: usize| -> Vec<Rect> {
+            let from = (top + band_rows * i as u16).min(bottom);
+            let to = (from + band_rows).min(bottom);
+            dirty_rects
+                .iter()
+                .filter_map(|rect| clip_rows(*rect, from, to))
+                .collect()
+        };
+
+        self.segments.resize_with(bands - 1, Vec::new);
+        let mut result = DiffResult::default();
+        let outcomes: Vec<(DiffResult, DiffState)> = thread::scope(|scope| {
+            let workers: Vec<_> = self
+                .segments
+                .iter_mut()
+                .enumerate()
+                .map(|(i, segment)| {
+                    let rects = band(i + 1);
+                    let mut band_state = state.clone();
+                    band_state.reset();
+                    scope.spawn(move || {
+                        segment.clear();
+                        let result = if rects.is_empty() {
+                            DiffResult::default()
+                        } else {
+                            render_diff(current, next, &rects, segment, &mut band_state)
+                        };
+                        (result, band_state)
+                    })
+                })
+                .collect();
+
+            // The first band runs here, continuing the caller's state
+            let first = band(0);
+            if !first.is_empty() {
+                add(&mut result, &render_diff(current, next, &first, output, state));
+            }
+
+            workers
+                .into_iter()
+                .map(|worker| worker.join().unwrap_or_else(|panic| std::panic::resume_unwind(panic)))
+                .collect()
+        });
+
+        for ((band_result, band_state), segment) in outcomes.into_iter().zip(&self.segments) {
+            add(&mut result, &band_result);
+            if !segment.is_empty() {
+                output.extend_from_slice(b"\x1b[0m");
+                output.extend_from_slice(segment);
+                *state = band_state;
+            }
+        }
+
+        (result, bands)
+    }
+
+    /// Fold a timed diff of `cells` cells in `bands` bands into the cost
+    /// estimates.
+    fn record(&mut self, cells: usize, bands: usize, nanos: u64) {
+        let cells = u64::try_from(cells).unwrap_or(u64::MAX).max(1);
+        if bands < 2 {
+            self.cell_cost = average(self.cell_cost, nanos.saturating_mul(1000) / cells);
+        } else {
+            let work = self.cell_cost.saturating_mul(cells) / 1000 / bands as u64;
+            self.overhead = average(self.overhead, nanos.saturating_sub(work));
+        }
+        self.retune();
+    }
+
+    /// Recompute the crossover from the cost estimates.
+    ///
+    /// Splitting into `n` bands saves `(n - 1) / n` of the serial cost, so
+    /// it pays off from `overhead * n / (cell_cost * (n - 1))` cells.
+    fn retune(&mut self) {
+        let bands = self.workers as u64;
+        self.threshold = if bands < 2 {
+            usize::MAX
+        } else {
+            let saved = self.cell_cost.max(1).saturating_mul(bands - 1);
+            let cells = self.overhead.saturating_mul(1000).saturating_mul(bands) / saved;
+            usize::try_from(cells).unwrap_or(usize::MAX).max(MIN_PARALLEL_CELLS)
+        };
+    }
+}
+
+/// Moving average weighting the newest sample by 1/8.
+const fn average(old: u64, sample: u64) -> u64 {
+    (old * 7 + sample) / 8
+}
+
+/// Number of cells of `rect` inside `buffer`.
+fn clipped_area(rect: Rect, buffer: &Buffer) -> usize {
+    let width = rect.right().min(buffer.width()).saturating_sub(rect.x);
+    let height = rect.bottom().min(buffer.height()).saturating_sub(rect.y);
+    usize::from(width) * usize::from(height)
+}
+
+/// The part of `rect` in rows `from..to`, if any.
+fn clip_rows(rect: Rect, from: u16, to: u16) -> Option<Rect> {
+    let y = rect.y.max(from);
+    let bottom = rect.bottom().min(to);
+    (y < bottom).then(|| Rect::new(rect.x, y, rect.width, bottom - y))
+}
+
+/// Add the statistics of one band to the frame's.
+const fn add(total: &mut DiffResult, part: &DiffResult) {
+    total.cells_changed += part.cells_changed;
+    total.cursor_moves += part.cursor_moves;
+    total.color_changes += part.color_changes;
+    total.modifier_changes += part.modifier_changes;
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::buffer::{Cell, Modifiers, Rgb};
+
+    /// Apply ANSI output to a grid of characters, tracking cursor moves,
+    /// the reset and the bold modifier.
+    fn apply(output: &[u8], width: u16, height: u16) -> Vec<(char, bool)> {
+        let text = String::from_utf8_lossy(output);
+        let mut grid = vec![(' ', false); usize::from(width) * usize::from(height)];
+        let (mut x, mut y, mut bold) = (0usize, 0usize, false);
+        let mut chars = text.chars();
+        while let Some(c) = chars.next() {
+            if c != '\x1b' {
+                grid[y * usize::from(width) + x] = (c, bold);
+                x += 1;
+                continue;
+            }
+            chars.next(); // '['
+            let mut params = String::new();
+            let command = loop {
+                match chars.next() {
+                    Some(c) if c.is_ascii_digit() || c == ';' => params.push(c),
+                    other => break other,
+                }
+            };
+            match (command, params.as_str()) {
+                (Some('H'), "") => (x, y) = (0, 0),
+                (Some('H'), position) => {
+                    let mut parts = position.split(';').map(|n| n.parse::<usize>().unwrap_or(1));
+                    y = parts.next().unwrap_or(1) - 1;
+                    x = parts.next().unwrap_or(1) - 1;
+                },
+                (Some('m'), "0") => bold = false,
+                (Some('m'), "1") => bold = true,
+                _ => {},
+            }
+        }
+        grid
+    }
+
+    #[test]
+    fn test_bands_match_serial_diff() {
+        let (width, height) = (40, 64);
+        let current = Buffer::new(width, height);
+        let mut next = Buffer::new(width, height);
+        for y in (0..height).step_by(3) {
+            let bold = if y % 2 == 0 { Modifiers::BOLD } else { Modifiers::empty() };
+            for x in (y % 5..width).step_by(2) {
+                next.set(x, y, Cell::new('#').with_fg(Rgb::new(255, 0, 0)).with_modifiers(bold));
+            }
+        }
+        let rects = [Rect::new(0, 0, width, height)];
+
+        let mut serial = Vec::new();
+        let mut serial_state = DiffState::new();
+        let expected = render_diff(&current, &next, &rects, &mut serial, &mut serial_state);
+
+        let mut split = Vec::new();
+        let mut state = DiffState::new();
+        let (result, bands) =
+            ParallelDiff::with_workers(4).render_bands(&current, &next, &rects, &mut split, &mut state);
+        assert_eq!(bands, 4);
+        assert_eq!(result.cells_changed, expected.cells_changed);
+        assert_eq!(apply(&split, width, height), apply(&serial, width, height));
+
+        // The state continues from the last band written
+        assert_eq!(format!("{state:?}"), format!("{serial_state:?}"));
+    }
+
+    #[test]
+    fn test_small_frames_stay_serial() {
+        let diff = ParallelDiff::with_workers(8);
+        assert!(diff.threshold() >= MIN_PARALLEL_CELLS);
+        assert_eq!(ParallelDiff::with_workers(1).threshold(), usize::MAX);
+
+        let mut diff = ParallelDiff::with_workers(8);
+        let (result, bands) = diff.render_bands(
+            &Buffer::new(80, 24),
+            &Buffer::new(80, 24),
+            &[Rect::new(0, 0, 80, 24)],
+            &mut Vec::new(),
+            &mut DiffState::new(),
+        );
+        assert_eq!((result.cells_changed, bands), (0, 1));
+    }
+}
@@ -0,0 +1,339 @@
+//! Planar Buffer: A structure-of-arrays copy of a [`Buffer`].
+//!
+//! [`Buffer`] keeps each cell's glyph, colors and modifiers together, which
+//! suits drawing but makes every comparison stream all 16 bytes of a cell.
+//! A [`PlanarBuffer`] splits the cells into planes of plain integers:
+//!
+//! ```text
+//! glyphs:  [u64]  grapheme bytes | length + width | flags
+//! fg:      [u32]  foreground color (RGB + palette slot)
+//! bg:      [u32]  background color
+//! attrs:   [u8]   modifiers
+//! ```
+//!
+//! Equal rows are found with one slice comparison per plane, which the
+//! compiler turns into wide vector compares. Operations on one aspect touch
+//! one plane: a theme change rewrites only the color planes, and a text-only
+//! change leaves the color lanes of a row equal, so they are skipped after a
+//! single compare.
+//!
+//! With the `planar` feature the renderer keeps its retained frames in this
+//! form; see [`render_planar_diff`].
+
+use super::diff::{emit_changed_cell, DiffResult, DiffState};
+use super::{Buffer, Cell, CellFlags, Modifiers, Rgb};
+use crate::layout::Rect;
+use std::collections::HashMap;
+use std::sync::Arc;
+
+/// Pack the glyph part of a cell into a plane lane.
+#[inline]
+const fn glyph_of(cell: &Cell) -> u64 {
+    let (grapheme, len, width) = cell.raw_grapheme();
+    u32::from_le_bytes(grapheme) as u64
+        | ((len & 0b111 | (width & 0b11) << 3) as u64) << 32
+        | (cell.flags().bits() as u64) << 40
+}
+
+/// Pack a color into a plane lane.
+#[inline]
+const fn color_of(color: Rgb) -> u32 {
+    u32::from_le_bytes(color.to_bytes())
+}
+
+/// Rebuild a cell from its plane lanes.
+#[inline]
+#[allow(clippy::cast_possible_truncation)]
+const fn cell_of(glyph: u64, fg: u32, bg: u32, attrs: u8) -> Cell {
+    let meta = (glyph >> 32) as u8;
+    Cell::from_raw(
+        (glyph as u32).to_le_bytes(),
+        meta & 0b111,
+        meta >> 3,
+        CellFlags::from_bits_retain((glyph >> 40) as u8),
+    )
+    .with_fg(Rgb::from_bytes(fg.to_le_bytes()))
+    .with_bg(Rgb::from_bytes(bg.to_le_bytes()))
+    .with_modifiers(Modifiers::from_bits_retain(attrs))
+}
+
+/// A grid of cells stored as separate glyph, color and modifier planes.
+#[derive(Clone)]
+pub struct PlanarBuffer {
+    /// Glyph plane: grapheme bytes, length and width, flags.
+    glyphs: Vec<u64>,
+    /// Foreground color plane.
+    fg: Vec<u32>,
+    /// Background color plane.
+    bg: Vec<u32>,
+    /// Modifier plane.
+    attrs: Vec<u8>,
+    /// Width in columns.
+    width: u16,
+    /// Height in rows.
+    height: u16,
+    /// Graphemes held by the source buffer, by id.
+    graphemes: HashMap<u32, Arc<str>>,
+    /// Version of the source buffer's graphemes when they were copied.
+    graphemes_version: u64,
+}
+
+impl PlanarBuffer {
+    /// Create a planar buffer of empty cells.
+    pub fn new(width: u16, height: u16) -> Self {
+        let size = usize::from(width) * usize::from(height);
+        Self {
+            glyphs: vec![glyph_of(&Cell::EMPTY); size],
+            fg: vec![color_of(Cell::EMPTY.fg()); size],
+            bg: vec![color_of(Cell::EMPTY.bg()); size],
+            attrs: vec![Cell::EMPTY.modifiers().bits(); size],
+            width,
+            height,
+            graphemes: HashMap::new(),
+            graphemes_version: 0,
+        }
+    }
+
+    /// Get the width.
+    #[inline]
+    pub const fn width(&self) -> u16 {
+        self.width
+    }
+
+    /// Get the height.
+    #[inline]
+    pub const fn height(&self) -> u16 {
+        self.height
+    }
+
+    /// Get the cell at (x, y).
+    pub fn get(&self, x: u16, y: u16) -> Option<Cell> {
+        let i = self.index_of(x, y)?;
+        Some(cell_of(self.glyphs[i], self.fg[i], self.bg[i], self.attrs[i]))
+    }
+
+    /// Get an overflow grapheme by its id.
+    #[inline]
+    pub fn get_overflow(&self, index: u32) -> Option<&str> {
+        self.graphemes.get(&index).map(AsRef::as_ref)
+    }
+
+    /// Convert (x, y) coordinates to a linear index.
+    #[inline]
+    const fn index_of(&self, x: u16, y: u16) -> Option<usize> {
+        if x < self.width && y < self.height {
+            Some(y as usize * self.width as usize + x as usize)
+        } else {
+            None
+        }
+    }
+
+    /// Replace the contents with `buffer`, taking the size along.
+    pub fn load(&mut self, buffer: &Buffer) {
+        let size = buffer.len();
+        self.width = buffer.width();
+        self.height = buffer.height();
+        self.glyphs.resize(size, 0);
+        self.fg.resize(size, 0);
+        self.bg.resize(size, 0);
+        self.attrs.resize(size, 0);
+        if self.graphemes_version != buffer.graphemes_version() {
+            self.graphemes.clone_from(buffer.graphemes());
+            self.graphemes_version = buffer.graphemes_version();
+        }
+
+        // One pass per plane keeps each write stream sequential
+        let cells = buffer.cells();
+        for (lane, cell) in self.glyphs.iter_mut().zip(cells) {
+            *lane = glyph_of(cell);
+        }
+        for (lane, cell) in self.fg.iter_mut().zip(cells) {
+            *lane = color_of(cell.fg());
+        }
+        for (lane, cell) in self.bg.iter_mut().zip(cells) {
+            *lane = color_of(cell.bg());
+        }
+        for (lane, cell) in self.attrs.iter_mut().zip(cells) {
+            *lane = cell.modifiers().bits();
+        }
+    }
+
+    /// Get the index range of row `y`, columns `x0..x1`, clipped.
+    fn span(&self, y: u16, x0: u16, x1: u16) -> std::ops::Range<usize> {
+        let row = usize::from(y) * usize::from(self.width);
+        row + usize::from(x0.min(self.width))..row + usize::from(x1.min(self.width))
+    }
+
+    /// Fill a rectangular region with a cell, one plane at a time.
+    ///
+    /// Overflow cells are stored as they are; their grapheme must already
+    /// be held by this buffer.
+    pub fn fill_rect(&mut self, x: u16, y: u16, width: u16, height: u16, cell: Cell) {
+        let x_end = x.saturating_add(width);
+        for row in y..y.saturating_add(height).min(self.height) {
+            let span = self.span(row, x, x_end);
+            self.glyphs[span.clone()].fill(glyph_of(&cell));
+            self.fg[span.clone()].fill(color_of(cell.fg()));
+            self.bg[span.clone()].fill(color_of(cell.bg()));
+            self.attrs[span].fill(cell.modifiers().bits());
+        }
+    }
+
+    /// Set the colors of a rectangular region, leaving glyphs and modifiers
+    /// alone.
+    pub fn set_colors(&mut self, x: u16, y: u16, width: u16, height: u16, fg: Rgb, bg: Rgb) {
+        let x_end = x.saturating_add(width);
+        for row in y..y.saturating_add(height).min(self.height) {
+            let span = self.span(row, x, x_end);
+            self.fg[span.clone()].fill(color_of(fg));
+            self.bg[span].fill(color_of(bg));
+        }
+    }
+
+    /// Replace one color with another everywhere, in both color planes.
+    ///
+    /// This is how a theme change is applied: glyphs and modifiers aren't
+    /// touched.
+    pub fn replace_color(&mut self, from: Rgb, to: Rgb) {
+        let (from, to) = (color_of(from), color_of(to));
+        for lane in self.fg.iter_mut().chain(self.bg.iter_mut()) {
+            if *lane == from {
+                *lane = to;
+            }
+        }
+    }
+
+    /// Swap the contents of two buffers.
+    pub const fn swap(&mut self, other: &mut Self) {
+        std::mem::swap(self, other);
+    }
+
+    /// Get memory usage in bytes (approximate).
+    pub fn memory_usage(&self) -> usize {
+        let lanes = self.glyphs.len() * (8 + 4 + 4 + 1);
+        let graphemes = self.graphemes.capacity() * std::mem::size_of::<(u32, Arc<str>)>();
+        lanes + graphemes + std::mem::size_of::<Self>()
+    }
+}
+
+impl std::fmt::Debug for PlanarBuffer {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("PlanarBuffer")
+            .field("width", &self.width)
+            .field("height", &self.height)
+            .field("memory_bytes", &self.memory_usage())
+            .finish_non_exhaustive()
+    }
+}
+
+/// Render the difference between two planar buffers.
+///
+/// Produces the same output as [`render_diff`](super::diff::render_diff)
+/// on the equivalent buffers. Each row is first compared plane by plane;
+/// rows equal in every plane are skipped, and rows whose color and
+/// modifier planes are equal compare glyphs only.
+pub fn render_planar_diff(
+    current: &PlanarBuffer,
+    next: &PlanarBuffer,
+    dirty_rects: &[Rect],
+    output: &mut Vec<u8>,
+    state: &mut DiffState,
+) -> DiffResult {
+    debug_assert_eq!(current.width(), next.width());
+    debug_assert_eq!(current.height(), next.height());
+
+    let mut result = DiffResult::default();
+    let full_rect = Rect::from_size(next.width(), next.height());
+    let rects: &[Rect] = if dirty_rects.is_empty() {
+        std::slice::from_ref(&full_rect)
+    } else {
+        dirty_rects
+    };
+
+    for rect in rects {
+        let x_end = rect.x.saturating_add(rect.width).min(next.width());
+        let y_end = rect.y.saturating_add(rect.height).min(next.height());
+        for y in rect.y..y_end {
+            let span = next.span(y, rect.x, x_end);
+            let glyphs_equal = current.glyphs[span.clone()] == next.glyphs[span.clone()];
+            let styles_equal = current.fg[span.clone()] == next.fg[span.clone()]
+                && current.bg[span.clone()] == next.bg[span.clone()]
+                && current.attrs[span.clone()] == next.attrs[span.clone()];
+            if glyphs_equal && styles_equal {
+                continue;
+            }
+
+            for (x, i) in (rect.x..).zip(span) {
+                let glyph = next.glyphs[i];
+                let changed = current.glyphs[i] != glyph
+                    || !styles_equal
+                        && (current.fg[i] != next.fg[i]
+                            || current.bg[i] != next.bg[i]
+                            || current.attrs[i] != next.attrs[i]);
+                if !changed {
+                    continue;
+                }
+                let cell = cell_of(glyph, next.fg[i], next.bg[i], next.attrs[i]);
+                if cell.is_wide_continuation() {
+                    continue;
+                }
+                emit_changed_cell(output, state, &mut result, x, y, &cell, &next.graphemes);
+            }
+        }
+    }
+
+    result
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::buffer::diff::render_diff;
+
+    #[test]
+    fn test_planar_matches_cells() {
+        let red = Rgb::new(255, 0, 0);
+        let mut before = Buffer::new(12, 3);
+        before.set_str(0, 0, "hello 漢", red, Rgb::from_ansi_index(4));
+        before.set_grapheme(0, 2, "👨‍👩‍👧‍👦", red, Rgb::DEFAULT_BG);
+        let mut after = before.clone();
+        after.set_str(1, 0, "EL", red, Rgb::from_ansi_index(4));
+        after.set(3, 1, Cell::new('x').with_modifiers(Modifiers::BOLD));
+        after.fill_rect(4, 2, 3, 1, Cell::new('-').with_bg(red));
+
+        let mut current = PlanarBuffer::new(1, 1);
+        let mut next = PlanarBuffer::new(1, 1);
+        current.load(&before);
+        next.load(&after);
+        for y in 0..3 {
+            for x in 0..12 {
+                assert_eq!(next.get(x, y).as_ref(), after.get(x, y));
+            }
+        }
+
+        let mut expected = Vec::new();
+        let full = render_diff(&before, &after, &[], &mut expected, &mut DiffState::new());
+        let mut output = Vec::new();
+        let planar = render_planar_diff(&current, &next, &[], &mut output, &mut DiffState::new());
+        assert_eq!(String::from_utf8_lossy(&output), String::from_utf8_lossy(&expected));
+        assert_eq!(planar.cells_changed, full.cells_changed);
+    }
+
+    #[test]
+    fn test_planar_plane_updates() {
+        let mut buffer = PlanarBuffer::new(4, 2);
+        let blue = Rgb::from_ansi_index(4);
+        buffer.fill_rect(1, 0, 10, 1, Cell::new('#').with_fg(blue));
+        assert_eq!(buffer.get(0, 0), Some(Cell::EMPTY));
+        assert_eq!(buffer.get(3, 0), Some(Cell::new('#').with_fg(blue)));
+
+        // Theme change: only colors move
+        let green = Rgb::from_ansi_index(2);
+        buffer.replace_color(blue, green);
+        assert_eq!(buffer.get(2, 0), Some(Cell::new('#').with_fg(green)));
+
+        buffer.set_colors(0, 1, 2, 1, green, blue);
+        let cell = buffer.get(1, 1).unwrap();
+        assert_eq!((cell.grapheme(), cell.fg(), cell.bg()), (Some(" "), green, blue));
+    }
+}
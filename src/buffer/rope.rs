@@ -4,18 +4,71 @@
 //! - Large documents (1M+ lines) with minimal allocations
 //! - O(1) append and O(log n) random access
 //! - Good cache locality through chunking
+//! - Indexed full-text search (see [`search`](super::search))
+//! - Long history in little memory, by compressing cold chunks in memory
+//!   or spilling them to disk (see [`RopeBuffer::with_compression`] and
+//!   [`RopeBuffer::with_spill`])
+//! - Repeated lines stored once (see [`intern`](super::intern))
 
+use std::borrow::Cow;
+use std::collections::VecDeque;
+use std::io;
+use std::ops::Range;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use crate::buffer::cold::{self, Extent, SpillFile};
+use crate::buffer::intern::{LineCells, LineInterner};
+use crate::buffer::search::{self, ChunkIndex, ChunkView, SearchMatch, SearchQuery};
 use crate::buffer::Cell;
 
 /// Number of lines per chunk.
 /// Tuned for a balance between overhead and cache utilization.
-const CHUNK_SIZE: usize = 64;
+pub(crate) const CHUNK_SIZE: usize = 64;
+
+/// Cold chunks kept in memory after being read back.
+const COLD_CACHE_CHUNKS: usize = 8;
+
+/// Cold chunks read back at a time while searching.
+const SEARCH_BATCH_CHUNKS: usize = 32;
+
+/// Where a frozen chunk's compressed bytes live.
+#[derive(Debug, Clone)]
+enum ColdPlace {
+    /// Compressed in memory.
+    Memory(Box<[u8]>),
+    /// Compressed in the spill file.
+    Disk(Extent),
+}
+
+/// A compressed copy of a chunk's lines.
+#[derive(Debug, Clone)]
+struct ColdCopy {
+    /// Where the compressed bytes live.
+    place: ColdPlace,
+    /// Memory the lines took when resident, in bytes.
+    raw_bytes: usize,
+}
+
+impl ColdCopy {
+    /// Get the compressed size in bytes.
+    fn len(&self) -> usize {
+        match &self.place {
+            ColdPlace::Memory(bytes) => bytes.len(),
+            ColdPlace::Disk(extent) => extent.len(),
+        }
+    }
+}
 
 /// A chunk of lines stored contiguously.
 #[derive(Debug, Clone)]
 struct Chunk {
-    /// Lines in this chunk.
+    /// Lines in this chunk; empty while frozen and not loaded.
     lines: Vec<ChunkedLine>,
+    /// Search index over the lines, or `None` if stale.
+    index: Option<ChunkIndex>,
+    /// Compressed copy of the lines, if it is current.
+    cold: Option<ColdCopy>,
 }
 
 impl Chunk {
@@ -23,6 +76,8 @@ impl Chunk {
     fn new() -> Self {
         Self {
             lines: Vec::with_capacity(CHUNK_SIZE),
+            index: None,
+            cold: None,
         }
     }
 
@@ -31,20 +86,32 @@ impl Chunk {
         self.lines.len() >= CHUNK_SIZE
     }
 
+    /// Check if the chunk's lines are in memory.
+    const fn is_resident(&self) -> bool {
+        !self.lines.is_empty() || self.cold.is_none()
+    }
+
     /// Get the number of lines in this chunk.
+    ///
+    /// Only sealed (full) chunks are ever frozen.
     const fn len(&self) -> usize {
-        self.lines.len()
+        if self.is_resident() {
+            self.lines.len()
+        } else {
+            CHUNK_SIZE
+        }
     }
 
     /// Check if the chunk is empty.
     #[allow(dead_code)]
     const fn is_empty(&self) -> bool {
-        self.lines.is_empty()
+        self.len() == 0
     }
 
     /// Push a line to this chunk.
     fn push(&mut self, line: ChunkedLine) {
         self.lines.push(line);
+        self.index = None;
     }
 
     /// Get a line by index within this chunk.
@@ -53,43 +120,176 @@ impl Chunk {
     }
 
     /// Get a mutable line by index within this chunk.
-    fn get_mut(&mut self, index: usize) -> Option<&mut ChunkedLine> {
+    ///
+    /// The search index and compressed copy are dropped, since the caller
+    /// may change the line; a spilled copy's extent is released to `tier`.
+    /// Frozen chunks have no lines to change.
+    fn get_mut(&mut self, index: usize, tier: Option<&mut ColdTier>) -> Option<&mut ChunkedLine> {
+        if !self.is_resident() {
+            return None;
+        }
+        self.index = None;
+        if let (Some(copy), Some(tier)) = (self.cold.take(), tier) {
+            tier.release(copy);
+        }
         self.lines.get_mut(index)
     }
+
+    /// Get the search index, building it if stale.
+    fn ensure_index(&mut self) -> &ChunkIndex {
+        self.index.get_or_insert_with(|| ChunkIndex::build(&self.lines))
+    }
+
+    /// Get the lines, decompressing them if they aren't resident.
+    fn read(&self, tier: &ColdTier) -> io::Result<Cow<'_, [ChunkedLine]>> {
+        let copy = match &self.cold {
+            Some(copy) if !self.is_resident() => copy,
+            _ => return Ok(Cow::Borrowed(&self.lines)),
+        };
+        let lines = match (&copy.place, &tier.disk) {
+            (ColdPlace::Memory(bytes), _) => cold::thaw(bytes)?,
+            (ColdPlace::Disk(extent), Some(disk)) => cold::thaw(&disk.file.read(*extent)?)?,
+            (ColdPlace::Disk(_), None) => {
+                return Err(io::Error::new(io::ErrorKind::NotFound, "no spill file"));
+            },
+        };
+        Ok(Cow::Owned(lines))
+    }
+
+    /// Compress the chunk unless its compressed copy is current, then free
+    /// its lines.
+    ///
+    /// The search index stays resident, so frozen chunks that can't match
+    /// a query are skipped without being read back.
+    fn freeze(&mut self, tier: &mut ColdTier) -> io::Result<()> {
+        self.ensure_index();
+        if self.cold.is_none() {
+            let raw_bytes = self.lines.iter().map(ChunkedLine::memory_usage).sum();
+            let bytes = cold::freeze(&self.lines);
+            let place = match &mut tier.disk {
+                Some(disk) => ColdPlace::Disk(disk.file.write(&bytes)?),
+                None => ColdPlace::Memory(bytes.into_boxed_slice()),
+            };
+            self.cold = Some(ColdCopy { place, raw_bytes });
+        }
+        self.lines = Vec::new();
+        Ok(())
+    }
+
+    /// Decompress the chunk's lines if they aren't resident, recording the
+    /// time taken.
+    fn load(&mut self, tier: &mut ColdTier) -> io::Result<()> {
+        if !self.is_resident() {
+            let start = Instant::now();
+            self.lines = self.read(tier)?.into_owned();
+            tier.record_decode(start.elapsed());
+        }
+        Ok(())
+    }
 }
 
 /// A line stored in the rope buffer.
 #[derive(Debug, Clone)]
 pub struct ChunkedLine {
-    /// The cells in this line.
-    pub content: Vec<Cell>,
-    /// Whether this line was soft-wrapped.
+    /// The cells in this line, shared with identical lines once finished.
+    ///
+    /// Reads as a `[Cell]` slice; [`LineCells::to_mut`] gives the owned
+    /// `Vec<Cell>` this field used to be.
+    pub content: LineCells,
+    /// Whether this line was soft-wrapped into the next one.
     pub wrapped: bool,
 }
 
 impl ChunkedLine {
     /// Create a new line with the given content.
-    pub const fn new(content: Vec<Cell>, wrapped: bool) -> Self {
-        Self { content, wrapped }
+    pub fn new(content: Vec<Cell>, wrapped: bool) -> Self {
+        Self {
+            content: content.into(),
+            wrapped,
+        }
     }
 
     /// Create an empty line.
     pub const fn empty() -> Self {
         Self {
-            content: Vec::new(),
+            content: LineCells::new(),
             wrapped: false,
         }
     }
 
     /// Get the number of cells in this line.
-    pub const fn len(&self) -> usize {
+    pub fn len(&self) -> usize {
         self.content.len()
     }
 
     /// Check if the line is empty.
-    pub const fn is_empty(&self) -> bool {
+    pub fn is_empty(&self) -> bool {
         self.content.is_empty()
     }
+
+    /// Get the approximate memory used by this line, in bytes.
+    ///
+    /// Interned cells are counted in full, as if the line owned them.
+    pub fn memory_usage(&self) -> usize {
+        std::mem::size_of::<Self>() + self.content.len() * std::mem::size_of::<Cell>()
+    }
+}
+
+/// Spill file of a rope buffer.
+#[derive(Debug)]
+struct Disk {
+    /// Directory holding the spill file.
+    dir: PathBuf,
+    /// Segment file holding spilled chunks.
+    file: SpillFile,
+}
+
+/// Cold tier of a rope buffer: where chunks go once they leave the hot set.
+#[derive(Debug)]
+struct ColdTier {
+    /// Number of newest chunks always kept in memory.
+    hot_chunks: usize,
+    /// Spill file, if cold chunks go to disk rather than stay in memory.
+    disk: Option<Disk>,
+    /// Ids of cold chunks read back, least recently used first.
+    loaded: VecDeque<usize>,
+    /// Number of chunks decompressed on demand.
+    decodes: u32,
+    /// Total time spent decompressing on demand.
+    decode_time: Duration,
+}
+
+impl ColdTier {
+    /// Create a cold tier, with a new spill file in `dir` if given.
+    fn new(hot_chunks: usize, dir: Option<&Path>) -> io::Result<Self> {
+        let disk = match dir {
+            Some(dir) => Some(Disk {
+                dir: dir.to_path_buf(),
+                file: SpillFile::create(dir)?,
+            }),
+            None => None,
+        };
+        Ok(Self {
+            hot_chunks: hot_chunks.max(1),
+            disk,
+            loaded: VecDeque::new(),
+            decodes: 0,
+            decode_time: Duration::ZERO,
+        })
+    }
+
+    /// Drop a compressed copy, releasing its extent if it was spilled.
+    fn release(&mut self, copy: ColdCopy) {
+        if let (ColdPlace::Disk(extent), Some(disk)) = (copy.place, &mut self.disk) {
+            disk.file.release(extent);
+        }
+    }
+
+    /// Record an on-demand decompression.
+    fn record_decode(&mut self, elapsed: Duration) {
+        self.decodes = self.decodes.saturating_add(1);
+        self.decode_time += elapsed;
+    }
 }
 
 /// A rope-based line buffer for efficient large document storage.
@@ -99,16 +299,37 @@ impl ChunkedLine {
 /// - Memory fragmentation
 /// - Allocation overhead
 /// - Cache misses during iteration
+///
+/// Every chunk but the last is full. When trimming to `max_lines`, lines
+/// are evicted one at a time from the first chunk, which is dropped once
+/// all of its lines are gone.
+///
+/// With [`with_compression`](Self::with_compression) or
+/// [`with_spill`](Self::with_spill), chunks older than the hot set are
+/// frozen: compressed in memory or on disk, with their cells freed. Their
+/// lines read as absent until brought back with
+/// [`ensure_resident`](Self::ensure_resident).
+///
+/// Each line is interned when the next one is pushed, so identical lines
+/// share one copy of their cells.
 #[derive(Debug)]
 pub struct RopeBuffer {
     /// Chunks of lines.
-    chunks: Vec<Chunk>,
+    chunks: VecDeque<Chunk>,
+    /// Number of evicted lines at the start of the first chunk.
+    front: usize,
+    /// Number of chunks dropped from the front, so chunk ids stay stable.
+    dropped_chunks: usize,
     /// Total number of lines.
     total_lines: usize,
     /// Maximum number of lines to retain (0 = unlimited).
     max_lines: usize,
     /// Current scroll offset from bottom.
     scroll_offset: usize,
+    /// Cold tier, if cold chunks are frozen.
+    cold: Option<ColdTier>,
+    /// Shared payloads of finished lines.
+    interner: LineInterner,
 }
 
 impl RopeBuffer {
@@ -118,15 +339,92 @@ impl RopeBuffer {
     ///
     /// * `max_lines` - Maximum lines to retain. 0 means unlimited.
     pub fn new(max_lines: usize) -> Self {
-        let mut buffer = Self {
-            chunks: Vec::new(),
+        Self::from_lines(max_lines, [ChunkedLine::empty()])
+    }
+
+    /// Create a rope buffer holding the given lines.
+    ///
+    /// If `lines` is empty, the buffer starts with one empty line.
+    ///
+    /// # Arguments
+    ///
+    /// * `max_lines` - Maximum lines to retain. 0 means unlimited.
+    /// * `lines` - Initial content, oldest first.
+    pub fn from_lines(max_lines: usize, lines: impl IntoIterator<Item = ChunkedLine>) -> Self {
+        let mut buffer = Self::with_tier(max_lines, None);
+        for line in lines {
+            buffer.push_line(line);
+        }
+        if buffer.is_empty() {
+            buffer.push_line(ChunkedLine::empty());
+        }
+        buffer
+    }
+
+    /// Create a rope buffer that compresses cold chunks in memory.
+    ///
+    /// The newest `hot_chunks` chunks always stay as cells. Older chunks
+    /// are compressed as they leave the hot set and their cells freed;
+    /// they are decompressed into a small cache when scrolled into view.
+    ///
+    /// # Arguments
+    ///
+    /// * `max_lines` - Maximum lines to retain. 0 means unlimited.
+    /// * `hot_chunks` - Chunks kept uncompressed (at least 1).
+    pub fn with_compression(max_lines: usize, hot_chunks: usize) -> Self {
+        let tier = ColdTier::new(hot_chunks, None).ok();
+        let mut buffer = Self::with_tier(max_lines, tier);
+        buffer.push_line(ChunkedLine::empty());
+        buffer
+    }
+
+    /// Create a rope buffer that spills cold chunks to disk.
+    ///
+    /// Like [`with_compression`](Self::with_compression), but compressed
+    /// chunks are written to a spill file in `dir` instead of being kept in
+    /// memory; the file is removed when the buffer is dropped. Memory use
+    /// is then bounded by the hot set, a small cache of chunks read back
+    /// for display, and any `max_lines` limit.
+    ///
+    /// # Arguments
+    ///
+    /// * `max_lines` - Maximum lines to retain. 0 means unlimited.
+    /// * `hot_chunks` - Chunks kept in memory (at least 1).
+    /// * `dir` - Directory for the spill file.
+    ///
+    /// # Errors
+    /// Returns an error if the spill file can't be created.
+    pub fn with_spill(max_lines: usize, hot_chunks: usize, dir: &Path) -> io::Result<Self> {
+        let mut buffer = Self::with_tier(max_lines, Some(ColdTier::new(hot_chunks, Some(dir))?));
+        buffer.push_line(ChunkedLine::empty());
+        Ok(buffer)
+    }
+
+    /// Create a buffer with no lines.
+    fn with_tier(max_lines: usize, cold: Option<ColdTier>) -> Self {
+        Self {
+            chunks: VecDeque::new(),
+            front: 0,
+            dropped_chunks: 0,
             total_lines: 0,
             max_lines,
             scroll_offset: 0,
-        };
-        // Start with one empty line
-        buffer.push_line(ChunkedLine::empty());
-        buffer
+            cold,
+            interner: LineInterner::new(),
+        }
+    }
+
+    /// Create a buffer with no lines and the same limits as this one.
+    ///
+    /// A spilling buffer gets its own spill file in the same directory, or
+    /// keeps everything in memory if that file can't be created.
+    #[must_use]
+    pub fn empty_like(&self) -> Self {
+        let cold = self.cold.as_ref().and_then(|tier| {
+            let dir = tier.disk.as_ref().map(|disk| disk.dir.as_path());
+            ColdTier::new(tier.hot_chunks, dir).ok()
+        });
+        Self::with_tier(self.max_lines, cold)
     }
 
     /// Create an unbounded rope buffer.
@@ -145,28 +443,47 @@ impl RopeBuffer {
     }
 
     /// Get the number of chunks.
-    pub const fn chunk_count(&self) -> usize {
+    pub fn chunk_count(&self) -> usize {
         self.chunks.len()
     }
 
+    /// Map a global line index to (chunk, line within chunk).
+    const fn locate(&self, index: usize) -> (usize, usize) {
+        let slot = index + self.front;
+        (slot / CHUNK_SIZE, slot % CHUNK_SIZE)
+    }
+
     /// Get a line by global index.
+    ///
+    /// Returns `None` for lines in frozen chunks that aren't loaded.
     pub fn get_line(&self, index: usize) -> Option<&ChunkedLine> {
         if index >= self.total_lines {
             return None;
         }
-        let chunk_idx = index / CHUNK_SIZE;
-        let line_idx = index % CHUNK_SIZE;
+        let (chunk_idx, line_idx) = self.locate(index);
         self.chunks.get(chunk_idx)?.get(line_idx)
     }
 
     /// Get a mutable reference to a line by global index.
+    ///
+    /// Returns `None` for lines in frozen chunks that aren't loaded.
     pub fn get_line_mut(&mut self, index: usize) -> Option<&mut ChunkedLine> {
         if index >= self.total_lines {
             return None;
         }
-        let chunk_idx = index / CHUNK_SIZE;
-        let line_idx = index % CHUNK_SIZE;
-        self.chunks.get_mut(chunk_idx)?.get_mut(line_idx)
+        let (chunk_idx, line_idx) = self.locate(index);
+
+        // A line continuing the previous chunk's last line is in its tail
+        let lines = &self.chunks.get(chunk_idx)?.lines;
+        if chunk_idx > 0 && lines.iter().take(line_idx).all(|line| line.wrapped) {
+            if let Some(index) = &mut self.chunks[chunk_idx - 1].index {
+                index.reopen_tail();
+            }
+        }
+
+        self.chunks
+            .get_mut(chunk_idx)?
+            .get_mut(line_idx, self.cold.as_mut())
     }
 
     /// Get the current (last) line.
@@ -186,15 +503,61 @@ impl RopeBuffer {
         self.get_line_mut(idx)
     }
 
+    /// Iterate over all resident lines, oldest first.
+    ///
+    /// Frozen chunks that aren't loaded are skipped; use
+    /// [`visit_lines`](Self::visit_lines) to include them.
+    pub fn iter(&self) -> impl Iterator<Item = &ChunkedLine> {
+        self.chunks.iter().enumerate().flat_map(move |(i, chunk)| {
+            let skip = if i == 0 { self.front } else { 0 };
+            chunk.lines.get(skip..).unwrap_or_default().iter()
+        })
+    }
+
+    /// Visit every line, oldest first, reading frozen chunks back.
+    ///
+    /// Frozen chunks are read one at a time and not kept in memory.
+    ///
+    /// # Errors
+    /// Returns an error if a frozen chunk can't be read back.
+    pub fn visit_lines(&self, mut visit: impl FnMut(&ChunkedLine)) -> io::Result<()> {
+        for (i, chunk) in self.chunks.iter().enumerate() {
+            let skip = if i == 0 { self.front } else { 0 };
+            let lines = match &self.cold {
+                Some(tier) => chunk.read(tier)?,
+                None => Cow::Borrowed(chunk.lines.as_slice()),
+            };
+            lines.get(skip..).unwrap_or_default().iter().for_each(&mut visit);
+        }
+        Ok(())
+    }
+
     /// Push a new line to the buffer.
     pub fn push_line(&mut self, line: ChunkedLine) {
+        // The current line is finished: share its cells with identical lines
+        if let Some(last) = self.chunks.back_mut().and_then(|chunk| chunk.lines.last_mut()) {
+            last.content.intern(&mut self.interner);
+        }
+
         // Check if we need a new chunk
-        if self.chunks.is_empty() || self.chunks.last().is_none_or(Chunk::is_full) {
-            self.chunks.push(Chunk::new());
+        if self.chunks.back().is_none_or(Chunk::is_full) {
+            // The previous chunk is sealed: index it while it is hot, and
+            // complete the index of the chunk before, whose tail it holds
+            if let Some(sealed) = self.chunks.back_mut() {
+                sealed.ensure_index();
+            }
+            let mut last = self.chunks.range_mut(self.chunks.len().saturating_sub(2)..);
+            if let (Some(before), Some(sealed)) = (last.next(), last.next()) {
+                if let Some(index) = &mut before.index {
+                    index.add_tail(&sealed.lines);
+                }
+            }
+            self.chunks.push_back(Chunk::new());
+            self.freeze_cold();
         }
 
         // Push to the last chunk
-        if let Some(chunk) = self.chunks.last_mut() {
+        if let Some(chunk) = self.chunks.back_mut() {
             chunk.push(line);
             self.total_lines += 1;
         }
@@ -205,6 +568,77 @@ impl RopeBuffer {
         }
     }
 
+    /// Freeze the chunk that just left the hot set.
+    fn freeze_cold(&mut self) {
+        let Some(tier) = &mut self.cold else {
+            return;
+        };
+        let Some(cold) = self.chunks.len().checked_sub(tier.hot_chunks + 1) else {
+            return;
+        };
+        // If the write fails the chunk simply stays in memory
+        let _ = self.chunks[cold].freeze(tier);
+    }
+
+    /// Read frozen chunks covering `lines` back into memory.
+    ///
+    /// Loaded chunks are cached; once the cache is full, the least recently
+    /// used one is frozen again. The cache always fits the whole range.
+    ///
+    /// # Errors
+    /// Returns an error if a chunk can't be read back. Its lines stay
+    /// absent; chunks before it in the range are loaded.
+    pub fn ensure_resident(&mut self, lines: Range<usize>) -> io::Result<()> {
+        self.ensure_resident_runs(&[lines])
+    }
+
+    /// Read frozen chunks covering several runs of lines back into memory.
+    ///
+    /// Like [`ensure_resident`](Self::ensure_resident), but the cache fits
+    /// every run at once, for views that skip over lines.
+    ///
+    /// # Errors
+    /// Returns an error if a chunk can't be read back.
+    pub fn ensure_resident_runs(&mut self, runs: &[Range<usize>]) -> io::Result<()> {
+        let Some(tier) = &mut self.cold else {
+            return Ok(());
+        };
+        let chunk_runs: Vec<Range<usize>> = runs
+            .iter()
+            .filter_map(|lines| {
+                let end = lines.end.min(self.total_lines);
+                (lines.start < end).then(|| {
+                    (lines.start + self.front) / CHUNK_SIZE..(end - 1 + self.front) / CHUNK_SIZE + 1
+                })
+            })
+            .collect();
+
+        let capacity = COLD_CACHE_CHUNKS.max(chunk_runs.iter().map(ExactSizeIterator::len).sum());
+        for i in chunk_runs.into_iter().flatten() {
+            let id = self.dropped_chunks + i;
+            let chunk = &mut self.chunks[i];
+            if chunk.is_resident() {
+                // Refresh a cached chunk's position
+                if let Some(pos) = tier.loaded.iter().position(|&loaded| loaded == id) {
+                    tier.loaded.remove(pos);
+                    tier.loaded.push_back(id);
+                }
+                continue;
+            }
+
+            chunk.load(tier)?;
+            tier.loaded.push_back(id);
+            while tier.loaded.len() > capacity {
+                let oldest = tier.loaded.pop_front().unwrap_or_default();
+                let evicted = oldest.checked_sub(self.dropped_chunks);
+                if let Some(chunk) = evicted.and_then(|i| self.chunks.get_mut(i)) {
+                    let _ = chunk.freeze(tier);
+                }
+            }
+        }
+        Ok(())
+    }
+
     /// Add a new empty line.
     pub fn newline(&mut self) {
         self.push_line(ChunkedLine::empty());
@@ -218,10 +652,23 @@ impl RopeBuffer {
     }
 
     /// Clear all content.
+    ///
+    /// A spilling buffer starts a fresh spill file, reclaiming disk space.
     pub fn clear(&mut self) {
+        self.dropped_chunks += self.chunks.len();
         self.chunks.clear();
+        self.front = 0;
         self.total_lines = 0;
         self.scroll_offset = 0;
+        self.interner.clear();
+        if let Some(tier) = &mut self.cold {
+            tier.loaded.clear();
+            if let Some(disk) = &mut tier.disk {
+                if let Ok(file) = SpillFile::create(&disk.dir) {
+                    disk.file = file;
+                }
+            }
+        }
         self.push_line(ChunkedLine::empty());
     }
 
@@ -259,38 +706,206 @@ impl RopeBuffer {
         })
     }
 
+    /// Search all lines.
+    ///
+    /// Resident chunks whose index is stale are re-indexed first; chunks
+    /// that can't contain a match are skipped without being scanned, and
+    /// the rest are scanned in parallel when there are many of them.
+    /// Frozen chunks keep their index, so only those that may match are
+    /// read back, a batch at a time and without being kept; any that can't
+    /// be read are skipped.
+    ///
+    /// # Returns
+    /// All matches, in line order.
+    pub fn search(&mut self, query: &SearchQuery) -> Vec<SearchMatch> {
+        for chunk in self.chunks.iter_mut().filter(|chunk| chunk.is_resident()) {
+            chunk.ensure_index();
+        }
+        // Complete indexes rebuilt or reopened since the next chunk sealed
+        for i in 1..self.chunks.len().saturating_sub(1) {
+            if self.chunks[i - 1].index.as_ref().is_some_and(ChunkIndex::tail_pending) {
+                let next = self.next_lines(i - 1).into_owned();
+                if let Some(index) = &mut self.chunks[i - 1].index {
+                    index.add_tail(&next);
+                }
+            }
+        }
+
+        let nexts: Vec<Cow<'_, [ChunkedLine]>> = (0..self.chunks.len())
+            .map(|i| {
+                let chunk = &self.chunks[i];
+                match chunk.lines.last() {
+                    Some(line) if line.wrapped => self.next_lines(i),
+                    _ => Cow::Borrowed(&[][..]),
+                }
+            })
+            .collect();
+        let views: Vec<ChunkView<'_>> = self
+            .chunks
+            .iter()
+            .zip(&nexts)
+            .enumerate()
+            .filter_map(|(i, (chunk, next))| {
+                Some(ChunkView {
+                    first_slot: i * CHUNK_SIZE,
+                    lines: &chunk.lines,
+                    next,
+                    index: chunk.index.as_ref()?,
+                })
+            })
+            .collect();
+        let mut matches = search::scan(&views, self.front, query);
+
+        let Some(tier) = &self.cold else {
+            return matches;
+        };
+        let frozen: Vec<usize> = (0..self.chunks.len())
+            .filter(|&i| {
+                let chunk = &self.chunks[i];
+                !chunk.is_resident() && chunk.index.as_ref().is_some_and(|index| index.may_match(query))
+            })
+            .collect();
+        for batch in frozen.chunks(SEARCH_BATCH_CHUNKS) {
+            let read: Vec<(usize, Vec<ChunkedLine>, Cow<'_, [ChunkedLine]>)> = batch
+                .iter()
+                .filter_map(|&i| {
+                    let lines = self.chunks[i].read(tier).ok()?.into_owned();
+                    let next = match lines.last() {
+                        Some(line) if line.wrapped => self.next_lines(i),
+                        _ => Cow::Borrowed(&[][..]),
+                    };
+                    Some((i, lines, next))
+                })
+                .collect();
+            let views: Vec<ChunkView<'_>> = read
+                .iter()
+                .filter_map(|(i, lines, next)| {
+                    Some(ChunkView {
+                        first_slot: i * CHUNK_SIZE,
+                        lines,
+                        next,
+                        index: self.chunks[*i].index.as_ref()?,
+                    })
+                })
+                .collect();
+            matches.extend(search::scan(&views, self.front, query));
+        }
+
+        if !frozen.is_empty() {
+            matches.sort_by_key(|m| (m.line, m.col));
+        }
+        matches
+    }
+
+    /// Get the lines of the chunk after chunk `i` that continue its last
+    /// line, reading them back if that chunk is frozen.
+    ///
+    /// Empty for the last chunk or if the read fails.
+    fn next_lines(&self, i: usize) -> Cow<'_, [ChunkedLine]> {
+        let Some(next) = self.chunks.get(i + 1) else {
+            return Cow::Borrowed(&[]);
+        };
+        match &self.cold {
+            Some(tier) if !next.is_resident() => next
+                .read(tier)
+                .map_or(Cow::Borrowed(&[][..]), |lines| Cow::Owned(search::tail_of(&lines).to_vec())),
+            _ => Cow::Borrowed(search::tail_of(&next.lines)),
+        }
+    }
+
     /// Trim lines from the front to stay within `max_lines`.
     fn trim_front(&mut self) {
-        while self.total_lines > self.max_lines && !self.chunks.is_empty() {
-            // Remove the first chunk
-            let removed_chunk = self.chunks.remove(0);
-            self.total_lines -= removed_chunk.len();
-            
-            // Adjust scroll offset
-            if self.scroll_offset > removed_chunk.len() {
-                self.scroll_offset -= removed_chunk.len();
-            } else {
-                self.scroll_offset = 0;
+        while self.total_lines > self.max_lines {
+            let Some(first) = self.chunks.front_mut() else {
+                break;
+            };
+
+            // Release the evicted line's cells; the slot goes with its chunk
+            if let Some(line) = first.lines.get_mut(self.front) {
+                *line = ChunkedLine::empty();
+            }
+            self.front += 1;
+            self.total_lines -= 1;
+            self.scroll_offset = self.scroll_offset.saturating_sub(1);
+
+            if self.front == first.len() {
+                let cold = self.chunks.pop_front().and_then(|chunk| chunk.cold);
+                if let (Some(copy), Some(tier)) = (cold, &mut self.cold) {
+                    tier.release(copy);
+                }
+                self.front = 0;
+                self.dropped_chunks += 1;
             }
         }
     }
 
     /// Get memory usage statistics.
+    #[allow(clippy::cast_precision_loss)]
     pub fn memory_stats(&self) -> RopeMemoryStats {
+        let mut resident_lines = 0;
         let mut total_cells = 0;
+        let mut owned_bytes = 0;
+        let mut interned_lines = 0;
+        let mut index_bytes = 0;
+        let mut compressed_chunks = 0;
+        let mut compressed_bytes = 0;
+        let mut spilled_chunks = 0;
+        let mut frozen_raw_bytes = 0;
+        let mut frozen_bytes = 0;
         for chunk in &self.chunks {
+            resident_lines += chunk.lines.len();
             for line in &chunk.lines {
                 total_cells += line.content.len();
+                owned_bytes += line.content.owned_bytes();
+                interned_lines += usize::from(line.content.is_shared());
+            }
+            index_bytes += chunk.index.as_ref().map_or(0, ChunkIndex::memory_usage);
+
+            match &chunk.cold {
+                Some(copy) if !chunk.is_resident() => {
+                    frozen_raw_bytes += copy.raw_bytes;
+                    frozen_bytes += copy.len();
+                    if let ColdPlace::Memory(bytes) = &copy.place {
+                        compressed_chunks += 1;
+                        compressed_bytes += bytes.len();
+                    } else {
+                        spilled_chunks += 1;
+                    }
+                },
+                _ => {},
             }
         }
 
+        let interned_bytes = self.interner.memory_usage();
+        let tier = self.cold.as_ref();
+        let decodes = tier.map_or(0, |tier| tier.decodes);
         RopeMemoryStats {
             chunks: self.chunks.len(),
             lines: self.total_lines,
             cells: total_cells,
+            interned_lines,
+            interned_bytes,
+            index_bytes,
+            compressed_chunks,
+            compressed_bytes,
+            spilled_chunks,
+            spilled_bytes: tier
+                .and_then(|tier| tier.disk.as_ref())
+                .map_or(0, |disk| disk.file.len()),
+            compression_ratio: if frozen_bytes == 0 {
+                1.0
+            } else {
+                frozen_raw_bytes as f64 / frozen_bytes as f64
+            },
+            decode_latency: tier
+                .filter(|_| decodes > 0)
+                .map_or(Duration::ZERO, |tier| tier.decode_time / decodes),
             bytes_estimated: self.chunks.len() * std::mem::size_of::<Chunk>()
-                + self.total_lines * std::mem::size_of::<ChunkedLine>()
-                + total_cells * std::mem::size_of::<Cell>(),
+                + resident_lines * std::mem::size_of::<ChunkedLine>()
+                + owned_bytes
+                + interned_bytes
+                + index_bytes
+                + compressed_bytes,
         }
     }
 }
@@ -302,8 +917,27 @@ pub struct RopeMemoryStats {
     pub chunks: usize,
     /// Number of lines.
     pub lines: usize,
-    /// Number of cells.
+    /// Number of cells in memory, counting shared cells once per line.
     pub cells: usize,
+    /// Number of lines in memory whose cells are interned.
+    pub interned_lines: usize,
+    /// Bytes used by interned cells and the interner's table.
+    pub interned_bytes: usize,
+    /// Bytes used by search indexes.
+    pub index_bytes: usize,
+    /// Number of chunks compressed in memory and not loaded.
+    pub compressed_chunks: usize,
+    /// Bytes used by compressed chunks.
+    pub compressed_bytes: usize,
+    /// Number of chunks spilled to disk and not loaded.
+    pub spilled_chunks: usize,
+    /// Size of the spill file in bytes.
+    pub spilled_bytes: u64,
+    /// Resident size of frozen chunks over their compressed size (1.0 if
+    /// none are frozen).
+    pub compression_ratio: f64,
+    /// Average time to decompress a chunk scrolled into view.
+    pub decode_latency: Duration,
     /// Estimated memory usage in bytes.
     pub bytes_estimated: usize,
 }
@@ -348,9 +982,10 @@ mod tests {
             buffer.newline();
         }
         
-        // Should be trimmed to around max_lines
-        // Note: trimming is chunk-based, so might be slightly over
-        assert!(buffer.len() <= 100 + CHUNK_SIZE);
+        // Trimming is exact, even mid-chunk
+        assert_eq!(buffer.len(), 100);
+        assert!(buffer.iter().all(ChunkedLine::is_empty));
+        assert_eq!(buffer.iter().count(), 100);
     }
 
     #[test]
@@ -400,4 +1035,108 @@ mod tests {
         assert_eq!(stats.cells, 8000);
         assert!(stats.bytes_estimated > 0);
     }
+
+    #[test]
+    fn test_rope_buffer_interning() {
+        let mut buffer = RopeBuffer::new(1000);
+        for i in 0..100 {
+            let line = if i % 2 == 0 { "─".repeat(80) } else { format!("step {i:02}") };
+            buffer.append(line.chars().map(Cell::from_char));
+            buffer.newline();
+        }
+
+        // 50 borders share one payload; every finished line is interned
+        let stats = buffer.memory_stats();
+        assert_eq!(stats.cells, 50 * 80 + 50 * 7);
+        assert_eq!(stats.interned_lines, 100);
+        assert!(stats.interned_bytes < 50 * 80 * std::mem::size_of::<Cell>() / 4);
+
+        // Writing to an interned line copies it first
+        buffer.get_line_mut(0).unwrap().content[0] = Cell::from_char('x');
+        assert_eq!(buffer.get_line(2).unwrap().content[0], Cell::from_char('─'));
+        assert!(!buffer.get_line(0).unwrap().content.is_shared());
+    }
+
+    #[test]
+    fn test_rope_buffer_spill() {
+        let mut buffer = RopeBuffer::with_spill(0, 2, &std::env::temp_dir()).unwrap();
+        for i in 0..1000 {
+            buffer.append(format!("line {i}").chars().map(Cell::from_char));
+            buffer.newline();
+        }
+
+        // 16 chunks, of which the newest 2 stay in memory
+        let stats = buffer.memory_stats();
+        assert_eq!(stats.spilled_chunks, 14);
+        assert!(stats.cells < 2 * CHUNK_SIZE * 8);
+        assert!(stats.spilled_bytes > 0);
+        assert!(buffer.get_line(10).is_none());
+
+        buffer.ensure_resident(10..20).unwrap();
+        let text: String = buffer.get_line(10).unwrap().content.iter()
+            .map(|c| c.grapheme().unwrap_or(""))
+            .collect();
+        assert_eq!(text, "line 10");
+
+        let mut count = 0;
+        buffer.visit_lines(|_| count += 1).unwrap();
+        assert_eq!(count, 1001);
+
+        let lines: Vec<_> = buffer
+            .search(&SearchQuery::substring("line 42"))
+            .iter()
+            .map(|m| m.line)
+            .collect();
+        assert_eq!(lines, [42].into_iter().chain(420..430).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_rope_buffer_spill_reuses_space() {
+        let mut buffer = RopeBuffer::with_spill(10 * CHUNK_SIZE, 2, &std::env::temp_dir()).unwrap();
+        let push = |buffer: &mut RopeBuffer, lines: std::ops::Range<usize>| {
+            for i in lines {
+                buffer.append(format!("line {i:06}").chars().map(Cell::from_char));
+                buffer.newline();
+            }
+        };
+        push(&mut buffer, 0..2000);
+        let settled = buffer.memory_stats().spilled_bytes;
+        assert!(settled > 0);
+
+        // Evicted chunks give their space to newly frozen ones, so the file
+        // stays near the size of the live chunks
+        push(&mut buffer, 2000..20_000);
+        assert!(buffer.memory_stats().spilled_bytes < 2 * settled);
+
+        // So does a chunk changed after being read back
+        buffer.ensure_resident(0..1).unwrap();
+        buffer.get_line_mut(0).unwrap().content.extend([Cell::new('!')]);
+        push(&mut buffer, 20_000..20_000 + 4 * CHUNK_SIZE);
+        assert!(buffer.memory_stats().spilled_bytes < 2 * settled);
+    }
+
+    #[test]
+    fn test_rope_buffer_compression() {
+        let mut buffer = RopeBuffer::with_compression(0, 2);
+        let level = Cell::new('I').with_fg(crate::buffer::Rgb::new(0, 200, 0));
+        for i in 0..1000 {
+            buffer.append(std::iter::once(level));
+            let line = format!("NFO 12:00:{:02} worker={} request handled", i % 60, i % 4);
+            buffer.append(line.chars().map(Cell::from_char));
+            buffer.newline();
+        }
+
+        let stats = buffer.memory_stats();
+        assert_eq!(stats.compressed_chunks, 14);
+        assert_eq!(stats.spilled_bytes, 0);
+        assert!(stats.compression_ratio > 10.0, "{}", stats.compression_ratio);
+        assert!(buffer.get_line(100).is_none());
+        // Frozen chunks keep their search index
+        assert!(buffer.chunks.iter().filter(|chunk| !chunk.is_resident()).all(|chunk| chunk.index.is_some()));
+
+        buffer.ensure_resident(100..101).unwrap();
+        assert_eq!(buffer.get_line(100).unwrap().content[0], level);
+        assert!(buffer.memory_stats().decode_latency > Duration::ZERO);
+        assert_eq!(buffer.search(&SearchQuery::substring("12:00:07 worker=3")).len(), 17);
+    }
 }
@@ -0,0 +1,583 @@
+//! Scrollback Search: Trigram-indexed substring and regex search.
+//!
+//! Each [`RopeBuffer`](super::RopeBuffer) chunk carries a [`ChunkIndex`]:
+//! a Bloom filter over the byte trigrams of the chunk's text. The index is
+//! built once when a chunk is sealed, kept while the chunk is frozen, and
+//! dropped with the chunk on eviction. A query's required literal is split
+//! into trigrams, chunks whose filter lacks any of them are skipped, and
+//! only the remaining chunks have their text rebuilt from the cells and
+//! scanned. Matches are mapped back to line and column for highlighting.
+//!
+//! A chunk whose last line is soft-wrapped owns its text up to the next
+//! hard newline: the next chunk's leading wrapped lines are scanned with
+//! it (and their trigrams added to its filter once that chunk is sealed),
+//! and only matches starting in the chunk itself are reported. A match
+//! that runs on past the whole next chunk is not found.
+
+use std::thread;
+
+use regex::{Regex, RegexBuilder};
+
+use super::rope::ChunkedLine;
+
+/// Smallest Bloom filter, in bits.
+const MIN_FILTER_BITS: usize = 512;
+
+/// Bloom filter bits per byte of chunk text.
+const FILTER_BITS_PER_BYTE: usize = 4;
+
+/// Candidate chunks needed before a scan is split across threads.
+const PARALLEL_MIN_CHUNKS: usize = 32;
+
+/// Search index for one chunk of lines.
+#[derive(Debug, Clone)]
+pub struct ChunkIndex {
+    /// Bloom filter over the trigrams of the chunk's text, and of its tail
+    /// once added.
+    filter: Vec<u64>,
+    /// Last two bytes of the text if the last line is soft-wrapped, to
+    /// form the trigrams that span into the tail.
+    seam: Vec<u8>,
+    /// Whether the tail's trigrams are missing from the filter.
+    tail_pending: bool,
+}
+
+impl ChunkIndex {
+    /// Build the index for a chunk's lines.
+    ///
+    /// If the last line is soft-wrapped, the filter lacks the tail until
+    /// [`add_tail`](Self::add_tail) is called, and every query may match.
+    pub fn build(lines: &[ChunkedLine]) -> Self {
+        let text = ChunkText::build(lines, &[]).text;
+        let bits = (text.len() * FILTER_BITS_PER_BYTE)
+            .next_power_of_two()
+            .max(MIN_FILTER_BITS);
+        let seam = if lines.last().is_some_and(|line| line.wrapped) {
+            text.as_bytes()[text.len().saturating_sub(2)..].to_vec()
+        } else {
+            Vec::new()
+        };
+        let mut index = Self {
+            filter: vec![0u64; bits / 64],
+            tail_pending: !seam.is_empty(),
+            seam,
+        };
+        index.insert(text.as_bytes());
+        index
+    }
+
+    /// Set the filter bits of every trigram in `bytes`.
+    fn insert(&mut self, bytes: &[u8]) {
+        let bits = self.filter.len() * 64;
+        for trigram in bytes.windows(3).map(trigram) {
+            for bit in filter_bits(trigram, bits) {
+                self.filter[bit / 64] |= 1 << (bit % 64);
+            }
+        }
+    }
+
+    /// Check whether the filter still lacks the chunk's tail.
+    pub const fn tail_pending(&self) -> bool {
+        self.tail_pending
+    }
+
+    /// Add the trigrams of the tail: the leading wrapped lines of `next`,
+    /// the chunk after this one, through its first hard newline.
+    ///
+    /// Call it once `next` is sealed, and again if those lines change.
+    pub fn add_tail(&mut self, next: &[ChunkedLine]) {
+        if self.seam.is_empty() {
+            return;
+        }
+        let mut bytes = self.seam.clone();
+        bytes.extend_from_slice(ChunkText::build(&[], tail_of(next)).text.as_bytes());
+        self.insert(&bytes);
+        self.tail_pending = false;
+    }
+
+    /// Mark the tail as changed, so queries may match until it is added
+    /// again.
+    pub const fn reopen_tail(&mut self) {
+        self.tail_pending = !self.seam.is_empty();
+    }
+
+    /// Check whether the chunk may contain all of the given trigrams.
+    ///
+    /// False positives are possible; false negatives are not.
+    pub fn may_contain(&self, trigrams: &[u32]) -> bool {
+        let bits = self.filter.len() * 64;
+        trigrams.iter().all(|&t| {
+            filter_bits(t, bits)
+                .into_iter()
+                .all(|bit| self.filter[bit / 64] & (1 << (bit % 64)) != 0)
+        })
+    }
+
+    /// Check whether the chunk may hold a match of `query`.
+    pub(crate) fn may_match(&self, query: &SearchQuery) -> bool {
+        self.tail_pending || self.may_contain(&query.trigrams)
+    }
+
+    /// Get the approximate heap memory used by this index.
+    pub const fn memory_usage(&self) -> usize {
+        self.filter.capacity() * 8 + self.seam.capacity()
+    }
+}
+
+/// Get the lines of `next` that continue the previous chunk's last line:
+/// its leading soft-wrapped lines and the line ending them.
+pub(crate) fn tail_of(next: &[ChunkedLine]) -> &[ChunkedLine] {
+    let end = next.iter().position(|line| !line.wrapped).map_or(next.len(), |i| i + 1);
+    &next[..end]
+}
+
+/// A chunk's text, rebuilt from its cells while the chunk is scanned.
+struct ChunkText {
+    /// Lines ending in a hard newline are followed by `\n`; soft-wrapped
+    /// lines run straight into the next one.
+    text: String,
+    /// Byte offset of each line in `text`.
+    line_starts: Vec<u32>,
+    /// Length of the chunk's own text, before the tail.
+    own_len: usize,
+}
+
+impl ChunkText {
+    /// Build the text of a chunk's lines, continued into the tail from
+    /// `next` if the last line is soft-wrapped.
+    #[allow(clippy::cast_possible_truncation)]
+    fn build(lines: &[ChunkedLine], next: &[ChunkedLine]) -> Self {
+        let tail = match lines.last() {
+            Some(line) if !line.wrapped => &[],
+            _ => tail_of(next),
+        };
+        let mut text = String::new();
+        let mut line_starts = Vec::with_capacity(lines.len() + tail.len());
+        let mut own_len = 0;
+        for (i, line) in lines.iter().chain(tail).enumerate() {
+            if i == lines.len() {
+                own_len = text.len();
+            }
+            line_starts.push(text.len() as u32);
+            for cell in &line.content {
+                text.push_str(cell.grapheme().unwrap_or(" "));
+            }
+            if !line.wrapped {
+                text.push('\n');
+            }
+        }
+        if tail.is_empty() {
+            own_len = text.len();
+        }
+        Self {
+            text,
+            line_starts,
+            own_len,
+        }
+    }
+
+    /// Map a byte offset in the text to (line from the chunk start,
+    /// column). Lines past the chunk's own are the tail, from `next`.
+    #[allow(clippy::cast_possible_truncation)]
+    fn position(&self, lines: &[ChunkedLine], next: &[ChunkedLine], offset: usize) -> (usize, u16) {
+        let line = self
+            .line_starts
+            .partition_point(|&start| start as usize <= offset)
+            - 1;
+        let cells = lines
+            .get(line)
+            .map_or_else(|| &next[line - lines.len()].content, |own| &own.content);
+        let mut byte = self.line_starts[line] as usize;
+        let mut col = 0u16;
+        for cell in cells {
+            if byte >= offset {
+                break;
+            }
+            byte += cell.grapheme().map_or(1, str::len);
+            col += u16::from(cell.display_width());
+        }
+        (line, col)
+    }
+}
+
+/// Pack three bytes into a trigram key.
+fn trigram(bytes: &[u8]) -> u32 {
+    u32::from(bytes[0]) << 16 | u32::from(bytes[1]) << 8 | u32::from(bytes[2])
+}
+
+/// Bloom filter bit positions for a trigram.
+const fn filter_bits(trigram: u32, bits: usize) -> [usize; 2] {
+    let mask = bits - 1;
+    let h1 = trigram.wrapping_mul(0x9E37_79B1);
+    let h2 = trigram.wrapping_mul(0x85EB_CA77).rotate_left(15);
+    [h1 as usize & mask, (h1 >> 16 ^ h2) as usize & mask]
+}
+
+/// What a query matches.
+#[derive(Debug, Clone)]
+enum Matcher {
+    /// Exact substring.
+    Substring(String),
+    /// Regular expression (multi-line mode).
+    Regex(Regex),
+}
+
+/// A compiled search query.
+#[derive(Debug, Clone)]
+pub struct SearchQuery {
+    /// The matcher applied to candidate chunks.
+    matcher: Matcher,
+    /// Trigrams every match must contain, used to skip chunks.
+    trigrams: Vec<u32>,
+}
+
+impl SearchQuery {
+    /// Create a query for an exact substring.
+    pub fn substring(needle: &str) -> Self {
+        Self {
+            trigrams: needle.as_bytes().windows(3).map(trigram).collect(),
+            matcher: Matcher::Substring(needle.to_string()),
+        }
+    }
+
+    /// Create a query for a regular expression.
+    ///
+    /// `^` and `$` match at line boundaries. Chunks are skipped using the
+    /// longest literal every match must contain, when one can be found.
+    ///
+    /// # Errors
+    /// Returns an error if `pattern` is not a valid regular expression.
+    pub fn regex(pattern: &str) -> Result<Self, regex::Error> {
+        let regex = RegexBuilder::new(pattern).multi_line(true).build()?;
+        let trigrams = required_literal(pattern)
+            .map(|literal| literal.as_bytes().windows(3).map(trigram).collect())
+            .unwrap_or_default();
+
+        Ok(Self {
+            matcher: Matcher::Regex(regex),
+            trigrams,
+        })
+    }
+
+    /// Find all matches in one chunk's text, as byte ranges.
+    fn find(&self, text: &str, mut emit: impl FnMut(usize, usize)) {
+        match &self.matcher {
+            Matcher::Substring(needle) if needle.is_empty() => {},
+            Matcher::Substring(needle) => {
+                for (start, m) in text.match_indices(needle.as_str()) {
+                    emit(start, start + m.len());
+                }
+            },
+            Matcher::Regex(regex) => {
+                for m in regex.find_iter(text).filter(|m| !m.is_empty()) {
+                    emit(m.start(), m.end());
+                }
+            },
+        }
+    }
+}
+
+/// Find the longest literal that every match of `pattern` must contain.
+///
+/// This is deliberately conservative: patterns with alternation or inline
+/// flags yield nothing, and literals inside groups, classes or escapes are
+/// ignored.
+fn required_literal(pattern: &str) -> Option<String> {
+    if pattern.contains('|') || pattern.contains("(?") {
+        return None;
+    }
+
+    let mut best = String::new();
+    let mut run = String::new();
+    let mut depth = 0usize;
+    let mut chars = pattern.chars();
+    let mut flush = |run: &mut String| {
+        if run.len() > best.len() {
+            best.clone_from(run);
+        }
+        run.clear();
+    };
+
+    while let Some(c) = chars.next() {
+        match c {
+            '\\' => {
+                flush(&mut run);
+                chars.next();
+            },
+            '(' => {
+                flush(&mut run);
+                depth += 1;
+            },
+            ')' => {
+                flush(&mut run);
+                depth = depth.saturating_sub(1);
+            },
+            '[' => {
+                flush(&mut run);
+                // A leading `]` is part of the class
+                let mut first = true;
+                while let Some(c) = chars.next() {
+                    match c {
+                        '\\' => {
+                            chars.next();
+                        },
+                        ']' if !first => break,
+                        _ => {},
+                    }
+                    first = false;
+                }
+            },
+            // The previous character may be absent
+            '*' | '?' | '{' => {
+                run.pop();
+                flush(&mut run);
+                if c == '{' {
+                    chars.by_ref().find(|&c| c == '}');
+                }
+            },
+            '.' | '^' | '$' | '+' => flush(&mut run),
+            _ if depth == 0 => run.push(c),
+            _ => {},
+        }
+    }
+    flush(&mut run);
+
+    (best.len() >= 3).then_some(best)
+}
+
+/// A search match, as positions in the scrollback.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SearchMatch {
+    /// Line index of the first matched cell.
+    pub line: usize,
+    /// Column of the first matched cell.
+    pub col: u16,
+    /// Line index where the match ends.
+    pub end_line: usize,
+    /// Column just past the last matched cell on `end_line`.
+    pub end_col: u16,
+}
+
+/// A chunk's lines and search index, positioned in the rope.
+#[derive(Clone, Copy)]
+pub(crate) struct ChunkView<'a> {
+    /// Rope slot of the chunk's first line (chunk number × `CHUNK_SIZE`).
+    pub first_slot: usize,
+    /// The chunk's lines.
+    pub lines: &'a [ChunkedLine],
+    /// Lines of the next chunk, or at least its [tail](tail_of); empty
+    /// for the last chunk.
+    pub next: &'a [ChunkedLine],
+    /// Index built from `lines`.
+    pub index: &'a ChunkIndex,
+}
+
+/// Scan indexed chunks for matches.
+///
+/// # Arguments
+/// * `chunks` - Chunks to scan, oldest first.
+/// * `front` - Evicted lines at the start of the first chunk.
+/// * `query` - The query to run.
+///
+/// # Returns
+/// All matches, in line order.
+pub(crate) fn scan(
+    chunks: &[ChunkView<'_>],
+    front: usize,
+    query: &SearchQuery,
+) -> Vec<SearchMatch> {
+    let candidates: Vec<&ChunkView<'_>> = chunks
+        .iter()
+        .filter(|chunk| chunk.index.may_match(query))
+        .collect();
+
+    let scan_chunks = |candidates: &[&ChunkView<'_>]| {
+        let mut matches = Vec::new();
+        for chunk in candidates {
+            scan_chunk(chunk, front, query, &mut matches);
+        }
+        matches
+    };
+
+    let threads = thread::available_parallelism().map_or(1, usize::from);
+    if threads < 2 || candidates.len() < PARALLEL_MIN_CHUNKS {
+        return scan_chunks(&candidates);
+    }
+
+    let per_thread = candidates.len().div_ceil(threads);
+    thread::scope(|scope| {
+        // Spawn every worker before joining any of them
+        #[allow(clippy::needless_collect)]
+        let workers: Vec<_> = candidates
+            .chunks(per_thread)
+            .map(|part| scope.spawn(move || scan_chunks(part)))
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().unwrap_or_default())
+            .collect()
+    })
+}
+
+/// Scan one chunk, appending matches that aren't in evicted lines.
+fn scan_chunk(
+    chunk: &ChunkView<'_>,
+    front: usize,
+    query: &SearchQuery,
+    matches: &mut Vec<SearchMatch>,
+) {
+    let ChunkView {
+        first_slot,
+        lines,
+        next,
+        ..
+    } = *chunk;
+
+    let text = ChunkText::build(lines, next);
+    query.find(&text.text, |start, end| {
+        // Matches starting in the tail belong to the next chunk
+        if start >= text.own_len {
+            return;
+        }
+        let (line, col) = text.position(lines, next, start);
+        if first_slot + line < front {
+            return;
+        }
+        let (end_line, end_col) = text.position(lines, next, end);
+        matches.push(SearchMatch {
+            line: first_slot + line - front,
+            col,
+            end_line: first_slot + end_line - front,
+            end_col,
+        });
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::buffer::rope::CHUNK_SIZE;
+    use crate::buffer::{Cell, RopeBuffer};
+
+    fn line(text: &str, wrapped: bool) -> ChunkedLine {
+        ChunkedLine::new(text.chars().map(Cell::from_char).collect(), wrapped)
+    }
+
+    #[test]
+    fn test_search_substring_positions() {
+        let mut buffer = RopeBuffer::from_lines(
+            0,
+            [
+                line("cargo build", false),
+                line("error: 漢字 not found", false),
+                line("warning: unused, err", true),
+                line("or here", false),
+            ],
+        );
+
+        let matches = buffer.search(&SearchQuery::substring("not found"));
+        assert_eq!(
+            matches,
+            vec![SearchMatch {
+                line: 1,
+                col: 12,
+                end_line: 1,
+                end_col: 21
+            }]
+        );
+
+        // Matches continue across soft wraps but not hard newlines
+        let matches = buffer.search(&SearchQuery::substring("error"));
+        assert_eq!(matches.len(), 2);
+        assert_eq!(
+            matches[1],
+            SearchMatch {
+                line: 2,
+                col: 17,
+                end_line: 3,
+                end_col: 2
+            }
+        );
+        assert!(buffer
+            .search(&SearchQuery::substring("buildaerror"))
+            .is_empty());
+    }
+
+    #[test]
+    fn test_search_match_across_chunk_seam() {
+        // Row 63 is the last of the first chunk and wraps into row 64
+        let filler = |n| (0..n).map(|_| line("filler", false));
+        let lines = filler(63)
+            .chain([line("compile err", true), line("or here", false)])
+            .chain(filler(2 * CHUNK_SIZE));
+        let seam = SearchMatch {
+            line: 63,
+            col: 8,
+            end_line: 64,
+            end_col: 2,
+        };
+
+        let mut buffer = RopeBuffer::from_lines(0, lines.clone());
+        assert_eq!(buffer.search(&SearchQuery::substring("error")), vec![seam]);
+        assert_eq!(
+            buffer.search(&SearchQuery::regex("err+or h").unwrap()),
+            vec![SearchMatch { end_col: 4, ..seam }]
+        );
+
+        // The first chunk's filter follows edits to its tail
+        buffer.get_line_mut(64).unwrap().content.to_mut()[0] = Cell::from_char('x');
+        assert!(buffer.search(&SearchQuery::substring("error")).is_empty());
+        buffer.get_line_mut(64).unwrap().content.to_mut()[0] = Cell::from_char('o');
+        assert_eq!(buffer.search(&SearchQuery::substring("error")), vec![seam]);
+
+        // And frozen chunks read back their neighbour's tail
+        let mut buffer = RopeBuffer::with_compression(0, 1);
+        for line in lines.skip(1) {
+            buffer.push_line(line);
+        }
+        assert_eq!(buffer.search(&SearchQuery::substring("error")), vec![seam]);
+    }
+
+    #[test]
+    fn test_search_regex_across_chunks() {
+        // Enough chunks to take the parallel path
+        let mut buffer = RopeBuffer::new(10_000);
+        for i in 0..5000 {
+            buffer.append(format!("line {i} status=ok").chars().map(Cell::from_char));
+            buffer.newline();
+        }
+
+        let query = SearchQuery::regex(r"^line 4\d7 status").unwrap();
+        let lines: Vec<_> = buffer.search(&query).iter().map(|m| m.line).collect();
+        assert_eq!(lines, (0..10).map(|i| 407 + i * 10).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_search_skips_evicted_lines() {
+        let mut buffer = RopeBuffer::new(100);
+        for i in 0..250 {
+            buffer.append(format!("entry {i}").chars().map(Cell::from_char));
+            buffer.newline();
+        }
+
+        // Line 0 now holds "entry 151"
+        let matches = buffer.search(&SearchQuery::substring("entry 15"));
+        let lines: Vec<_> = matches.iter().map(|m| m.line).collect();
+        assert_eq!(lines, vec![0, 1, 2, 3, 4, 5, 6, 7, 8]);
+    }
+
+    #[test]
+    fn test_required_literal() {
+        assert_eq!(
+            required_literal(r"error: \w+ failed").as_deref(),
+            Some("error: ")
+        );
+        assert_eq!(
+            required_literal("colou?r value").as_deref(),
+            Some("r value")
+        );
+        assert_eq!(required_literal("foo|barbaz"), None);
+        assert_eq!(required_literal("(?i)warning"), None);
+        assert_eq!(required_literal("[abc]+x{2}"), None);
+    }
+}
@@ -0,0 +1,263 @@
+//! Text Ingestion: Fast classification and width lookup for incoming text.
+//!
+//! Every text entry point in the crate goes through this module:
+//! - Printable ASCII runs are found a `u64` word at a time and become cells
+//!   directly, with no segmentation or width lookup
+//! - Non-ASCII text is split into grapheme clusters
+//! - Widths of BMP characters come from a compact precomputed table, with
+//!   `unicode_width` only consulted outside the BMP and for multi-character
+//!   clusters
+
+use std::sync::OnceLock;
+use unicode_segmentation::{Graphemes, UnicodeSegmentation};
+use unicode_width::{UnicodeWidthChar, UnicodeWidthStr};
+
+/// Code points per width table block.
+const BLOCK_SIZE: usize = 128;
+
+/// Widths are packed four to a byte (2 bits each).
+const BLOCK_BYTES: usize = BLOCK_SIZE / 4;
+
+/// Number of blocks covering the BMP.
+const BLOCK_COUNT: usize = 0x1_0000 / BLOCK_SIZE;
+
+/// Two-level display width table for the Basic Multilingual Plane.
+///
+/// Most blocks are uniform (all narrow, all wide, ...), so identical blocks
+/// are stored once and shared through the index. The whole table is a few
+/// kilobytes.
+struct WidthTable {
+    /// Block number for each 128-code-point range.
+    index: [u16; BLOCK_COUNT],
+    /// Deduplicated blocks of packed 2-bit widths.
+    blocks: Vec<[u8; BLOCK_BYTES]>,
+}
+
+impl WidthTable {
+    /// Build the table from `unicode_width`.
+    #[allow(clippy::cast_possible_truncation)]
+    fn build() -> Self {
+        let mut index = [0u16; BLOCK_COUNT];
+        let mut blocks: Vec<[u8; BLOCK_BYTES]> = Vec::new();
+
+        for (block_no, slot) in index.iter_mut().enumerate() {
+            let mut block = [0u8; BLOCK_BYTES];
+            for offset in 0..BLOCK_SIZE {
+                let cp = (block_no * BLOCK_SIZE + offset) as u32;
+                // Surrogates are not chars and never reach the lookup
+                let width = char::from_u32(cp).and_then(UnicodeWidthChar::width).unwrap_or(0);
+                block[offset / 4] |= (width as u8 & 0b11) << ((offset % 4) * 2);
+            }
+
+            *slot = blocks.iter().position(|b| *b == block).unwrap_or_else(|| {
+                blocks.push(block);
+                blocks.len() - 1
+            }) as u16;
+        }
+
+        Self { index, blocks }
+    }
+
+    /// Look up the width of a BMP code point.
+    #[inline]
+    fn get(&self, cp: usize) -> u8 {
+        let block = &self.blocks[self.index[cp / BLOCK_SIZE] as usize];
+        let offset = cp % BLOCK_SIZE;
+        (block[offset / 4] >> ((offset % 4) * 2)) & 0b11
+    }
+}
+
+/// Get the shared width table, building it on first use.
+fn width_table() -> &'static WidthTable {
+    static TABLE: OnceLock<WidthTable> = OnceLock::new();
+    TABLE.get_or_init(WidthTable::build)
+}
+
+/// Check whether a byte is printable ASCII (`0x20..=0x7E`).
+#[inline]
+pub const fn is_printable_ascii(b: u8) -> bool {
+    b >= 0x20 && b < 0x7F
+}
+
+/// Length of the leading run of printable ASCII in `bytes`.
+///
+/// Scans a `u64` word at a time, flagging bytes that are non-ASCII, control
+/// characters or DEL, and stops at the first flagged byte.
+pub fn printable_ascii_len(bytes: &[u8]) -> usize {
+    const ONES: u64 = 0x0101_0101_0101_0101;
+    const HIGH: u64 = 0x8080_8080_8080_8080;
+
+    let mut words = bytes.chunks_exact(8);
+    let mut len = 0;
+    for word in &mut words {
+        let w = u64::from_le_bytes(word.try_into().unwrap_or_default());
+        // Bytes below 0x20; borrows only propagate upward from a real hit,
+        // so the lowest flagged byte is exact.
+        let control = w.wrapping_sub(ONES * 0x20) & !w;
+        let del = (w ^ (ONES * 0x7F)).wrapping_sub(ONES) & !(w ^ (ONES * 0x7F));
+        let mask = (w | control | del) & HIGH;
+        if mask != 0 {
+            return len + (mask.trailing_zeros() / 8) as usize;
+        }
+        len += 8;
+    }
+
+    len + words.remainder().iter().take_while(|&&b| is_printable_ascii(b)).count()
+}
+
+/// Display width of a single character.
+///
+/// Matches `UnicodeWidthChar::width`, with control characters reported as 0.
+#[inline]
+#[allow(clippy::cast_possible_truncation)]
+pub fn char_width(c: char) -> u8 {
+    let cp = c as usize;
+    if cp < 0x80 {
+        u8::from(is_printable_ascii(cp as u8))
+    } else if cp < 0x1_0000 {
+        width_table().get(cp)
+    } else {
+        c.width().unwrap_or(0) as u8
+    }
+}
+
+/// Display width of a string.
+///
+/// Matches `UnicodeWidthStr::width`. Printable ASCII and single characters
+/// are answered without the general-purpose lookup.
+pub fn str_width(s: &str) -> usize {
+    let bytes = s.as_bytes();
+    if printable_ascii_len(bytes) == bytes.len() {
+        return bytes.len();
+    }
+
+    let mut chars = s.chars();
+    match (chars.next(), chars.next()) {
+        // `UnicodeWidthStr` counts a lone control character as one column
+        (Some(c), None) if c.is_control() => 1,
+        (Some(c), None) => usize::from(char_width(c)),
+        _ => s.width(),
+    }
+}
+
+/// A classified piece of text produced by [`segments`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Segment<'a> {
+    /// A run of printable ASCII: one cell per byte, each one column wide.
+    Ascii(&'a [u8]),
+    /// A single ASCII control character or DEL.
+    Control(u8),
+    /// A grapheme cluster containing non-ASCII text.
+    Grapheme(&'a str),
+}
+
+/// Iterator over the [`Segment`]s of a string.
+pub struct Segments<'a> {
+    /// Text being split.
+    text: &'a str,
+    /// Byte offset of the next unclassified byte.
+    pos: usize,
+    /// Clusters of the non-ASCII run currently being split.
+    clusters: Option<Graphemes<'a>>,
+}
+
+impl<'a> Iterator for Segments<'a> {
+    type Item = Segment<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if let Some(clusters) = &mut self.clusters {
+            if let Some(grapheme) = clusters.next() {
+                return Some(Segment::Grapheme(grapheme));
+            }
+            self.clusters = None;
+        }
+
+        let bytes = self.text.as_bytes();
+        let start = self.pos;
+        let first = *bytes.get(start)?;
+
+        let mut end = start + printable_ascii_len(&bytes[start..]);
+        // Combining marks cluster with the character before them, so leave
+        // that character to the segmenter.
+        if end > start && bytes.get(end).is_some_and(|&b| b >= 0x80) {
+            end -= 1;
+        }
+        if end > start {
+            self.pos = end;
+            return Some(Segment::Ascii(&bytes[start..end]));
+        }
+
+        if first < 0x80 && !is_printable_ascii(first) {
+            self.pos += 1;
+            return Some(Segment::Control(first));
+        }
+
+        // Non-ASCII run, possibly led by the ASCII character it attaches to.
+        // The run ends on an ASCII byte, which is always a char boundary.
+        let end = bytes[start + 1..]
+            .iter()
+            .position(|&b| b < 0x80)
+            .map_or(bytes.len(), |n| start + 1 + n);
+        self.pos = end;
+        self.clusters = Some(self.text[start..end].graphemes(true));
+        self.next()
+    }
+}
+
+/// Split text into printable ASCII runs, control characters and grapheme
+/// clusters, in order.
+///
+/// # Arguments
+/// * `text` - The text to classify.
+///
+/// # Returns
+/// An iterator of [`Segment`]s covering all of `text`.
+pub const fn segments(text: &str) -> Segments<'_> {
+    Segments {
+        text,
+        pos: 0,
+        clusters: None,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_printable_ascii_len() {
+        assert_eq!(printable_ascii_len(b""), 0);
+        assert_eq!(printable_ascii_len(b"hello world, this is ascii"), 26);
+        assert_eq!(printable_ascii_len(b"0123456789\nabc"), 10);
+        assert_eq!(printable_ascii_len(b"abcdefg\x7f"), 7);
+        assert_eq!(printable_ascii_len("abcdefghij\u{e9}".as_bytes()), 10);
+        assert_eq!(printable_ascii_len(b"\tabc"), 0);
+    }
+
+    #[test]
+    fn test_width_table_matches_unicode_width() {
+        for c in (0..0x1_0000).filter_map(char::from_u32) {
+            let mut utf8 = [0u8; 4];
+            let s = c.encode_utf8(&mut utf8);
+            assert_eq!(usize::from(char_width(c)), c.width().unwrap_or(0), "{c:?}");
+            assert_eq!(str_width(s), s.width(), "{c:?}");
+        }
+        assert_eq!(str_width("漢字 ok"), 7);
+        assert_eq!(str_width("e\u{301}"), 1);
+    }
+
+    #[test]
+    fn test_segments() {
+        let parts: Vec<_> = segments("ab\tcafe\u{301}!").collect();
+        assert_eq!(
+            parts,
+            vec![
+                Segment::Ascii(b"ab"),
+                Segment::Control(b'\t'),
+                Segment::Ascii(b"caf"),
+                Segment::Grapheme("e\u{301}"),
+                Segment::Ascii(b"!"),
+            ]
+        );
+    }
+}
@@ -27,7 +27,7 @@
 #![warn(missing_docs)]
 #![warn(clippy::pedantic)]
 #![warn(clippy::nursery)]
-#![deny(unsafe_code)]  // Core library denies unsafe - only FFI module may allow it
+#![deny(unsafe_code)]  // Core library denies unsafe - only FFI and the PTY spawn hook may allow it
 #![allow(clippy::module_name_repetitions)]
 #![allow(clippy::must_use_candidate)]
 #![allow(clippy::similar_names)]
@@ -44,14 +44,21 @@ pub mod widget;
 pub mod ffi;
 
 // Re-exports for convenience
-pub use buffer::{Buffer, Cell, CellFlags, Modifiers, Rgb, RopeBuffer, ChunkedLine, RopeMemoryStats};
+pub use buffer::{
+    Buffer, Cell, CellFlags, ColorMode, Modifiers, Rgb, RopeBuffer, ChunkedLine, LineCells,
+    RopeMemoryStats, SearchMatch, SearchQuery,
+};
 pub use layout::{Layout, Rect, Region, RegionId};
-pub use actor::{Engine, EngineConfig, InputEvent, KeyCode, KeyModifiers, RenderCommand, AgentEvent, TickerActor, Tick};
+pub use actor::{
+    Engine, EngineConfig, InputEvent, KeyCode, KeyModifiers, RenderCommand, AgentEvent, TickerActor,
+    Tick, TokenRouter, RoutedFrame, FrameOutput,
+};
 pub use widget::{
-    Widget, StreamWidget, StreamConfig, AppendResult, ScrollBuffer,
+    Widget, StreamWidget, StreamConfig, AppendResult, ScrollBuffer, FoldId, StreamWriter,
+    Highlighter, Markdown, Syntax, Theme,
     TextInput, TextInputConfig,
     StatusBar, StatusBarConfig,
     ProgressBar, ProgressBarConfig, ProgressStyle,
-    Terminal,
+    Terminal, LogView, Vt,
 };
 
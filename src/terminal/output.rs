@@ -1,5 +1,6 @@
 //! `OutputBuffer`: Single-syscall output buffer for ANSI sequences.
 
+use crate::buffer::palette::{self, ColorMode};
 use crate::buffer::Rgb;
 use std::io::Write;
 
@@ -79,16 +80,16 @@ impl OutputBuffer {
         self.data.extend_from_slice(b"\x1b[?25h");
     }
 
-    /// Set foreground color (true color).
+    /// Set foreground color (true color, or the palette index it came from).
     #[inline]
     pub fn set_fg(&mut self, color: Rgb) {
-        write!(self.data, "\x1b[38;2;{};{};{}m", color.r, color.g, color.b).unwrap();
+        palette::write_fg(&mut self.data, color, ColorMode::TrueColor);
     }
 
-    /// Set background color (true color).
+    /// Set background color (true color, or the palette index it came from).
     #[inline]
     pub fn set_bg(&mut self, color: Rgb) {
-        write!(self.data, "\x1b[48;2;{};{};{}m", color.r, color.g, color.b).unwrap();
+        palette::write_bg(&mut self.data, color, ColorMode::TrueColor);
     }
 
     /// Reset all attributes.
@@ -0,0 +1,500 @@
+//! ANSI Ingestion: A minimal SGR/CSI state machine for colored text.
+//!
+//! Tool output often carries color codes. Rather than emulating a terminal,
+//! this parser separates text from escape sequences, turns SGR (Select
+//! Graphic Rendition) sequences into style changes and drops everything
+//! else, including cursor movement. It keeps its state between calls, so
+//! sequences split across tokens are handled, and it never allocates.
+
+use crate::buffer::{Modifiers, Rgb};
+
+/// Maximum number of parameters kept for one CSI sequence.
+const MAX_PARAMS: usize = 16;
+
+/// SGR codes for each modifier, in emission order.
+pub const MODIFIER_CODES: [(Modifiers, u8); 8] = [
+    (Modifiers::BOLD, 1),
+    (Modifiers::DIM, 2),
+    (Modifiers::ITALIC, 3),
+    (Modifiers::UNDERLINE, 4),
+    (Modifiers::BLINK, 5),
+    (Modifiers::REVERSED, 7),
+    (Modifiers::HIDDEN, 8),
+    (Modifiers::STRIKETHROUGH, 9),
+];
+
+/// Parser state between bytes.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum State {
+    /// Plain text.
+    Ground,
+    /// After ESC.
+    Escape,
+    /// Inside an ESC sequence with intermediate bytes.
+    EscIntermediate,
+    /// Collecting CSI parameters.
+    Csi,
+    /// Inside a malformed or unsupported CSI sequence.
+    CsiIgnore,
+    /// Inside an OSC string, terminated by BEL or ST.
+    Osc,
+    /// Inside a DCS/SOS/PM/APC string, terminated by ST.
+    Str,
+}
+
+const STATE_COUNT: usize = 7;
+const STATES: [State; STATE_COUNT] = [
+    State::Ground,
+    State::Escape,
+    State::EscIntermediate,
+    State::Csi,
+    State::CsiIgnore,
+    State::Osc,
+    State::Str,
+];
+
+/// Byte classes that drive transitions.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Class {
+    /// `0`-`9`
+    Digit,
+    /// `;` and `:`
+    Separator,
+    /// `<`, `=`, `>`, `?`
+    Private,
+    /// `0x20`-`0x2F`
+    Intermediate,
+    /// `[`
+    CsiIntro,
+    /// `]`
+    OscIntro,
+    /// `P`, `X`, `^`, `_`
+    StrIntro,
+    /// Any other byte in `0x40`-`0x7E`
+    Final,
+    /// ESC
+    Esc,
+    /// BEL
+    Bel,
+    /// CAN and SUB abort a sequence
+    Cancel,
+    /// Other control characters, DEL and non-ASCII bytes
+    Other,
+}
+
+const CLASS_COUNT: usize = 12;
+const CLASSES: [Class; CLASS_COUNT] = [
+    Class::Digit,
+    Class::Separator,
+    Class::Private,
+    Class::Intermediate,
+    Class::CsiIntro,
+    Class::OscIntro,
+    Class::StrIntro,
+    Class::Final,
+    Class::Esc,
+    Class::Bel,
+    Class::Cancel,
+    Class::Other,
+];
+
+/// Work to do on a transition.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Action {
+    None,
+    /// Start a new CSI sequence.
+    Clear,
+    /// Accumulate a parameter digit.
+    Digit,
+    /// Start the next parameter.
+    Separator,
+    /// Mark the sequence as private (`CSI ? ...`).
+    Private,
+    /// Complete a CSI sequence.
+    Dispatch,
+}
+
+/// Classify a byte.
+const fn classify(b: u8) -> Class {
+    match b {
+        b'0'..=b'9' => Class::Digit,
+        b';' | b':' => Class::Separator,
+        b'<'..=b'?' => Class::Private,
+        0x20..=0x2F => Class::Intermediate,
+        b'[' => Class::CsiIntro,
+        b']' => Class::OscIntro,
+        b'P' | b'X' | b'^' | b'_' => Class::StrIntro,
+        0x40..=0x7E => Class::Final,
+        0x1B => Class::Esc,
+        0x07 => Class::Bel,
+        0x18 | 0x1A => Class::Cancel,
+        _ => Class::Other,
+    }
+}
+
+/// The transition function, evaluated once at compile time into [`TRANSITIONS`].
+#[allow(clippy::match_same_arms)] // Arms are grouped by state, not by outcome
+const fn transition(state: State, class: Class) -> (State, Action) {
+    use Class as C;
+    use State as S;
+
+    match (state, class) {
+        // ESC always starts a new sequence; it is also the first byte of ST
+        (_, C::Esc) => (S::Escape, Action::None),
+        (_, C::Cancel) => (S::Ground, Action::None),
+
+        (S::Escape, C::CsiIntro) => (S::Csi, Action::Clear),
+        (S::Escape, C::OscIntro) => (S::Osc, Action::None),
+        (S::Escape, C::StrIntro) => (S::Str, Action::None),
+        (S::Escape | S::EscIntermediate, C::Intermediate) => (S::EscIntermediate, Action::None),
+        (
+            S::Escape | S::EscIntermediate,
+            C::Digit
+            | C::Separator
+            | C::Private
+            | C::CsiIntro
+            | C::OscIntro
+            | C::StrIntro
+            | C::Final,
+        ) => (S::Ground, Action::None),
+
+        (S::Csi, C::Digit) => (S::Csi, Action::Digit),
+        (S::Csi, C::Separator) => (S::Csi, Action::Separator),
+        (S::Csi, C::Private) => (S::Csi, Action::Private),
+        (S::Csi, C::Intermediate) => (S::CsiIgnore, Action::None),
+        (S::Csi, C::CsiIntro | C::OscIntro | C::StrIntro | C::Final) => {
+            (S::Ground, Action::Dispatch)
+        },
+        (S::CsiIgnore, C::CsiIntro | C::OscIntro | C::StrIntro | C::Final) => {
+            (S::Ground, Action::None)
+        },
+
+        (S::Osc, C::Bel) => (S::Ground, Action::None),
+
+        // Everything else is ignored in place
+        (state, _) => (state, Action::None),
+    }
+}
+
+/// Byte class lookup table.
+const BYTE_CLASSES: [Class; 256] = {
+    let mut table = [Class::Other; 256];
+    let mut i = 0;
+    while i < 256 {
+        #[allow(clippy::cast_possible_truncation)]
+        {
+            table[i] = classify(i as u8);
+        }
+        i += 1;
+    }
+    table
+};
+
+/// State transition table, indexed by state then byte class.
+const TRANSITIONS: [[(State, Action); CLASS_COUNT]; STATE_COUNT] = {
+    let mut table = [[(State::Ground, Action::None); CLASS_COUNT]; STATE_COUNT];
+    let mut s = 0;
+    while s < STATE_COUNT {
+        let mut c = 0;
+        while c < CLASS_COUNT {
+            table[s][c] = transition(STATES[s], CLASSES[c]);
+            c += 1;
+        }
+        s += 1;
+    }
+    table
+};
+
+/// Parameters of a completed SGR sequence.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SgrParams {
+    /// Parameter values; missing parameters are 0.
+    values: [u16; MAX_PARAMS],
+    /// Number of parameters present (at least 1).
+    len: u8,
+}
+
+impl SgrParams {
+    /// A single empty parameter, as for `CSI m`.
+    const fn new() -> Self {
+        Self {
+            values: [0; MAX_PARAMS],
+            len: 1,
+        }
+    }
+
+    /// Get the parameters as a slice.
+    pub fn as_slice(&self) -> &[u16] {
+        &self.values[..self.len as usize]
+    }
+}
+
+/// Text style tracked while parsing.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Pen {
+    /// Foreground color.
+    pub fg: Rgb,
+    /// Background color.
+    pub bg: Rgb,
+    /// Text modifiers.
+    pub modifiers: Modifiers,
+}
+
+impl Pen {
+    /// Apply an SGR sequence.
+    ///
+    /// # Arguments
+    /// * `params` - The sequence parameters.
+    /// * `default_fg` / `default_bg` - Colors restored by codes 0, 39 and 49.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn apply_sgr(&mut self, params: &[u16], default_fg: Rgb, default_bg: Rgb) {
+        let mut i = 0;
+        while i < params.len() {
+            match params[i] {
+                0 => {
+                    self.fg = default_fg;
+                    self.bg = default_bg;
+                    self.modifiers = Modifiers::empty();
+                },
+                21 => self.modifiers.insert(Modifiers::UNDERLINE),
+                22 => self.modifiers.remove(Modifiers::BOLD | Modifiers::DIM),
+                6 => self.modifiers.insert(Modifiers::BLINK),
+                code @ 1..=9 => self.modifiers.insert(modifier_for(code)),
+                code @ 23..=29 => self.modifiers.remove(modifier_for(code - 20)),
+                code @ 30..=37 => self.fg = Rgb::from_ansi_index((code - 30) as u8),
+                code @ 40..=47 => self.bg = Rgb::from_ansi_index((code - 40) as u8),
+                code @ 90..=97 => self.fg = Rgb::from_ansi_index((code - 90 + 8) as u8),
+                code @ 100..=107 => self.bg = Rgb::from_ansi_index((code - 100 + 8) as u8),
+                39 => self.fg = default_fg,
+                49 => self.bg = default_bg,
+                code @ (38 | 48) => {
+                    let Some((color, used)) = extended_color(&params[i + 1..]) else {
+                        // Malformed: the remaining parameters can't be trusted
+                        return;
+                    };
+                    if code == 38 {
+                        self.fg = color;
+                    } else {
+                        self.bg = color;
+                    }
+                    i += used;
+                },
+                _ => {},
+            }
+            i += 1;
+        }
+    }
+}
+
+/// Look up the modifier set by an SGR code, if any.
+fn modifier_for(code: u16) -> Modifiers {
+    MODIFIER_CODES
+        .iter()
+        .find(|&&(_, c)| u16::from(c) == code)
+        .map_or(Modifiers::empty(), |&(modifier, _)| modifier)
+}
+
+/// Decode the color after a 38/48 code.
+///
+/// Returns the color and how many parameters it used.
+#[allow(clippy::cast_possible_truncation)]
+fn extended_color(params: &[u16]) -> Option<(Rgb, usize)> {
+    let channel = |v: u16| v.min(255) as u8;
+    match *params {
+        [5, index, ..] => Some((Rgb::from_ansi_index(channel(index)), 2)),
+        [2, r, g, b, ..] => Some((Rgb::new(channel(r), channel(g), channel(b)), 4)),
+        _ => None,
+    }
+}
+
+/// A piece of parsed input.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum AnsiEvent<'a> {
+    /// Text to display, possibly including control characters other than ESC.
+    Text(&'a str),
+    /// An SGR sequence to apply to the current style.
+    Sgr(SgrParams),
+}
+
+/// Incremental parser for text interleaved with ANSI escape sequences.
+#[derive(Debug, Clone, Copy)]
+pub struct AnsiParser {
+    /// Current state.
+    state: State,
+    /// Parameters of the CSI sequence being collected.
+    params: SgrParams,
+    /// Whether the CSI sequence has a private marker.
+    private: bool,
+}
+
+impl Default for AnsiParser {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl AnsiParser {
+    /// Create a parser in the ground state.
+    pub const fn new() -> Self {
+        Self {
+            state: State::Ground,
+            params: SgrParams::new(),
+            private: false,
+        }
+    }
+
+    /// Parse a chunk of input.
+    ///
+    /// Escape sequences may be split across chunks.
+    ///
+    /// # Returns
+    /// An iterator over the text runs and SGR sequences in `text`.
+    pub const fn feed<'p, 't>(&'p mut self, text: &'t str) -> AnsiEvents<'p, 't> {
+        AnsiEvents {
+            parser: self,
+            text,
+            pos: 0,
+        }
+    }
+
+    /// Process one byte of an escape sequence.
+    ///
+    /// Returns the completed SGR parameters, if this byte finished one.
+    fn advance(&mut self, b: u8) -> Option<SgrParams> {
+        let (next, action) = TRANSITIONS[self.state as usize][BYTE_CLASSES[b as usize] as usize];
+        self.state = next;
+
+        match action {
+            Action::None => {},
+            Action::Clear => {
+                self.params = SgrParams::new();
+                self.private = false;
+            },
+            Action::Digit => {
+                let slot = &mut self.params.values[self.params.len as usize - 1];
+                *slot = slot.saturating_mul(10).saturating_add(u16::from(b - b'0'));
+            },
+            Action::Separator => {
+                if (self.params.len as usize) < MAX_PARAMS {
+                    self.params.len += 1;
+                }
+            },
+            Action::Private => self.private = true,
+            Action::Dispatch => {
+                if b == b'm' && !self.private {
+                    return Some(self.params);
+                }
+            },
+        }
+        None
+    }
+}
+
+/// Iterator over the events in one chunk of input. See [`AnsiParser::feed`].
+pub struct AnsiEvents<'p, 't> {
+    parser: &'p mut AnsiParser,
+    text: &'t str,
+    pos: usize,
+}
+
+impl<'t> Iterator for AnsiEvents<'_, 't> {
+    type Item = AnsiEvent<'t>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let bytes = self.text.as_bytes();
+        while self.pos < bytes.len() {
+            if self.parser.state == State::Ground {
+                // Text runs until the next ESC, which is always a char boundary
+                let start = self.pos;
+                self.pos = bytes[start..]
+                    .iter()
+                    .position(|&b| b == 0x1B)
+                    .map_or(bytes.len(), |n| start + n);
+                if self.pos > start {
+                    return Some(AnsiEvent::Text(&self.text[start..self.pos]));
+                }
+            }
+
+            let b = bytes[self.pos];
+            self.pos += 1;
+            if let Some(params) = self.parser.advance(b) {
+                return Some(AnsiEvent::Sgr(params));
+            }
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn apply(parser: &mut AnsiParser, pen: &mut Pen, input: &str) -> String {
+        let mut text = String::new();
+        for event in parser.feed(input) {
+            match event {
+                AnsiEvent::Text(t) => text.push_str(t),
+                AnsiEvent::Sgr(params) => pen.apply_sgr(params.as_slice(), Rgb::WHITE, Rgb::BLACK),
+            }
+        }
+        text
+    }
+
+    #[test]
+    fn test_ansi_sgr_colors_and_modifiers() {
+        let mut parser = AnsiParser::new();
+        let mut pen = Pen {
+            fg: Rgb::WHITE,
+            bg: Rgb::BLACK,
+            modifiers: Modifiers::empty(),
+        };
+
+        let text = apply(
+            &mut parser,
+            &mut pen,
+            "\x1b[1;31merror\x1b[0m: \x1b[38;2;1;2;3;48;5;196mx",
+        );
+        assert_eq!(text, "error: x");
+        assert_eq!(pen.fg, Rgb::new(1, 2, 3));
+        assert_eq!(pen.bg, Rgb::from_ansi_index(196));
+        assert_eq!(pen.bg.index(), Some(196));
+        assert!(pen.modifiers.is_empty());
+
+        apply(&mut parser, &mut pen, "\x1b[1;4;9m\x1b[24;39m");
+        assert_eq!(pen.modifiers, Modifiers::BOLD | Modifiers::STRIKETHROUGH);
+        assert_eq!(pen.fg, Rgb::WHITE);
+    }
+
+    #[test]
+    fn test_ansi_ignores_other_sequences() {
+        let mut parser = AnsiParser::new();
+        let mut pen = Pen {
+            fg: Rgb::WHITE,
+            bg: Rgb::BLACK,
+            modifiers: Modifiers::empty(),
+        };
+
+        let text = apply(
+            &mut parser,
+            &mut pen,
+            "a\x1b[2J\x1b[10;5Hb\x1b[?25lc\x1b]0;title\x07d\x1b]8;;http://x\x1b\\e\x1b(Bf",
+        );
+        assert_eq!(text, "abcdef");
+        assert_eq!(pen.fg, Rgb::WHITE);
+    }
+
+    #[test]
+    fn test_ansi_split_across_chunks() {
+        let mut parser = AnsiParser::new();
+        let mut pen = Pen {
+            fg: Rgb::WHITE,
+            bg: Rgb::BLACK,
+            modifiers: Modifiers::empty(),
+        };
+
+        let mut text = apply(&mut parser, &mut pen, "ok \x1b[3");
+        text += &apply(&mut parser, &mut pen, "2mdone");
+        assert_eq!(text, "ok done");
+        assert_eq!(pen.fg, Rgb::from_ansi_index(2));
+    }
+}
@@ -0,0 +1,469 @@
+//! Fold Index: Maps viewport rows to scrollback lines around folded regions.
+//!
+//! A fold region is a range of line ids that can be hidden and shown
+//! again without touching the lines themselves. Regions may nest or
+//! overlap; a line is hidden while any folded region covers it.
+//!
+//! # Structure
+//!
+//! Region boundaries split the id space into elementary intervals, the
+//! leaves of a segment tree. Each node keeps the minimum cover count of
+//! its leaves and how many lines sit at that minimum, so folding or
+//! unfolding a region is a range add and mapping a row to a line is a
+//! single descent: both O(log F) in the number of boundaries, however
+//! many lines a region spans.
+//!
+//! Boundaries are only ever added at the end of the buffer, so new leaves
+//! are appended; the tree is rebuilt when it runs out of leaves, dropping
+//! regions whose lines have all been evicted.
+
+use std::collections::HashMap;
+use std::ops::Range;
+
+/// Leaves allocated when the tree is first built.
+const MIN_LEAVES: usize = 16;
+
+/// Handle to a fold region in a [`ScrollBuffer`](super::ScrollBuffer).
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct FoldId(u64);
+
+/// A fold region over line ids.
+#[derive(Debug, Clone, Copy)]
+struct Fold {
+    /// First line id in the region.
+    start: usize,
+    /// Line id just past the region, or `None` while it is still open.
+    end: Option<usize>,
+    /// Whether the region is hidden.
+    folded: bool,
+}
+
+/// Segment tree of cover counts over weighted leaves.
+///
+/// Adds are kept at the node they were applied to rather than pushed
+/// down, so `min[node]` is relative to the node's ancestors.
+#[derive(Debug, Default)]
+struct CoverTree {
+    /// Number of leaves (a power of two, or 0 before the first build).
+    leaves: usize,
+    /// Minimum cover count below each node, including its own add.
+    min: Vec<u32>,
+    /// Cover count added to each whole node.
+    add: Vec<u32>,
+    /// Number of lines below each node at the minimum cover count.
+    at_min: Vec<usize>,
+}
+
+impl CoverTree {
+    /// Build a tree with every cover count zero.
+    fn build(leaves: usize, weights: impl Iterator<Item = usize>) -> Self {
+        let leaves = leaves.next_power_of_two().max(MIN_LEAVES);
+        let mut tree = Self {
+            leaves,
+            min: vec![0; 2 * leaves],
+            add: vec![0; 2 * leaves],
+            at_min: vec![0; 2 * leaves],
+        };
+        for (leaf, weight) in weights.enumerate() {
+            tree.at_min[leaves + leaf] = weight;
+        }
+        for node in (1..leaves).rev() {
+            tree.pull(node);
+        }
+        tree
+    }
+
+    /// Recompute a node from its children.
+    fn pull(&mut self, node: usize) {
+        let (left, right) = (2 * node, 2 * node + 1);
+        let min = self.min[left].min(self.min[right]);
+        let at_min = |child: usize| {
+            if self.min[child] == min {
+                self.at_min[child]
+            } else {
+                0
+            }
+        };
+        self.at_min[node] = at_min(left) + at_min(right);
+        self.min[node] = min + self.add[node];
+    }
+
+    /// Set the weight of an uncovered leaf.
+    fn set_weight(&mut self, leaf: usize, weight: usize) {
+        let mut node = self.leaves + leaf;
+        self.at_min[node] = weight;
+        while node > 1 {
+            node /= 2;
+            self.pull(node);
+        }
+    }
+
+    /// Add `delta` to the cover count of leaves in `range`.
+    fn update(&mut self, range: &Range<usize>, delta: i32) {
+        self.update_node(1, 0..self.leaves, range, delta);
+    }
+
+    fn update_node(&mut self, node: usize, span: Range<usize>, range: &Range<usize>, delta: i32) {
+        if range.end <= span.start || span.end <= range.start {
+            return;
+        }
+        if range.start <= span.start && span.end <= range.end {
+            self.min[node] = self.min[node].wrapping_add_signed(delta);
+            self.add[node] = self.add[node].wrapping_add_signed(delta);
+            return;
+        }
+        let mid = span.start.midpoint(span.end);
+        self.update_node(2 * node, span.start..mid, range, delta);
+        self.update_node(2 * node + 1, mid..span.end, range, delta);
+        self.pull(node);
+    }
+
+    /// Count uncovered lines in leaves `0..end`.
+    fn uncovered_before(&self, end: usize) -> usize {
+        let (mut node, mut span, mut above) = (1, 0..self.leaves, 0);
+        let mut count = 0;
+        while span.start < end {
+            if self.min[node] + above > 0 {
+                break;
+            }
+            if span.end <= end {
+                count += self.at_min[node];
+                break;
+            }
+            // Take the whole left half if it is in range, then go right
+            above += self.add[node];
+            let mid = span.start.midpoint(span.end);
+            let left = 2 * node;
+            if end <= mid {
+                node = left;
+                span = span.start..mid;
+            } else {
+                if self.min[left] + above == 0 {
+                    count += self.at_min[left];
+                }
+                node = left + 1;
+                span = mid..span.end;
+            }
+        }
+        count
+    }
+
+    /// Get the cover count of a leaf.
+    fn cover(&self, leaf: usize) -> u32 {
+        let mut node = self.leaves + leaf;
+        let mut cover = self.min[node];
+        while node > 1 {
+            node /= 2;
+            cover += self.add[node];
+        }
+        cover
+    }
+
+    /// Get the total number of uncovered lines.
+    fn uncovered(&self) -> usize {
+        if self.min.get(1).copied().unwrap_or_default() == 0 {
+            self.at_min.get(1).copied().unwrap_or_default()
+        } else {
+            0
+        }
+    }
+
+    /// Find the `n`th uncovered line, as (leaf, offset within the leaf).
+    ///
+    /// `n` must be less than [`uncovered`](Self::uncovered).
+    fn nth_uncovered(&self, mut n: usize) -> (usize, usize) {
+        let (mut node, mut above) = (1, 0);
+        while node < self.leaves {
+            above += self.add[node];
+            let left = 2 * node;
+            let in_left = if self.min[left] + above == 0 {
+                self.at_min[left]
+            } else {
+                0
+            };
+            if n < in_left {
+                node = left;
+            } else {
+                n -= in_left;
+                node = left + 1;
+            }
+        }
+        (node - self.leaves, n)
+    }
+}
+
+/// Index of fold regions over line ids.
+///
+/// Line ids increase by one per line and are never reused, so regions
+/// stay attached to their lines as older lines are evicted.
+#[derive(Debug, Default)]
+pub struct FoldIndex {
+    /// Regions by handle.
+    folds: HashMap<u64, Fold>,
+    /// Handle of the next region.
+    next_id: u64,
+    /// Sorted region boundaries; leaf `i` spans ids `boundaries[i]..boundaries[i + 1]`.
+    boundaries: Vec<usize>,
+    /// Cover counts of the leaves.
+    tree: CoverTree,
+    /// Number of folded regions.
+    folded: usize,
+    /// Id of the oldest line still in the buffer.
+    first: usize,
+}
+
+impl FoldIndex {
+    /// Create an empty index.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Record that lines with ids below `first` have been evicted.
+    ///
+    /// Regions that lie entirely before it are dropped the next time the
+    /// tree is rebuilt.
+    pub const fn evict_before(&mut self, first: usize) {
+        self.first = first;
+    }
+
+    /// Check if any region is folded, so some lines may be hidden.
+    pub const fn any_folded(&self) -> bool {
+        self.folded > 0
+    }
+
+    /// Open a region starting at line id `start`.
+    ///
+    /// `start` must not be before any boundary already added.
+    pub fn begin(&mut self, start: usize) -> FoldId {
+        let id = self.next_id;
+        self.next_id += 1;
+        self.folds.insert(
+            id,
+            Fold {
+                start,
+                end: None,
+                folded: false,
+            },
+        );
+        self.push_boundary(start);
+        FoldId(id)
+    }
+
+    /// Close a region just before line id `end`.
+    ///
+    /// Returns `false` if the region doesn't exist or is already closed.
+    pub fn end(&mut self, id: FoldId, end: usize) -> bool {
+        let Some(fold) = self.folds.get_mut(&id.0) else {
+            return false;
+        };
+        if fold.end.is_some() {
+            return false;
+        }
+        let end = end.max(fold.start);
+        fold.end = Some(end);
+        self.push_boundary(end);
+        true
+    }
+
+    /// Fold or unfold a closed region.
+    ///
+    /// Returns `false` if the region doesn't exist, is still open, or was
+    /// already in that state.
+    pub fn set_folded(&mut self, id: FoldId, folded: bool) -> bool {
+        let Some(fold) = self.folds.get_mut(&id.0) else {
+            return false;
+        };
+        let Some(end) = fold.end else {
+            return false;
+        };
+        if fold.folded == folded {
+            return false;
+        }
+        fold.folded = folded;
+        let start = fold.start;
+        let leaves = self.leaf_of(start)..self.leaf_of(end);
+        self.tree.update(&leaves, if folded { 1 } else { -1 });
+        if folded {
+            self.folded += 1;
+        } else {
+            self.folded -= 1;
+        }
+        true
+    }
+
+    /// Check if a region is folded.
+    pub fn is_folded(&self, id: FoldId) -> bool {
+        self.folds.get(&id.0).is_some_and(|fold| fold.folded)
+    }
+
+    /// Count the visible lines with ids below `id`.
+    pub fn visible_before(&self, id: usize) -> usize {
+        let (Some(&first), Some(&last)) = (self.boundaries.first(), self.boundaries.last()) else {
+            return id;
+        };
+        if id <= first {
+            return id;
+        }
+        if id >= last {
+            return first + self.tree.uncovered() + (id - last);
+        }
+        // Whole leaves before the one holding `id`, then part of that one
+        let leaf = self.boundaries.partition_point(|&b| b <= id) - 1;
+        let partial = if self.tree.cover(leaf) == 0 {
+            id - self.boundaries[leaf]
+        } else {
+            0
+        };
+        first + self.tree.uncovered_before(leaf) + partial
+    }
+
+    /// Get the id of the `n`th visible line, counting from id 0.
+    pub fn nth_visible(&self, n: usize) -> usize {
+        let (Some(&first), Some(&last)) = (self.boundaries.first(), self.boundaries.last()) else {
+            return n;
+        };
+        if n < first {
+            return n;
+        }
+        let n = n - first;
+        let uncovered = self.tree.uncovered();
+        if n >= uncovered {
+            return last + (n - uncovered);
+        }
+        let (leaf, offset) = self.tree.nth_uncovered(n);
+        self.boundaries[leaf] + offset
+    }
+
+    /// Check if the line with the given id is hidden.
+    pub fn is_hidden(&self, id: usize) -> bool {
+        if !self.any_folded() {
+            return false;
+        }
+        let leaf = self.boundaries.partition_point(|&b| b <= id);
+        leaf > 0 && leaf < self.boundaries.len() && self.tree.cover(leaf - 1) > 0
+    }
+
+    /// Get the sorted region boundaries.
+    pub fn boundaries(&self) -> &[usize] {
+        &self.boundaries
+    }
+
+    /// Move every region boundary through `map`, which must keep their
+    /// order, after the lines were renumbered from `first`.
+    pub fn remap(&mut self, first: usize, map: impl Fn(usize) -> usize) {
+        for fold in self.folds.values_mut() {
+            fold.start = map(fold.start);
+            fold.end = fold.end.map(&map);
+        }
+        self.first = first;
+        self.rebuild();
+    }
+
+    /// Drop every region.
+    pub fn clear(&mut self) {
+        self.folds.clear();
+        self.boundaries.clear();
+        self.tree = CoverTree::default();
+        self.folded = 0;
+        self.first = 0;
+    }
+
+    /// Get the leaf starting at boundary `id`.
+    fn leaf_of(&self, id: usize) -> usize {
+        self.boundaries.partition_point(|&b| b < id)
+    }
+
+    /// Add a boundary at the end of the id space, growing the tree.
+    fn push_boundary(&mut self, id: usize) {
+        match self.boundaries.last() {
+            Some(&last) if last >= id => return,
+            Some(&last) if self.boundaries.len() <= self.tree.leaves => {
+                // The new leaf is past every closed region, so uncovered
+                self.tree.set_weight(self.boundaries.len() - 1, id - last);
+                self.boundaries.push(id);
+                return;
+            },
+            _ => {},
+        }
+        self.rebuild();
+    }
+
+    /// Rebuild the tree from the regions, dropping evicted ones.
+    fn rebuild(&mut self) {
+        let first = self.first;
+        self.folds
+            .retain(|_, fold| fold.end.is_none_or(|end| end > first));
+        let mut boundaries: Vec<usize> = self
+            .folds
+            .values()
+            .flat_map(|fold| [Some(fold.start), fold.end])
+            .flatten()
+            .collect();
+        boundaries.sort_unstable();
+        boundaries.dedup();
+        self.boundaries = boundaries;
+
+        let weights = self.boundaries.windows(2).map(|pair| pair[1] - pair[0]);
+        self.tree = CoverTree::build(2 * self.boundaries.len(), weights);
+        self.folded = 0;
+        let folded: Vec<Range<usize>> = self
+            .folds
+            .values()
+            .filter(|fold| fold.folded)
+            .filter_map(|fold| Some(fold.start..fold.end?))
+            .collect();
+        for range in folded {
+            let leaves = self.leaf_of(range.start)..self.leaf_of(range.end);
+            self.tree.update(&leaves, 1);
+            self.folded += 1;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_fold_index_maps_rows() {
+        let mut index = FoldIndex::new();
+        let outer = index.begin(10);
+        let inner = index.begin(20);
+        assert!(index.end(inner, 30));
+        assert!(index.end(outer, 50_010));
+
+        assert!(index.set_folded(inner, true));
+        assert_eq!(index.visible_before(40), 30);
+        assert_eq!(index.nth_visible(25), 35);
+        assert!(index.is_hidden(29) && !index.is_hidden(30));
+
+        // Nested: unfolding the outer region keeps the inner one hidden
+        assert!(index.set_folded(outer, true));
+        assert_eq!(index.visible_before(60_000), 60_000 - 50_000);
+        assert_eq!(index.nth_visible(10), 50_010);
+        assert!(index.set_folded(outer, false));
+        assert_eq!(index.nth_visible(20), 30);
+
+        assert!(index.set_folded(inner, false));
+        assert!(!index.any_folded());
+        assert_eq!(index.nth_visible(12_345), 12_345);
+    }
+
+    #[test]
+    fn test_fold_index_grows_and_prunes() {
+        let mut index = FoldIndex::new();
+        let mut ids = Vec::new();
+        for i in 0..100 {
+            let id = index.begin(i * 10);
+            index.end(id, i * 10 + 5);
+            index.set_folded(id, true);
+            ids.push(id);
+        }
+
+        // Every region hides 5 of each 10 lines
+        assert_eq!(index.visible_before(1000), 500);
+        assert_eq!(index.nth_visible(7), 17);
+        assert!(index.boundaries().len() <= 200);
+        assert!(ids.iter().all(|&id| index.is_folded(id)));
+    }
+}
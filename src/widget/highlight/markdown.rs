@@ -0,0 +1,386 @@
+//! Markdown lexer with fenced code blocks handed to per-language lexers.
+//!
+//! Agent output is mostly Markdown: headings, lists, emphasis and inline
+//! code around fenced blocks of source. The fence's info string picks the
+//! lexer for the block, whose state rides along in the upper half of the
+//! Markdown state so that a block resumes exactly where it left off.
+
+use super::syntax::Syntax;
+use super::{Class, LexState, Lexer, Token};
+use std::fmt;
+
+/// State bit set once a token has been lexed on the current line.
+const MID_LINE: LexState = 1;
+
+/// Shift of the open fence's kind: 0 for none, 1 for backticks, 2 for tildes.
+const FENCE_SHIFT: u32 = 1;
+
+/// Mask of the fence kind, after shifting.
+const FENCE: LexState = 0b11;
+
+/// Shift of the fenced block's language: its index plus one, or 0 for none.
+const LANG_SHIFT: u32 = 3;
+
+/// Mask of the language, after shifting.
+const LANG: LexState = 0xFF;
+
+/// State bit set inside inline code.
+const CODE: LexState = 1 << 11;
+
+/// State bit set inside strong emphasis.
+const STRONG: LexState = 1 << 12;
+
+/// State bit set inside emphasis.
+const EMPH: LexState = 1 << 13;
+
+/// State bit set on a heading line.
+const HEADING: LexState = 1 << 14;
+
+/// State bit set on the line closing a fence.
+const FENCE_LINE: LexState = 1 << 15;
+
+/// Bits of the state that belong to Markdown; the rest is the fenced
+/// block's lexer state.
+const OUTER: LexState = 0xFFFF_FFFF;
+
+/// Fence markers, by kind minus one.
+const FENCES: [&str; 2] = ["```", "~~~"];
+
+/// Most languages a fence can refer to.
+const MAX_LANGUAGES: usize = 255;
+
+/// Lexer registered for fenced blocks.
+struct Language {
+    /// Info-string names, in lowercase.
+    names: Vec<String>,
+    /// Lexer for the block's lines.
+    lexer: Box<dyn Lexer>,
+}
+
+/// Lexer for Markdown.
+///
+/// Styles headings, list and quote markers, `*` and `**` emphasis and
+/// inline code, and lexes fenced code blocks with the lexer registered for
+/// their info string. Blocks in unknown languages are styled as code.
+pub struct Markdown {
+    /// Languages for fenced blocks.
+    languages: Vec<Language>,
+}
+
+impl Markdown {
+    /// Create a Markdown lexer with the built-in languages: Rust, Python,
+    /// JSON and diffs.
+    pub fn new() -> Self {
+        let mut markdown = Self::without_languages();
+        markdown.add_language(&["rust", "rs"], Syntax::RUST);
+        markdown.add_language(&["python", "py", "python3"], Syntax::PYTHON);
+        markdown.add_language(&["json"], Syntax::JSON);
+        markdown.add_language(&["diff", "patch"], Syntax::DIFF);
+        markdown
+    }
+
+    /// Create a Markdown lexer that styles every fenced block as code.
+    pub const fn without_languages() -> Self {
+        Self {
+            languages: Vec::new(),
+        }
+    }
+
+    /// Lex fenced blocks whose info string starts with one of `names`.
+    ///
+    /// Names are matched case-insensitively; a later language takes over
+    /// names from an earlier one. The lexer's state must fit in 32 bits.
+    /// Languages past the 255th are never used.
+    pub fn add_language(&mut self, names: &[&str], lexer: impl Lexer + 'static) {
+        self.languages.push(Language {
+            names: names.iter().map(|name| name.to_lowercase()).collect(),
+            lexer: Box::new(lexer),
+        });
+    }
+
+    /// Find the language for a fence's info string, as its index plus one.
+    fn find(&self, info: &str) -> LexState {
+        let name = info
+            .trim_start()
+            .split(|c: char| c.is_whitespace() || c == ',' || c == '{')
+            .next()
+            .unwrap_or_default()
+            .to_lowercase();
+        let count = self.languages.len().min(MAX_LANGUAGES);
+        self.languages[..count]
+            .iter()
+            .rposition(|language| language.names.contains(&name))
+            .map_or(0, |index| index as LexState + 1)
+    }
+
+    /// Lex a token of a fenced block.
+    fn fenced(&self, text: &str, state: &mut LexState) -> Token {
+        let lang = ((*state >> LANG_SHIFT) & LANG) as usize;
+        let Some(language) = lang
+            .checked_sub(1)
+            .and_then(|index| self.languages.get(index))
+        else {
+            return Token::run(text.len(), Class::Code);
+        };
+        let mut inner = *state >> 32;
+        let token = language.lexer.token(text, &mut inner);
+        *state = (*state & OUTER) | ((inner & OUTER) << 32);
+        token
+    }
+
+    /// Lex a marker that only counts at the start of a line.
+    fn line_start(&self, text: &str, state: &mut LexState) -> Option<Token> {
+        for (kind, fence) in (1..).zip(FENCES) {
+            if let Some(info) = text.strip_prefix(fence) {
+                let lang = self.find(info.trim_start_matches(&fence[..1]));
+                *state = (*state & OUTER & !(FENCE << FENCE_SHIFT | LANG << LANG_SHIFT))
+                    | kind << FENCE_SHIFT
+                    | lang << LANG_SHIFT;
+                // The info string isn't settled until the line ends
+                return Some(Token::new(text.len(), Class::Markup));
+            }
+            if fence.starts_with(text) {
+                return Some(Token::new(text.len(), Class::Markup));
+            }
+        }
+
+        let bytes = text.as_bytes();
+        let marker = |len: usize, class: Class| match bytes.get(len) {
+            Some(b' ') => Some(Token::new(len + 1, class)),
+            None => Some(Token::new(len, Class::Plain)),
+            _ => None,
+        };
+        match bytes[0] {
+            b' ' => {
+                // Indentation: markers may still follow
+                *state &= !MID_LINE;
+                let len = text.find(|c| c != ' ').unwrap_or(text.len());
+                Some(Token::run(len, Class::Plain))
+            },
+            b'>' => {
+                *state &= !MID_LINE;
+                Some(Token::new(1, Class::Markup))
+            },
+            b'#' => {
+                let len = text.find(|c| c != '#').unwrap_or(text.len());
+                let token = marker(len, Class::Heading).filter(|_| len <= 6)?;
+                if token.class == Class::Heading {
+                    *state |= HEADING;
+                }
+                Some(token)
+            },
+            b'-' | b'*' | b'+' => marker(1, Class::Markup),
+            b'0'..=b'9' => {
+                let digits = text
+                    .find(|c: char| !c.is_ascii_digit())
+                    .unwrap_or(text.len());
+                match bytes.get(digits) {
+                    Some(b'.' | b')') => marker(digits + 1, Class::Markup),
+                    None => Some(Token::new(digits, Class::Plain)),
+                    _ => None,
+                }
+            },
+            _ => None,
+        }
+    }
+
+    /// Lex inline text.
+    fn inline(text: &str, state: &mut LexState) -> Token {
+        if *state & CODE != 0 {
+            let Some(end) = text.find('`') else {
+                return Token::run(text.len(), Class::Code);
+            };
+            *state &= !CODE;
+            return Token::new(end + 1, Class::Code);
+        }
+
+        let class = if *state & STRONG != 0 {
+            Class::Strong
+        } else if *state & EMPH != 0 {
+            Class::Emphasis
+        } else {
+            Class::Plain
+        };
+        let mut chars = text.chars();
+        match chars.next() {
+            Some('`') => {
+                *state |= CODE;
+                Token::new(1, Class::Code)
+            },
+            Some('*') => match chars.next() {
+                Some('*') => {
+                    *state ^= STRONG;
+                    Token::new(2, Class::Markup)
+                },
+                Some(next) if *state & EMPH != 0 || !next.is_whitespace() => {
+                    *state ^= EMPH;
+                    Token::new(1, Class::Markup)
+                },
+                _ => Token::new(1, class),
+            },
+            Some('\\') => {
+                let escaped = chars.next().map_or(0, char::len_utf8);
+                Token::new(1 + escaped, class)
+            },
+            _ => {
+                let len = text.find(['`', '*', '\\']).unwrap_or(text.len());
+                Token::run(len, class)
+            },
+        }
+    }
+}
+
+impl Default for Markdown {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl fmt::Debug for Markdown {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_list()
+            .entries(self.languages.iter().map(|language| &language.names))
+            .finish()
+    }
+}
+
+impl Lexer for Markdown {
+    fn token(&self, text: &str, state: &mut LexState) -> Token {
+        let line_start = *state & MID_LINE == 0;
+        *state |= MID_LINE;
+
+        let fence = (*state >> FENCE_SHIFT) & FENCE;
+        if fence != 0 {
+            let marker = FENCES[fence as usize - 1];
+            if line_start && text.starts_with(marker) {
+                *state =
+                    (*state & OUTER & !(FENCE << FENCE_SHIFT | LANG << LANG_SHIFT)) | FENCE_LINE;
+                return Token::run(text.len(), Class::Markup);
+            }
+            if line_start && marker.starts_with(text) {
+                return Token::new(text.len(), Class::Markup);
+            }
+            return self.fenced(text, state);
+        }
+
+        if *state & FENCE_LINE != 0 {
+            return Token::run(text.len(), Class::Markup);
+        }
+        if *state & HEADING != 0 {
+            return Token::run(text.len(), Class::Heading);
+        }
+        if line_start {
+            if let Some(token) = self.line_start(text, state) {
+                return token;
+            }
+        }
+        Self::inline(text, state)
+    }
+
+    fn end_line(&self, state: LexState) -> LexState {
+        let outer = state & OUTER & !(MID_LINE | CODE | STRONG | EMPH | HEADING | FENCE_LINE);
+        let lang = ((state >> LANG_SHIFT) & LANG) as usize;
+        let inner = match lang
+            .checked_sub(1)
+            .and_then(|index| self.languages.get(index))
+        {
+            Some(language) if (state >> FENCE_SHIFT) & FENCE != 0 => {
+                language.lexer.end_line(state >> 32) & OUTER
+            },
+            _ => 0,
+        };
+        outer | inner << 32
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Lex whole lines, returning each token's text and class.
+    fn lex(lexer: &impl Lexer, lines: &[&str]) -> Vec<(String, Class)> {
+        let mut state = 0;
+        let mut tokens = Vec::new();
+        for line in lines {
+            let mut pos = 0;
+            while pos < line.len() {
+                let token = lexer.token(&line[pos..], &mut state);
+                tokens.push((line[pos..pos + token.len].to_string(), token.class));
+                pos += token.len;
+            }
+            state = lexer.end_line(state);
+        }
+        tokens
+    }
+
+    /// Get the class of the first token with the given text.
+    fn class_of(tokens: &[(String, Class)], text: &str) -> Option<Class> {
+        tokens
+            .iter()
+            .find(|(t, _)| t == text)
+            .map(|&(_, class)| class)
+    }
+
+    #[test]
+    fn test_markdown_fenced_languages() {
+        let markdown = Markdown::new();
+        let tokens = lex(
+            &markdown,
+            &[
+                "## Plan",
+                "- use **bold** and `code`",
+                "```rust",
+                "fn main() { /* a",
+                "b */ }",
+                "```",
+                "```python",
+                "def f(): return None  # done",
+                "```",
+                "```json",
+                "{\"key\": [\"value\", 1, {\"inner\": true}]}",
+                "```",
+                "fn is prose again",
+            ],
+        );
+
+        assert_eq!(class_of(&tokens, "Plan"), Some(Class::Heading));
+        assert_eq!(class_of(&tokens, "- "), Some(Class::Markup));
+        assert_eq!(class_of(&tokens, "bold"), Some(Class::Strong));
+        assert_eq!(class_of(&tokens, "code`"), Some(Class::Code));
+        assert_eq!(class_of(&tokens, "fn"), Some(Class::Keyword));
+        assert_eq!(class_of(&tokens, "b */"), Some(Class::Comment));
+        assert_eq!(class_of(&tokens, "def"), Some(Class::Keyword));
+        assert_eq!(class_of(&tokens, "None"), Some(Class::Constant));
+        assert_eq!(class_of(&tokens, "# done"), Some(Class::Comment));
+        assert_eq!(class_of(&tokens, "key\""), Some(Class::Key));
+        assert_eq!(class_of(&tokens, "value\""), Some(Class::String));
+        assert_eq!(class_of(&tokens, "inner\""), Some(Class::Key));
+        assert_eq!(class_of(&tokens, "true"), Some(Class::Constant));
+        assert_eq!(tokens.last().map(|(_, class)| *class), Some(Class::Plain));
+    }
+
+    #[test]
+    fn test_diff_lines() {
+        let tokens = lex(
+            &Syntax::DIFF,
+            &["--- a/x", "+++ b/x", "@@ -1 +1 @@", "-old", "+new", " same"],
+        );
+        let classes: Vec<Class> = tokens.iter().map(|&(_, class)| class).collect();
+        assert_eq!(
+            classes,
+            [
+                Class::Meta,
+                Class::Meta,
+                Class::Meta,
+                Class::Meta,
+                Class::Meta,
+                Class::Meta,
+                Class::Removed,
+                Class::Removed,
+                Class::Added,
+                Class::Added,
+                Class::Plain,
+            ]
+        );
+    }
+}
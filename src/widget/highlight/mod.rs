@@ -0,0 +1,515 @@
+//! Incremental Highlighting: Styles streamed text as it is appended.
+//!
+//! A [`Highlighter`] sits in front of [`StreamWidget::append`] and splits
+//! each token into styled runs before it becomes cells. Highlighting is
+//! incremental:
+//!
+//! - The only lexer state kept is a checkpoint at the start of the current
+//!   line and one at the last token whose extent and class are settled.
+//! - New text is lexed from the settled checkpoint, so a token costs the
+//!   length of the unsettled tail (usually one word), not of the block.
+//! - Cells written earlier whose class changed (`fn` growing into
+//!   `fnord`, `/` becoming `//`) are restyled in place.
+//! - Finished lines are stored as styled cells, so rewrapping, scrolling
+//!   and folding never re-lex history.
+//!
+//! Lexers implement [`Lexer`]. [`Syntax`] is a table-driven lexer with
+//! built-in tables for Rust, Python, JSON and diffs; [`Markdown`] lexes
+//! prose and hands fenced code blocks to the lexer for their language.
+//!
+//! [`StreamWidget::append`]: super::StreamWidget::append
+
+mod markdown;
+mod syntax;
+
+pub use markdown::Markdown;
+pub use syntax::{Delimited, Syntax};
+
+use super::ansi::Pen;
+use crate::buffer::{Modifiers, Rgb};
+
+/// Lexer state carried from one token to the next.
+///
+/// Its meaning is up to the lexer. Zero is the state at the start of the
+/// first line.
+pub type LexState = u64;
+
+/// Syntactic class of a token, which the [`Theme`] maps to a style.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum Class {
+    /// Text without a class of its own.
+    Plain,
+    /// Language keyword.
+    Keyword,
+    /// Type name or lifetime.
+    Type,
+    /// Named constant such as `true` or `None`.
+    Constant,
+    /// String or character literal.
+    String,
+    /// Numeric literal.
+    Number,
+    /// Comment.
+    Comment,
+    /// Operator or punctuation.
+    Punctuation,
+    /// Attribute or decorator.
+    Attribute,
+    /// Object key.
+    Key,
+    /// Markdown heading.
+    Heading,
+    /// Markdown emphasis.
+    Emphasis,
+    /// Markdown strong emphasis.
+    Strong,
+    /// Markdown inline code, or a fenced block without a lexer.
+    Code,
+    /// Markdown syntax: fences, list and quote markers, emphasis markers.
+    Markup,
+    /// Line added in a diff.
+    Added,
+    /// Line removed from a diff.
+    Removed,
+    /// Diff headers and hunk markers.
+    Meta,
+}
+
+impl Class {
+    /// Number of classes.
+    pub const COUNT: usize = Self::Meta as usize + 1;
+}
+
+/// Token found by a [`Lexer`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Token {
+    /// Length in bytes; at least one character.
+    pub len: usize,
+    /// Class of the whole token.
+    pub class: Class,
+    /// Whether the token can be cut short at the end of the available
+    /// text, and lexing resumed there from the state it leaves.
+    pub split: bool,
+}
+
+impl Token {
+    /// Create a token whose extent or class may depend on what follows it.
+    pub const fn new(len: usize, class: Class) -> Self {
+        Self {
+            len,
+            class,
+            split: false,
+        }
+    }
+
+    /// Create a token that can be cut short, such as the body of a string
+    /// or comment: text arriving later can't change what it already covers.
+    pub const fn run(len: usize, class: Class) -> Self {
+        Self {
+            len,
+            class,
+            split: true,
+        }
+    }
+}
+
+/// Splits lines into classified tokens.
+///
+/// Lexers see one line at a time, starting wherever the previous token
+/// ended, and carry everything else in a [`LexState`]. The text may stop
+/// short of the end of the line when more of it hasn't arrived yet; a
+/// token reaching the end of the text is lexed again once it grows, unless
+/// it is a [`run`](Token::run).
+pub trait Lexer: Send {
+    /// Lex the token at the start of `text`, the rest of the current line.
+    ///
+    /// The token's extent and class may depend on its own text and on the
+    /// one character after it, never on text further ahead. `state` is
+    /// the state after the previous token and is updated for the next one.
+    fn token(&self, text: &str, state: &mut LexState) -> Token;
+
+    /// Get the state at the start of the line after one that ended in
+    /// `state`.
+    fn end_line(&self, state: LexState) -> LexState;
+}
+
+/// Colors and modifiers applied to a class, over the widget's own pen.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct Style {
+    /// Foreground color, or `None` to keep the widget's.
+    pub fg: Option<Rgb>,
+    /// Background color, or `None` to keep the widget's.
+    pub bg: Option<Rgb>,
+    /// Modifiers added to the widget's.
+    pub modifiers: Modifiers,
+}
+
+impl Style {
+    /// Style that leaves the widget's pen alone.
+    pub const PLAIN: Self = Self {
+        fg: None,
+        bg: None,
+        modifiers: Modifiers::empty(),
+    };
+
+    /// Create a style with a foreground color.
+    pub const fn fg(fg: Rgb) -> Self {
+        Self {
+            fg: Some(fg),
+            bg: None,
+            modifiers: Modifiers::empty(),
+        }
+    }
+
+    /// Set the modifiers.
+    #[must_use]
+    pub const fn with_modifiers(mut self, modifiers: Modifiers) -> Self {
+        self.modifiers = modifiers;
+        self
+    }
+
+    /// Apply the style over `pen`.
+    pub(super) fn apply(self, pen: Pen) -> Pen {
+        Pen {
+            fg: self.fg.unwrap_or(pen.fg),
+            bg: self.bg.unwrap_or(pen.bg),
+            modifiers: pen.modifiers | self.modifiers,
+        }
+    }
+}
+
+/// Style for each [`Class`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Theme {
+    /// Styles, indexed by class.
+    styles: [Style; Class::COUNT],
+}
+
+impl Theme {
+    /// Create a theme that styles every class plainly.
+    pub const fn plain() -> Self {
+        Self {
+            styles: [Style::PLAIN; Class::COUNT],
+        }
+    }
+
+    /// Get the style of a class.
+    pub const fn style(&self, class: Class) -> Style {
+        self.styles[class as usize]
+    }
+
+    /// Set the style of a class.
+    pub const fn set(&mut self, class: Class, style: Style) {
+        self.styles[class as usize] = style;
+    }
+}
+
+impl Default for Theme {
+    /// A dark-background palette.
+    fn default() -> Self {
+        let mut theme = Self::plain();
+        let italic = Modifiers::ITALIC;
+        let bold = Modifiers::BOLD;
+        theme.set(Class::Keyword, Style::fg(Rgb::new(198, 120, 221)));
+        theme.set(Class::Type, Style::fg(Rgb::new(229, 192, 123)));
+        theme.set(Class::Constant, Style::fg(Rgb::new(209, 154, 102)));
+        theme.set(Class::String, Style::fg(Rgb::new(152, 195, 121)));
+        theme.set(Class::Number, Style::fg(Rgb::new(209, 154, 102)));
+        theme.set(
+            Class::Comment,
+            Style::fg(Rgb::new(127, 132, 142)).with_modifiers(italic),
+        );
+        theme.set(Class::Attribute, Style::fg(Rgb::new(86, 182, 194)));
+        theme.set(Class::Key, Style::fg(Rgb::new(224, 108, 117)));
+        theme.set(
+            Class::Heading,
+            Style::fg(Rgb::new(97, 175, 239)).with_modifiers(bold),
+        );
+        theme.set(Class::Emphasis, Style::PLAIN.with_modifiers(italic));
+        theme.set(Class::Strong, Style::PLAIN.with_modifiers(bold));
+        theme.set(Class::Code, Style::fg(Rgb::new(229, 192, 123)));
+        theme.set(Class::Markup, Style::fg(Rgb::new(127, 132, 142)));
+        theme.set(Class::Added, Style::fg(Rgb::new(152, 195, 121)));
+        theme.set(Class::Removed, Style::fg(Rgb::new(224, 108, 117)));
+        theme.set(
+            Class::Meta,
+            Style::fg(Rgb::new(86, 182, 194)).with_modifiers(bold),
+        );
+        theme
+    }
+}
+
+/// Classified byte range of a [`Highlighter`]'s unsettled text.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Span {
+    /// Start offset.
+    pub start: usize,
+    /// End offset.
+    pub end: usize,
+    /// Class of the range.
+    pub class: Class,
+}
+
+/// Classes for text fed to a [`Highlighter`].
+///
+/// Covers the unsettled text before the new text, which may need
+/// restyling, followed by the new text.
+#[derive(Debug)]
+pub struct Update<'a> {
+    /// Unsettled text followed by the new text.
+    text: &'a str,
+    /// Offset of the new text.
+    fed: usize,
+    /// Spans covering `text`, in order.
+    spans: &'a [Span],
+    /// Theme for resolving classes.
+    theme: &'a Theme,
+}
+
+impl<'a> Update<'a> {
+    /// Get the unsettled text followed by the new text.
+    pub const fn text(&self) -> &'a str {
+        self.text
+    }
+
+    /// Get the offset in [`text`](Self::text) where the new text starts.
+    pub const fn fed(&self) -> usize {
+        self.fed
+    }
+
+    /// Get the spans covering [`text`](Self::text), in order.
+    pub const fn spans(&self) -> &'a [Span] {
+        self.spans
+    }
+
+    /// Get the style of a class.
+    pub const fn style(&self, class: Class) -> Style {
+        self.theme.style(class)
+    }
+}
+
+/// Incremental highlighter for streamed text.
+///
+/// Feed it text without line breaks through [`feed`](Self::feed) and
+/// report line breaks with [`end_line`](Self::end_line) and
+/// [`carriage_return`](Self::carriage_return). Install one on a widget
+/// with [`StreamWidget::set_highlighter`].
+///
+/// [`StreamWidget::set_highlighter`]: super::StreamWidget::set_highlighter
+pub struct Highlighter {
+    /// Lexer for the text.
+    lexer: Box<dyn Lexer>,
+    /// Styles for the lexer's classes.
+    theme: Theme,
+    /// Text of the current line from the settled checkpoint on.
+    tail: String,
+    /// Bytes at the start of `tail` settled by the last feed.
+    settled: usize,
+    /// State at the start of `tail`.
+    state: LexState,
+    /// State at the start of the current line.
+    line_state: LexState,
+    /// State after the last token of the current line.
+    end_state: LexState,
+    /// Spans from the last feed.
+    spans: Vec<Span>,
+}
+
+impl Highlighter {
+    /// Create a highlighter with the default theme.
+    pub fn new(lexer: impl Lexer + 'static) -> Self {
+        Self {
+            lexer: Box::new(lexer),
+            theme: Theme::default(),
+            tail: String::new(),
+            settled: 0,
+            state: 0,
+            line_state: 0,
+            end_state: 0,
+            spans: Vec::new(),
+        }
+    }
+
+    /// Create a highlighter for Markdown with the built-in languages.
+    pub fn markdown() -> Self {
+        Self::new(Markdown::new())
+    }
+
+    /// Get the theme.
+    pub const fn theme(&self) -> &Theme {
+        &self.theme
+    }
+
+    /// Set the theme.
+    ///
+    /// Text already highlighted keeps its styles.
+    pub const fn set_theme(&mut self, theme: Theme) {
+        self.theme = theme;
+    }
+
+    /// Get the lexer state checkpointed at the start of the current line.
+    pub const fn line_state(&self) -> LexState {
+        self.line_state
+    }
+
+    /// Lex text added to the current line.
+    ///
+    /// Only the unsettled tail of the line is lexed again. Tokens ending
+    /// before the end of the text are settled, as are runs; the last token
+    /// otherwise stays unsettled until more text arrives.
+    ///
+    /// # Arguments
+    /// * `text` - Text without line breaks.
+    pub fn feed(&mut self, text: &str) -> Update<'_> {
+        self.tail.drain(..self.settled);
+        let fed = self.tail.len();
+        self.tail.push_str(text);
+        self.spans.clear();
+
+        let mut pos = 0;
+        let mut state = self.state;
+        let mut settled = (0, self.state);
+        while pos < self.tail.len() {
+            let rest = &self.tail[pos..];
+            let token = self.lexer.token(rest, &mut state);
+            let end = pos + token_len(rest, token.len);
+            if end < self.tail.len() || token.split {
+                settled = (end, state);
+            }
+
+            match self.spans.last_mut() {
+                Some(last) if last.class == token.class => last.end = end,
+                _ => self.spans.push(Span {
+                    start: pos,
+                    end,
+                    class: token.class,
+                }),
+            }
+            pos = end;
+        }
+
+        (self.settled, self.state) = settled;
+        self.end_state = state;
+        Update {
+            text: &self.tail,
+            fed,
+            spans: &self.spans,
+            theme: &self.theme,
+        }
+    }
+
+    /// End the current line.
+    pub fn end_line(&mut self) {
+        self.line_state = self.lexer.end_line(self.end_state);
+        self.carriage_return();
+    }
+
+    /// Restart the current line, as text after a carriage return replaces it.
+    pub fn carriage_return(&mut self) {
+        self.tail.clear();
+        self.settled = 0;
+        self.state = self.line_state;
+        self.end_state = self.line_state;
+    }
+
+    /// Forget all state, as if nothing had been fed.
+    pub fn reset(&mut self) {
+        self.line_state = 0;
+        self.carriage_return();
+    }
+}
+
+impl std::fmt::Debug for Highlighter {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("Highlighter")
+            .field("tail", &self.tail)
+            .field("state", &self.state)
+            .field("line_state", &self.line_state)
+            .finish_non_exhaustive()
+    }
+}
+
+/// Clamp a lexer's token length to at least one character, ending on a
+/// character boundary within `text`.
+fn token_len(text: &str, len: usize) -> usize {
+    let first = text.chars().next().map_or(0, char::len_utf8);
+    let mut len = len.clamp(first, text.len());
+    while !text.is_char_boundary(len) {
+        len += 1;
+    }
+    len
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Final class of every byte of `tokens`, fed in order.
+    fn classes(highlighter: &mut Highlighter, tokens: &[&str]) -> Vec<Class> {
+        let mut out = Vec::new();
+        for token in tokens {
+            for (i, part) in token.split('\n').enumerate() {
+                if i > 0 {
+                    highlighter.end_line();
+                    out.push(Class::Plain);
+                }
+                let update = highlighter.feed(part);
+                out.truncate(out.len() - update.fed());
+                for span in update.spans() {
+                    out.extend(std::iter::repeat(span.class).take(span.end - span.start));
+                }
+            }
+        }
+        out
+    }
+
+    #[test]
+    fn test_highlighter_restyles_unsettled_tail() {
+        let mut highlighter = Highlighter::new(Syntax::RUST);
+
+        let update = highlighter.feed("fn");
+        assert_eq!(
+            update.spans(),
+            &[Span {
+                start: 0,
+                end: 2,
+                class: Class::Keyword
+            }]
+        );
+
+        // The keyword grows into an identifier and is restyled
+        let update = highlighter.feed("ord = 1");
+        assert_eq!(update.fed(), 2);
+        assert_eq!(update.spans()[0].class, Class::Plain);
+
+        // Only the unsettled number is lexed again
+        let update = highlighter.feed("2; /");
+        assert_eq!(update.text(), "12; /");
+        let update = highlighter.feed("/ done");
+        assert_eq!(update.text(), "// done");
+        assert_eq!(
+            update.spans(),
+            &[Span {
+                start: 0,
+                end: 7,
+                class: Class::Comment
+            }]
+        );
+
+        // Comment runs settle as they arrive
+        assert_eq!(highlighter.feed(" now").text(), " now");
+    }
+
+    #[test]
+    fn test_highlighter_token_boundaries_dont_matter() {
+        let text = "let s = \"a \\\"quoted\\\" str\"; // x\n/* multi\nline */ x.0 + 'a' + r#struct";
+        let whole = classes(&mut Highlighter::new(Syntax::RUST), &[text]);
+
+        let chars: Vec<String> = text.chars().map(String::from).collect();
+        let chars: Vec<&str> = chars.iter().map(String::as_str).collect();
+        let split = classes(&mut Highlighter::new(Syntax::RUST), &chars);
+        assert_eq!(whole, split);
+        assert_eq!(whole[text.find("multi").unwrap()], Class::Comment);
+        assert_eq!(whole[text.find("'a'").unwrap()], Class::String);
+    }
+}
@@ -0,0 +1,499 @@
+//! Table-driven lexer for programming languages and line-oriented formats.
+//!
+//! A [`Syntax`] is plain data: word lists, comment and string delimiters,
+//! line prefixes. One interpreter lexes every table, so adding a language
+//! means writing a table, not a lexer.
+
+use super::{Class, LexState, Lexer, Token};
+
+/// State bit set once a token has been lexed on the current line.
+const MID_LINE: LexState = 1 << 31;
+
+/// State bit set while the current string is an object key.
+const KEY_STRING: LexState = 1 << 30;
+
+/// State bit set when the next string would be an object key.
+const EXPECT_KEY: LexState = 1 << 29;
+
+/// Mask of the lexer mode.
+const MODE: LexState = 0b11;
+
+/// Mode: between tokens.
+const NORMAL: LexState = 0;
+
+/// Mode: inside a delimited token; the index is in the argument bits.
+const DELIMITED: LexState = 1;
+
+/// Mode: the rest of the line has one class; its index is in the
+/// argument bits.
+const LINE: LexState = 2;
+
+/// Shift of the mode argument.
+const ARG_SHIFT: u32 = 2;
+
+/// Mask of the mode argument, after shifting.
+const ARG: LexState = 0xFF;
+
+/// Shift of the nesting depth of objects and arrays.
+const DEPTH_SHIFT: u32 = 10;
+
+/// Mask of the nesting depth, after shifting.
+const DEPTH: LexState = 0x1F;
+
+/// Deepest nesting whose kind is tracked.
+const MAX_DEPTH: LexState = 14;
+
+/// Shift of the nesting stack: one bit per level, set for objects.
+const STACK_SHIFT: LexState = 15;
+
+/// Token between an opening and a closing delimiter, such as a string or a
+/// block comment.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Delimited {
+    /// Opening delimiter.
+    pub open: &'static str,
+    /// Closing delimiter.
+    pub close: &'static str,
+    /// Class of the whole token, delimiters included.
+    pub class: Class,
+    /// Whether the token continues onto following lines when unclosed.
+    pub multiline: bool,
+    /// Whether a backslash escapes the character after it.
+    pub escapes: bool,
+}
+
+impl Delimited {
+    /// Create a string delimited by `quote` on both sides, with escapes.
+    pub const fn string(quote: &'static str, multiline: bool) -> Self {
+        Self {
+            open: quote,
+            close: quote,
+            class: Class::String,
+            multiline,
+            escapes: true,
+        }
+    }
+}
+
+/// Lexer table for a language.
+///
+/// Identifiers are looked up in the word lists; anything else is matched
+/// against the delimiters and comment markers, in table order, so longer
+/// delimiters sharing a prefix with shorter ones must come first.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Syntax {
+    /// Keywords.
+    pub keywords: &'static [&'static str],
+    /// Built-in type names.
+    pub types: &'static [&'static str],
+    /// Named constants.
+    pub constants: &'static [&'static str],
+    /// Whether identifiers starting with an uppercase letter are types.
+    pub capitalized_types: bool,
+    /// Markers starting a comment that runs to the end of the line.
+    pub line_comments: &'static [&'static str],
+    /// Strings, block comments and other delimited tokens.
+    pub delimited: &'static [Delimited],
+    /// Character introducing a decorator, which styles the dotted name
+    /// after it as an attribute.
+    pub decorator: Option<char>,
+    /// Whether `'` starts a one-character literal or, when no closing
+    /// quote follows, a lifetime.
+    pub char_literals: bool,
+    /// Prefixes giving a whole line one class, in matching order. Lines
+    /// matching none are plain when the table has any. The rest of the
+    /// line is plain unless the class is a comment, meta, added or removed.
+    pub line_prefixes: &'static [(&'static str, Class)],
+    /// Whether strings opening an object member are keys.
+    pub object_keys: bool,
+}
+
+/// Classes a [`LINE`] mode can have, indexed by the mode argument.
+const LINE_CLASSES: [Class; 5] = [
+    Class::Plain,
+    Class::Comment,
+    Class::Meta,
+    Class::Added,
+    Class::Removed,
+];
+
+impl Syntax {
+    /// Rust.
+    pub const RUST: Self = Self {
+        keywords: &[
+            "as", "async", "await", "break", "const", "continue", "crate", "dyn", "else", "enum",
+            "extern", "fn", "for", "if", "impl", "in", "let", "loop", "match", "mod", "move",
+            "mut", "pub", "ref", "return", "static", "struct", "super", "trait", "type", "unsafe",
+            "use", "where", "while", "yield",
+        ],
+        types: &[
+            "bool", "char", "f32", "f64", "i8", "i16", "i32", "i64", "i128", "isize", "str", "u8",
+            "u16", "u32", "u64", "u128", "usize",
+        ],
+        constants: &["true", "false", "self", "Self", "None", "Some", "Ok", "Err"],
+        capitalized_types: true,
+        line_comments: &["//"],
+        delimited: &[
+            Delimited::string("\"", true),
+            Delimited {
+                open: "/*",
+                close: "*/",
+                class: Class::Comment,
+                multiline: true,
+                escapes: false,
+            },
+            Delimited {
+                open: "#[",
+                close: "]",
+                class: Class::Attribute,
+                multiline: false,
+                escapes: false,
+            },
+            Delimited {
+                open: "#![",
+                close: "]",
+                class: Class::Attribute,
+                multiline: false,
+                escapes: false,
+            },
+        ],
+        decorator: None,
+        char_literals: true,
+        line_prefixes: &[],
+        object_keys: false,
+    };
+
+    /// Python.
+    pub const PYTHON: Self = Self {
+        keywords: &[
+            "and", "as", "assert", "async", "await", "break", "class", "continue", "def", "del",
+            "elif", "else", "except", "finally", "for", "from", "global", "if", "import", "in",
+            "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try", "while",
+            "with", "yield",
+        ],
+        types: &[
+            "bool", "bytes", "dict", "float", "int", "list", "object", "set", "str", "tuple",
+        ],
+        constants: &["True", "False", "None", "self", "cls"],
+        capitalized_types: true,
+        line_comments: &["#"],
+        delimited: &[
+            Delimited::string("\"\"\"", true),
+            Delimited::string("'''", true),
+            Delimited::string("\"", false),
+            Delimited::string("'", false),
+        ],
+        decorator: Some('@'),
+        char_literals: false,
+        line_prefixes: &[],
+        object_keys: false,
+    };
+
+    /// JSON.
+    pub const JSON: Self = Self {
+        keywords: &[],
+        types: &[],
+        constants: &["true", "false", "null"],
+        capitalized_types: false,
+        line_comments: &[],
+        delimited: &[Delimited::string("\"", false)],
+        decorator: None,
+        char_literals: false,
+        line_prefixes: &[],
+        object_keys: true,
+    };
+
+    /// Unified diffs.
+    pub const DIFF: Self = Self {
+        keywords: &[],
+        types: &[],
+        constants: &[],
+        capitalized_types: false,
+        line_comments: &[],
+        delimited: &[],
+        decorator: None,
+        char_literals: false,
+        line_prefixes: &[
+            ("+++", Class::Meta),
+            ("---", Class::Meta),
+            ("@@", Class::Meta),
+            ("diff ", Class::Meta),
+            ("index ", Class::Meta),
+            ("+", Class::Added),
+            ("-", Class::Removed),
+            ("\\", Class::Comment),
+        ],
+        object_keys: false,
+    };
+
+    /// Class of an identifier.
+    fn word_class(&self, word: &str) -> Class {
+        if self.keywords.contains(&word) {
+            Class::Keyword
+        } else if self.constants.contains(&word) {
+            Class::Constant
+        } else if self.types.contains(&word)
+            || (self.capitalized_types && word.starts_with(|c: char| c.is_uppercase()))
+        {
+            Class::Type
+        } else {
+            Class::Plain
+        }
+    }
+
+    /// Check if `text` is the start of a marker it is too short to match,
+    /// so the token can't be told until more arrives.
+    fn is_partial_marker(&self, text: &str) -> bool {
+        let partial = |marker: &str| marker.len() > text.len() && marker.starts_with(text);
+        self.line_comments.iter().any(|m| partial(m))
+            || self.delimited.iter().any(|d| partial(d.open))
+    }
+
+    /// Lex the start of a line against the line prefixes.
+    fn line_prefix(&self, text: &str, state: &mut LexState) -> Token {
+        let partial = self
+            .line_prefixes
+            .iter()
+            .any(|(prefix, _)| prefix.len() > text.len() && prefix.starts_with(text));
+        if partial {
+            return Token::new(text.len(), Class::Plain);
+        }
+
+        let (len, class) = self
+            .line_prefixes
+            .iter()
+            .find(|(prefix, _)| text.starts_with(prefix))
+            .map_or((0, Class::Plain), |&(prefix, class)| (prefix.len(), class));
+        *state = line_mode(*state, class);
+        if len == 0 {
+            Token::run(text.len(), class)
+        } else {
+            Token::new(len, class)
+        }
+    }
+
+    /// Lex inside a delimited token, up to and including its close.
+    fn delimited_body(&self, text: &str, index: usize, state: &mut LexState) -> Token {
+        let delimited = &self.delimited[index];
+        let class = if *state & KEY_STRING == 0 {
+            delimited.class
+        } else {
+            Class::Key
+        };
+
+        let mut i = 0;
+        while i < text.len() {
+            let rest = &text[i..];
+            if delimited.escapes && rest.starts_with('\\') {
+                match rest[1..].chars().next() {
+                    Some(c) => i += 1 + c.len_utf8(),
+                    // The escaped character hasn't arrived yet
+                    None if i > 0 => return Token::run(i, class),
+                    None => return Token::new(1, class),
+                }
+                continue;
+            }
+            if rest.starts_with(delimited.close) {
+                *state = set_mode(*state & !KEY_STRING, NORMAL, 0);
+                return Token::new(i + delimited.close.len(), class);
+            }
+            if delimited.close.len() > rest.len() && delimited.close.starts_with(rest) {
+                // Possibly the start of the close
+                return if i > 0 {
+                    Token::run(i, class)
+                } else {
+                    Token::new(rest.len(), class)
+                };
+            }
+            i += rest.chars().next().map_or(1, char::len_utf8);
+        }
+        Token::run(text.len(), class)
+    }
+
+    /// Lex a `'`: a character literal, a lifetime or a lone quote.
+    fn quote(text: &str) -> Token {
+        let mut chars = text[1..].char_indices();
+        let Some((_, c)) = chars.next() else {
+            return Token::new(text.len(), Class::String);
+        };
+
+        if c == '\\' {
+            // Escaped character: up to the closing quote
+            return match text.get(3..).map(|rest| rest.find('\'')) {
+                Some(Some(end)) if end <= 8 => Token::new(end + 4, Class::String),
+                None | Some(None) if text.len() < 12 => Token::new(text.len(), Class::String),
+                _ => Token::new(1, Class::Punctuation),
+            };
+        }
+        match chars.next() {
+            Some((_, '\'')) => Token::new(2 + c.len_utf8(), Class::String),
+            None => Token::new(text.len(), Class::String),
+            _ if is_ident_start(c) => {
+                let len = 1 + ident_len(&text[1..]);
+                Token::new(len, Class::Type)
+            },
+            _ => Token::new(1, Class::Punctuation),
+        }
+    }
+}
+
+impl Lexer for Syntax {
+    fn token(&self, text: &str, state: &mut LexState) -> Token {
+        let line_start = *state & MID_LINE == 0;
+        *state |= MID_LINE;
+        let arg = ((*state >> ARG_SHIFT) & ARG) as usize;
+        match *state & MODE {
+            DELIMITED => return self.delimited_body(text, arg, state),
+            LINE => return Token::run(text.len(), LINE_CLASSES[arg]),
+            _ => {},
+        }
+        if line_start && !self.line_prefixes.is_empty() {
+            return self.line_prefix(text, state);
+        }
+
+        let c = text.chars().next().unwrap_or(' ');
+        if c.is_whitespace() {
+            let len = text
+                .find(|c: char| !c.is_whitespace())
+                .unwrap_or(text.len());
+            return Token::run(len, Class::Plain);
+        }
+        let expect_key = *state & EXPECT_KEY != 0;
+        *state &= !EXPECT_KEY;
+        if is_ident_start(c) {
+            let len = ident_len(text);
+            return Token::new(len, self.word_class(&text[..len]));
+        }
+        if c.is_ascii_digit() {
+            return Token::new(number_len(text), Class::Number);
+        }
+
+        if self.is_partial_marker(text) {
+            return Token::new(text.len(), Class::Plain);
+        }
+        if self.line_comments.iter().any(|m| text.starts_with(m)) {
+            *state = line_mode(*state, Class::Comment);
+            return Token::run(text.len(), Class::Comment);
+        }
+        if let Some(index) = self.delimited.iter().position(|d| text.starts_with(d.open)) {
+            if expect_key {
+                *state |= KEY_STRING;
+            }
+            *state = set_mode(*state, DELIMITED, index as LexState);
+            let open = self.delimited[index].open.len();
+            let class = if *state & KEY_STRING == 0 {
+                self.delimited[index].class
+            } else {
+                Class::Key
+            };
+            return Token::new(open, class);
+        }
+
+        if self.char_literals && c == '\'' {
+            return Self::quote(text);
+        }
+        if self.decorator == Some(c) {
+            let rest = &text[1..];
+            let len = 1 + rest
+                .find(|c: char| !(c == '.' || c == '_' || c.is_alphanumeric()))
+                .unwrap_or(rest.len());
+            return Token::new(len, Class::Attribute);
+        }
+        if c.is_ascii_punctuation() {
+            if self.object_keys {
+                *state = track_nesting(*state, c);
+            }
+            return Token::new(1, Class::Punctuation);
+        }
+        Token::new(c.len_utf8(), Class::Plain)
+    }
+
+    fn end_line(&self, state: LexState) -> LexState {
+        let arg = ((state >> ARG_SHIFT) & ARG) as usize;
+        let state = state & !MID_LINE;
+        match state & MODE {
+            DELIMITED if self.delimited[arg].multiline => state,
+            _ => set_mode(state & !KEY_STRING, NORMAL, 0),
+        }
+    }
+}
+
+/// Replace the mode and its argument.
+const fn set_mode(state: LexState, mode: LexState, arg: LexState) -> LexState {
+    let cleared = state & !(MODE | (ARG << ARG_SHIFT));
+    cleared | mode | (arg << ARG_SHIFT)
+}
+
+/// Replace the mode with a [`LINE`] mode of the given class.
+fn line_mode(state: LexState, class: Class) -> LexState {
+    let index = LINE_CLASSES.iter().position(|&c| c == class).unwrap_or(0);
+    set_mode(state, LINE, index as LexState)
+}
+
+/// Update object and array nesting for a punctuation character.
+///
+/// Levels past [`MAX_DEPTH`] are counted but their kind is forgotten, so
+/// keys aren't recognized in them.
+const fn track_nesting(state: LexState, c: char) -> LexState {
+    let depth = (state >> DEPTH_SHIFT) & DEPTH;
+    match c {
+        '{' | '[' if depth < DEPTH => {
+            let depth = depth + 1;
+            let mut state = set_depth(state, depth);
+            if depth <= MAX_DEPTH {
+                let bit = 1 << (STACK_SHIFT + depth - 1);
+                state = if c == '{' {
+                    state | bit | EXPECT_KEY
+                } else {
+                    state & !bit
+                };
+            }
+            state
+        },
+        '}' | ']' => set_depth(state, depth.saturating_sub(1)),
+        ',' if depth > 0 && depth <= MAX_DEPTH => {
+            let in_object = state >> (STACK_SHIFT + depth - 1) & 1 == 1;
+            if in_object {
+                state | EXPECT_KEY
+            } else {
+                state
+            }
+        },
+        _ => state,
+    }
+}
+
+/// Replace the nesting depth.
+const fn set_depth(state: LexState, depth: LexState) -> LexState {
+    (state & !(DEPTH << DEPTH_SHIFT)) | (depth << DEPTH_SHIFT)
+}
+
+/// Check if a character can start an identifier.
+fn is_ident_start(c: char) -> bool {
+    c == '_' || c.is_alphabetic()
+}
+
+/// Get the length of the identifier at the start of `text`.
+fn ident_len(text: &str) -> usize {
+    text.find(|c: char| !(c == '_' || c.is_alphanumeric()))
+        .unwrap_or(text.len())
+}
+
+/// Get the length of the number at the start of `text`.
+///
+/// A `.` belongs to the number when a digit follows it, or nothing has
+/// arrived after it yet.
+fn number_len(text: &str) -> usize {
+    let bytes = text.as_bytes();
+    let mut i = 0;
+    while i < bytes.len() {
+        match bytes[i] {
+            b'_' => {},
+            b if b.is_ascii_alphanumeric() => {},
+            b'.' if bytes.get(i + 1).is_none_or(u8::is_ascii_digit) => {},
+            _ => break,
+        }
+        i += 1;
+    }
+    i
+}
@@ -0,0 +1,779 @@
+//! Log View Widget: Pages through large log files without loading them.
+//!
+//! A [`LogView`] never holds the file's contents. It keeps a sparse index
+//! of line start offsets, built by scanning the file a block at a time
+//! (in parallel for large files), and reads only the lines in the
+//! viewport with positioned reads. Cells are produced for those rows alone
+//! at render time, so memory is the viewport plus the index, whatever the
+//! file size:
+//!
+//! ```text
+//! file:   |line 0 ... line 64 ... line 128 ... line 192 ...      |
+//! index:   (0, 0)    (64, off) (128, off) (192, off)   ← one per 64 lines
+//! view:                         ╰─ seek, skip ≤ 2×64 lines, read rows
+//! ```
+//!
+//! Growing files are followed like `tail -f`: [`refresh`](LogView::refresh)
+//! indexes just the bytes appended since the last call, and starts over
+//! when the file was truncated, rewritten or rotated.
+
+use std::fs::File;
+use std::io::{self, Read, Seek, SeekFrom};
+use std::path::{Path, PathBuf};
+use std::thread;
+
+use unicode_segmentation::UnicodeSegmentation;
+
+use super::ansi::{AnsiEvent, AnsiParser, Pen};
+use super::traits::Widget;
+use crate::actor::{InputEvent, KeyCode};
+use crate::buffer::text::str_width;
+use crate::buffer::{Buffer, Cell, Modifiers, Rgb};
+use crate::layout::Rect;
+
+/// Lines between index checkpoints.
+const STRIDE: usize = 64;
+
+/// Bytes read per block while scanning.
+const BLOCK: usize = 1 << 20;
+
+/// Smallest range worth splitting across threads.
+const PARALLEL_MIN_BYTES: u64 = 16 << 20;
+
+/// Longest line prefix read for display; the rest of the line is skipped.
+const MAX_LINE_BYTES: usize = 16 << 10;
+
+/// Columns between tab stops.
+const TAB_WIDTH: u16 = 8;
+
+/// Indexed bytes, ending at the indexed length, compared on each refresh
+/// to notice a file rewritten in place.
+const ANCHOR_BYTES: u64 = 64;
+
+/// Sparse line index: the start offset of roughly every [`STRIDE`]th line.
+#[derive(Debug, Clone)]
+struct LineIndex {
+    /// `(line, offset)` pairs in line order, starting with `(0, 0)`. Ranges
+    /// indexed in parallel restart the stride, so checkpoints are at most
+    /// `2 * STRIDE` lines apart.
+    checkpoints: Vec<(usize, u64)>,
+    /// Newlines in the indexed bytes.
+    newlines: usize,
+    /// Offset where the last, unterminated line starts.
+    tail_start: u64,
+    /// Bytes indexed.
+    len: u64,
+}
+
+/// Result of scanning a byte range for newlines.
+#[derive(Debug, Default)]
+struct Scan {
+    /// Newlines found.
+    newlines: usize,
+    /// `(n, offset)` for every [`STRIDE`]th newline, where line `n` of the
+    /// range (counted from 0 at the range start) starts at `offset`.
+    checkpoints: Vec<(usize, u64)>,
+    /// Offset after the last newline found, if any.
+    last_line_start: Option<u64>,
+}
+
+impl LineIndex {
+    /// Create an index of an empty file.
+    fn new() -> Self {
+        Self {
+            checkpoints: vec![(0, 0)],
+            newlines: 0,
+            tail_start: 0,
+            len: 0,
+        }
+    }
+
+    /// Number of lines, counting an unterminated last line.
+    fn line_count(&self) -> usize {
+        self.newlines + usize::from(self.len > self.tail_start)
+    }
+
+    /// Index the bytes of `path` from the indexed length up to `len`.
+    fn extend(&mut self, path: &Path, len: u64) -> io::Result<()> {
+        let from = self.len;
+        if len <= from {
+            return Ok(());
+        }
+
+        for scan in scan_parallel(path, from, len)? {
+            let base = self.newlines;
+            self.checkpoints.extend(
+                scan.checkpoints
+                    .iter()
+                    .map(|&(line, offset)| (base + line, offset)),
+            );
+            self.newlines += scan.newlines;
+            if let Some(start) = scan.last_line_start {
+                self.tail_start = start;
+            }
+        }
+        self.len = len;
+        Ok(())
+    }
+
+    /// Find the start offset of `line`.
+    ///
+    /// Reads forward from the nearest checkpoint at or before the line.
+    fn line_start(&self, file: &File, line: usize) -> io::Result<u64> {
+        if line >= self.newlines {
+            return Ok(self.tail_start);
+        }
+        let slot = self.checkpoints.partition_point(|&(l, _)| l <= line) - 1;
+        let (mut at, offset) = self.checkpoints[slot];
+        if at == line {
+            return Ok(offset);
+        }
+
+        let mut reader = BlockReader::new(file, offset, self.len);
+        while let Some((block_start, block)) = reader.next_block()? {
+            let mut found = None;
+            for_each_newline(block, |i| {
+                at += 1;
+                if at == line {
+                    found = Some(block_start + i as u64 + 1);
+                    return false;
+                }
+                true
+            });
+            if let Some(start) = found {
+                return Ok(start);
+            }
+        }
+        Ok(self.tail_start)
+    }
+
+    /// Approximate heap usage in bytes.
+    const fn memory_usage(&self) -> usize {
+        self.checkpoints.capacity() * std::mem::size_of::<(usize, u64)>()
+    }
+}
+
+/// Scan `[from, to)` of `path`, splitting large ranges across threads.
+///
+/// # Returns
+/// One scan per part, in file order.
+fn scan_parallel(path: &Path, from: u64, to: u64) -> io::Result<Vec<Scan>> {
+    let threads = thread::available_parallelism().map_or(1, usize::from) as u64;
+    let len = to - from;
+    if threads < 2 || len < PARALLEL_MIN_BYTES {
+        return Ok(vec![scan_range(&File::open(path)?, from, to)?]);
+    }
+
+    let per_thread = len.div_ceil(threads).max(BLOCK as u64);
+    thread::scope(|scope| {
+        // Spawn every worker before joining any of them. Each opens its own
+        // handle, since a shared one would share the file position.
+        #[allow(clippy::needless_collect)]
+        let workers: Vec<_> = (from..to)
+            .step_by(usize::try_from(per_thread).unwrap_or(usize::MAX))
+            .map(|start| {
+                let end = (start + per_thread).min(to);
+                scope.spawn(move || scan_range(&File::open(path)?, start, end))
+            })
+            .collect();
+        workers
+            .into_iter()
+            .map(|worker| {
+                worker
+                    .join()
+                    .unwrap_or_else(|_| Err(io::Error::other("index worker panicked")))
+            })
+            .collect()
+    })
+}
+
+/// Scan `[from, to)` of `file` for newlines.
+fn scan_range(file: &File, from: u64, to: u64) -> io::Result<Scan> {
+    let mut scan = Scan::default();
+    let mut reader = BlockReader::new(file, from, to);
+    while let Some((block_start, block)) = reader.next_block()? {
+        for_each_newline(block, |i| {
+            let start = block_start + i as u64 + 1;
+            scan.newlines += 1;
+            if scan.newlines % STRIDE == 0 {
+                scan.checkpoints.push((scan.newlines, start));
+            }
+            scan.last_line_start = Some(start);
+            true
+        });
+    }
+    Ok(scan)
+}
+
+/// Call `f` with the index of each `\n` in `bytes`, in order, until it
+/// returns `false`.
+///
+/// Compares a `u64` word at a time. The zero-byte test is the exact form
+/// (no borrow between lanes), so every flagged byte is a real newline.
+fn for_each_newline(bytes: &[u8], mut f: impl FnMut(usize) -> bool) {
+    const ONES: u64 = 0x0101_0101_0101_0101;
+    const LOW: u64 = 0x7F7F_7F7F_7F7F_7F7F;
+
+    let mut words = bytes.chunks_exact(8);
+    let mut base = 0;
+    for word in &mut words {
+        let w = u64::from_le_bytes(word.try_into().unwrap_or_default()) ^ (ONES * u64::from(b'\n'));
+        let mut mask = !(((w & LOW) + LOW) | w | LOW);
+        while mask != 0 {
+            if !f(base + (mask.trailing_zeros() / 8) as usize) {
+                return;
+            }
+            mask &= mask - 1;
+        }
+        base += 8;
+    }
+    for (i, &b) in words.remainder().iter().enumerate() {
+        if b == b'\n' && !f(base + i) {
+            return;
+        }
+    }
+}
+
+/// Sequential block reader over a byte range of a file.
+struct BlockReader<'a> {
+    /// The file.
+    file: &'a File,
+    /// Offset of the next block.
+    pos: u64,
+    /// End of the range.
+    end: u64,
+    /// Block buffer, reused across reads.
+    buf: Vec<u8>,
+}
+
+impl<'a> BlockReader<'a> {
+    /// Create a reader for `[from, to)`.
+    const fn new(file: &'a File, from: u64, to: u64) -> Self {
+        Self {
+            file,
+            pos: from,
+            end: to,
+            buf: Vec::new(),
+        }
+    }
+
+    /// Read the next block.
+    ///
+    /// # Returns
+    /// The block's offset and bytes, or `None` at the end of the range.
+    #[allow(clippy::cast_possible_truncation)]
+    fn next_block(&mut self) -> io::Result<Option<(u64, &[u8])>> {
+        if self.pos >= self.end {
+            return Ok(None);
+        }
+        let len = (self.end - self.pos).min(BLOCK as u64) as usize;
+        self.buf.resize(len, 0);
+        let mut file = self.file;
+        file.seek(SeekFrom::Start(self.pos))?;
+        file.read_exact(&mut self.buf)?;
+
+        let start = self.pos;
+        self.pos += len as u64;
+        Ok(Some((start, &self.buf)))
+    }
+}
+
+/// Check whether two stats are of the same file.
+#[cfg(unix)]
+fn same_file(a: &std::fs::Metadata, b: &std::fs::Metadata) -> bool {
+    use std::os::unix::fs::MetadataExt;
+    a.dev() == b.dev() && a.ino() == b.ino()
+}
+
+/// Check whether two stats are of the same file.
+///
+/// Without inode numbers a replaced file is only noticed by its contents.
+#[cfg(not(unix))]
+const fn same_file(_: &std::fs::Metadata, _: &std::fs::Metadata) -> bool {
+    true
+}
+
+/// A widget showing a window of a log file.
+///
+/// Call [`refresh`](Self::refresh) once per frame (or whenever the file
+/// may have grown) before rendering: it indexes appended bytes and reads
+/// the rows that scrolled into view. Scrolling itself never touches the
+/// file.
+#[derive(Debug)]
+pub struct LogView {
+    /// Path of the log, reopened by index workers.
+    path: PathBuf,
+    /// Open handle for reading visible rows.
+    file: File,
+    /// Line index.
+    index: LineIndex,
+    /// The last indexed bytes, as read when they were indexed.
+    anchor: Vec<u8>,
+    /// Widget bounds.
+    bounds: Rect,
+    /// First visible line.
+    top: usize,
+    /// Whether the view sticks to the end as the file grows.
+    follow: bool,
+    /// Text of the visible lines, read by the last refresh.
+    visible: Vec<String>,
+    /// Line that `visible` starts at, or `None` if it must be reread.
+    loaded: Option<usize>,
+    /// Default foreground color.
+    fg: Rgb,
+    /// Default background color.
+    bg: Rgb,
+    /// Needs redraw flag.
+    dirty: bool,
+}
+
+impl LogView {
+    /// Open a log file and index its current contents.
+    ///
+    /// The view starts following the end of the file.
+    ///
+    /// # Errors
+    /// Returns an error if the file can't be opened or read.
+    pub fn open(path: impl AsRef<Path>, bounds: Rect) -> io::Result<Self> {
+        let path = path.as_ref().to_path_buf();
+        let file = File::open(&path)?;
+        let mut view = Self {
+            path,
+            file,
+            index: LineIndex::new(),
+            anchor: Vec::new(),
+            bounds,
+            top: 0,
+            follow: true,
+            visible: Vec::new(),
+            loaded: None,
+            fg: Rgb::DEFAULT_FG,
+            bg: Rgb::DEFAULT_BG,
+            dirty: true,
+        };
+        view.refresh()?;
+        Ok(view)
+    }
+
+    /// Index bytes appended since the last refresh and read the rows in
+    /// view, if they changed.
+    ///
+    /// The file is indexed again from the start if the path now names a
+    /// different file (it was rotated or replaced; Unix only), if it
+    /// shrank, or if the last indexed bytes changed (it was truncated and
+    /// written again). While the path names no file, the old one is shown
+    /// but not followed.
+    ///
+    /// # Returns
+    /// Whether the view needs redrawing.
+    ///
+    /// # Errors
+    /// Returns an error if the file can't be read.
+    pub fn refresh(&mut self) -> io::Result<bool> {
+        let current = match std::fs::metadata(&self.path) {
+            Ok(current) => Some(current),
+            Err(err) if err.kind() == io::ErrorKind::NotFound => None,
+            Err(err) => return Err(err),
+        };
+        let len = match current {
+            Some(current) if !same_file(&self.file.metadata()?, &current) => {
+                self.file = File::open(&self.path)?;
+                self.reset();
+                self.file.metadata()?.len()
+            },
+            Some(_) => self.file.metadata()?.len(),
+            None => self.index.len,
+        };
+        if len < self.index.len || self.read_anchor()? != self.anchor {
+            self.reset();
+        }
+        if len > self.index.len {
+            let lines = self.index.line_count();
+            self.index.extend(&self.path, len)?;
+            self.anchor = self.read_anchor()?;
+            if self.follow {
+                self.top = self.bottom_line();
+            }
+            // A view reaching the old last line shows the line that grew
+            if self.loaded.is_some_and(|top| top + self.rows() >= lines) {
+                self.loaded = None;
+            }
+        }
+
+        if self.loaded == Some(self.top) {
+            return Ok(self.dirty);
+        }
+        self.load_visible()?;
+        self.dirty = true;
+        Ok(true)
+    }
+
+    /// Drop the index, to index the file again from the start.
+    fn reset(&mut self) {
+        self.index = LineIndex::new();
+        self.anchor.clear();
+        self.top = 0;
+        self.loaded = None;
+    }
+
+    /// Read the bytes the anchor covers, as the file is now.
+    ///
+    /// A file shorter than the indexed length yields fewer bytes.
+    #[allow(clippy::cast_possible_truncation)]
+    fn read_anchor(&self) -> io::Result<Vec<u8>> {
+        let end = self.index.len;
+        let start = end.saturating_sub(ANCHOR_BYTES);
+        let mut bytes = vec![0; (end - start) as usize];
+        let mut file = &self.file;
+        file.seek(SeekFrom::Start(start))?;
+        let mut filled = 0;
+        while filled < bytes.len() {
+            match file.read(&mut bytes[filled..])? {
+                0 => break,
+                n => filled += n,
+            }
+        }
+        bytes.truncate(filled);
+        Ok(bytes)
+    }
+
+    /// Read the lines in view.
+    fn load_visible(&mut self) -> io::Result<()> {
+        self.visible.clear();
+        let count = self
+            .rows()
+            .min(self.index.line_count().saturating_sub(self.top));
+        if count > 0 {
+            let start = self.index.line_start(&self.file, self.top)?;
+            let mut reader = BlockReader::new(&self.file, start, self.index.len);
+            let mut line = Vec::new();
+            let mut skipping = false;
+            'read: while let Some((_, block)) = reader.next_block()? {
+                let mut rest = block;
+                while !rest.is_empty() {
+                    let end = rest.iter().position(|&b| b == b'\n');
+                    let part = &rest[..end.unwrap_or(rest.len())];
+                    if !skipping {
+                        let room = MAX_LINE_BYTES - line.len();
+                        line.extend_from_slice(&part[..part.len().min(room)]);
+                        skipping = line.len() == MAX_LINE_BYTES;
+                    }
+                    let Some(end) = end else { break };
+                    self.visible.push(decode_line(&line));
+                    if self.visible.len() == count {
+                        break 'read;
+                    }
+                    line.clear();
+                    skipping = false;
+                    rest = &rest[end + 1..];
+                }
+            }
+            if self.visible.len() < count {
+                // The unterminated last line
+                self.visible.push(decode_line(&line));
+            }
+        }
+        self.loaded = Some(self.top);
+        Ok(())
+    }
+
+    /// Number of rows in view.
+    fn rows(&self) -> usize {
+        usize::from(self.bounds.height)
+    }
+
+    /// First line of the view when scrolled to the end.
+    fn bottom_line(&self) -> usize {
+        self.index.line_count().saturating_sub(self.rows())
+    }
+
+    /// Get the path of the log.
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Get the number of lines indexed.
+    pub fn line_count(&self) -> usize {
+        self.index.line_count()
+    }
+
+    /// Get the number of bytes indexed.
+    pub const fn len(&self) -> u64 {
+        self.index.len
+    }
+
+    /// Check if the indexed file is empty.
+    pub const fn is_empty(&self) -> bool {
+        self.index.len == 0
+    }
+
+    /// Get the first visible line.
+    pub const fn top(&self) -> usize {
+        self.top
+    }
+
+    /// Check if the view follows the end of the file.
+    pub const fn is_following(&self) -> bool {
+        self.follow
+    }
+
+    /// Set the default colors for text without its own.
+    pub const fn set_colors(&mut self, fg: Rgb, bg: Rgb) {
+        self.fg = fg;
+        self.bg = bg;
+        self.dirty = true;
+    }
+
+    /// Scroll so `line` is the first visible line.
+    ///
+    /// Scrolling to the end resumes following the file; anywhere else
+    /// stops it.
+    pub fn scroll_to(&mut self, line: usize) {
+        self.top = line.min(self.bottom_line());
+        self.follow = self.top == self.bottom_line();
+    }
+
+    /// Scroll up (toward the start of the file).
+    pub fn scroll_up(&mut self, lines: usize) {
+        self.scroll_to(self.top.saturating_sub(lines));
+    }
+
+    /// Scroll down (toward the end of the file).
+    pub fn scroll_down(&mut self, lines: usize) {
+        self.scroll_to(self.top.saturating_add(lines));
+    }
+
+    /// Scroll to the end and follow the file.
+    pub fn scroll_to_bottom(&mut self) {
+        self.scroll_to(usize::MAX);
+    }
+
+    /// Get the approximate heap memory used, in bytes.
+    ///
+    /// This is the index plus the visible lines, independent of the file
+    /// size beyond one checkpoint per [`STRIDE`] lines.
+    pub fn memory_usage(&self) -> usize {
+        self.index.memory_usage() + self.visible.iter().map(String::capacity).sum::<usize>()
+    }
+
+    /// Draw one line, clipped to the widget, returning the columns used.
+    #[allow(clippy::cast_possible_truncation)]
+    fn render_line(&self, buffer: &mut Buffer, y: u16, line: &str) -> u16 {
+        let mut pen = Pen {
+            fg: self.fg,
+            bg: self.bg,
+            modifiers: Modifiers::empty(),
+        };
+        let mut col = 0u16;
+        let mut parser = AnsiParser::new();
+        for event in parser.feed(line) {
+            let run = match event {
+                AnsiEvent::Text(run) => run,
+                AnsiEvent::Sgr(params) => {
+                    pen.apply_sgr(params.as_slice(), self.fg, self.bg);
+                    continue;
+                },
+            };
+            for grapheme in run.graphemes(true) {
+                let width = if grapheme == "\t" {
+                    TAB_WIDTH - col % TAB_WIDTH
+                } else {
+                    str_width(grapheme) as u16
+                };
+                if width == 0 || grapheme.starts_with(char::is_control) && grapheme != "\t" {
+                    continue;
+                }
+                if col + width > self.bounds.width {
+                    return col;
+                }
+                let x = self.bounds.x + col;
+                if grapheme == "\t" {
+                    let blank = Cell::new(' ').with_bg(pen.bg);
+                    buffer.fill_row_span(x, y, width, blank);
+                } else {
+                    buffer.set_grapheme(x, y, grapheme, pen.fg, pen.bg);
+                    if let Some(cell) = buffer.get_mut(x, y) {
+                        cell.set_modifiers(pen.modifiers);
+                    }
+                }
+                col += width;
+            }
+        }
+        col
+    }
+}
+
+/// Decode a line for display, replacing invalid UTF-8.
+fn decode_line(bytes: &[u8]) -> String {
+    let bytes = bytes.strip_suffix(b"\r").unwrap_or(bytes);
+    String::from_utf8_lossy(bytes).into_owned()
+}
+
+impl Widget for LogView {
+    fn bounds(&self) -> Rect {
+        self.bounds
+    }
+
+    fn set_bounds(&mut self, bounds: Rect) {
+        if bounds != self.bounds {
+            self.bounds = bounds;
+            if self.follow {
+                self.top = self.bottom_line();
+            }
+            self.loaded = None;
+            self.dirty = true;
+        }
+    }
+
+    #[allow(clippy::cast_possible_truncation)]
+    fn render(&self, buffer: &mut Buffer) {
+        let blank = Cell::new(' ').with_fg(self.fg).with_bg(self.bg);
+        for row in 0..self.bounds.height {
+            let y = self.bounds.y + row;
+            let used = self
+                .visible
+                .get(usize::from(row))
+                .map_or(0, |line| self.render_line(buffer, y, line));
+            let rest = self.bounds.width - used;
+            buffer.fill_row_span(self.bounds.x + used, y, rest, blank);
+        }
+    }
+
+    fn handle_input(&mut self, event: &InputEvent) -> bool {
+        let page = self.rows().max(1);
+        match event {
+            InputEvent::Key { code, .. } => match code {
+                KeyCode::Up => self.scroll_up(1),
+                KeyCode::Down => self.scroll_down(1),
+                KeyCode::PageUp => self.scroll_up(page),
+                KeyCode::PageDown => self.scroll_down(page),
+                KeyCode::Home => self.scroll_to(0),
+                KeyCode::End => self.scroll_to_bottom(),
+                _ => return false,
+            },
+            InputEvent::MouseScroll { delta, .. } => {
+                let lines = usize::from(delta.unsigned_abs()) * 3;
+                if *delta > 0 {
+                    self.scroll_up(lines);
+                } else {
+                    self.scroll_down(lines);
+                }
+            },
+            _ => return false,
+        }
+        true
+    }
+
+    fn needs_redraw(&self) -> bool {
+        self.dirty
+    }
+
+    fn clear_redraw(&mut self) {
+        self.dirty = false;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+
+    /// Write `contents` to a fresh file in the temp directory.
+    fn temp_log(name: &str, contents: &[u8]) -> PathBuf {
+        let path = std::env::temp_dir().join(format!("flywheel-{}-{name}.log", std::process::id()));
+        std::fs::write(&path, contents).unwrap();
+        path
+    }
+
+    #[test]
+    fn test_newline_scan() {
+        let text = b"a\nbb\n\n0123456789abcdef\nx\n";
+        let mut found = Vec::new();
+        for_each_newline(text, |i| {
+            found.push(i);
+            true
+        });
+        let expected: Vec<usize> = (0..text.len()).filter(|&i| text[i] == b'\n').collect();
+        assert_eq!(found, expected);
+
+        // Bytes next to a newline that differ by one bit aren't matched
+        let mut count = 0;
+        for_each_newline(b"\x0b\n\x0b\x0a\x8a\x0a\x00\x0a", |_| {
+            count += 1;
+            true
+        });
+        assert_eq!(count, 4);
+    }
+
+    #[test]
+    fn test_log_view_pages_and_follows() {
+        let mut contents = Vec::new();
+        for i in 0..1000 {
+            writeln!(contents, "line {i}").unwrap();
+        }
+        let path = temp_log("pages", &contents);
+
+        let mut view = LogView::open(&path, Rect::new(0, 0, 20, 5)).unwrap();
+        assert_eq!(view.line_count(), 1000);
+        assert_eq!(view.top(), 995);
+        assert_eq!(view.visible.last().map(String::as_str), Some("line 999"));
+
+        // Lines between checkpoints are found by scanning forward
+        view.scroll_to(130);
+        assert!(!view.is_following());
+        view.refresh().unwrap();
+        assert_eq!(view.visible[0], "line 130");
+        assert_eq!(view.visible[4], "line 134");
+
+        let mut buffer = Buffer::new(20, 5);
+        view.render(&mut buffer);
+        assert_eq!(buffer.get_grapheme(5, 0), Some("1"));
+
+        // Appended text is indexed incrementally; only a following view moves
+        let mut file = std::fs::OpenOptions::new()
+            .append(true)
+            .open(&path)
+            .unwrap();
+        file.write_all(b"line 1000\npartial").unwrap();
+        view.refresh().unwrap();
+        assert_eq!(view.line_count(), 1002);
+        assert_eq!(view.top(), 130);
+        view.scroll_to_bottom();
+        view.refresh().unwrap();
+        assert_eq!(view.visible.last().map(String::as_str), Some("partial"));
+
+        file.write_all(b" line\n").unwrap();
+        view.refresh().unwrap();
+        assert_eq!(view.line_count(), 1002);
+        assert_eq!(
+            view.visible.last().map(String::as_str),
+            Some("partial line")
+        );
+
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn test_log_view_rewritten_and_rotated() {
+        let path = temp_log("rotate", b"old 0\nold 1\n");
+        let mut view = LogView::open(&path, Rect::new(0, 0, 20, 5)).unwrap();
+        assert_eq!(view.line_count(), 2);
+
+        // Truncated and regrown past the old length between refreshes
+        std::fs::write(&path, b"new 0\nnew 1\nnew 2\n").unwrap();
+        view.refresh().unwrap();
+        assert_eq!(view.line_count(), 3);
+        assert_eq!(view.visible[0], "new 0");
+
+        // Rotated: the path names a new, longer file
+        let rotated = path.with_extension("log.1");
+        std::fs::rename(&path, &rotated).unwrap();
+        std::fs::write(&path, b"next 0\nnext 1\nnext 2\nnext 3\n").unwrap();
+        view.refresh().unwrap();
+        assert_eq!(view.line_count(), 4);
+        assert_eq!(view.visible[0], "next 0");
+
+        std::fs::remove_file(&path).unwrap();
+        std::fs::remove_file(&rotated).unwrap();
+    }
+}
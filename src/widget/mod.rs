@@ -9,6 +9,8 @@
 //! - [`TextInput`] - Single-line text input with cursor
 //! - [`StatusBar`] - Three-section status bar (left, center, right)
 //! - [`ProgressBar`] - Horizontal progress indicator
+//! - [`LogView`] - Pager over log files too large to load, with `tail -f` following
+//! - [`Terminal`] - Embedded terminal, backed by the native [`Vt`] emulator
 //!
 //! # Widget Trait
 //!
@@ -36,18 +38,34 @@
 //! ```
 
 mod traits;
+mod ansi;
+mod fold;
+mod highlight;
+mod log_view;
 mod stream;
 mod scroll_buffer;
+mod writer;
 mod text_input;
 mod status_bar;
 mod progress_bar;
 mod terminal;
+mod vt;
+#[cfg(unix)]
+mod pty;
 
 pub use traits::Widget;
 pub use stream::{StreamWidget, StreamConfig, AppendResult};
 pub use scroll_buffer::ScrollBuffer;
+pub use writer::StreamWriter;
+pub use fold::FoldId;
+pub use highlight::{
+    Class, Delimited, Highlighter, LexState, Lexer, Markdown, Span, Style, Syntax, Theme, Token,
+    Update,
+};
+pub use log_view::LogView;
 pub use text_input::{TextInput, TextInputConfig};
 pub use status_bar::{StatusBar, StatusBarConfig};
 pub use progress_bar::{ProgressBar, ProgressBarConfig, ProgressStyle};
 pub use terminal::Terminal;
+pub use vt::{Grid, Vt};
 
@@ -157,9 +157,7 @@ impl Widget for ProgressBar {
         let width = self.bounds.width as usize;
 
         // Clear the line with background
-        for i in 0..self.bounds.width {
-            buffer.set(x + i, y, Cell::new(' ').with_bg(self.config.bg));
-        }
+        buffer.fill_row_span(x, y, self.bounds.width, Cell::new(' ').with_bg(self.config.bg));
 
         // Calculate space for label and percentage
         let label_len = self.config.label.as_ref().map_or(0, |l| l.chars().count() + 1);
@@ -174,41 +172,30 @@ impl Widget for ProgressBar {
 
         // Draw label if present
         if let Some(ref label) = self.config.label {
-            for c in label.chars().take(width / 3) {
-                buffer.set(offset, y, Cell::new(c)
-                    .with_fg(self.config.label_fg)
-                    .with_bg(self.config.bg));
-                offset += 1;
-            }
-            buffer.set(offset, y, Cell::new(' ').with_bg(self.config.bg));
-            offset += 1;
+            let cells = label
+                .chars()
+                .take(width / 3)
+                .map(|c| Cell::new(c).with_fg(self.config.label_fg).with_bg(self.config.bg));
+            // The separating space is already cleared
+            offset += buffer.write_row_span_iter(offset, y, cells) + 1;
         }
 
         // Draw progress bar
         let (filled_char, empty_char) = self.style_chars();
-        let filled_count = (self.progress * bar_width as f32).round() as usize;
-
-        for i in 0..bar_width {
-            let (c, fg) = if i < filled_count {
-                (filled_char, self.config.filled_fg)
-            } else {
-                (empty_char, self.config.empty_fg)
-            };
-            buffer.set(offset + i as u16, y, Cell::new(c)
-                .with_fg(fg)
-                .with_bg(self.config.bg));
-        }
+        let filled_count = ((self.progress * bar_width as f32).round() as usize).min(bar_width);
+        let filled = Cell::new(filled_char).with_fg(self.config.filled_fg).with_bg(self.config.bg);
+        let empty = Cell::new(empty_char).with_fg(self.config.empty_fg).with_bg(self.config.bg);
+        buffer.fill_row_span(offset, y, filled_count as u16, filled);
+        buffer.fill_row_span(offset + filled_count as u16, y, (bar_width - filled_count) as u16, empty);
         offset += bar_width as u16;
 
         // Draw percentage
         if self.config.show_percentage {
             let pct = format!(" {:>3}%", (self.progress * 100.0).round() as u32);
-            for c in pct.chars() {
-                buffer.set(offset, y, Cell::new(c)
-                    .with_fg(self.config.percentage_fg)
-                    .with_bg(self.config.bg));
-                offset += 1;
-            }
+            let cells = pct
+                .chars()
+                .map(|c| Cell::new(c).with_fg(self.config.percentage_fg).with_bg(self.config.bg));
+            buffer.write_row_span_iter(offset, y, cells);
         }
     }
 
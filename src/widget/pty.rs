@@ -0,0 +1,514 @@
+//! PTY Session: A child process on a pseudo-terminal, parsed off the UI thread.
+//!
+//! The child's output never touches the UI thread. A reader thread reads
+//! the PTY, feeds the emulator and publishes immutable screen snapshots;
+//! a writer thread forwards batched input. The UI thread only swaps in the
+//! latest snapshot when it renders:
+//!
+//! ```text
+//!              ┌──────────────┐ Arc<Snapshot> ┌──────────────────┐
+//! child ─PTY─▶ │  Reader+Vt   │ ────────────▶ │ Terminal::render │
+//!   ▲          └──────────────┘ (double buf)  └──────────────────┘
+//!   │          ┌──────────────┐   Vec<u8>       (one batch/frame)
+//!   └───PTY─── │    Writer    │ ◀──────────── Terminal::flush_input
+//!              └──────────────┘
+//! ```
+//!
+//! Snapshots are double-buffered: the reader fills a back snapshot and
+//! swaps it with the published one under a lock held only for the swap.
+//! The back snapshot is reused whenever the UI has let go of it, so a
+//! steady stream of output doesn't allocate a grid per frame. Rows changed
+//! by each publish are collected next to the published snapshot until the
+//! UI takes them, so it only copies rows that changed since its last frame.
+//!
+//! Replies to status requests (cursor position, device attributes) go back
+//! to the child through the writer thread. Rows scrolled off the top of
+//! the screen are moved into a shared scrollback on each publish.
+
+use super::vt::{self, Grid, Vt};
+use crate::buffer::RopeBuffer;
+use crate::actor::{KeyCode, KeyModifiers};
+use crossbeam_channel::{unbounded, Sender};
+use rustix::fs::OFlags;
+use rustix::pty::{grantpt, openpt, ptsname, unlockpt, OpenptFlags};
+use rustix::termios::{tcsetwinsize, Winsize};
+use std::ffi::OsStr;
+use std::fs::{File, OpenOptions};
+use std::io::{self, Read, Write};
+use std::os::fd::OwnedFd;
+use std::os::unix::ffi::OsStrExt;
+use std::os::unix::fs::OpenOptionsExt;
+use std::os::unix::process::CommandExt;
+use std::process::{Child, Command, ExitStatus, Stdio};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// Bytes read from the PTY at a time.
+const READ_CHUNK: usize = 64 * 1024;
+
+/// Longest a steady stream of output goes without a published snapshot.
+const PUBLISH_INTERVAL: Duration = Duration::from_millis(8);
+
+/// An immutable copy of the emulator's screen.
+#[derive(Debug, Clone)]
+pub struct Snapshot {
+    /// The screen's cells.
+    screen: Grid,
+    /// Cursor position (x, y).
+    pub cursor: (u16, u16),
+    /// Whether the child hid the cursor.
+    pub hide_cursor: bool,
+    /// Whether arrow keys should be sent in application mode.
+    pub application_cursor: bool,
+    /// Whether pastes should be bracketed.
+    pub bracketed_paste: bool,
+    /// Publish count when this snapshot was taken.
+    pub generation: u64,
+}
+
+impl Default for Snapshot {
+    fn default() -> Self {
+        Self {
+            screen: Grid::new(1, 1),
+            cursor: (0, 0),
+            hide_cursor: false,
+            application_cursor: false,
+            bracketed_paste: false,
+            generation: 0,
+        }
+    }
+}
+
+impl Snapshot {
+    /// Get the screen's cells.
+    pub const fn screen(&self) -> &Grid {
+        &self.screen
+    }
+
+    /// Copy the emulator's state, reusing this snapshot's cell storage.
+    fn fill(&mut self, vt: &Vt, generation: u64) {
+        self.screen.copy_from(vt.screen());
+        self.cursor = vt.cursor();
+        self.hide_cursor = vt.hide_cursor();
+        self.application_cursor = vt.application_cursor();
+        self.bracketed_paste = vt.bracketed_paste();
+        self.generation = generation;
+    }
+}
+
+/// The published snapshot and the rows changed since the UI last took it.
+#[derive(Debug, Default)]
+struct Front {
+    /// The published snapshot.
+    snapshot: Arc<Snapshot>,
+    /// Rows changed by publishes the UI hasn't taken, one flag per row.
+    damage: Vec<bool>,
+}
+
+/// State shared between the session and its reader thread.
+#[derive(Debug)]
+struct Shared {
+    /// The published snapshot.
+    front: Mutex<Front>,
+    /// Number of snapshots published.
+    generation: AtomicU64,
+    /// Screen size to apply before the next output is parsed.
+    resize: Mutex<Option<(u16, u16)>>,
+    /// Rows scrolled off the top of the screen, up to the last publish.
+    history: Mutex<RopeBuffer>,
+}
+
+/// A child process running on a pseudo-terminal.
+///
+/// Dropping the session kills the child.
+#[derive(Debug)]
+pub struct PtySession {
+    /// The child process.
+    child: Child,
+    /// PTY master, kept for resizing.
+    master: OwnedFd,
+    /// Input batches for the writer thread.
+    input_tx: Sender<Vec<u8>>,
+    /// Input queued since the last flush.
+    pending: Vec<u8>,
+    /// State shared with the reader thread.
+    shared: Arc<Shared>,
+}
+
+impl PtySession {
+    /// Spawn `command` on a new PTY of the given size.
+    ///
+    /// The child gets the PTY as its controlling terminal and standard
+    /// streams, and `TERM=xterm-256color` unless the command sets `TERM`.
+    /// Up to `history` rows that scroll off the screen are kept.
+    ///
+    /// # Errors
+    /// Returns an error if the PTY can't be allocated or the child can't be
+    /// spawned.
+    pub fn spawn(mut command: Command, rows: u16, cols: u16, history: usize) -> io::Result<Self> {
+        let master = openpt(OpenptFlags::RDWR | OpenptFlags::NOCTTY)?;
+        grantpt(&master)?;
+        unlockpt(&master)?;
+        let name = ptsname(&master, Vec::new())?;
+        let slave_path = OsStr::from_bytes(name.as_bytes());
+        let slave = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .custom_flags(OFlags::NOCTTY.bits().cast_signed())
+            .open(slave_path)?;
+        tcsetwinsize(&master, winsize(rows, cols))?;
+
+        if command.get_envs().all(|(key, _)| key != "TERM") {
+            command.env("TERM", "xterm-256color");
+        }
+        command
+            .stdin(Stdio::from(slave.try_clone()?))
+            .stdout(Stdio::from(slave.try_clone()?))
+            .stderr(Stdio::from(slave));
+        set_controlling_terminal(&mut command);
+        let child = command.spawn()?;
+        // The command still holds the slave; the reader only sees end of
+        // output once every copy outside the child is closed
+        drop(command);
+
+        let shared = Arc::new(Shared {
+            front: Mutex::default(),
+            generation: AtomicU64::new(0),
+            resize: Mutex::new(None),
+            history: Mutex::new(vt::history_buffer(history)),
+        });
+        let reader = File::from(master.try_clone()?);
+        let mut writer = File::from(master.try_clone()?);
+        let (input_tx, input_rx) = unbounded::<Vec<u8>>();
+
+        let reader_shared = Arc::clone(&shared);
+        let reply_tx = input_tx.clone();
+        thread::Builder::new()
+            .name("flywheel-pty-read".to_string())
+            .spawn(move || {
+                let vt = Vt::with_history(cols, rows, history);
+                read_loop(reader, &reader_shared, &reply_tx, vt);
+            })?;
+        thread::Builder::new()
+            .name("flywheel-pty-write".to_string())
+            .spawn(move || {
+                while let Ok(bytes) = input_rx.recv() {
+                    if writer.write_all(&bytes).is_err() {
+                        break;
+                    }
+                }
+            })?;
+
+        Ok(Self {
+            child,
+            master,
+            input_tx,
+            pending: Vec::new(),
+            shared,
+        })
+    }
+
+    /// Get the latest published snapshot.
+    ///
+    /// The lock is held only to clone the pointer, so this never waits on
+    /// parsing.
+    pub fn snapshot(&self) -> Arc<Snapshot> {
+        self.shared
+            .front
+            .lock()
+            .map(|front| Arc::clone(&front.snapshot))
+            .unwrap_or_default()
+    }
+
+    /// Get the latest published snapshot along with the rows changed since
+    /// the last call, which are written into `damage`.
+    ///
+    /// Rows missing from `damage` should be treated as changed.
+    pub fn take_frame(&self, damage: &mut Vec<bool>) -> Arc<Snapshot> {
+        damage.clear();
+        let Ok(mut front) = self.shared.front.lock() else {
+            return Arc::default();
+        };
+        damage.extend_from_slice(&front.damage);
+        front.damage.fill(false);
+        Arc::clone(&front.snapshot)
+    }
+
+    /// Lock the scrollback: rows scrolled off the top of the screen, as of
+    /// the latest published snapshot.
+    ///
+    /// The reader thread takes this lock to publish, so hold it only while
+    /// drawing.
+    pub fn history(&self) -> Option<MutexGuard<'_, RopeBuffer>> {
+        self.shared.history.lock().ok()
+    }
+
+    /// Get the number of snapshots published so far.
+    pub fn generation(&self) -> u64 {
+        self.shared.generation.load(Ordering::Acquire)
+    }
+
+    /// Queue input for the child.
+    ///
+    /// Nothing is written until [`flush_input`](Self::flush_input).
+    pub fn queue_input(&mut self, bytes: &[u8]) {
+        self.pending.extend_from_slice(bytes);
+    }
+
+    /// Hand queued input to the writer thread as one batch.
+    ///
+    /// Never blocks: a child that stops reading its input backs up the
+    /// writer thread, not the caller.
+    pub fn flush_input(&mut self) {
+        if !self.pending.is_empty() {
+            let _ = self.input_tx.send(std::mem::take(&mut self.pending));
+        }
+    }
+
+    /// Resize the PTY and, before it parses more output, the emulator.
+    ///
+    /// # Errors
+    /// Returns an error if the PTY size can't be set.
+    pub fn resize(&self, rows: u16, cols: u16) -> io::Result<()> {
+        if let Ok(mut resize) = self.shared.resize.lock() {
+            *resize = Some((rows, cols));
+        }
+        tcsetwinsize(&self.master, winsize(rows, cols))?;
+        Ok(())
+    }
+
+    /// Check whether the child has exited, without waiting.
+    ///
+    /// # Errors
+    /// Returns an error if the child's status can't be read.
+    pub fn try_wait(&mut self) -> io::Result<Option<ExitStatus>> {
+        self.child.try_wait()
+    }
+}
+
+impl Drop for PtySession {
+    fn drop(&mut self) {
+        let _ = self.child.kill();
+        let _ = self.child.wait();
+    }
+}
+
+/// Read and parse output until the PTY closes, publishing snapshots.
+fn read_loop(mut master: File, shared: &Shared, replies: &Sender<Vec<u8>>, mut vt: Vt) {
+    let mut buf = vec![0u8; READ_CHUNK];
+    let mut back = Arc::new(Snapshot::default());
+    let mut last_publish = Instant::now();
+
+    loop {
+        let n = match master.read(&mut buf) {
+            Ok(0) => break,
+            Ok(n) => n,
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+            // EIO once the child side is closed
+            Err(_) => break,
+        };
+        if let Some((rows, cols)) = shared.resize.lock().ok().and_then(|mut r| r.take()) {
+            vt.resize(cols, rows);
+        }
+        vt.feed(&buf[..n]);
+        let responses = vt.take_responses();
+        if !responses.is_empty() {
+            let _ = replies.send(responses);
+        }
+
+        // A short read means the child has gone quiet for now
+        if n < buf.len() || last_publish.elapsed() >= PUBLISH_INTERVAL {
+            publish(&mut vt, &mut back, shared);
+            last_publish = Instant::now();
+        }
+    }
+    publish(&mut vt, &mut back, shared);
+}
+
+/// Fill the back snapshot from the emulator and swap it to the front.
+fn publish(vt: &mut Vt, back: &mut Arc<Snapshot>, shared: &Shared) {
+    if Arc::get_mut(back).is_none() {
+        // The UI still holds the previous front; don't wait for it
+        *back = Arc::default();
+    }
+    let Some(snapshot) = Arc::get_mut(back) else {
+        return;
+    };
+    let generation = shared.generation.load(Ordering::Relaxed) + 1;
+    snapshot.fill(vt, generation);
+    if vt.has_history() {
+        if let Ok(mut history) = shared.history.lock() {
+            vt.drain_history(&mut history);
+        }
+    }
+
+    if let Ok(mut front) = shared.front.lock() {
+        std::mem::swap(&mut front.snapshot, back);
+        if front.damage.len() == vt.damage().len() {
+            for (pending, &changed) in front.damage.iter_mut().zip(vt.damage()) {
+                *pending |= changed;
+            }
+        } else {
+            front.damage = vec![true; vt.damage().len()];
+        }
+    }
+    vt.clear_damage();
+    shared.generation.store(generation, Ordering::Release);
+}
+
+/// Build a window size for the PTY.
+const fn winsize(rows: u16, cols: u16) -> Winsize {
+    Winsize {
+        ws_row: rows,
+        ws_col: cols,
+        ws_xpixel: 0,
+        ws_ypixel: 0,
+    }
+}
+
+/// Make the child a session leader with its PTY as controlling terminal,
+/// so job control and signals from keys like Ctrl-C work.
+#[allow(unsafe_code)]
+fn set_controlling_terminal(command: &mut Command) {
+    // SAFETY: The hook runs in the forked child before exec and only makes
+    // the setsid and TIOCSCTTY system calls, which are async-signal-safe
+    // and neither allocate nor take locks.
+    unsafe {
+        command.pre_exec(|| {
+            rustix::process::setsid()?;
+            rustix::process::ioctl_tiocsctty(rustix::stdio::stdin())?;
+            Ok(())
+        });
+    }
+}
+
+/// Encode a key for the child, as xterm would send it.
+///
+/// # Returns
+/// Whether the key has an encoding.
+#[allow(clippy::cast_possible_truncation)]
+pub fn encode_key(
+    code: KeyCode,
+    modifiers: KeyModifiers,
+    application_cursor: bool,
+    out: &mut Vec<u8>,
+) -> bool {
+    if matches!(code, KeyCode::F(0 | 13..) | KeyCode::Null) {
+        return false;
+    }
+    let arrow = |out: &mut Vec<u8>, letter: u8| {
+        out.extend_from_slice(if application_cursor { b"\x1bO" } else { b"\x1b[" });
+        out.push(letter);
+    };
+    if modifiers.alt {
+        out.push(0x1b);
+    }
+    match code {
+        KeyCode::Char(c) if modifiers.control && c.is_ascii_alphabetic() => {
+            out.push(c.to_ascii_lowercase() as u8 & 0x1f);
+        },
+        KeyCode::Char(c) => {
+            let mut utf8 = [0u8; 4];
+            out.extend_from_slice(c.encode_utf8(&mut utf8).as_bytes());
+        },
+        KeyCode::Enter => out.push(b'\r'),
+        KeyCode::Backspace => out.push(0x7f),
+        KeyCode::Tab => out.push(b'\t'),
+        KeyCode::BackTab => out.extend_from_slice(b"\x1b[Z"),
+        KeyCode::Esc => out.push(0x1b),
+        KeyCode::Up => arrow(out, b'A'),
+        KeyCode::Down => arrow(out, b'B'),
+        KeyCode::Right => arrow(out, b'C'),
+        KeyCode::Left => arrow(out, b'D'),
+        KeyCode::Home => arrow(out, b'H'),
+        KeyCode::End => arrow(out, b'F'),
+        KeyCode::Insert => out.extend_from_slice(b"\x1b[2~"),
+        KeyCode::Delete => out.extend_from_slice(b"\x1b[3~"),
+        KeyCode::PageUp => out.extend_from_slice(b"\x1b[5~"),
+        KeyCode::PageDown => out.extend_from_slice(b"\x1b[6~"),
+        KeyCode::F(n @ 1..=4) => {
+            out.extend_from_slice(b"\x1bO");
+            out.push(b'P' + n - 1);
+        },
+        KeyCode::F(n @ 5..=12) => {
+            const CODES: [u8; 8] = [15, 17, 18, 19, 20, 21, 23, 24];
+            let _ = write!(out, "\x1b[{}~", CODES[usize::from(n - 5)]);
+        },
+        KeyCode::F(_) | KeyCode::Null => {},
+    }
+    true
+}
+
+/// Encode pasted text for the child, bracketed by `ESC [200~` and
+/// `ESC [201~` if it asked for that.
+///
+/// End markers inside the text are dropped, so a paste can't end the
+/// bracket early and have the rest run as typed input.
+pub fn encode_paste(text: &str, bracketed: bool, out: &mut Vec<u8>) {
+    if !bracketed {
+        out.extend_from_slice(text.as_bytes());
+        return;
+    }
+    out.extend_from_slice(b"\x1b[200~");
+    for part in text.split("\x1b[201~") {
+        out.extend_from_slice(part.as_bytes());
+    }
+    out.extend_from_slice(b"\x1b[201~");
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_encode_key() {
+        let mut out = Vec::new();
+        let ctrl = KeyModifiers {
+            control: true,
+            ..KeyModifiers::NONE
+        };
+        assert!(encode_key(KeyCode::Char('c'), ctrl, false, &mut out));
+        assert!(encode_key(KeyCode::Up, KeyModifiers::NONE, false, &mut out));
+        assert!(encode_key(KeyCode::Up, KeyModifiers::NONE, true, &mut out));
+        assert!(encode_key(KeyCode::F(5), KeyModifiers::NONE, false, &mut out));
+        assert!(!encode_key(KeyCode::Null, KeyModifiers::NONE, false, &mut out));
+        assert_eq!(out, b"\x03\x1b[A\x1bOA\x1b[15~");
+    }
+
+    #[test]
+    fn test_encode_paste() {
+        let mut out = Vec::new();
+        encode_paste("ls\n", false, &mut out);
+        encode_paste("rm -rf\x1b[201~\n", true, &mut out);
+        assert_eq!(out, b"ls\n\x1b[200~rm -rf\n\x1b[201~");
+    }
+
+    #[test]
+    fn test_pty_session_runs_shell() {
+        let mut command = Command::new("/bin/sh");
+        command.args(["-c", "read line; printf 'got %s' \"$line\""]);
+        let mut session = PtySession::spawn(command, 5, 40, 0).unwrap();
+
+        session.queue_input(b"hi");
+        session.queue_input(b"\r");
+        session.flush_input();
+
+        let deadline = Instant::now() + Duration::from_secs(5);
+        let found = loop {
+            let snapshot = session.snapshot();
+            let screen = snapshot.screen();
+            let text: String = (0..screen.height())
+                .flat_map(|y| (0..screen.width()).map(move |x| (x, y)))
+                .filter_map(|(x, y)| screen.get_grapheme(x, y))
+                .collect();
+            if text.contains("got hi") || Instant::now() > deadline {
+                break text.contains("got hi");
+            }
+            thread::sleep(Duration::from_millis(10));
+        };
+        assert!(found);
+        assert!(session.generation() > 0);
+    }
+}
@@ -2,32 +2,33 @@
 //!
 //! This provides efficient storage for text content that may scroll
 //! off the visible area, with O(1) append and scroll operations.
+//! Lines live in a [`RopeBuffer`], so scrollback is chunked, searchable
+//! and can spill to disk. Regions of lines can be folded away; scrolling
+//! and viewport mapping then count rows, which skip hidden lines.
 
-use std::collections::VecDeque;
-use crate::buffer::Cell;
+use std::io;
+use std::ops::Range;
+use std::path::Path;
+use crate::buffer::rope::CHUNK_SIZE;
+use crate::buffer::{Cell, ChunkedLine, RopeBuffer, SearchMatch, SearchQuery};
+use super::ansi::Pen;
+use super::fold::{FoldId, FoldIndex};
 
-/// A line of text with associated style information.
-#[derive(Debug, Clone)]
-pub struct StyledLine {
-    /// The text content of the line.
-    pub content: Vec<Cell>,
-    /// Whether this line was soft-wrapped (vs. hard newline).
-    pub wrapped: bool,
-}
+/// Chunks kept uncompressed by [`ScrollBuffer::with_compression`].
+const COMPRESS_HOT_CHUNKS: usize = 4;
 
-impl StyledLine {
-    /// Create a new styled line.
-    pub const fn new(content: Vec<Cell>, wrapped: bool) -> Self {
-        Self { content, wrapped }
-    }
+/// A line of text with associated style information.
+pub type StyledLine = ChunkedLine;
 
-    /// Create an empty line.
-    pub const fn empty() -> Self {
-        Self {
-            content: Vec::new(),
-            wrapped: false,
-        }
-    }
+/// Write position inside the current logical line after a carriage return.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct WritePos {
+    /// Physical lines between the write line and the last line.
+    ///
+    /// Counted from the end so it stays valid when old lines are evicted.
+    back: usize,
+    /// Cell index within the write line.
+    cell: usize,
 }
 
 /// Ring buffer for storing lines with scrollback.
@@ -37,33 +38,72 @@ impl StyledLine {
 #[derive(Debug)]
 pub struct ScrollBuffer {
     /// Lines stored in the buffer.
-    lines: VecDeque<StyledLine>,
-    /// Maximum number of lines to retain.
-    max_lines: usize,
+    lines: RopeBuffer,
     /// Current scroll offset from the bottom (0 = at bottom).
     scroll_offset: usize,
+    /// Overwrite position, or `None` when writes append to the last line.
+    overwrite: Option<WritePos>,
+    /// Fold regions, by line id.
+    folds: FoldIndex,
+    /// Id of the first retained line: the number of lines evicted before it.
+    first_id: usize,
 }
 
 impl ScrollBuffer {
     /// Create a new scroll buffer with the given capacity.
     pub fn new(max_lines: usize) -> Self {
-        let mut lines = VecDeque::with_capacity(max_lines);
-        lines.push_back(StyledLine::empty());
+        Self {
+            lines: RopeBuffer::new(max_lines.max(1)),
+            scroll_offset: 0,
+            overwrite: None,
+            folds: FoldIndex::new(),
+            first_id: 0,
+        }
+    }
 
+    /// Create a scroll buffer that compresses lines far from the bottom.
+    ///
+    /// Up to `max_lines` lines are kept, as with [`new`](Self::new), but
+    /// only the newest few hundred stay as cells; the rest are compressed
+    /// and decompressed when scrolled into view (see
+    /// [`ensure_visible`](Self::ensure_visible)).
+    pub fn with_compression(max_lines: usize) -> Self {
         Self {
-            lines,
-            max_lines,
+            lines: RopeBuffer::with_compression(max_lines.max(1), COMPRESS_HOT_CHUNKS),
             scroll_offset: 0,
+            overwrite: None,
+            folds: FoldIndex::new(),
+            first_id: 0,
         }
     }
 
+    /// Create a scroll buffer that keeps all history, spilling to disk.
+    ///
+    /// About `max_lines` of the newest lines stay in memory; older lines
+    /// are written to a spill file in `dir` instead of being discarded,
+    /// and read back when scrolled into view (see
+    /// [`ensure_visible`](Self::ensure_visible)).
+    ///
+    /// # Errors
+    /// Returns an error if the spill file can't be created.
+    pub fn with_spill(max_lines: usize, dir: &Path) -> io::Result<Self> {
+        let hot_chunks = max_lines.div_ceil(CHUNK_SIZE).max(2);
+        Ok(Self {
+            lines: RopeBuffer::with_spill(0, hot_chunks, dir)?,
+            scroll_offset: 0,
+            overwrite: None,
+            folds: FoldIndex::new(),
+            first_id: 0,
+        })
+    }
+
     /// Get the total number of lines in the buffer.
-    pub fn len(&self) -> usize {
+    pub const fn len(&self) -> usize {
         self.lines.len()
     }
 
     /// Check if the buffer is empty.
-    pub fn is_empty(&self) -> bool {
+    pub const fn is_empty(&self) -> bool {
         self.lines.is_empty()
     }
 
@@ -73,7 +113,7 @@ impl ScrollBuffer {
     ///
     /// Panics if the buffer is empty (which should never happen).
     pub fn current_line(&self) -> &StyledLine {
-        self.lines.back().expect("Buffer should never be empty")
+        self.lines.current_line().expect("Buffer should never be empty")
     }
 
     /// Get a mutable reference to the current line.
@@ -82,48 +122,295 @@ impl ScrollBuffer {
     ///
     /// Panics if the buffer is empty (which should never happen).
     pub fn current_line_mut(&mut self) -> &mut StyledLine {
-        self.lines.back_mut().expect("Buffer should never be empty")
+        self.lines.current_line_mut().expect("Buffer should never be empty")
+    }
+
+    /// Get a mutable reference to the line `back` lines above the last one.
+    fn line_back_mut(&mut self, back: usize) -> &mut StyledLine {
+        let index = self.lines.len() - 1 - back;
+        self.lines.get_line_mut(index).expect("Write line should be retained")
     }
 
     /// Append cells to the current line.
+    ///
+    /// This ignores any overwrite position; use [`put`](Self::put) to
+    /// honour it.
     pub fn append(&mut self, cells: impl IntoIterator<Item = Cell>) {
         self.current_line_mut().content.extend(cells);
     }
 
+    /// Write a cell at the write position.
+    ///
+    /// After a [`carriage_return`](Self::carriage_return) this replaces the
+    /// existing cell and advances; otherwise it appends to the current line.
+    ///
+    /// # Returns
+    /// The cell that was replaced, if any.
+    pub fn put(&mut self, cell: Cell) -> Option<Cell> {
+        let Some(pos) = self.overwrite else {
+            self.current_line_mut().content.push(cell);
+            return None;
+        };
+
+        let line = &mut self.line_back_mut(pos.back).content;
+        let replaced = if pos.cell < line.len() {
+            Some(std::mem::replace(&mut line[pos.cell], cell))
+        } else {
+            line.push(cell);
+            None
+        };
+        let caught_up = pos.back == 0 && pos.cell + 1 >= line.len();
+
+        // Caught up with the end of the buffer: back to plain appends
+        self.overwrite = (!caught_up).then_some(WritePos {
+            back: pos.back,
+            cell: pos.cell + 1,
+        });
+        replaced
+    }
+
+    /// Get the cell just before the write position on the write line.
+    pub fn previous_cell_mut(&mut self) -> Option<&mut Cell> {
+        let (back, cell) = self.overwrite.map_or((0, usize::MAX), |pos| (pos.back, pos.cell));
+        let line = &mut self.line_back_mut(back).content;
+        let end = cell.min(line.len());
+        line[..end].last_mut()
+    }
+
+    /// Restyle the cells just before the write position.
+    ///
+    /// `pens` gives the new style of each of the last `pens.len()` cells
+    /// written, oldest first. The walk continues onto earlier physical
+    /// lines that soft-wrap into the write line.
+    ///
+    /// # Returns
+    /// The position of the earliest cell that changed, as the number of
+    /// physical lines above the write line and the cell index, or `None`
+    /// if every cell already had its style.
+    pub fn restyle_back(&mut self, pens: &[Pen]) -> Option<(usize, usize)> {
+        let (mut back, mut end) =
+            self.overwrite.map_or((0, usize::MAX), |pos| (pos.back, pos.cell));
+        let mut pens = pens.iter().rev();
+        let mut changed = None;
+        for above in 0.. {
+            let index = self.lines.len() - 1 - back;
+            let Some(line) = self.lines.get_line_mut(index) else {
+                break;
+            };
+            let cells = &mut line.content;
+            for i in (0..end.min(cells.len())).rev() {
+                let Some(pen) = pens.next() else {
+                    return changed;
+                };
+                let cell = cells[i];
+                if (cell.fg(), cell.bg(), cell.modifiers()) != (pen.fg, pen.bg, pen.modifiers) {
+                    cells[i] = cell.with_fg(pen.fg).with_bg(pen.bg).with_modifiers(pen.modifiers);
+                    changed = Some((above, i));
+                }
+            }
+
+            let wraps_into = index > 0
+                && self.lines.get_line(index - 1).is_some_and(|line| line.wrapped);
+            if !wraps_into {
+                break;
+            }
+            back += 1;
+            end = usize::MAX;
+        }
+        changed
+    }
+
+    /// Rewind the write position to the start of the current logical line.
+    ///
+    /// Subsequent [`put`](Self::put) calls overwrite the line in place
+    /// instead of growing it.
+    ///
+    /// # Returns
+    /// The number of physical lines between the start of the logical line
+    /// and the last line.
+    pub fn carriage_return(&mut self) -> usize {
+        let last = self.lines.len() - 1;
+        let back = (0..last)
+            .rev()
+            .take_while(|&i| self.lines.get_line(i).is_some_and(|line| line.wrapped))
+            .count();
+        self.overwrite = Some(WritePos { back, cell: 0 });
+        back
+    }
+    /// Move an overwrite to the start of the next physical line of the same
+    /// logical line.
+    ///
+    /// Returns `false` if not overwriting or already on the last line.
+    pub const fn advance_line(&mut self) -> bool {
+        match self.overwrite.as_mut() {
+            Some(pos) if pos.back > 0 => {
+                pos.back -= 1;
+                pos.cell = 0;
+                true
+            }
+            _ => false,
+        }
+    }
+
+    /// Stop overwriting, returning subsequent writes to the end of the buffer.
+    ///
+    /// # Returns
+    /// How many physical lines the write position was above the last line.
+    pub fn end_overwrite(&mut self) -> usize {
+        self.overwrite.take().map_or(0, |pos| pos.back)
+    }
+
+    /// Get how many physical lines the write position is above the last line.
+    pub const fn write_line_back(&self) -> usize {
+        match self.overwrite {
+            Some(pos) => pos.back,
+            None => 0,
+        }
+    }
+
+    /// Check if writes currently overwrite existing cells.
+    pub const fn is_overwriting(&self) -> bool {
+        self.overwrite.is_some()
+    }
+
     /// Start a new line.
     ///
+    /// Any overwrite in progress ends; the new line follows the last line.
+    ///
     /// # Arguments
     ///
-    /// * `wrapped` - Whether the new line is due to soft wrapping.
+    /// * `wrapped` - Whether the current line is being soft-wrapped onto
+    ///   the new line, rather than ended by a hard newline.
     pub fn newline(&mut self, wrapped: bool) {
-        // Trim excess lines if at capacity
-        while self.lines.len() >= self.max_lines {
-            self.lines.pop_front();
+        self.overwrite = None;
+        self.current_line_mut().wrapped = wrapped;
+
+        // Excess lines are trimmed by the rope
+        let before = self.lines.len();
+        self.lines.newline();
+        self.first_id += before + 1 - self.lines.len();
+        self.folds.evict_before(self.first_id);
+    }
+
+    /// Get the line id of the next fold boundary: the current line if
+    /// nothing has been written to it yet, otherwise the line after it.
+    fn fold_boundary(&self) -> usize {
+        let last = self.first_id + self.lines.len() - 1;
+        if self.current_line().is_empty() {
+            last
+        } else {
+            last + 1
         }
+    }
+
+    /// Start a fold region.
+    ///
+    /// The region begins with the next line to be started: the current
+    /// line if it is still empty, otherwise the line after it.
+    pub fn begin_fold(&mut self) -> FoldId {
+        let start = self.fold_boundary();
+        self.folds.begin(start)
+    }
 
-        self.lines.push_back(StyledLine::new(Vec::new(), wrapped));
+    /// End a fold region.
+    ///
+    /// The region takes every line started since
+    /// [`begin_fold`](Self::begin_fold), including the current line unless
+    /// it is still empty.
+    ///
+    /// # Returns
+    /// `false` if the region was already ended or has been evicted.
+    pub fn end_fold(&mut self, id: FoldId) -> bool {
+        let end = self.fold_boundary();
+        self.folds.end(id, end)
+    }
+
+    /// Hide or show the lines of an ended fold region.
+    ///
+    /// Takes O(log n) in the number of regions, however many lines the
+    /// region holds; lines are neither copied nor rewrapped.
+    ///
+    /// # Returns
+    /// `false` if the region doesn't exist, hasn't ended, or was already
+    /// in that state.
+    pub fn set_folded(&mut self, id: FoldId, folded: bool) -> bool {
+        let changed = self.folds.set_folded(id, folded);
+        if changed {
+            self.scroll_offset = self.scroll_offset.min(self.row_count().saturating_sub(1));
+        }
+        changed
+    }
+
+    /// Check if a fold region is folded.
+    pub fn is_folded(&self, id: FoldId) -> bool {
+        self.folds.is_folded(id)
+    }
+
+    /// Check if a line is hidden by a folded region.
+    pub fn is_hidden(&self, index: usize) -> bool {
+        self.folds.is_hidden(self.first_id + index)
+    }
+
+    /// Get the number of rows: lines not hidden by folded regions.
+    pub fn row_count(&self) -> usize {
+        if !self.folds.any_folded() {
+            return self.lines.len();
+        }
+        let end = self.first_id + self.lines.len();
+        self.folds.visible_before(end) - self.folds.visible_before(self.first_id)
+    }
+
+    /// Get the index of the line shown on a row.
+    ///
+    /// `row` must be less than [`row_count`](Self::row_count).
+    pub fn row_line(&self, row: usize) -> usize {
+        if !self.folds.any_folded() {
+            return row;
+        }
+        let skipped = self.folds.visible_before(self.first_id);
+        self.folds.nth_visible(skipped + row) - self.first_id
+    }
+
+    /// Get the row a line is shown on, or would be if it weren't hidden:
+    /// the number of visible lines before it.
+    pub fn line_row(&self, index: usize) -> usize {
+        if !self.folds.any_folded() {
+            return index;
+        }
+        self.folds.visible_before(self.first_id + index)
+            - self.folds.visible_before(self.first_id)
     }
 
     /// Get a line by index from the top of the buffer.
     pub fn get(&self, index: usize) -> Option<&StyledLine> {
-        self.lines.get(index)
+        self.lines.get_line(index)
     }
 
     /// Get visible lines for a given viewport height.
     ///
     /// Returns an iterator over lines that should be visible,
-    /// accounting for scroll offset.
+    /// accounting for scroll offset and folded regions.
     pub fn visible_lines(&self, viewport_height: usize) -> impl Iterator<Item = &StyledLine> {
-        let total = self.lines.len();
+        self.visible_range(viewport_height)
+            .filter_map(|row| self.lines.get_line(self.row_line(row)))
+    }
+
+    /// Get the range of rows visible in a viewport of the given height.
+    ///
+    /// Row `range.start` is drawn on the first viewport row; map rows to
+    /// lines with [`row_line`](Self::row_line). Without folded regions,
+    /// rows are line indices.
+    pub fn visible_range(&self, viewport_height: usize) -> Range<usize> {
+        let total = self.row_count();
         let end = total.saturating_sub(self.scroll_offset);
         let start = end.saturating_sub(viewport_height);
 
-        self.lines.range(start..end)
+        start..end
     }
 
     /// Scroll up by the given number of lines.
     pub fn scroll_up(&mut self, lines: usize) {
-        let max_offset = self.lines.len().saturating_sub(1);
+        let max_offset = self.row_count().saturating_sub(1);
         self.scroll_offset = (self.scroll_offset + lines).min(max_offset);
     }
 
@@ -142,11 +429,44 @@ impl ScrollBuffer {
         self.scroll_offset == 0
     }
 
+    /// Make sure the lines visible in a viewport of the given height are in
+    /// memory, decompressing them if they were frozen.
+    ///
+    /// # Errors
+    /// Returns an error if frozen lines can't be read back; they are then
+    /// missing from [`get`](Self::get).
+    pub fn ensure_visible(&mut self, viewport_height: usize) -> io::Result<()> {
+        let rows = self.visible_range(viewport_height);
+        if !self.folds.any_folded() {
+            return self.lines.ensure_resident(rows);
+        }
+
+        // Folded regions split the viewport into runs of adjacent lines
+        let mut runs: Vec<Range<usize>> = Vec::new();
+        for line in rows.map(|row| self.row_line(row)) {
+            match runs.last_mut() {
+                Some(run) if run.end == line => run.end += 1,
+                _ => runs.push(line..line + 1),
+            }
+        }
+        self.lines.ensure_resident_runs(&runs)
+    }
+
+    /// Search the scrollback.
+    ///
+    /// # Returns
+    /// All matches, in order, with line indices as used by [`get`](Self::get).
+    pub fn search(&mut self, query: &SearchQuery) -> Vec<SearchMatch> {
+        self.lines.search(query)
+    }
+
     /// Clear all content.
     pub fn clear(&mut self) {
         self.lines.clear();
-        self.lines.push_back(StyledLine::empty());
         self.scroll_offset = 0;
+        self.overwrite = None;
+        self.folds.clear();
+        self.first_id = 0;
     }
 
     /// Get the length of the current line in characters.
@@ -163,49 +483,65 @@ impl ScrollBuffer {
             return;
         }
 
-        // Collect all content into logical lines (merging soft-wrapped lines)
-        let mut logical_lines: Vec<Vec<Cell>> = Vec::new();
-        let mut current_logical: Vec<Cell> = Vec::new();
+        // Stream logical lines (merging soft-wrapped lines) into a new
+        // buffer, re-wrapped to the new width; it trims to the same limit
+        let mut rewrapped = self.lines.empty_like();
+        let mut push_logical = |logical: &[Cell]| {
+            if logical.is_empty() {
+                rewrapped.push_line(StyledLine::empty());
+                return 1;
+            }
+            let chunk_count = logical.len().div_ceil(new_width);
+            for (i, chunk) in logical.chunks(new_width).enumerate() {
+                rewrapped.push_line(StyledLine::new(chunk.to_vec(), i < chunk_count - 1));
+            }
+            chunk_count
+        };
+
+        // Fold boundaries move to the new first line of their logical line
+        let mut boundaries = self.folds.boundaries().iter().copied().peekable();
+        let mut moved: Vec<(usize, usize)> = Vec::new();
+        let mut move_boundaries = |old_end: usize, new_id: usize| {
+            while let Some(boundary) = boundaries.next_if(|&b| b < old_end) {
+                moved.push((boundary, new_id));
+            }
+        };
+        let mut old_id = self.first_id;
+        let mut new_id = 0;
 
-        for line in &self.lines {
+        let mut current_logical: Vec<Cell> = Vec::new();
+        let mut any_logical = false;
+        let visited = self.lines.visit_lines(|line| {
             current_logical.extend(line.content.iter().copied());
+            old_id += 1;
             if !line.wrapped {
                 // Hard newline - end of logical line
-                logical_lines.push(std::mem::take(&mut current_logical));
+                move_boundaries(old_id, new_id);
+                new_id += push_logical(&current_logical);
+                current_logical.clear();
+                any_logical = true;
             }
+        });
+        if visited.is_err() {
+            // Keep the old layout rather than lose history
+            return;
         }
         // Don't forget the last line if it didn't end with a newline
-        if !current_logical.is_empty() || logical_lines.is_empty() {
-            logical_lines.push(current_logical);
-        }
-
-        // Re-wrap logical lines to new width
-        self.lines.clear();
-        for logical in logical_lines {
-            if logical.is_empty() {
-                self.lines.push_back(StyledLine::empty());
-            } else {
-                let chunks: Vec<_> = logical.chunks(new_width).collect();
-                let chunk_count = chunks.len();
-                for (i, chunk) in chunks.into_iter().enumerate() {
-                    let wrapped = i < chunk_count - 1;
-                    self.lines.push_back(StyledLine::new(chunk.to_vec(), wrapped));
-                }
-            }
-        }
-
-        // Ensure we always have at least one line
-        if self.lines.is_empty() {
-            self.lines.push_back(StyledLine::empty());
-        }
-
-        // Trim to max_lines if needed
-        while self.lines.len() > self.max_lines {
-            self.lines.pop_front();
+        if !current_logical.is_empty() || !any_logical {
+            move_boundaries(old_id, new_id);
+            new_id += push_logical(&current_logical);
         }
+        move_boundaries(usize::MAX, new_id);
+        self.first_id = new_id - rewrapped.len();
+        self.folds.remap(self.first_id, |old| {
+            let i = moved.partition_point(|&(boundary, _)| boundary < old);
+            moved.get(i).map_or(new_id, |&(_, new)| new)
+        });
+        self.lines = rewrapped;
 
         // Reset scroll to bottom after rewrap
         self.scroll_offset = 0;
+        self.overwrite = None;
     }
 }
 
@@ -285,4 +621,52 @@ mod tests {
         buf.scroll_to_bottom();
         assert!(buf.at_bottom());
     }
+
+    #[test]
+    fn test_scroll_buffer_carriage_return() {
+        let mut buf = ScrollBuffer::new(100);
+        buf.append(text_to_cells("12345"));
+        buf.newline(true);
+        buf.append(text_to_cells("678"));
+
+        // Rewinds to the start of the logical line, not the physical one
+        assert_eq!(buf.carriage_return(), 1);
+        for cell in text_to_cells("ab") {
+            assert!(buf.put(cell).is_some());
+        }
+        assert_eq!(buf.write_line_back(), 1);
+
+        let l0: String = buf.get(0).unwrap().content.iter().map(|c| c.grapheme().unwrap_or("")).collect();
+        assert_eq!(l0, "ab345");
+
+        // Running past the end of the last line resumes appending
+        assert!(buf.advance_line());
+        for cell in text_to_cells("xyz!") {
+            buf.put(cell);
+        }
+        assert!(!buf.is_overwriting());
+        assert_eq!(buf.current_line_len(), 4);
+        assert_eq!(buf.len(), 2);
+    }
+
+    #[test]
+    fn test_scroll_buffer_spill() {
+        let mut buf = ScrollBuffer::with_spill(64, &std::env::temp_dir()).unwrap();
+        for i in 0..500 {
+            buf.append(text_to_cells(&format!("Line {i}")));
+            buf.newline(false);
+        }
+
+        // The oldest lines are on disk until scrolled into view
+        assert_eq!(buf.len(), 501);
+        assert!(buf.get(0).is_none());
+        buf.scroll_up(500);
+        buf.ensure_visible(10).unwrap();
+        let l0: String = buf.get(0).unwrap().content.iter().map(|c| c.grapheme().unwrap_or("")).collect();
+        assert_eq!(l0, "Line 0");
+
+        // Rewrapping reads every line back: each one now takes two rows
+        buf.rewrap(4);
+        assert_eq!(buf.len(), 2 * 500 + 1);
+    }
 }
@@ -132,45 +132,28 @@ impl Widget for StatusBar {
         let width = self.bounds.width as usize;
 
         // Clear the line with background
-        for i in 0..self.bounds.width {
-            buffer.set(x + i, y, Cell::new(' ').with_bg(self.config.bg));
-        }
+        buffer.fill_row_span(x, y, self.bounds.width, Cell::new(' ').with_bg(self.config.bg));
+
+        // Each section gets at most a third of the bar
+        let max = width / 3;
+        let bg = self.config.bg;
+        let cells = |fg| move |c| Cell::new(c).with_fg(fg).with_bg(bg);
 
         // Draw left section (left-aligned)
-        let left_chars: Vec<char> = self.left.chars().collect();
-        for (i, &c) in left_chars.iter().take(width / 3).enumerate() {
-            #[allow(clippy::cast_possible_truncation)]
-            let px = x + i as u16;
-            buffer.set(px, y, Cell::new(c)
-                .with_fg(self.config.left_fg)
-                .with_bg(self.config.bg));
-        }
+        let left = self.left.chars().take(max).map(cells(self.config.left_fg));
+        buffer.write_row_span_iter(x, y, left);
 
         // Draw center section (centered)
-        let center_chars: Vec<char> = self.center.chars().collect();
-        let center_len = center_chars.len().min(width / 3);
+        let center = self.center.chars().take(max);
         #[allow(clippy::cast_possible_truncation)]
-        let center_start = x + ((width - center_len) / 2) as u16;
-        for (i, &c) in center_chars.iter().take(center_len).enumerate() {
-            #[allow(clippy::cast_possible_truncation)]
-            let px = center_start + i as u16;
-            buffer.set(px, y, Cell::new(c)
-                .with_fg(self.config.center_fg)
-                .with_bg(self.config.bg));
-        }
+        let center_start = x + ((width - center.clone().count()) / 2) as u16;
+        buffer.write_row_span_iter(center_start, y, center.map(cells(self.config.center_fg)));
 
         // Draw right section (right-aligned)
-        let right_chars: Vec<char> = self.right.chars().collect();
-        let right_len = right_chars.len().min(width / 3);
+        let right = self.right.chars().take(max);
         #[allow(clippy::cast_possible_truncation)]
-        let right_start = x + (width - right_len) as u16;
-        for (i, &c) in right_chars.iter().take(right_len).enumerate() {
-            #[allow(clippy::cast_possible_truncation)]
-            let px = right_start + i as u16;
-            buffer.set(px, y, Cell::new(c)
-                .with_fg(self.config.right_fg)
-                .with_bg(self.config.bg));
-        }
+        let right_start = x + (width - right.clone().count()) as u16;
+        buffer.write_row_span_iter(right_start, y, right.map(cells(self.config.right_fg)));
     }
 
     fn handle_input(&mut self, _event: &InputEvent) -> bool {
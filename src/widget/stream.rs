@@ -16,19 +16,41 @@
 //! - **Fast Path**: Direct ANSI emission for simple appends (0ms latency)
 //! - **Slow Path**: Buffer update for wrapping/scrolling (next frame)
 
+use super::ansi::{AnsiEvent, AnsiParser, Pen, MODIFIER_CODES};
+use super::fold::FoldId;
+use super::highlight::{Highlighter, Update};
 use super::scroll_buffer::ScrollBuffer;
+use super::writer::{Inbox, StreamWriter};
 use crate::actor::Engine;
-use crate::buffer::{Buffer, Cell, Rgb};
+use crate::buffer::palette;
+use crate::buffer::text::{self, Segment};
+use crate::buffer::{Buffer, Cell, ColorMode, Modifiers, Rgb, SearchMatch, SearchQuery};
 use crate::layout::Rect;
 use std::io::Write;
-use unicode_segmentation::UnicodeSegmentation;
-use unicode_width::UnicodeWidthStr;
+use std::path::PathBuf;
 
 /// Configuration for the stream widget.
 #[derive(Debug, Clone)]
 pub struct StreamConfig {
     /// Maximum lines to keep in scrollback.
+    ///
+    /// With [`spill_dir`](Self::spill_dir) set, this is roughly how many
+    /// lines stay in memory instead.
     pub max_scrollback: usize,
+    /// Whether to compress scrollback far from the bottom.
+    ///
+    /// Only the newest few hundred lines stay as cells; older ones are
+    /// compressed in memory, typically 5-10x smaller for logs and code,
+    /// and decompressed when scrolled into view. Ignored when `spill_dir`
+    /// is set, since spilled lines are compressed anyway.
+    pub compress_scrollback: bool,
+    /// Directory for a scrollback spill file.
+    ///
+    /// When set, lines beyond `max_scrollback` are moved to disk rather
+    /// than discarded and read back when scrolled into view, so the whole
+    /// session stays scrollable. If the file can't be created, scrollback
+    /// is bounded in memory as usual.
+    pub spill_dir: Option<PathBuf>,
     /// Default foreground color.
     pub default_fg: Rgb,
     /// Default background color.
@@ -43,6 +65,8 @@ impl Default for StreamConfig {
     fn default() -> Self {
         Self {
             max_scrollback: 10000,
+            compress_scrollback: false,
+            spill_dir: None,
             default_fg: Rgb::new(220, 220, 220),
             default_bg: Rgb::DEFAULT_BG,
             auto_scroll: true,
@@ -56,7 +80,8 @@ impl Default for StreamConfig {
 pub enum AppendResult {
     /// Content was appended using fast path (direct cursor write).
     FastPath {
-        /// Number of characters appended.
+        /// Number of characters written from `start_col` on: those
+        /// appended, plus any restyled to their left.
         chars: usize,
         /// Starting column of the append.
         start_col: u16,
@@ -94,10 +119,24 @@ pub struct StreamWidget {
     current_fg: Rgb,
     /// Current background color.
     current_bg: Rgb,
+    /// Current text modifiers.
+    current_modifiers: Modifiers,
+    /// Escape sequence state carried between [`append_ansi`](Self::append_ansi) calls.
+    ansi: AnsiParser,
     /// Whether the widget needs a full redraw.
     needs_full_redraw: bool,
     /// Dirty rectangles accumulated since last render.
     dirty_rects: Vec<Rect>,
+    /// Number of trailing content lines modified since last render.
+    ///
+    /// Appends only ever touch the end of the scrollback, so damage is
+    /// always a suffix of the line list. Counting from the end keeps it
+    /// valid when old lines are evicted from the front.
+    damaged_tail: usize,
+    /// Ring fed by [`StreamWriter`]s, created on first use.
+    inbox: Option<Inbox>,
+    /// Highlighter styling appended text, if any.
+    highlighter: Option<Highlighter>,
 }
 
 impl StreamWidget {
@@ -108,16 +147,33 @@ impl StreamWidget {
 
     /// Create a new stream widget with custom configuration.
     pub fn with_config(bounds: Rect, config: StreamConfig) -> Self {
+        let content = config
+            .spill_dir
+            .as_deref()
+            .and_then(|dir| ScrollBuffer::with_spill(config.max_scrollback, dir).ok())
+            .unwrap_or_else(|| {
+                if config.compress_scrollback {
+                    ScrollBuffer::with_compression(config.max_scrollback)
+                } else {
+                    ScrollBuffer::new(config.max_scrollback)
+                }
+            });
+
         Self {
             bounds,
             current_fg: config.default_fg,
             current_bg: config.default_bg,
-            content: ScrollBuffer::new(config.max_scrollback),
+            current_modifiers: Modifiers::empty(),
+            ansi: AnsiParser::new(),
+            content,
             config,
             cursor_col: 0,
             cursor_row: 0,
             needs_full_redraw: true,
             dirty_rects: Vec::new(),
+            damaged_tail: 0,
+            inbox: None,
+            highlighter: None,
         }
     }
 
@@ -152,176 +208,364 @@ impl StreamWidget {
         self.current_bg = bg;
     }
 
+    /// Set the text modifiers for subsequent text.
+    pub const fn set_modifiers(&mut self, modifiers: Modifiers) {
+        self.current_modifiers = modifiers;
+    }
+
     /// Reset colors to defaults.
     pub const fn reset_colors(&mut self) {
         self.current_fg = self.config.default_fg;
         self.current_bg = self.config.default_bg;
     }
 
-    /// Check if fast path append is possible for the given text.
+    /// Style appended text with a highlighter, or stop highlighting.
     ///
-    /// Fast path is possible when:
-    /// 1. We're at the bottom of the scroll buffer
-    /// 2. The text doesn't contain newlines
-    /// 3. The text fits on the current line without wrapping
-    /// 4. No scrolling is needed
-    fn can_fast_path(&self, text: &str) -> bool {
-        // Must be at bottom for fast path
-        if !self.content.at_bottom() {
-            return false;
+    /// Text passed to [`append`](Self::append) and friends goes through the
+    /// highlighter first; its classes are styled over the current colors.
+    /// [`append_ansi`](Self::append_ansi) is never highlighted.
+    ///
+    /// # Returns
+    /// The highlighter previously installed, if any.
+    pub const fn set_highlighter(
+        &mut self,
+        highlighter: Option<Highlighter>,
+    ) -> Option<Highlighter> {
+        std::mem::replace(&mut self.highlighter, highlighter)
+    }
+
+    /// Get the installed highlighter.
+    pub const fn highlighter(&self) -> Option<&Highlighter> {
+        self.highlighter.as_ref()
+    }
+
+    /// Get the installed highlighter mutably.
+    pub const fn highlighter_mut(&mut self) -> Option<&mut Highlighter> {
+        self.highlighter.as_mut()
+    }
+
+    /// Get the current colors and modifiers.
+    const fn pen(&self) -> Pen {
+        Pen {
+            fg: self.current_fg,
+            bg: self.current_bg,
+            modifiers: self.current_modifiers,
         }
+    }
 
-        // No newlines allowed in fast path
-        if text.contains('\n') {
-            return false;
+    /// Set the current colors and modifiers.
+    const fn set_pen(&mut self, pen: Pen) {
+        self.current_fg = pen.fg;
+        self.current_bg = pen.bg;
+        self.current_modifiers = pen.modifiers;
+    }
+
+    /// Append a single-line run of printable ASCII, wrapping as needed.
+    ///
+    /// ASCII bytes are their own grapheme clusters and always one column
+    /// wide, so the run is placed without segmentation or width lookups.
+    #[allow(clippy::cast_possible_truncation)]
+    fn ingest_ascii(&mut self, mut run: &[u8], pass: &mut Ingest) {
+        while !run.is_empty() {
+            let available = self.bounds.width.saturating_sub(self.cursor_col) as usize;
+            if available == 0 {
+                if !self.wrap(pass) {
+                    return;
+                }
+                continue;
+            }
+
+            let (head, rest) = run.split_at(available.min(run.len()));
+            let (fg, bg, modifiers) = (self.current_fg, self.current_bg, self.current_modifiers);
+            let cells = head
+                .iter()
+                .map(|&b| Cell::new(b as char).with_fg(fg).with_bg(bg).with_modifiers(modifiers));
+            self.mark_write_line_damaged();
+            if self.content.is_overwriting() {
+                for cell in cells {
+                    self.put_cell(cell, pass);
+                }
+            } else {
+                self.content.append(cells);
+            }
+            self.cursor_col += head.len() as u16;
+            pass.max_col = pass.max_col.max(self.cursor_col);
+            pass.graphemes += head.len();
+            run = rest;
+        }
+    }
+
+    /// Write one cell at the write position.
+    ///
+    /// Overwriting a cell of a different width shifts the rest of the line,
+    /// which a direct terminal write can't reproduce.
+    fn put_cell(&mut self, cell: Cell, pass: &mut Ingest) {
+        if let Some(old) = self.content.put(cell) {
+            if old.display_width() != cell.display_width() {
+                pass.fast = false;
+            }
+        }
+    }
+
+    /// Append a single grapheme cluster, wrapping as needed.
+    #[allow(clippy::cast_possible_truncation)]
+    fn ingest_grapheme(&mut self, grapheme: &str, pass: &mut Ingest) {
+        let width = text::str_width(grapheme) as u16;
+        if width == 0 {
+            // A cluster split across tokens: fold it into the previous cell
+            self.extend_last_cell(grapheme);
+            return;
         }
 
-        // Check if text fits on current line
-        let text_width = UnicodeWidthStr::width(text);
-        let available = (self.bounds.width as usize).saturating_sub(self.cursor_col as usize);
+        if self.cursor_col + width > self.bounds.width && !self.wrap(pass) {
+            return;
+        }
 
-        text_width <= available
+        // Clusters that don't fit inline keep their base character
+        let cell = Cell::from_grapheme(grapheme)
+            .or_else(|| grapheme.chars().next().map(Cell::from_char))
+            .unwrap_or_default();
+        self.mark_write_line_damaged();
+        let cell = cell
+            .with_fg(self.current_fg)
+            .with_bg(self.current_bg)
+            .with_modifiers(self.current_modifiers);
+        self.put_cell(cell, pass);
+        self.cursor_col += u16::from(cell.display_width());
+        pass.max_col = pass.max_col.max(self.cursor_col);
+        pass.graphemes += 1;
     }
 
-    /// Append text using the fast path.
+    /// Merge a zero-width continuation into the cell before the write position.
+    fn extend_last_cell(&mut self, grapheme: &str) {
+        let back = self.content.write_line_back();
+        let Some(last) = self.content.previous_cell_mut() else {
+            return;
+        };
+        let mut joined = String::with_capacity(8);
+        joined.push_str(last.grapheme().unwrap_or_default());
+        joined.push_str(grapheme);
+        if let Some(cell) = Cell::from_grapheme(&joined) {
+            *last = cell.with_fg(last.fg()).with_bg(last.bg()).with_modifiers(last.modifiers());
+            self.damaged_tail = self.damaged_tail.max(back + 1);
+        }
+    }
+
+    /// Rewind to the start of the current logical line.
+    ///
+    /// Text written afterwards replaces the existing cells in place, so
+    /// progress output that redraws itself with `\r` doesn't grow the line.
+    #[allow(clippy::cast_possible_truncation)]
+    fn carriage_return(&mut self, pass: &mut Ingest) {
+        let back = self.content.carriage_return();
+        let back_rows = back.min(u16::MAX as usize) as u16;
+        if back_rows > self.cursor_row {
+            // The start of the line is above the viewport
+            self.needs_full_redraw = true;
+        }
+        if back > 0 {
+            pass.fast = false;
+        }
+
+        self.cursor_row = self.cursor_row.saturating_sub(back_rows);
+        self.cursor_col = 0;
+        pass.min_row = pass.min_row.min(self.cursor_row);
+        pass.min_col = 0;
+    }
+
+    /// Start a new line, either soft-wrapped or for a hard newline.
     ///
-    /// This directly emits ANSI sequences without going through the diffing
-    /// engine. Only call this after checking `can_fast_path()`.
-    fn append_fast_path(&mut self, text: &str) -> AppendResult {
-        let start_col = self.cursor_col;
-        let row = self.cursor_row;
-        let mut char_count = 0;
+    /// While overwriting a logical line that spans several physical lines,
+    /// wrapping moves onto the next existing line instead, and a hard
+    /// newline ends the logical line after its last physical line.
+    #[allow(clippy::cast_possible_truncation)]
+    fn break_line(&mut self, wrapped: bool, pass: &mut Ingest) {
+        pass.fast = false;
+        pass.min_col = 0;
+        if wrapped && self.content.advance_line() {
+            self.cursor_col = 0;
+            self.cursor_row += 1;
+            pass.max_row = pass.max_row.max(self.cursor_row);
+            return;
+        }
 
-        // Append to content buffer
-        let cells = text.graphemes(true).filter_map(|g| {
-             Cell::from_grapheme(g).map(|mut c| {
-                 c.set_fg(self.current_fg);
-                 c.set_bg(self.current_bg);
-                 c
-             })
-        });
-        self.content.append(cells);
+        let back = self.content.end_overwrite().min(u16::MAX as usize) as u16;
+        let last_row = self.bounds.height.saturating_sub(1);
+        self.cursor_row = self.cursor_row.saturating_add(back).min(last_row);
 
-        // Update cursor position
-        for grapheme in text.graphemes(true) {
-            let width = UnicodeWidthStr::width(grapheme);
-            // safe cast: can_fast_path ensures it fits in width
-            self.cursor_col += u16::try_from(width).unwrap_or(0);
-            char_count += 1;
+        let was_at_bottom = self.content.at_bottom();
+        self.content.newline(wrapped);
+        self.shift_damage();
+        if !was_at_bottom {
+            self.content.scroll_up(1);
         }
 
-        AppendResult::FastPath {
-            chars: char_count,
-            start_col,
-            row,
+        self.cursor_col = 0;
+        self.cursor_row += 1;
+
+        // Check for scroll
+        if self.cursor_row >= self.bounds.height {
+            self.handle_scroll(was_at_bottom);
         }
+        pass.max_row = pass.max_row.max(self.cursor_row);
     }
 
-    /// Append text using the slow path.
+    /// Wrap to the next line if word wrapping is enabled.
     ///
-    /// This processes the text, handling newlines and wrapping, and marks
-    /// the affected area as dirty for the diffing engine.
-    fn append_slow_path(&mut self, text: &str) -> AppendResult {
-        let initial_row = self.cursor_row;
-        let mut max_row = self.cursor_row;
-        let initial_col = self.cursor_col;
-        let mut min_touched_col = self.cursor_col;
-        let mut max_col = self.cursor_col;
+    /// Returns `false` if the text should be dropped instead. Dropped text
+    /// isn't in the buffer, so it must not reach the terminal either.
+    fn wrap(&mut self, pass: &mut Ingest) -> bool {
+        if !self.config.word_wrap || self.bounds.width == 0 {
+            pass.fast = false;
+            return false;
+        }
+        self.break_line(true, pass);
+        true
+    }
 
-        for ch in text.chars() {
-            match ch {
-                '\n' => {
-                    // Hard newline
-                    let was_at_bottom = self.content.at_bottom();
-                    self.content.newline(false);
-                    if !was_at_bottom {
-                        self.content.scroll_up(1);
-                    }
-                    
-                    max_col = max_col.max(self.cursor_col);
-                    self.cursor_col = 0;
-                    min_touched_col = 0; // Newline starts at 0
-                    self.cursor_row += 1;
-
-                    // Check for scroll
-                    if self.cursor_row >= self.bounds.height {
-                        self.handle_scroll(was_at_bottom);
-                    }
-                }
-                '\r' => {
-                    // Carriage return
-                    self.cursor_col = 0;
-                    min_touched_col = 0;
-                }
-                '\t' => {
-                    // Tab - expand to spaces
-                    let spaces = 4 - (self.cursor_col % 4);
-                    for _ in 0..spaces {
-                        self.append_char(' ');
+    /// Append one token as part of an ingest pass, through the highlighter
+    /// if one is installed.
+    fn ingest(&mut self, text: &str, pass: &mut Ingest) {
+        match self.highlighter.take() {
+            Some(mut highlighter) => {
+                self.ingest_highlighted(&mut highlighter, text, pass);
+                self.highlighter = Some(highlighter);
+            },
+            None => self.ingest_text(text, pass),
+        }
+    }
+
+    /// Append one token through a highlighter.
+    ///
+    /// Cells holding earlier text of the line whose class changed are
+    /// restyled first, then the new text is written run by run in the
+    /// style of its class.
+    fn ingest_highlighted(&mut self, highlighter: &mut Highlighter, text: &str, pass: &mut Ingest) {
+        let pen = self.pen();
+        let mut rest = text;
+        while !rest.is_empty() {
+            let end = rest.find(['\n', '\r']).unwrap_or(rest.len());
+            let (line, tail) = rest.split_at(end);
+            if !line.is_empty() {
+                let update = highlighter.feed(line);
+                self.restyle(&update, pen, pass);
+                for span in update.spans() {
+                    let start = span.start.max(update.fed());
+                    if start < span.end {
+                        self.set_pen(update.style(span.class).apply(pen));
+                        self.ingest_text(&update.text()[start..span.end], pass);
                     }
                 }
-                _ => {
-                    self.append_char(ch);
-                }
+                self.set_pen(pen);
             }
 
-            max_row = max_row.max(self.cursor_row);
-            max_col = max_col.max(self.cursor_col);
-            
-            // If wrap happened in append_char, min_touched_col should be updated in a real implementation
-            if self.cursor_col < initial_col && self.cursor_row > initial_row {
-                 min_touched_col = 0;
+            match tail.as_bytes().first() {
+                Some(b'\n') => highlighter.end_line(),
+                Some(_) => highlighter.carriage_return(),
+                None => break,
             }
+            self.ingest_text(&tail[..1], pass);
+            rest = &tail[1..];
         }
+    }
 
-        // Calculate dirty rect
-        let dirty_rect = Rect {
-            x: self.bounds.x + min_touched_col,
-            y: self.bounds.y + initial_row,
-            width: self.bounds.width,
-            height: (max_row - initial_row + 1).max(1),
-        };
+    /// Restyle the cells holding a highlighter's unsettled text.
+    ///
+    /// Text containing tabs or control characters doesn't map onto cells
+    /// one to one, so it keeps the styles it was written with.
+    #[allow(clippy::cast_possible_truncation)]
+    fn restyle(&mut self, update: &Update<'_>, pen: Pen, pass: &mut Ingest) {
+        let old = &update.text()[..update.fed()];
+        if old.is_empty() {
+            return;
+        }
 
-        if !self.needs_full_redraw {
-             self.dirty_rects.push(dirty_rect);
+        let mut spans = update.spans().iter().peekable();
+        let mut pen_at = |offset: usize| {
+            while spans.next_if(|span| span.end <= offset).is_some() {}
+            spans.peek().map_or(pen, |span| update.style(span.class).apply(pen))
+        };
+        let mut pens = Vec::with_capacity(old.len());
+        let mut offset = 0;
+        for segment in text::segments(old) {
+            match segment {
+                Segment::Ascii(run) => {
+                    pens.extend((offset..offset + run.len()).map(&mut pen_at));
+                    offset += run.len();
+                },
+                Segment::Grapheme(grapheme) => {
+                    if text::str_width(grapheme) > 0 {
+                        pens.push(pen_at(offset));
+                    }
+                    offset += grapheme.len();
+                },
+                Segment::Control(_) => return,
+            }
         }
 
-        AppendResult::SlowPath { dirty_rect }
+        let Some((above, index)) = self.content.restyle_back(&pens) else {
+            return;
+        };
+        let back = self.content.write_line_back() + above;
+        self.damaged_tail = self.damaged_tail.max(back + 1);
+        if above == 0 {
+            let line = self.content.get(self.content.len() - 1 - back);
+            let cells = line.map_or(&[][..], |line| &line.content[..index]);
+            let col: usize = cells.iter().map(|cell| usize::from(cell.display_width())).sum();
+            pass.min_col = pass.min_col.min(col as u16);
+        } else {
+            // Restyled cells on rows above can't be written directly
+            let above_rows = above.min(u16::MAX as usize) as u16;
+            if above_rows > self.cursor_row {
+                self.needs_full_redraw = true;
+            }
+            pass.fast = false;
+            pass.min_col = 0;
+            pass.min_row = pass.min_row.min(self.cursor_row.saturating_sub(above_rows));
+        }
     }
 
-    /// Append a single character, handling wrapping.
-    #[allow(clippy::cast_possible_truncation)]
-    fn append_char(&mut self, ch: char) {
-        let char_width = unicode_width::UnicodeWidthChar::width(ch).unwrap_or(0) as u16;
-
-        // Check for wrap
-        if self.cursor_col + char_width > self.bounds.width {
-            if self.config.word_wrap {
-                let was_at_bottom = self.content.at_bottom();
-                self.content.newline(true);
-                if !was_at_bottom {
-                    self.content.scroll_up(1);
+    /// Append one token as part of an ingest pass, in the current style.
+    ///
+    /// Printable ASCII runs are placed directly; everything else goes
+    /// through grapheme segmentation, so clusters are never split into
+    /// separate cells.
+    fn ingest_text(&mut self, text: &str, pass: &mut Ingest) {
+        pass.bytes += text.len();
+
+        for segment in text::segments(text) {
+            match segment {
+                Segment::Ascii(run) => self.ingest_ascii(run, pass),
+                Segment::Grapheme(grapheme) => self.ingest_grapheme(grapheme, pass),
+                Segment::Control(b'\n') => self.break_line(false, pass),
+                Segment::Control(b'\r') => self.carriage_return(pass),
+                Segment::Control(b'\t') => {
+                    // Tab - expand to spaces
+                    let spaces = 4 - usize::from(self.cursor_col % 4);
+                    self.ingest_ascii(&b"    "[..spaces], pass);
+                    pass.fast = false;
                 }
-                
-                self.cursor_col = 0;
-                self.cursor_row += 1;
-
-                if self.cursor_row >= self.bounds.height {
-                    self.handle_scroll(was_at_bottom);
+                Segment::Control(_) => {
+                    // Other control characters have no cell representation
+                    pass.fast = false;
                 }
-            } else {
-                // No wrap - just don't add the character
-                return;
             }
         }
+    }
 
-        // Add character to content
-        let mut cell = Cell::from_char(ch);
-        cell.set_fg(self.current_fg);
-        cell.set_bg(self.current_bg);
-        
-        self.content.append(std::iter::once(cell));
-        self.cursor_col += char_width;
+    /// Record that the line at the write position is about to be written to.
+    fn mark_write_line_damaged(&mut self) {
+        self.damaged_tail = self.damaged_tail.max(self.content.write_line_back() + 1);
+    }
+
+    /// Account for a new line being pushed after pending damage.
+    ///
+    /// Previously damaged lines move one step further from the end. The new
+    /// line itself starts empty and is only damaged once written to.
+    const fn shift_damage(&mut self) {
+        if self.damaged_tail > 0 {
+            self.damaged_tail += 1;
+        }
     }
 
     /// Handle scrolling when cursor goes past bottom.
@@ -344,96 +588,299 @@ impl StreamWidget {
     /// This automatically chooses between fast and slow path based on
     /// the text content and current state.
     pub fn append(&mut self, text: &str) -> AppendResult {
-        if text.is_empty() {
-            return AppendResult::Empty;
+        self.append_batch(&[text])
+    }
+
+    /// Append a burst of tokens in a single pass.
+    ///
+    /// The tokens are processed as one stream: the outcome is a single
+    /// fast-path result if everything landed on the current line, or a
+    /// single dirty rect covering all affected rows otherwise. This avoids
+    /// the per-call overhead of [`append`](Self::append) when tokens
+    /// arrive in bursts.
+    ///
+    /// # Arguments
+    /// * `tokens` - Text fragments, appended in order.
+    ///
+    /// # Returns
+    /// The combined [`AppendResult`] for the whole batch.
+    pub fn append_batch<S: AsRef<str>>(&mut self, tokens: &[S]) -> AppendResult {
+        let mut pass = self.begin_ingest();
+        for token in tokens {
+            self.ingest(token.as_ref(), &mut pass);
         }
+        self.finish_ingest(&pass)
+    }
 
-        if self.can_fast_path(text) {
-            self.append_fast_path(text)
-        } else {
-            self.append_slow_path(text)
+    /// Append text containing ANSI escape sequences.
+    ///
+    /// SGR sequences update the current colors and modifiers; all other
+    /// escape sequences, including cursor movement, are dropped. Sequences
+    /// may be split across calls. Colored text that fits on the current
+    /// line still takes the fast path; emit it with
+    /// [`write_fast_path_cells`](Self::write_fast_path_cells).
+    ///
+    /// # Arguments
+    /// * `text` - Text with embedded escape sequences, such as tool output.
+    ///
+    /// # Returns
+    /// The combined [`AppendResult`]. A fast-path `start_col` is the
+    /// leftmost column written.
+    pub fn append_ansi(&mut self, text: &str) -> AppendResult {
+        let mut parser = self.ansi;
+        let mut pass = self.begin_ingest();
+        for event in parser.feed(text) {
+            match event {
+                AnsiEvent::Text(run) => self.ingest_text(run, &mut pass),
+                AnsiEvent::Sgr(params) => {
+                    let mut pen = self.pen();
+                    let (default_fg, default_bg) = (self.config.default_fg, self.config.default_bg);
+                    pen.apply_sgr(params.as_slice(), default_fg, default_bg);
+                    self.set_pen(pen);
+                }
+            }
+        }
+        self.ansi = parser;
+
+        match self.finish_ingest(&pass) {
+            AppendResult::FastPath { chars, row, .. } => AppendResult::FastPath {
+                chars,
+                start_col: pass.min_col,
+                row,
+            },
+            result => result,
         }
     }
 
-    /// Render the widget to a buffer.
+    /// Start an ingest pass at the current cursor position.
     ///
-    /// This renders the visible content to the given buffer.
-    #[allow(clippy::cast_possible_truncation)]
-    pub fn render(&mut self, buffer: &mut Buffer) {
-        let viewport_height = self.bounds.height as usize;
+    /// Text can only go straight to the terminal when the write line is on
+    /// screen: at the bottom and not folded away.
+    fn begin_ingest(&self) -> Ingest {
+        let write_line = self.content.len() - 1 - self.content.write_line_back();
+        Ingest {
+            start_col: self.cursor_col,
+            start_row: self.cursor_row,
+            min_col: self.cursor_col,
+            max_col: self.cursor_col,
+            min_row: self.cursor_row,
+            max_row: self.cursor_row,
+            graphemes: 0,
+            bytes: 0,
+            fast: self.content.at_bottom() && !self.content.is_hidden(write_line),
+        }
+    }
 
-        // Get visible lines
-        let visible_lines: Vec<_> = self.content.visible_lines(viewport_height).collect();
+    /// Turn a finished ingest pass into its result, recording damage.
+    fn finish_ingest(&mut self, pass: &Ingest) -> AppendResult {
+        if pass.bytes == 0 {
+            return AppendResult::Empty;
+        }
 
-        // Render each line
-        for (row, line) in visible_lines.iter().enumerate() {
-            let y = self.bounds.y + row as u16;
-            if y >= self.bounds.y + self.bounds.height {
-                break;
+        if pass.fast {
+            // Highlighting can restyle cells left of where the text started,
+            // and every cell from there on is written again
+            if self.highlighter.is_some() {
+                let mut col = 0u16;
+                let chars = self
+                    .content
+                    .current_line()
+                    .content
+                    .iter()
+                    .filter(|cell| {
+                        let from = col;
+                        col += u16::from(cell.display_width());
+                        from >= pass.min_col
+                    })
+                    .count();
+                return AppendResult::FastPath {
+                    chars,
+                    start_col: pass.min_col,
+                    row: pass.start_row,
+                };
             }
+            return AppendResult::FastPath {
+                chars: pass.graphemes,
+                start_col: pass.start_col,
+                row: pass.start_row,
+            };
+        }
 
-            let mut col = 0u16;
-            for cell in &line.content {
-                if col >= self.bounds.width {
-                    break;
-                }
-
-                let x = self.bounds.x + col;
-                // buffer.set(x, y, *cell); // Direct set since cell has grapheme and style
-                // But wait, buffer.set takes x, y, Cell.
-                buffer.set(x, y, *cell); 
-                
-                col += u16::from(cell.display_width());
-            }
+        // Calculate dirty rect: just the written span when it stayed on one
+        // row (such as a carriage-return overwrite), otherwise whole rows
+        let width = if pass.max_row == pass.min_row {
+            pass.max_col.saturating_sub(pass.min_col)
+        } else {
+            self.bounds.width.saturating_sub(pass.min_col)
+        };
+        let dirty_rect = Rect {
+            x: self.bounds.x + pass.min_col,
+            y: self.bounds.y + pass.min_row,
+            width,
+            height: pass.max_row.saturating_sub(pass.min_row) + 1,
+        };
 
-            // Clear rest of line
-            while col < self.bounds.width {
-                let x = self.bounds.x + col;
-                buffer.set(x, y, Cell::new(' ').with_fg(self.current_fg).with_bg(self.current_bg));
-                col += 1;
-            }
+        if !self.needs_full_redraw {
+            self.dirty_rects.push(dirty_rect);
         }
 
-        // Clear any remaining rows
-        for row in visible_lines.len()..viewport_height {
+        AppendResult::SlowPath { dirty_rect }
+    }
+
+    /// Render the widget to a buffer.
+    ///
+    /// Only viewport rows that changed since the previous render are written:
+    /// the rows of lines appended or extended since then, or every row after a
+    /// scroll, resize, clear or [`invalidate`](Self::invalidate). This relies
+    /// on `buffer` retaining what the previous call wrote, which holds for
+    /// the engine's persistent buffer.
+    ///
+    /// Returns the rectangle covering the rows that were written, or `None`
+    /// if nothing needed repainting.
+    #[allow(clippy::cast_possible_truncation)]
+    pub fn render(&mut self, buffer: &mut Buffer) -> Option<Rect> {
+        let viewport_height = self.bounds.height as usize;
+        // Frozen lines that can't be read back render as blank rows
+        let _ = self.content.ensure_visible(viewport_height);
+        let visible = self.content.visible_range(viewport_height);
+
+        let rows = if self.needs_full_redraw {
+            0..viewport_height
+        } else {
+            // Map the damaged line suffix onto viewport rows
+            let first_damaged = self.content.len().saturating_sub(self.damaged_tail);
+            let first = self.content.line_row(first_damaged).clamp(visible.start, visible.end);
+            (first - visible.start)..(visible.end - visible.start)
+        };
+
+        for row in rows.clone() {
+            let row_index = visible.start + row;
+            let line = if row_index < visible.end {
+                self.content.get(self.content.row_line(row_index))
+            } else {
+                None
+            };
             let y = self.bounds.y + row as u16;
-            for col in 0..self.bounds.width {
-                let x = self.bounds.x + col;
-                buffer.set(x, y, Cell::new(' ').with_fg(self.current_fg).with_bg(self.current_bg));
-            }
+            self.render_row(buffer, y, line.map(|l| l.content.as_slice()));
         }
 
         self.needs_full_redraw = false;
+        self.damaged_tail = 0;
         self.dirty_rects.clear();
+
+        (!rows.is_empty()).then(|| Rect {
+            x: self.bounds.x,
+            y: self.bounds.y + rows.start as u16,
+            width: self.bounds.width,
+            height: rows.len() as u16,
+        })
+    }
+
+    /// Write one viewport row, padding past the end of the line with blanks.
+    fn render_row(&self, buffer: &mut Buffer, y: u16, cells: Option<&[Cell]>) {
+        let col = buffer.write_cells(self.bounds.x, y, self.bounds.width, cells.unwrap_or_default());
+
+        // Clear rest of line
+        let blank = Cell::new(' ').with_fg(self.config.default_fg).with_bg(self.config.default_bg);
+        buffer.fill_row_span(self.bounds.x + col, y, self.bounds.width - col, blank);
     }
 
     /// Write fast-path output directly to an output buffer.
     ///
     /// This generates ANSI sequences for direct terminal output,
-    /// bypassing the buffer diffing.
+    /// bypassing the buffer diffing. Colors are written for `color_mode`,
+    /// which should be the engine's [`Engine::color_mode`].
     pub fn write_fast_path(
         &self,
         result: AppendResult,
         text: &str,
+        color_mode: ColorMode,
+        output: &mut Vec<u8>,
+    ) {
+        self.write_fast_path_batch(result, &[text], color_mode, output);
+    }
+
+    /// Write fast-path output for a batch appended with
+    /// [`append_batch`](Self::append_batch).
+    ///
+    /// The tokens are emitted back to back after a single cursor move and
+    /// color setup. A carriage return becomes a cursor move back to the
+    /// widget's left edge, so overwritten text lands where the buffer has it.
+    /// With a highlighter installed the tokens were split into styled runs,
+    /// so the output comes from the cells as with
+    /// [`write_fast_path_cells`](Self::write_fast_path_cells).
+    pub fn write_fast_path_batch<S: AsRef<str>>(
+        &self,
+        result: AppendResult,
+        tokens: &[S],
+        color_mode: ColorMode,
         output: &mut Vec<u8>,
     ) {
+        if self.highlighter.is_some() {
+            self.write_fast_path_cells(result, color_mode, output);
+            return;
+        }
         if let AppendResult::FastPath { start_col, row, .. } = result {
-            // Move cursor to position
-            let abs_x = self.bounds.x + start_col + 1; // 1-indexed
             let abs_y = self.bounds.y + row + 1; // 1-indexed
 
-            let _ = write!(output, "\x1b[{abs_y};{abs_x}H");
-
-            // Set colors
-            let _ = write!(
+            // Set colors and modifiers
+            write_style(
                 output,
-                "\x1b[38;2;{};{};{}m\x1b[48;2;{};{};{}m",
-                self.current_fg.r, self.current_fg.g, self.current_fg.b,
-                self.current_bg.r, self.current_bg.g, self.current_bg.b
+                (self.current_fg, self.current_bg, self.current_modifiers),
+                color_mode,
             );
 
-            // Write text
-            output.extend_from_slice(text.as_bytes());
+            // Write text, moving the cursor only before visible output
+            let mut pending_col = Some(start_col);
+            for token in tokens {
+                for (i, part) in token.as_ref().split('\r').enumerate() {
+                    if i > 0 {
+                        pending_col = Some(0);
+                    }
+                    if part.is_empty() {
+                        continue;
+                    }
+                    if let Some(col) = pending_col.take() {
+                        let abs_x = self.bounds.x + col + 1; // 1-indexed
+                        let _ = write!(output, "\x1b[{abs_y};{abs_x}H");
+                    }
+                    output.extend_from_slice(part.as_bytes());
+                }
+            }
+        }
+    }
+
+    /// Write fast-path output for text appended with
+    /// [`append_ansi`](Self::append_ansi).
+    ///
+    /// The input may have switched styles midway, so the output is generated
+    /// from the widget's own cells for the rest of the row, with one SGR
+    /// sequence per style change. Escape sequences in the input never reach
+    /// the terminal.
+    pub fn write_fast_path_cells(
+        &self,
+        result: AppendResult,
+        color_mode: ColorMode,
+        output: &mut Vec<u8>,
+    ) {
+        if let AppendResult::FastPath { start_col, row, .. } = result {
+            let abs_x = self.bounds.x + start_col + 1; // 1-indexed
+            let abs_y = self.bounds.y + row + 1; // 1-indexed
+            let _ = write!(output, "\x1b[{abs_y};{abs_x}H");
+
+            let mut col = 0u16;
+            let mut style = None;
+            for cell in &self.content.current_line().content {
+                if col >= start_col {
+                    let cell_style = (cell.fg(), cell.bg(), cell.modifiers());
+                    if style != Some(cell_style) {
+                        write_style(output, cell_style, color_mode);
+                        style = Some(cell_style);
+                    }
+                    output.extend_from_slice(cell.grapheme().unwrap_or(" ").as_bytes());
+                }
+                col += u16::from(cell.display_width());
+            }
         }
     }
 
@@ -442,10 +889,15 @@ impl StreamWidget {
     /// If the text was successfully appended via fast path (no wrap, no scroll),
     /// the ANSI sequence is written to `output` and `true` is returned.
     /// Otherwise returns `false` (caller should rely on standard cycle).
-    pub fn append_fast_into(&mut self, text: &str, output: &mut Vec<u8>) -> bool {
+    pub fn append_fast_into(
+        &mut self,
+        text: &str,
+        color_mode: ColorMode,
+        output: &mut Vec<u8>,
+    ) -> bool {
         let result = self.append(text);
         if let AppendResult::FastPath { .. } = result {
-            self.write_fast_path(result, text, output);
+            self.write_fast_path(result, text, color_mode, output);
             true
         } else {
             false
@@ -476,13 +928,100 @@ impl StreamWidget {
         if let AppendResult::FastPath { .. } = result {
             // Zero-latency path: emit ANSI directly
             let mut output = Vec::with_capacity(64);
-            self.write_fast_path(result, text, &mut output);
+            self.write_fast_path(result, text, engine.color_mode(), &mut output);
             engine.write_raw(output);
         }
         // SlowPath/Empty: Buffer updated or nothing to do.
         // The render cycle will pick up dirty state.
     }
 
+    /// Push a burst of tokens to the stream with automatic optimization.
+    ///
+    /// Equivalent to calling [`push`](Self::push) for each token, but the
+    /// batch is ingested in one pass and emitted with at most one raw write.
+    pub fn push_batch<S: AsRef<str>>(&mut self, engine: &Engine, tokens: &[S]) {
+        let result = self.append_batch(tokens);
+
+        if let AppendResult::FastPath { .. } = result {
+            let len = tokens.iter().map(|t| t.as_ref().len()).sum::<usize>();
+            let mut output = Vec::with_capacity(64 + len);
+            self.write_fast_path_batch(result, tokens, engine.color_mode(), &mut output);
+            engine.write_raw(output);
+        }
+    }
+
+    /// Get a handle for appending to this widget from another thread.
+    ///
+    /// Tokens written through any handle wait in a ring owned by the
+    /// widget until [`append_pending`](Self::append_pending) or
+    /// [`push_pending`](Self::push_pending) takes them on the UI thread.
+    pub fn writer(&mut self) -> StreamWriter {
+        self.inbox.get_or_insert_with(Inbox::new).writer()
+    }
+
+    /// Check if writers have queued tokens since the last drain.
+    pub fn has_pending(&self) -> bool {
+        self.inbox.as_ref().is_some_and(|inbox| !inbox.is_empty())
+    }
+
+    /// Append the tokens queued by [`StreamWriter`]s as one batch.
+    ///
+    /// Tokens from one writer keep their order; tokens from different
+    /// writers interleave in the order they reached the ring.
+    ///
+    /// # Returns
+    /// The combined [`AppendResult`], as from [`append_batch`](Self::append_batch).
+    pub fn append_pending(&mut self) -> AppendResult {
+        let Some(inbox) = self.inbox.as_mut() else {
+            return AppendResult::Empty;
+        };
+        let tokens = inbox.take();
+        let result = self.append_batch(&tokens);
+        self.restore_pending(tokens);
+        result
+    }
+
+    /// Push the tokens queued by [`StreamWriter`]s with automatic optimization.
+    ///
+    /// Like [`push_batch`](Self::push_batch), for whatever the writers
+    /// queued since the last drain. Call it once per frame.
+    pub fn push_pending(&mut self, engine: &Engine) -> AppendResult {
+        let Some(inbox) = self.inbox.as_mut() else {
+            return AppendResult::Empty;
+        };
+        let tokens = inbox.take();
+        let result = self.append_batch(&tokens);
+
+        if let AppendResult::FastPath { .. } = result {
+            let len = tokens.iter().map(String::len).sum::<usize>();
+            let mut output = Vec::with_capacity(64 + len);
+            self.write_fast_path_batch(result, &tokens, engine.color_mode(), &mut output);
+            engine.write_raw(output);
+        }
+        self.restore_pending(tokens);
+        result
+    }
+
+    /// Hand a drained token vector back to the inbox for reuse.
+    fn restore_pending(&mut self, tokens: Vec<String>) {
+        if let Some(inbox) = self.inbox.as_mut() {
+            inbox.restore(tokens);
+        }
+    }
+
+    /// Push text containing ANSI escape sequences to the stream.
+    ///
+    /// Like [`push`](Self::push), using [`append_ansi`](Self::append_ansi).
+    pub fn push_ansi(&mut self, engine: &Engine, text: &str) {
+        let result = self.append_ansi(text);
+
+        if let AppendResult::FastPath { .. } = result {
+            let mut output = Vec::with_capacity(64 + text.len());
+            self.write_fast_path_cells(result, engine.color_mode(), &mut output);
+            engine.write_raw(output);
+        }
+    }
+
     /// Check if a full redraw is needed.
     pub const fn needs_redraw(&self) -> bool {
         self.needs_full_redraw || !self.dirty_rects.is_empty()
@@ -504,6 +1043,10 @@ impl StreamWidget {
         self.cursor_col = 0;
         self.cursor_row = 0;
         self.needs_full_redraw = true;
+        self.damaged_tail = 0;
+        if let Some(highlighter) = self.highlighter.as_mut() {
+            highlighter.reset();
+        }
     }
 
     /// Scroll up by the given number of lines.
@@ -524,9 +1067,124 @@ impl StreamWidget {
     }
 
     /// Get the number of lines in the buffer.
-    pub fn line_count(&self) -> usize {
+    pub const fn line_count(&self) -> usize {
         self.content.len()
     }
+
+    /// Search the scrollback.
+    ///
+    /// Match line indices count from the oldest retained line, so the last
+    /// match is at most `line_count() - 1`.
+    pub fn search(&mut self, query: &SearchQuery) -> Vec<SearchMatch> {
+        self.content.search(query)
+    }
+
+    /// Start a fold region, such as the output of a tool call.
+    ///
+    /// The region begins with the next line to be started. Write a summary
+    /// line before it to keep something on screen while it is folded.
+    pub fn begin_fold(&mut self) -> FoldId {
+        self.content.begin_fold()
+    }
+
+    /// End a fold region.
+    ///
+    /// The region takes every line started since
+    /// [`begin_fold`](Self::begin_fold), including the current line unless
+    /// nothing has been written to it yet.
+    ///
+    /// # Returns
+    /// `false` if the region was already ended or has scrolled out of the
+    /// scrollback.
+    pub fn end_fold(&mut self, id: FoldId) -> bool {
+        self.content.end_fold(id)
+    }
+
+    /// Fold or unfold an ended region.
+    ///
+    /// Takes O(log n) in the number of regions however large the region
+    /// is; nothing is copied or rewrapped. The next render redraws the
+    /// viewport.
+    ///
+    /// # Returns
+    /// `false` if nothing changed.
+    pub fn set_folded(&mut self, id: FoldId, folded: bool) -> bool {
+        if !self.content.set_folded(id, folded) {
+            return false;
+        }
+        self.needs_full_redraw = true;
+        self.sync_cursor_row();
+        true
+    }
+
+    /// Check if a region is folded.
+    pub fn is_folded(&self, id: FoldId) -> bool {
+        self.content.is_folded(id)
+    }
+
+    /// Move the cursor to the viewport row of the write line after the
+    /// rows above it changed.
+    #[allow(clippy::cast_possible_truncation)]
+    fn sync_cursor_row(&mut self) {
+        let height = self.bounds.height as usize;
+        let top = self.content.visible_range(height).start;
+        let write_line = self.content.len() - 1 - self.content.write_line_back();
+        let row = self.content.line_row(write_line).saturating_sub(top);
+        self.cursor_row = row.min(height.saturating_sub(1)) as u16;
+    }
+}
+
+impl<S: AsRef<str>> Extend<S> for StreamWidget {
+    /// Append every token in one ingest pass, recording damage for the
+    /// next render.
+    fn extend<I: IntoIterator<Item = S>>(&mut self, tokens: I) {
+        let mut pass = self.begin_ingest();
+        for token in tokens {
+            self.ingest(token.as_ref(), &mut pass);
+        }
+        // Nothing is written directly, so a fast-path result still needs
+        // its row repainted by the render cycle.
+        pass.fast = false;
+        self.finish_ingest(&pass);
+    }
+}
+
+/// Write one SGR sequence selecting exactly the given style, with colors
+/// written for `mode`.
+fn write_style(output: &mut Vec<u8>, (fg, bg, modifiers): (Rgb, Rgb, Modifiers), mode: ColorMode) {
+    output.extend_from_slice(b"\x1b[0");
+    for (modifier, code) in MODIFIER_CODES {
+        if modifiers.contains(modifier) {
+            output.extend_from_slice(&[b';', b'0' + code]);
+        }
+    }
+    output.push(b';');
+    palette::push_params(output, fg, mode, 30);
+    output.push(b';');
+    palette::push_params(output, bg, mode, 40);
+    output.push(b'm');
+}
+
+/// Running state of one ingest pass over a batch of tokens.
+struct Ingest {
+    /// Cursor column when the pass started.
+    start_col: u16,
+    /// Cursor row when the pass started.
+    start_row: u16,
+    /// Leftmost column touched on the first row.
+    min_col: u16,
+    /// Rightmost column touched on the last row.
+    max_col: u16,
+    /// Topmost row touched.
+    min_row: u16,
+    /// Lowest row touched.
+    max_row: u16,
+    /// Grapheme clusters appended.
+    graphemes: usize,
+    /// Input bytes consumed.
+    bytes: usize,
+    /// Whether the pass can still be emitted as a fast-path write.
+    fast: bool,
 }
 
 #[cfg(test)]
@@ -582,6 +1240,33 @@ mod tests {
         assert!(widget.cursor_row > 0);
     }
 
+    #[test]
+    fn test_stream_widget_clipped_text_is_not_fast() {
+        let config = StreamConfig { word_wrap: false, ..StreamConfig::default() };
+        let mut widget = StreamWidget::with_config(Rect::new(0, 0, 10, 3), config);
+        assert!(matches!(widget.append("12345678"), AppendResult::FastPath { .. }));
+
+        // Text past the right edge is dropped, so it can't be written directly
+        assert!(matches!(widget.append("abcd"), AppendResult::SlowPath { .. }));
+        assert_eq!(widget.cursor_position(), (10, 0));
+    }
+
+    #[test]
+    fn test_stream_widget_fast_path_color_mode() {
+        let config = StreamConfig {
+            default_fg: Rgb::from_ansi_index(2),
+            ..StreamConfig::default()
+        };
+        let mut widget = StreamWidget::with_config(Rect::new(0, 0, 10, 3), config);
+        let result = widget.append("hi");
+        let mut output = Vec::new();
+        widget.write_fast_path_batch(result, &["hi"], ColorMode::Palette256, &mut output);
+
+        let output = String::from_utf8(output).unwrap();
+        assert!(output.starts_with("\x1b[0;32;48;5;"), "{output:?}");
+        assert!(!output.contains(";2;"));
+    }
+
     #[test]
     fn test_stream_widget_render() {
         let mut widget = StreamWidget::new(Rect::new(0, 0, 10, 3));
@@ -594,4 +1279,252 @@ mod tests {
         let cell = buffer.get(0, 0).unwrap();
         assert_eq!(cell.grapheme(), Some("L"));
     }
+
+    #[test]
+    fn test_stream_widget_render_incremental() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 10, 4));
+        widget.append("Line 1\nLine 2");
+
+        let mut buffer = Buffer::new(10, 4);
+        assert_eq!(widget.render(&mut buffer), Some(Rect::new(0, 0, 10, 4)));
+
+        // Nothing changed: nothing is repainted
+        assert_eq!(widget.render(&mut buffer), None);
+
+        // A fast-path append only repaints the row it landed on
+        widget.append("!");
+        buffer.set(0, 0, Cell::new('X'));
+        assert_eq!(widget.render(&mut buffer), Some(Rect::new(0, 1, 10, 1)));
+        assert_eq!(buffer.get(0, 0).unwrap().grapheme(), Some("X"));
+        assert_eq!(buffer.get(6, 1).unwrap().grapheme(), Some("!"));
+
+        // A newline damages the extended line and the new one
+        widget.append("?\nLine 3");
+        assert_eq!(widget.render(&mut buffer), Some(Rect::new(0, 1, 10, 2)));
+        assert_eq!(buffer.get(0, 2).unwrap().grapheme(), Some("L"));
+
+        // Scrolling shifts every row
+        widget.scroll_up(1);
+        assert_eq!(widget.render(&mut buffer), Some(Rect::new(0, 0, 10, 4)));
+    }
+
+    #[test]
+    fn test_stream_widget_append_batch() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 80, 24));
+        let result = widget.append_batch(&["Hel", "lo", ", wor", "ld"]);
+
+        assert_eq!(result, AppendResult::FastPath { chars: 12, start_col: 0, row: 0 });
+        assert_eq!(widget.cursor_position(), (12, 0));
+
+        let result = widget.append_batch(&["one\n", "two\n", "three"]);
+        match result {
+            AppendResult::SlowPath { dirty_rect } => {
+                assert_eq!(dirty_rect.y, 0);
+                assert_eq!(dirty_rect.height, 3);
+            }
+            _ => panic!("Expected slow path due to newline"),
+        }
+        assert_eq!(widget.cursor_position(), (5, 2));
+        assert_eq!(widget.append_batch(&["", ""]), AppendResult::Empty);
+    }
+
+    #[test]
+    fn test_stream_widget_grapheme_clusters() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 80, 24));
+
+        // Combining mark in the same token and split across tokens
+        widget.append("cafe\u{301}");
+        widget.extend(["e", "\u{301}!"]);
+
+        let line = &widget.content.current_line().content;
+        assert_eq!(line.len(), 6);
+        assert_eq!(line[3].grapheme(), Some("e\u{301}"));
+        assert_eq!(line[4].grapheme(), Some("e\u{301}"));
+        assert_eq!(widget.cursor_position(), (6, 0));
+    }
+
+    #[test]
+    fn test_stream_widget_carriage_return_overwrite() {
+        let mut widget = StreamWidget::new(Rect::new(2, 0, 20, 5));
+        widget.append("build: [    ]");
+        for step in ["=   ", "==  ", "=== ", "===="] {
+            let token = format!("\rbuild: [{step}]");
+            let result = widget.append(&token);
+            assert_eq!(result, AppendResult::FastPath { chars: 13, start_col: 13, row: 0 });
+
+            // One cursor move to the left edge, then the text
+            let mut output = Vec::new();
+            widget.write_fast_path(result, &token, ColorMode::TrueColor, &mut output);
+            let output = String::from_utf8(output).unwrap();
+            assert_eq!(output.matches("\x1b[1;3H").count(), 1);
+            assert!(output.ends_with(&token[1..]));
+        }
+
+        // The line was overwritten in place rather than grown
+        assert_eq!(widget.line_count(), 1);
+        assert_eq!(widget.content.current_line_len(), 13);
+        assert_eq!(widget.cursor_position(), (13, 0));
+
+        // Shorter text only replaces its own span
+        let result = widget.append_batch(&["\r", "ok"]);
+        assert_eq!(result, AppendResult::FastPath { chars: 2, start_col: 13, row: 0 });
+        widget.append("\n");
+        let line: String = widget.content.get(0).unwrap().content.iter()
+            .map(|c| c.grapheme().unwrap_or(""))
+            .collect();
+        assert_eq!(line, "okild: [====]");
+        assert_eq!(widget.cursor_position(), (0, 1));
+    }
+
+    #[test]
+    fn test_stream_widget_carriage_return_wrapped() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 4, 5));
+        widget.append("abcdefg");
+        assert_eq!(widget.cursor_position(), (3, 1));
+
+        // Rewinds across the soft wrap and reuses the existing rows
+        let result = widget.append("\rWXYZ12");
+        match result {
+            AppendResult::SlowPath { dirty_rect } => {
+                assert_eq!(dirty_rect.y, 0);
+                assert_eq!(dirty_rect.height, 2);
+            }
+            _ => panic!("Expected slow path for a wrapped overwrite"),
+        }
+        assert_eq!(widget.line_count(), 2);
+        assert_eq!(widget.cursor_position(), (2, 1));
+
+        widget.append("\nnext");
+        assert_eq!(widget.line_count(), 3);
+        assert_eq!(widget.cursor_position(), (4, 2));
+    }
+
+    #[test]
+    fn test_stream_widget_append_ansi() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 40, 5));
+        let result = widget.append_ansi("\x1b[1;32mok\x1b[0m \x1b[5;1Hdone");
+        assert_eq!(result, AppendResult::FastPath { chars: 7, start_col: 0, row: 0 });
+
+        let line = &widget.content.current_line().content;
+        assert_eq!(line[0].fg(), Rgb::from_ansi_index(2));
+        assert_eq!(line[0].modifiers(), Modifiers::BOLD);
+        assert_eq!(line[3].fg(), widget.config.default_fg);
+        assert!(line[3].modifiers().is_empty());
+
+        // Output is rebuilt from cells: one SGR per style run, no input escapes
+        let mut output = Vec::new();
+        widget.write_fast_path_cells(result, ColorMode::TrueColor, &mut output);
+        let output = String::from_utf8(output).unwrap();
+        assert!(output.starts_with("\x1b[1;1H\x1b[0;1;32;"));
+        assert_eq!(output.matches("\x1b[0").count(), 2);
+        assert!(!output.contains("\x1b[5;1H"));
+        assert!(output.ends_with("m done"));
+
+        // Style-only input appends nothing
+        assert_eq!(widget.append_ansi("\x1b[31m"), AppendResult::Empty);
+    }
+
+    #[test]
+    fn test_stream_widget_fold() {
+        let config = StreamConfig {
+            max_scrollback: 100_000,
+            ..StreamConfig::default()
+        };
+        let mut widget = StreamWidget::with_config(Rect::new(0, 0, 20, 5), config);
+        widget.append("> tool call\n");
+        let fold = widget.begin_fold();
+        let output: Vec<String> = (0..50_000).map(|i| format!("out {i}\n")).collect();
+        widget.append_batch(&output);
+        assert!(widget.end_fold(fold));
+        widget.append("done");
+
+        // The block collapses to nothing between its header and what follows
+        assert!(widget.set_folded(fold, true));
+        let mut buffer = Buffer::new(20, 5);
+        widget.render(&mut buffer);
+        let row = |buffer: &Buffer, y| -> String {
+            (0..20).map(|x| buffer.get(x, y).unwrap().grapheme().unwrap_or(" ")).collect()
+        };
+        assert_eq!(row(&buffer, 0).trim_end(), "> tool call");
+        assert_eq!(row(&buffer, 1).trim_end(), "done");
+        assert!(matches!(widget.append("!"), AppendResult::FastPath { row: 1, .. }));
+
+        // Rewrapping keeps the region folded
+        widget.set_bounds(Rect::new(0, 0, 8, 5));
+        widget.render(&mut buffer);
+        assert_eq!(row(&buffer, 2).trim_end(), "done!");
+
+        assert!(widget.set_folded(fold, false));
+        assert!(!widget.set_folded(fold, false));
+        widget.render(&mut buffer);
+        assert_eq!(row(&buffer, 4).trim_end(), "done!");
+        assert_eq!(row(&buffer, 2).trim_end(), "out 4999");
+        assert_eq!(row(&buffer, 3).trim_end(), "9");
+    }
+
+    #[test]
+    fn test_stream_widget_writers() {
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 40, 10));
+        assert_eq!(widget.append_pending(), AppendResult::Empty);
+
+        let writers: Vec<_> = (0..4)
+            .map(|id| {
+                let writer = widget.writer();
+                std::thread::spawn(move || {
+                    for i in 0..500 {
+                        writer.write(format!("{id}:{i}\n")).unwrap();
+                    }
+                })
+            })
+            .collect();
+        for writer in writers {
+            writer.join().unwrap();
+        }
+
+        assert!(widget.has_pending());
+        assert!(matches!(widget.append_pending(), AppendResult::SlowPath { .. }));
+        assert!(!widget.has_pending());
+        assert_eq!(widget.line_count(), 2001);
+
+        // Same-line tokens still take the fast path
+        let writer = widget.writer();
+        writer.write("a").unwrap();
+        writer.try_write(String::from("b")).unwrap();
+        assert!(matches!(widget.append_pending(), AppendResult::FastPath { chars: 2, .. }));
+
+        drop(widget);
+        assert_eq!(writer.write("late"), Err("late".to_string()));
+    }
+
+    #[test]
+    fn test_stream_widget_highlighting() {
+        use crate::widget::{Class, Theme};
+
+        let mut widget = StreamWidget::new(Rect::new(0, 0, 20, 5));
+        widget.set_highlighter(Some(Highlighter::markdown()));
+        let keyword = Theme::default().style(Class::Keyword).fg.unwrap();
+        let plain = widget.config.default_fg;
+        let fg = |widget: &StreamWidget, col: usize| {
+            widget.content.current_line().content[col].fg()
+        };
+
+        widget.append("```rust\n");
+        let result = widget.append("x = fn");
+        assert!(matches!(result, AppendResult::FastPath { start_col: 0, .. }));
+        assert_eq!(fg(&widget, 4), keyword);
+
+        // The keyword grows into an identifier and is restyled in place
+        let result = widget.append("ord;");
+        assert!(matches!(result, AppendResult::FastPath { start_col: 4, chars: 6, .. }));
+        assert_eq!(fg(&widget, 4), plain);
+
+        let mut output = Vec::new();
+        widget.write_fast_path_batch(result, &["ord;"], ColorMode::TrueColor, &mut output);
+        assert!(String::from_utf8(output).unwrap().ends_with("fnord;"));
+
+        // Outside the fence the same word is prose
+        widget.append("\n```\nfn");
+        assert_eq!(fg(&widget, 0), plain);
+        assert_eq!(widget.current_fg, plain);
+    }
 }
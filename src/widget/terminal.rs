@@ -1,49 +1,323 @@
 //! Terminal Widget: Embedded terminal emulator for Flywheel.
 //!
-//! This widget uses `vt100` to provide a full terminal emulation
-//! within a Flywheel widget. It handles ANSI escape sequences,
+//! This widget uses the native [`Vt`] emulator to provide a full terminal
+//! emulation within a Flywheel widget. It handles ANSI escape sequences,
 //! colors, and scrolling.
+//!
+//! Rendering is row-damaged: the emulator flags each row it changes, and
+//! only flagged rows are copied into the buffer, so a build scrolling one
+//! line per write costs a few rows, not the grid. The emulator's screen is
+//! already made of Flywheel cells, so a row is copied, not converted.
+//!
+//! On Unix the widget can also run a child process itself with
+//! [`Terminal::spawn`]. The child's output is then read and parsed on a
+//! dedicated thread, and rendering works from the latest published
+//! snapshot instead of the emulator.
+//!
+//! Rows that scroll off the top of the screen are kept in a compressed
+//! [`RopeBuffer`], the storage behind `StreamWidget`'s scrollback, so a
+//! long build's output stays reachable. Scrolling up with
+//! [`Terminal::scroll_up`] or Shift+PageUp shows history lines above the
+//! screen; drawing the scrolled view reads only the lines in view.
 
-use crate::buffer::{Buffer, Cell, Rgb};
+use crate::buffer::{Buffer, Cell, RopeBuffer};
 use crate::layout::Rect;
-use crate::actor::InputEvent;
+use crate::actor::{InputEvent, KeyCode};
 use crate::widget::Widget;
-use std::sync::{Arc, Mutex};
+use super::vt::{self, Grid, Vt};
+use std::sync::Mutex;
+
+#[cfg(unix)]
+use super::pty::{self, PtySession};
+#[cfg(unix)]
+use std::{io, process::Command};
+
+/// Rows of scrollback kept by [`Terminal::new`] and [`Terminal::spawn`].
+const DEFAULT_HISTORY: usize = 10_000;
+
+/// Render state, behind the widget's lock so `render(&self)` can clear the
+/// damage it has drawn.
+struct Screen {
+    /// The terminal emulator, for terminals fed through [`Terminal::write`].
+    vt: Option<Vt>,
+    /// Rows scrolled off the emulator's screen; spawned sessions keep
+    /// their own.
+    history: Option<RopeBuffer>,
+    /// Rows changed in the snapshot being drawn, for spawned sessions.
+    damage: Vec<bool>,
+    /// Whether every row must be written on the next render.
+    full: bool,
+    /// Snapshot generation last rendered, for spawned sessions.
+    generation: u64,
+}
 
 /// A terminal emulator widget.
 pub struct Terminal {
     bounds: Rect,
-    parser: Arc<Mutex<vt100::Parser>>,
+    screen: Mutex<Screen>,
+    /// Child process feeding the screen, if spawned.
+    #[cfg(unix)]
+    session: Option<PtySession>,
+    /// Snapshot generation seen by the last [`Widget::clear_redraw`].
+    #[cfg(unix)]
+    seen: u64,
+    /// Rows the view is scrolled up into the scrollback (0 = live screen).
+    scroll_offset: usize,
     needs_redraw: bool,
 }
 
 impl Terminal {
     /// Create a new terminal widget with the given bounds.
+    ///
+    /// Up to 10,000 rows of scrollback are kept.
     pub fn new(bounds: Rect) -> Self {
+        Self::with_history(bounds, DEFAULT_HISTORY)
+    }
+
+    /// Create a terminal widget keeping up to `max_lines` rows of
+    /// scrollback; 0 keeps none.
+    pub fn with_history(bounds: Rect, max_lines: usize) -> Self {
+        let vt = Vt::with_history(bounds.width, bounds.height, max_lines);
+        Self::with_vt(bounds, Some(vt), Some(vt::history_buffer(max_lines)))
+    }
+
+    /// Create a widget around an optional emulator and its scrollback.
+    const fn with_vt(bounds: Rect, vt: Option<Vt>, history: Option<RopeBuffer>) -> Self {
         Self {
             bounds,
-            parser: Arc::new(Mutex::new(vt100::Parser::new(bounds.height, bounds.width, 0))),
+            screen: Mutex::new(Screen {
+                vt,
+                history,
+                damage: Vec::new(),
+                full: true,
+                generation: 0,
+            }),
+            #[cfg(unix)]
+            session: None,
+            #[cfg(unix)]
+            seen: 0,
+            scroll_offset: 0,
             needs_redraw: true,
         }
     }
 
+    /// Run `command` on a pseudo-terminal sized to `bounds`.
+    ///
+    /// The child's output is parsed on its own thread, so heavy output
+    /// never stalls the caller. Keys passed to
+    /// [`handle_input`](Widget::handle_input) are queued for the child and
+    /// sent by [`flush_input`](Self::flush_input).
+    ///
+    /// # Errors
+    /// Returns an error if the PTY can't be allocated or the child can't be
+    /// spawned.
+    #[cfg(unix)]
+    pub fn spawn(bounds: Rect, command: Command) -> io::Result<Self> {
+        let session = PtySession::spawn(command, bounds.height, bounds.width, DEFAULT_HISTORY)?;
+        let mut terminal = Self::with_vt(bounds, None, None);
+        terminal.session = Some(session);
+        Ok(terminal)
+    }
+
     /// Process a chunk of bytes through the terminal emulator.
+    ///
+    /// Ignored by spawned terminals, whose output comes from the child.
     pub fn write(&mut self, data: &[u8]) {
-        if let Ok(mut parser) = self.parser.lock() {
-            parser.process(data);
+        if let Ok(Screen {
+            vt: Some(vt),
+            history: Some(history),
+            ..
+        }) = self.screen.get_mut()
+        {
+            vt.feed(data);
+            vt.drain_history(history);
             self.needs_redraw = true;
         }
     }
 
-    /// Clear the terminal content.
+    /// Clear the terminal content, keeping the scrollback.
+    ///
+    /// Ignored by spawned terminals.
     pub fn clear(&mut self) {
-        if let Ok(mut parser) = self.parser.lock() {
-            *parser = vt100::Parser::new(self.bounds.height, self.bounds.width, 0);
+        if let Ok(screen) = self.screen.get_mut() {
+            if let Some(vt) = &mut screen.vt {
+                vt.reset();
+                screen.full = true;
+                self.needs_redraw = true;
+            }
+        }
+    }
+
+    /// Take the emulator's replies to status requests (cursor position,
+    /// device attributes), which the caller should write to its PTY.
+    ///
+    /// Spawned terminals send these to the child themselves.
+    pub fn take_responses(&mut self) -> Vec<u8> {
+        match self.screen.get_mut() {
+            Ok(Screen { vt: Some(vt), .. }) => vt.take_responses(),
+            _ => Vec::new(),
+        }
+    }
+
+    /// Queue bytes for the spawned child's input.
+    #[cfg(unix)]
+    pub fn send_input(&mut self, bytes: &[u8]) {
+        if let Some(session) = &mut self.session {
+            session.queue_input(bytes);
+        }
+    }
+
+    /// Send input queued since the last flush to the child as one write.
+    ///
+    /// Call once per frame. Never blocks.
+    #[cfg(unix)]
+    pub fn flush_input(&mut self) {
+        if let Some(session) = &mut self.session {
+            session.flush_input();
+        }
+    }
+
+    /// Check whether the spawned child has exited, without waiting.
+    ///
+    /// # Returns
+    /// `None` while it runs, or for terminals without a child.
+    ///
+    /// # Errors
+    /// Returns an error if the child's status can't be read.
+    #[cfg(unix)]
+    pub fn try_wait(&mut self) -> io::Result<Option<std::process::ExitStatus>> {
+        self.session.as_mut().map_or(Ok(None), PtySession::try_wait)
+    }
+
+    /// Get the cursor position (x, y) within the widget, if it's visible.
+    pub fn cursor(&self) -> Option<(u16, u16)> {
+        #[cfg(unix)]
+        if let Some(session) = &self.session {
+            let snapshot = session.snapshot();
+            return (!snapshot.hide_cursor).then_some(snapshot.cursor);
+        }
+        let guard = self.screen.lock().ok()?;
+        let vt = guard.vt.as_ref()?;
+        let cursor = (!vt.hide_cursor()).then_some(vt.cursor());
+        drop(guard);
+        cursor
+    }
+
+    /// Get the number of rows in the scrollback.
+    pub fn history_len(&self) -> usize {
+        #[cfg(unix)]
+        if let Some(session) = &self.session {
+            return session.history().map_or(0, |history| history.len().saturating_sub(1));
+        }
+        self.screen
+            .lock()
+            .ok()
+            .and_then(|screen| Some(screen.history.as_ref()?.len().saturating_sub(1)))
+            .unwrap_or(0)
+    }
+
+    /// Get the number of rows the view is scrolled up into the scrollback.
+    pub const fn scroll_offset(&self) -> usize {
+        self.scroll_offset
+    }
+
+    /// Scroll the view up into the scrollback by the given number of rows.
+    ///
+    /// New output doesn't move the view back down; see
+    /// [`scroll_to_bottom`](Self::scroll_to_bottom).
+    pub fn scroll_up(&mut self, lines: usize) {
+        let offset = self.scroll_offset.saturating_add(lines).min(self.history_len());
+        self.set_scroll_offset(offset);
+    }
+
+    /// Scroll the view down towards the live screen by the given number of
+    /// rows.
+    pub fn scroll_down(&mut self, lines: usize) {
+        self.set_scroll_offset(self.scroll_offset.saturating_sub(lines));
+    }
+
+    /// Scroll the view back to the live screen.
+    pub fn scroll_to_bottom(&mut self) {
+        self.set_scroll_offset(0);
+    }
+
+    /// Move the view, redrawing every row.
+    fn set_scroll_offset(&mut self, offset: usize) {
+        if offset != self.scroll_offset {
+            self.scroll_offset = offset;
+            self.invalidate();
+        }
+    }
+
+    /// Write every row on the next render, not just the changed ones.
+    ///
+    /// Rendering only touches damaged rows and relies on the buffer keeping
+    /// the rest from the previous frame; call this when something else drew
+    /// over the widget's area or the buffer was cleared.
+    pub fn invalidate(&mut self) {
+        if let Ok(screen) = self.screen.get_mut() {
+            screen.full = true;
             self.needs_redraw = true;
         }
     }
 }
 
+/// Copy the damaged rows of a screen into the buffer at `bounds`.
+fn paint_rows(bounds: Rect, buffer: &mut Buffer, screen: &Grid, damage: &[bool], full: bool) {
+    for y in 0..screen.height().min(bounds.height) {
+        if full || damage.get(usize::from(y)).copied().unwrap_or(true) {
+            paint_row(bounds, buffer, screen, y, bounds.y + y);
+        }
+    }
+}
+
+/// Copy screen row `y` into the buffer at row `to`.
+fn paint_row(bounds: Rect, buffer: &mut Buffer, screen: &Grid, y: u16, to: u16) {
+    let width = screen
+        .width()
+        .min(bounds.width)
+        .min(buffer.width().saturating_sub(bounds.x));
+    let row = &screen.row(y)[..usize::from(width)];
+    buffer.write_row_span(bounds.x, to, row);
+
+    // Grapheme ids are global; the buffer only has to hold the graphemes
+    if row.iter().any(Cell::is_overflow) {
+        buffer.hold_graphemes(screen.storage());
+    }
+}
+
+/// Draw the view scrolled `offset` rows up: scrollback lines above the top
+/// rows of the screen.
+///
+/// Only the lines in view are read back, so this costs one viewport however
+/// long the scrollback is.
+fn paint_scrolled(bounds: Rect, buffer: &mut Buffer, history: &mut RopeBuffer, screen: &Grid, offset: usize) {
+    // The scrollback's last line is the open one, never written
+    let lines = history.len().saturating_sub(1);
+    let start = lines - offset.min(lines);
+    // Frozen lines that can't be read back render as blank rows
+    let _ = history.ensure_resident(start..lines.min(start + usize::from(bounds.height)));
+
+    for row in 0..bounds.height {
+        let index = start + usize::from(row);
+        let to = bounds.y + row;
+        match index.checked_sub(lines).map(u16::try_from) {
+            None => {
+                let cells = history.get_line(index).map(|line| line.content.as_slice());
+                paint_line(bounds, buffer, to, cells.unwrap_or_default());
+            },
+            Some(Ok(y)) if y < screen.height() => paint_row(bounds, buffer, screen, y, to),
+            Some(_) => paint_line(bounds, buffer, to, &[]),
+        }
+    }
+}
+
+/// Write a scrollback line into the buffer at row `to`, padding with blanks.
+fn paint_line(bounds: Rect, buffer: &mut Buffer, to: u16, cells: &[Cell]) {
+    let x = buffer.write_cells(bounds.x, to, bounds.width, cells);
+    buffer.fill_row_span(bounds.x + x, to, bounds.width - x, Cell::EMPTY);
+}
+
 impl Widget for Terminal {
     fn bounds(&self) -> Rect {
         self.bounds
@@ -52,100 +326,164 @@ impl Widget for Terminal {
     fn set_bounds(&mut self, bounds: Rect) {
         if bounds != self.bounds {
             self.bounds = bounds;
-            if let Ok(mut parser) = self.parser.lock() {
-                parser.set_size(bounds.height, bounds.width);
+            if let Ok(screen) = self.screen.get_mut() {
+                if let Some(vt) = &mut screen.vt {
+                    vt.resize(bounds.width, bounds.height);
+                }
+                screen.full = true;
+            }
+            #[cfg(unix)]
+            if let Some(session) = &self.session {
+                let _ = session.resize(bounds.height, bounds.width);
             }
             self.needs_redraw = true;
         }
     }
 
-    #[allow(clippy::cast_possible_truncation)]
     fn render(&self, buffer: &mut Buffer) {
-        let Ok(parser) = self.parser.lock() else { return };
-        let screen = parser.screen();
-
-        for y in 0..self.bounds.height {
-            for x in 0..self.bounds.width {
-                if let Some(cell) = screen.cell(y, x) {
-                    let mut fl_cell = Cell::from_char(cell.contents().chars().next().unwrap_or(' '));
-                    
-                    // FG Color
-                    match cell.fgcolor() {
-                        vt100::Color::Rgb(r, g, b) => {
-                            fl_cell.set_fg(Rgb::new(r, g, b));
-                        }
-                        vt100::Color::Idx(i) => {
-                            fl_cell.set_fg(ansi_to_rgb(i));
-                        }
-                        vt100::Color::Default => {}
-                    }
-                    
-                    // BG Color
-                    match cell.bgcolor() {
-                        vt100::Color::Rgb(r, g, b) => {
-                            fl_cell.set_bg(Rgb::new(r, g, b));
-                        }
-                        vt100::Color::Idx(i) => {
-                            fl_cell.set_bg(ansi_to_rgb(i));
-                        }
-                        vt100::Color::Default => {}
-                    }
-                    
-                    buffer.set(self.bounds.x + x, self.bounds.y + y, fl_cell);
+        let Ok(mut guard) = self.screen.lock() else { return };
+        let state = &mut *guard;
+
+        #[cfg(unix)]
+        if let Some(session) = &self.session {
+            let snapshot = session.take_frame(&mut state.damage);
+            state.generation = snapshot.generation;
+            if self.scroll_offset > 0 {
+                if let Some(mut history) = session.history() {
+                    paint_scrolled(self.bounds, buffer, &mut history, snapshot.screen(), self.scroll_offset);
                 }
+                // Returning to the live screen repaints it whole
+                state.full = true;
+                return;
             }
+            paint_rows(self.bounds, buffer, snapshot.screen(), &state.damage, state.full);
+            state.full = false;
+            return;
         }
+
+        let (Some(vt), Some(history)) = (&mut state.vt, &mut state.history) else { return };
+        if self.scroll_offset > 0 {
+            paint_scrolled(self.bounds, buffer, history, vt.screen(), self.scroll_offset);
+            vt.clear_damage();
+            state.full = true;
+            return;
+        }
+        paint_rows(self.bounds, buffer, vt.screen(), vt.damage(), state.full);
+        vt.clear_damage();
+        state.full = false;
     }
 
-    fn handle_input(&mut self, _event: &InputEvent) -> bool {
-        // Terminal doesn't handle input locally by default, 
-        // it just consumes it if it's targeted?
-        // Actually, the caller usually maps keys to bytes and writes to the PTY.
+    fn handle_input(&mut self, event: &InputEvent) -> bool {
+        // Shift+PageUp/PageDown page through the scrollback
+        if let InputEvent::Key { code, modifiers } = event {
+            let page = usize::from(self.bounds.height.max(1));
+            match code {
+                KeyCode::PageUp if modifiers.shift => {
+                    self.scroll_up(page);
+                    return true;
+                },
+                KeyCode::PageDown if modifiers.shift => {
+                    self.scroll_down(page);
+                    return true;
+                },
+                _ => {},
+            }
+        }
+
+        // Typing goes to the live screen
+        #[cfg(unix)]
+        if self.session.is_some() && matches!(event, InputEvent::Key { .. } | InputEvent::Paste(_)) {
+            self.scroll_to_bottom();
+        }
+
+        // Without a child, the caller maps keys to bytes for its own PTY
+        #[cfg(unix)]
+        if let Some(session) = &mut self.session {
+            let mut bytes = Vec::new();
+            let consumed = match event {
+                InputEvent::Key { code, modifiers } => {
+                    let application_cursor = session.snapshot().application_cursor;
+                    pty::encode_key(*code, *modifiers, application_cursor, &mut bytes)
+                },
+                InputEvent::Paste(text) => {
+                    let bracketed = session.snapshot().bracketed_paste;
+                    pty::encode_paste(text, bracketed, &mut bytes);
+                    true
+                },
+                _ => false,
+            };
+            session.queue_input(&bytes);
+            return consumed;
+        }
+        let _ = event;
         false
     }
 
     fn needs_redraw(&self) -> bool {
+        #[cfg(unix)]
+        if let Some(session) = &self.session {
+            return self.needs_redraw || session.generation() != self.seen;
+        }
         self.needs_redraw
     }
 
     fn clear_redraw(&mut self) {
+        #[cfg(unix)]
+        if let Ok(screen) = self.screen.get_mut() {
+            self.seen = screen.generation;
+        }
         self.needs_redraw = false;
     }
 }
 
-/// Convert ANSI color index to RGB.
-const fn ansi_to_rgb(idx: u8) -> Rgb {
-    match idx {
-        0 => Rgb::new(0, 0, 0),
-        1 => Rgb::new(128, 0, 0),
-        2 => Rgb::new(0, 128, 0),
-        3 => Rgb::new(128, 128, 0),
-        4 => Rgb::new(0, 0, 128),
-        5 => Rgb::new(128, 0, 128),
-        6 => Rgb::new(0, 128, 128),
-        7 => Rgb::new(192, 192, 192),
-        8 => Rgb::new(128, 128, 128),
-        9 => Rgb::new(255, 0, 0),
-        10 => Rgb::new(0, 255, 0),
-        11 => Rgb::new(255, 255, 0),
-        12 => Rgb::new(0, 0, 255),
-        13 => Rgb::new(255, 0, 255),
-        14 => Rgb::new(0, 255, 255),
-        15 => Rgb::new(255, 255, 255),
-        16..=231 => {
-            let i = idx - 16;
-            let r = (i / 36) % 6;
-            let g = (i / 6) % 6;
-            let b = i % 6;
-            Rgb::new(
-                if r == 0 { 0 } else { r * 40 + 55 },
-                if g == 0 { 0 } else { g * 40 + 55 },
-                if b == 0 { 0 } else { b * 40 + 55 },
-            )
-        }
-        232..=255 => {
-            let v = (idx - 232) * 10 + 8;
-            Rgb::new(v, v, v)
-        }
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_terminal_renders_damaged_rows() {
+        let mut term = Terminal::new(Rect::new(0, 0, 10, 3));
+        let mut buffer = Buffer::new(10, 3);
+        term.write(b"one\r\ntwo");
+        term.render(&mut buffer);
+        assert_eq!(buffer.get_grapheme(0, 0), Some("o"));
+        assert_eq!(buffer.get_grapheme(2, 1), Some("o"));
+
+        // Mark both rows; only the row that changed is written again
+        buffer.set(9, 0, Cell::new('#'));
+        buffer.set(9, 1, Cell::new('#'));
+        term.write(b"!");
+        term.render(&mut buffer);
+        assert_eq!(buffer.get_grapheme(9, 0), Some("#"));
+        assert_eq!(buffer.get_grapheme(3, 1), Some("!"));
+        assert_eq!(buffer.get_grapheme(9, 1), Some(" "));
+
+        term.invalidate();
+        term.render(&mut buffer);
+        assert_eq!(buffer.get_grapheme(9, 0), Some(" "));
+    }
+
+    #[test]
+    fn test_terminal_scrollback() {
+        let mut term = Terminal::new(Rect::new(0, 0, 6, 2));
+        let mut buffer = Buffer::new(6, 2);
+        term.write(b"first\r\nsecond\r\nthird");
+        assert_eq!(term.history_len(), 1);
+
+        // Scrolled up, the history line sits above the screen's top row
+        term.scroll_up(5);
+        assert_eq!(term.scroll_offset(), 1);
+        term.render(&mut buffer);
+        assert_eq!(buffer.get_grapheme(0, 0), Some("f"));
+        assert_eq!(buffer.get_grapheme(5, 0), Some(" "));
+        assert_eq!(buffer.get_grapheme(0, 1), Some("s"));
+
+        // Clearing keeps the history; the live screen comes back whole
+        term.clear();
+        term.scroll_to_bottom();
+        term.render(&mut buffer);
+        assert_eq!(term.history_len(), 1);
+        assert_eq!(buffer.get_grapheme(0, 0), Some(" "));
+        assert_eq!(buffer.get_grapheme(0, 1), Some(" "));
     }
 }
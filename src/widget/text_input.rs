@@ -217,21 +217,17 @@ impl Widget for TextInput {
         let width = self.bounds.width as usize;
 
         // Clear the line with background
-        for i in 0..self.bounds.width {
-            buffer.set(x + i, y, Cell::new(' ').with_bg(self.config.bg));
-        }
+        buffer.fill_row_span(x, y, self.bounds.width, Cell::new(' ').with_bg(self.config.bg));
 
         // Draw prompt
         let prompt_len = self.config.prompt.chars().count();
-        for (i, c) in self.config.prompt.chars().enumerate() {
-            #[allow(clippy::cast_possible_truncation)]
-            let px = x + i as u16;
-            if (px as usize) < x as usize + width {
-                buffer.set(px, y, Cell::new(c)
-                    .with_fg(self.config.prompt_fg)
-                    .with_bg(self.config.bg));
-            }
-        }
+        let prompt = self
+            .config
+            .prompt
+            .chars()
+            .take(width)
+            .map(|c| Cell::new(c).with_fg(self.config.prompt_fg).with_bg(self.config.bg));
+        buffer.write_row_span_iter(x, y, prompt);
 
         #[allow(clippy::cast_possible_truncation)]
         let text_start = x + prompt_len as u16;
@@ -239,18 +235,18 @@ impl Widget for TextInput {
 
         if self.content.is_empty() && !self.config.placeholder.is_empty() {
             // Draw placeholder
-            for (i, c) in self.config.placeholder.chars().take(text_width).enumerate() {
-                #[allow(clippy::cast_possible_truncation)]
-                let px = text_start + i as u16;
-                buffer.set(px, y, Cell::new(c)
-                    .with_fg(self.config.placeholder_fg)
-                    .with_bg(self.config.bg));
-            }
+            let placeholder = self
+                .config
+                .placeholder
+                .chars()
+                .take(text_width)
+                .map(|c| Cell::new(c).with_fg(self.config.placeholder_fg).with_bg(self.config.bg));
+            buffer.write_row_span_iter(text_start, y, placeholder);
         } else {
             // Draw content
             // Calculate visible window based on cursor position
             let cursor_char_pos = self.content[..self.cursor].chars().count();
-            let content_chars: Vec<char> = self.content.chars().collect();
+            let content_len = self.content.chars().count();
             
             // Calculate scroll offset to keep cursor visible
             let scroll_offset = if cursor_char_pos >= text_width {
@@ -259,23 +255,24 @@ impl Widget for TextInput {
                 0
             };
 
-            for (i, &c) in content_chars.iter().skip(scroll_offset).take(text_width).enumerate() {
-                #[allow(clippy::cast_possible_truncation)]
-                let px = text_start + i as u16;
-                let is_cursor = self.focused 
-                    && (i + scroll_offset) == cursor_char_pos
-                    && self.frame % 30 < 15;
-
-                if is_cursor {
-                    buffer.set(px, y, Cell::new(c)
-                        .with_fg(self.config.bg)
-                        .with_bg(self.config.cursor_fg));
-                } else {
-                    buffer.set(px, y, Cell::new(c)
-                        .with_fg(self.config.fg)
-                        .with_bg(self.config.bg));
-                }
-            }
+            // Invert the cell under the cursor
+            let blink = self.focused && self.frame % 30 < 15;
+            let cursor_col = cursor_char_pos.saturating_sub(scroll_offset);
+            let visible = self
+                .content
+                .chars()
+                .skip(scroll_offset)
+                .take(text_width)
+                .enumerate()
+                .map(|(col, c)| {
+                    let cell = Cell::new(c);
+                    if blink && col == cursor_col {
+                        cell.with_fg(self.config.bg).with_bg(self.config.cursor_fg)
+                    } else {
+                        cell.with_fg(self.config.fg).with_bg(self.config.bg)
+                    }
+                });
+            buffer.write_row_span_iter(text_start, y, visible);
 
             // Draw cursor at end if needed
             #[allow(clippy::cast_possible_truncation)]
@@ -283,7 +280,7 @@ impl Widget for TextInput {
             #[allow(clippy::cast_possible_truncation)]
             let text_width_u16 = text_width as u16;
             if self.focused 
-                && cursor_char_pos == content_chars.len() 
+                && cursor_char_pos == content_len 
                 && cursor_visual_pos < text_width_u16
                 && self.frame % 30 < 15
             {
@@ -0,0 +1,1393 @@
+//! VT Emulator: A native VT/xterm emulator that writes straight into a [`Buffer`].
+//!
+//! The emulator keeps its screen as Flywheel [`Cell`]s in a [`Buffer`], so
+//! a widget shows it by copying rows, with no second cell grid to convert
+//! from. Rows are reached through a row map, so scrolling rotates the map
+//! instead of moving the screen. Printable ASCII runs are found a `u64`
+//! word at a time by [`text::printable_ascii_len`] and stored into the row
+//! in one pass, so `cat`-style bursts cost a few instructions per byte.
+//! Only control bytes, escape sequences and non-ASCII text take the
+//! byte-at-a-time path.
+//!
+//! Coverage follows what shells, editors and build tools use:
+//! - C0 controls, including tabs, SO/SI and the DEC line-drawing charset
+//! - Cursor movement, erase, insert and delete of characters and lines,
+//!   scroll regions, tab stops and SGR colors
+//! - DEC private modes for the application cursor, origin, autowrap,
+//!   cursor visibility, the alternate screen (47, 1047, 1049) and
+//!   bracketed paste
+//! - Status and device attribute reports, queued for the child's input
+//! - OSC 0 and 2 window titles; other strings are skipped
+//!
+//! Every row carries a damage flag, set whenever it changes, so a renderer
+//! only copies the rows written since it last looked.
+//!
+//! An emulator made with [`Vt::with_history`] also keeps the rows that
+//! scroll off the top of the primary screen, trimmed to compact lines, for
+//! the owner to move into a [`RopeBuffer`] scrollback.
+
+use super::ansi::Pen;
+use crate::buffer::text::{self, char_width};
+use crate::buffer::{Buffer, Cell, ChunkedLine, Modifiers, Rgb, RopeBuffer};
+use bitflags::bitflags;
+use std::collections::VecDeque;
+use std::io::Write;
+
+/// Maximum number of parameters kept for one CSI sequence.
+const MAX_PARAMS: usize = 16;
+
+/// Longest OSC string kept; the rest is dropped.
+const MAX_OSC_LEN: usize = 4096;
+
+/// Longest grapheme kept in a cell, in bytes; further combining marks are
+/// dropped.
+const MAX_GRAPHEME_LEN: usize = 32;
+
+/// Columns between default tab stops.
+const TAB_WIDTH: u16 = 8;
+
+/// Reply to a primary device attributes request: a VT220 with color.
+const DEVICE_ATTRIBUTES: &[u8] = b"\x1b[?62;22c";
+
+/// Chunks of a history scrollback kept uncompressed.
+const HISTORY_HOT_CHUNKS: usize = 4;
+
+/// Style after a reset.
+const DEFAULT_PEN: Pen = Pen {
+    fg: Rgb::DEFAULT_FG,
+    bg: Rgb::DEFAULT_BG,
+    modifiers: Modifiers::empty(),
+};
+
+/// DEC special graphics for `0x5F`-`0x7E`, as xterm draws them.
+const DEC_GRAPHICS: [char; 32] = [
+    '\u{a0}', '◆', '▒', '␉', '␌', '␍', '␊', '°', '±', '␤', '␋', '┘', '┐', '┌', '└', '┼', '⎺', '⎻',
+    '─', '⎼', '⎽', '├', '┤', '┴', '┬', '│', '≤', '≥', 'π', '≠', '£', '·',
+];
+
+/// Create a scrollback for the history of an emulator made with
+/// [`Vt::with_history`].
+///
+/// Lines far from the bottom are compressed, so a long build's output
+/// costs little memory; at most `max_lines` finished rows are kept, plus
+/// the open line [`Vt::drain_history`] writes into.
+pub fn history_buffer(max_lines: usize) -> RopeBuffer {
+    RopeBuffer::with_compression(max_lines.saturating_add(1), HISTORY_HOT_CHUNKS)
+}
+
+/// Parser state between bytes.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum State {
+    /// Text and control characters.
+    Ground,
+    /// After ESC.
+    Escape,
+    /// Inside an ESC sequence with intermediate bytes.
+    EscIntermediate,
+    /// Collecting CSI parameters.
+    Csi,
+    /// Inside a malformed CSI sequence.
+    CsiIgnore,
+    /// Inside an OSC string, terminated by BEL or ST.
+    Osc,
+    /// Inside a DCS/SOS/PM/APC string, terminated by ST.
+    Str,
+}
+
+/// Character set designated to G0 or G1.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Charset {
+    /// US ASCII.
+    Ascii,
+    /// DEC special graphics (line drawing).
+    DecGraphics,
+}
+
+bitflags! {
+    /// Terminal modes set by SM/RM and DECSET/DECRST.
+    #[derive(Debug, Clone, Copy, PartialEq, Eq)]
+    struct Modes: u8 {
+        /// Wrap to the next line after the last column (DECAWM).
+        const AUTOWRAP = 0b0000_0001;
+        /// Shift the rest of the line right when printing (IRM).
+        const INSERT = 0b0000_0010;
+        /// Arrow keys send `ESC O` sequences (DECCKM).
+        const APPLICATION_CURSOR = 0b0000_0100;
+        /// The cursor is hidden (DECTCEM reset).
+        const HIDE_CURSOR = 0b0000_1000;
+        /// Pastes are bracketed by `ESC [200~` and `ESC [201~`.
+        const BRACKETED_PASTE = 0b0001_0000;
+        /// The alternate screen is shown.
+        const ALTERNATE = 0b0010_0000;
+    }
+}
+
+/// Cursor position and the state saved along with it by DECSC.
+#[derive(Debug, Clone, Copy)]
+struct Cursor {
+    /// Column.
+    x: u16,
+    /// Row.
+    y: u16,
+    /// Style for printed and erased cells.
+    pen: Pen,
+    /// Whether the next printable character wraps to the next line first.
+    wrap_pending: bool,
+    /// Whether rows are relative to the scroll region (DECOM).
+    origin: bool,
+    /// Character sets designated to G0 and G1.
+    charsets: [Charset; 2],
+    /// Index of the character set in use: 0 after SI, 1 after SO.
+    shift: usize,
+}
+
+impl Cursor {
+    /// The cursor after a reset.
+    const HOME: Self = Self {
+        x: 0,
+        y: 0,
+        pen: DEFAULT_PEN,
+        wrap_pending: false,
+        origin: false,
+        charsets: [Charset::Ascii; 2],
+        shift: 0,
+    };
+}
+
+/// A screen's cells, read in display order.
+///
+/// Storage rows are reached through a map from display rows, so scrolling
+/// a region rotates part of the map and blanks the rows that come in,
+/// instead of moving every cell.
+#[derive(Debug, Clone)]
+pub struct Grid {
+    /// Cell storage, in storage row order.
+    cells: Buffer,
+    /// Storage row of each display row.
+    order: Vec<u16>,
+}
+
+impl Grid {
+    /// Create a blank grid.
+    pub(crate) fn new(width: u16, height: u16) -> Self {
+        Self {
+            cells: Buffer::new(width, height),
+            order: (0..height).collect(),
+        }
+    }
+
+    /// Get the width in columns.
+    pub const fn width(&self) -> u16 {
+        self.cells.width()
+    }
+
+    /// Get the height in rows.
+    pub const fn height(&self) -> u16 {
+        self.cells.height()
+    }
+
+    /// Get a display row's cells.
+    ///
+    /// # Panics
+    /// Panics if `y` is out of bounds.
+    pub fn row(&self, y: u16) -> &[Cell] {
+        let width = usize::from(self.width());
+        &self.cells.cells()[usize::from(self.order[usize::from(y)]) * width..][..width]
+    }
+
+    /// Get the rows in display order.
+    pub fn rows(&self) -> impl Iterator<Item = &[Cell]> {
+        (0..self.height()).map(|y| self.row(y))
+    }
+
+    /// Get a reference to the cell at (x, y).
+    pub fn get(&self, x: u16, y: u16) -> Option<&Cell> {
+        self.cells.get(x, *self.order.get(usize::from(y))?)
+    }
+
+    /// Get the grapheme at (x, y), including overflow lookup.
+    pub fn get_grapheme(&self, x: u16, y: u16) -> Option<&str> {
+        self.cells.get_grapheme(x, *self.order.get(usize::from(y))?)
+    }
+
+    /// Get an overflow grapheme by its index.
+    pub fn get_overflow(&self, index: u32) -> Option<&str> {
+        self.cells.get_overflow(index)
+    }
+
+    /// Get the cell storage, which holds the grapheme of every overflow
+    /// cell.
+    pub(crate) const fn storage(&self) -> &Buffer {
+        &self.cells
+    }
+
+    /// Get a mutable display row.
+    fn row_mut(&mut self, y: u16) -> &mut [Cell] {
+        let width = usize::from(self.width());
+        let start = usize::from(self.order[usize::from(y)]) * width;
+        &mut self.cells.cells_mut()[start..][..width]
+    }
+
+    /// Get a mutable reference to the cell at (x, y).
+    fn get_mut(&mut self, x: u16, y: u16) -> Option<&mut Cell> {
+        self.cells.get_mut(x, *self.order.get(usize::from(y))?)
+    }
+
+    /// Set a grapheme at (x, y). See [`Buffer::set_grapheme`].
+    fn set_grapheme(&mut self, x: u16, y: u16, grapheme: &str, fg: Rgb, bg: Rgb) -> u8 {
+        let row = self.order[usize::from(y)];
+        self.cells.set_grapheme(x, row, grapheme, fg, bg)
+    }
+
+    /// Fill every cell.
+    fn fill(&mut self, cell: Cell) {
+        self.cells.cells_mut().fill(cell);
+    }
+
+    /// Blank every cell, dropping overflow graphemes.
+    fn clear(&mut self) {
+        self.cells.clear();
+    }
+
+    /// Copy another grid of any size into this one.
+    pub(crate) fn copy_from(&mut self, other: &Self) {
+        if (self.width(), self.height()) == (other.width(), other.height()) {
+            self.cells.copy_from(&other.cells);
+            self.order.copy_from_slice(&other.order);
+        } else {
+            self.clone_from(other);
+        }
+    }
+
+    /// Resize, keeping the top-left content in display order.
+    fn resize(&mut self, width: u16, height: u16) {
+        // Put storage rows back in display order first
+        let rows: Vec<Cell> = self.rows().flatten().copied().collect();
+        self.cells.cells_mut().copy_from_slice(&rows);
+        self.cells.resize(width, height);
+        self.order = (0..height).collect();
+    }
+
+    /// Scroll display rows `top..bottom` up by `n`, filling with `blank`.
+    fn scroll_up(&mut self, top: u16, bottom: u16, n: u16, blank: Cell) {
+        self.order[usize::from(top)..usize::from(bottom)].rotate_left(usize::from(n));
+        for y in bottom - n..bottom {
+            self.row_mut(y).fill(blank);
+        }
+    }
+
+    /// Scroll display rows `top..bottom` down by `n`, filling with `blank`.
+    fn scroll_down(&mut self, top: u16, bottom: u16, n: u16, blank: Cell) {
+        self.order[usize::from(top)..usize::from(bottom)].rotate_right(usize::from(n));
+        for y in top..top + n {
+            self.row_mut(y).fill(blank);
+        }
+    }
+}
+
+/// A VT/xterm terminal emulator.
+///
+/// Bytes from the child go in through [`feed`](Self::feed); the screen is
+/// read back as a [`Grid`] with [`screen`](Self::screen).
+#[derive(Debug)]
+pub struct Vt {
+    /// The screen being shown.
+    grid: Grid,
+    /// The other screen: the alternate one, or the primary one while the
+    /// alternate screen is shown.
+    other: Grid,
+    /// The cursor.
+    cursor: Cursor,
+    /// Cursor saved by DECSC.
+    saved: Cursor,
+    /// First row of the scroll region.
+    top: u16,
+    /// Last row of the scroll region, inclusive.
+    bottom: u16,
+    /// Tab stops, one flag per column.
+    tabs: Vec<bool>,
+    /// Modes in effect.
+    modes: Modes,
+    /// Rows changed since the last [`clear_damage`](Self::clear_damage).
+    damage: Vec<bool>,
+    /// Parser state.
+    state: State,
+    /// Parameters of the CSI sequence being collected; missing ones are 0.
+    params: [u16; MAX_PARAMS],
+    /// Number of parameters present (at least 1).
+    param_len: usize,
+    /// Private marker of the CSI sequence (`?`, `>`, ...), or 0.
+    private: u8,
+    /// Last intermediate byte of the sequence, or 0.
+    intermediate: u8,
+    /// OSC string being collected.
+    osc: Vec<u8>,
+    /// Start of a UTF-8 sequence split across calls to `feed`.
+    utf8: [u8; 4],
+    /// Bytes used in `utf8`.
+    utf8_len: usize,
+    /// Last printed character, for REP.
+    last: Option<char>,
+    /// Window title set by OSC 0 or 2.
+    title: String,
+    /// Replies to status requests, waiting to be sent to the child.
+    responses: Vec<u8>,
+    /// Rows scrolled off the top of the primary screen, waiting to be
+    /// moved into a scrollback by [`drain_history`](Self::drain_history).
+    history: VecDeque<ChunkedLine>,
+    /// Most rows kept in `history`; 0 keeps none.
+    history_limit: usize,
+    /// Whether the child erased the scrollback since the last drain.
+    history_erased: bool,
+}
+
+impl Vt {
+    /// Create an emulator with a blank screen of the given size.
+    ///
+    /// Sizes are raised to at least one row and column.
+    pub fn new(width: u16, height: u16) -> Self {
+        let (width, height) = (width.max(1), height.max(1));
+        Self {
+            grid: Grid::new(width, height),
+            other: Grid::new(width, height),
+            cursor: Cursor::HOME,
+            saved: Cursor::HOME,
+            top: 0,
+            bottom: height - 1,
+            tabs: (0..width).map(|x| x > 0 && x % TAB_WIDTH == 0).collect(),
+            modes: Modes::AUTOWRAP,
+            damage: vec![true; usize::from(height)],
+            state: State::Ground,
+            params: [0; MAX_PARAMS],
+            param_len: 1,
+            private: 0,
+            intermediate: 0,
+            osc: Vec::new(),
+            utf8: [0; 4],
+            utf8_len: 0,
+            last: None,
+            title: String::new(),
+            responses: Vec::new(),
+            history: VecDeque::new(),
+            history_limit: 0,
+            history_erased: false,
+        }
+    }
+
+    /// Create an emulator that keeps rows scrolled off the top of the
+    /// primary screen.
+    ///
+    /// Up to `max_lines` rows are held between calls to
+    /// [`drain_history`](Self::drain_history); older ones are dropped.
+    pub fn with_history(width: u16, height: u16, max_lines: usize) -> Self {
+        let mut vt = Self::new(width, height);
+        vt.history_limit = max_lines;
+        vt
+    }
+
+    /// Get the screen being shown.
+    pub const fn screen(&self) -> &Grid {
+        &self.grid
+    }
+
+    /// Get the cursor position as (x, y).
+    pub const fn cursor(&self) -> (u16, u16) {
+        (self.cursor.x, self.cursor.y)
+    }
+
+    /// Check whether the child hid the cursor.
+    pub const fn hide_cursor(&self) -> bool {
+        self.modes.contains(Modes::HIDE_CURSOR)
+    }
+
+    /// Check whether arrow keys should be sent in application mode.
+    pub const fn application_cursor(&self) -> bool {
+        self.modes.contains(Modes::APPLICATION_CURSOR)
+    }
+
+    /// Check whether pastes should be bracketed.
+    pub const fn bracketed_paste(&self) -> bool {
+        self.modes.contains(Modes::BRACKETED_PASTE)
+    }
+
+    /// Check whether the alternate screen is shown.
+    pub const fn alternate_screen(&self) -> bool {
+        self.modes.contains(Modes::ALTERNATE)
+    }
+
+    /// Get the window title set by the child.
+    pub fn title(&self) -> &str {
+        &self.title
+    }
+
+    /// Get the rows changed since the last [`clear_damage`](Self::clear_damage),
+    /// one flag per row.
+    pub fn damage(&self) -> &[bool] {
+        &self.damage
+    }
+
+    /// Mark every row as unchanged.
+    pub fn clear_damage(&mut self) {
+        self.damage.fill(false);
+    }
+
+    /// Take the replies to status requests that should be sent to the child.
+    pub fn take_responses(&mut self) -> Vec<u8> {
+        std::mem::take(&mut self.responses)
+    }
+
+    /// Check whether [`drain_history`](Self::drain_history) has anything
+    /// to do.
+    pub fn has_history(&self) -> bool {
+        !self.history.is_empty() || self.history_erased
+    }
+
+    /// Move the rows scrolled off since the last call into `scrollback`,
+    /// oldest first.
+    ///
+    /// The last line of `scrollback` is the open line of a stream: each row
+    /// is written into it and a new line started, so lines `0..len - 1`
+    /// are history. If the child erased the scrollback (`CSI 3 J`),
+    /// `scrollback` is cleared first.
+    pub fn drain_history(&mut self, scrollback: &mut RopeBuffer) {
+        if std::mem::take(&mut self.history_erased) {
+            scrollback.clear();
+        }
+        for line in self.history.drain(..) {
+            if let Some(open) = scrollback.current_line_mut() {
+                *open = line;
+            }
+            scrollback.newline();
+        }
+    }
+
+    /// Resize both screens, keeping their top-left content.
+    ///
+    /// The scroll region is reset and every row is marked as changed.
+    pub fn resize(&mut self, width: u16, height: u16) {
+        let (width, height) = (width.max(1), height.max(1));
+        if (width, height) == (self.grid.width(), self.grid.height()) {
+            return;
+        }
+        self.grid.resize(width, height);
+        self.other.resize(width, height);
+        for cursor in [&mut self.cursor, &mut self.saved] {
+            cursor.x = cursor.x.min(width - 1);
+            cursor.y = cursor.y.min(height - 1);
+            cursor.wrap_pending = false;
+        }
+        self.top = 0;
+        self.bottom = height - 1;
+        let old = self.tabs.len();
+        self.tabs.resize(usize::from(width), false);
+        for (x, tab) in (0..width).zip(&mut self.tabs).skip(old) {
+            *tab = x % TAB_WIDTH == 0;
+        }
+        self.damage = vec![true; usize::from(height)];
+    }
+
+    /// Reset to the initial state, keeping the size and any history not
+    /// yet drained.
+    pub fn reset(&mut self) {
+        let history = std::mem::take(&mut self.history);
+        let erased = self.history_erased;
+        *self = Self::with_history(self.grid.width(), self.grid.height(), self.history_limit);
+        self.history = history;
+        self.history_erased = erased;
+    }
+
+    /// Process output from the child.
+    ///
+    /// Sequences and UTF-8 characters may be split across calls.
+    pub fn feed(&mut self, data: &[u8]) {
+        let mut i = 0;
+        while i < data.len() {
+            if self.state == State::Ground && self.utf8_len == 0 {
+                let run = text::printable_ascii_len(&data[i..]);
+                if run > 0 {
+                    self.print_ascii(&data[i..i + run]);
+                    i += run;
+                    continue;
+                }
+                if data[i] >= 0x80 {
+                    // Non-ASCII runs end on an ASCII byte, a char boundary
+                    let end = data[i..]
+                        .iter()
+                        .position(|&b| b < 0x80)
+                        .map_or(data.len(), |n| i + n);
+                    self.print_utf8(&data[i..end]);
+                    i = end;
+                    continue;
+                }
+            }
+            self.advance(data[i]);
+            i += 1;
+        }
+    }
+
+    /// Process one byte outside the ASCII and UTF-8 fast paths.
+    #[allow(clippy::match_same_arms)] // Arms are grouped by state, not by outcome
+    fn advance(&mut self, b: u8) {
+        if self.utf8_len > 0 && self.continue_utf8(b) {
+            return;
+        }
+        match (self.state, b) {
+            (State::Ground, _) => self.ground(b),
+            // CAN and SUB abort any sequence
+            (_, 0x18 | 0x1A) => self.state = State::Ground,
+            (State::Osc, 0x07) => {
+                self.osc_dispatch();
+                self.state = State::Ground;
+            },
+            // ESC starts ST, which ends the string
+            (State::Osc, 0x1B) => {
+                self.osc_dispatch();
+                self.state = State::Escape;
+            },
+            (State::Osc, _) => {
+                if self.osc.len() < MAX_OSC_LEN {
+                    self.osc.push(b);
+                }
+            },
+            (State::Str, 0x1B) => self.state = State::Escape,
+            (State::Str, _) => {},
+            (_, 0x1B) => self.state = State::Escape,
+            // Controls take effect in the middle of a sequence
+            (_, 0x00..=0x1F) => self.execute(b),
+            (State::Escape, _) => self.escape(b),
+            (State::EscIntermediate, 0x20..=0x2F) => self.intermediate = b,
+            (State::EscIntermediate, _) => self.esc_dispatch(b),
+            (State::Csi, _) => self.csi(b),
+            (State::CsiIgnore, 0x40..=0x7E) => self.state = State::Ground,
+            (State::CsiIgnore, _) => {},
+        }
+    }
+
+    /// Handle a byte in the ground state.
+    fn ground(&mut self, b: u8) {
+        match b {
+            0x1B => self.state = State::Escape,
+            0x20..=0x7E => self.print_char(char::from(b)),
+            0x80.. => self.print_utf8(&[b]),
+            _ => self.execute(b),
+        }
+    }
+
+    /// Execute a C0 control character.
+    fn execute(&mut self, b: u8) {
+        match b {
+            0x08 => {
+                self.cursor.x = self.cursor.x.saturating_sub(1);
+                self.cursor.wrap_pending = false;
+            },
+            0x09 => self.tab_forward(1),
+            0x0A..=0x0C => self.index(),
+            0x0D => self.set_x(0),
+            0x0E => self.cursor.shift = 1,
+            0x0F => self.cursor.shift = 0,
+            _ => {},
+        }
+    }
+
+    /// Handle the byte after ESC.
+    fn escape(&mut self, b: u8) {
+        self.state = State::Ground;
+        match b {
+            b'[' => {
+                self.params = [0; MAX_PARAMS];
+                self.param_len = 1;
+                self.private = 0;
+                self.intermediate = 0;
+                self.state = State::Csi;
+            },
+            b']' => {
+                self.osc.clear();
+                self.state = State::Osc;
+            },
+            b'P' | b'X' | b'^' | b'_' => self.state = State::Str,
+            0x20..=0x2F => {
+                self.intermediate = b;
+                self.state = State::EscIntermediate;
+            },
+            b'7' => self.saved = self.cursor,
+            b'8' => self.restore_cursor(),
+            b'D' => self.index(),
+            b'E' => {
+                self.set_x(0);
+                self.index();
+            },
+            b'H' => self.tabs[usize::from(self.cursor.x)] = true,
+            b'M' => self.reverse_index(),
+            b'c' => self.reset(),
+            _ => {},
+        }
+    }
+
+    /// Complete an ESC sequence with intermediate bytes.
+    fn esc_dispatch(&mut self, b: u8) {
+        self.state = State::Ground;
+        let charset = if b == b'0' {
+            Charset::DecGraphics
+        } else {
+            Charset::Ascii
+        };
+        match (self.intermediate, b) {
+            (b'(', _) => self.cursor.charsets[0] = charset,
+            (b')', _) => self.cursor.charsets[1] = charset,
+            // DECALN: fill the screen with `E`
+            (b'#', b'8') => {
+                self.grid.fill(Cell::new('E'));
+                self.damage.fill(true);
+            },
+            _ => {},
+        }
+    }
+
+    /// Handle a byte of a CSI sequence.
+    fn csi(&mut self, b: u8) {
+        match b {
+            b'0'..=b'9' => {
+                let slot = &mut self.params[self.param_len - 1];
+                *slot = slot.saturating_mul(10).saturating_add(u16::from(b - b'0'));
+            },
+            b';' | b':' => {
+                if self.param_len < MAX_PARAMS {
+                    self.param_len += 1;
+                }
+            },
+            b'<'..=b'?' if self.param_len == 1 && self.params[0] == 0 && self.private == 0 => {
+                self.private = b;
+            },
+            0x20..=0x2F => self.intermediate = b,
+            0x40..=0x7E => {
+                self.state = State::Ground;
+                self.csi_dispatch(b);
+            },
+            _ => self.state = State::CsiIgnore,
+        }
+    }
+
+    /// Get a CSI parameter, with `default` for missing and zero values.
+    fn param(&self, index: usize, default: u16) -> u16 {
+        match self.params[..self.param_len].get(index) {
+            Some(&value) if value != 0 => value,
+            _ => default,
+        }
+    }
+
+    /// Complete a CSI sequence.
+    fn csi_dispatch(&mut self, b: u8) {
+        let n = self.param(0, 1);
+        let (x, y) = (self.cursor.x, self.cursor.y);
+        let origin_top = if self.cursor.origin { self.top } else { 0 };
+        match (self.private, self.intermediate, b) {
+            (0, 0, b'@') => self.insert_blanks(n),
+            (0, 0, b'A') => self.cursor_up(n),
+            (0, 0, b'B' | b'e') => self.cursor_down(n),
+            (0, 0, b'C' | b'a') => self.set_x(x.saturating_add(n)),
+            (0, 0, b'D') => self.set_x(x.saturating_sub(n)),
+            (0, 0, b'E') => {
+                self.cursor_down(n);
+                self.set_x(0);
+            },
+            (0, 0, b'F') => {
+                self.cursor_up(n);
+                self.set_x(0);
+            },
+            (0, 0, b'G' | b'`') => self.set_x(n - 1),
+            (0, 0, b'H' | b'f') => {
+                self.goto(self.param(1, 1) - 1, origin_top.saturating_add(n - 1));
+            },
+            (0, 0, b'I') => self.tab_forward(n),
+            (0, 0, b'J') => self.erase_display(self.param(0, 0)),
+            (0, 0, b'K') => self.erase_line(self.param(0, 0)),
+            (0, 0, b'L') if (self.top..=self.bottom).contains(&y) => {
+                self.scroll_down_from(y, n);
+                self.set_x(0);
+            },
+            (0, 0, b'M') if (self.top..=self.bottom).contains(&y) => {
+                self.scroll_up_from(y, n);
+                self.set_x(0);
+            },
+            (0, 0, b'P') => self.delete_chars(n),
+            (0, 0, b'S') => self.scroll_up_from(self.top, n),
+            // With more parameters, `CSI T` starts mouse highlight tracking
+            (0, 0, b'T') if self.param_len == 1 => self.scroll_down_from(self.top, n),
+            (0, 0, b'X') => self.erase(y, x, x.saturating_add(n).min(self.grid.width())),
+            (0, 0, b'Z') => self.tab_backward(n),
+            (0, 0, b'b') => self.repeat(n),
+            (0, 0, b'c') if self.param(0, 0) == 0 => {
+                self.responses.extend_from_slice(DEVICE_ATTRIBUTES);
+            },
+            (0, 0, b'd') => self.goto(x, origin_top.saturating_add(n - 1)),
+            (0, 0, b'g') => match self.param(0, 0) {
+                0 => self.tabs[usize::from(x)] = false,
+                3 => self.tabs.fill(false),
+                _ => {},
+            },
+            (0 | b'?', 0, b'h' | b'l') => {
+                for i in 0..self.param_len {
+                    self.set_mode(self.params[i], b == b'h');
+                }
+            },
+            (0, 0, b'm') => {
+                let params = &self.params[..self.param_len];
+                self.cursor
+                    .pen
+                    .apply_sgr(params, Rgb::DEFAULT_FG, Rgb::DEFAULT_BG);
+            },
+            (0, 0, b'n') => self.report(self.param(0, 0)),
+            (0, 0, b'r') => self.set_scroll_region(),
+            (0, 0, b's') => self.saved = self.cursor,
+            (0, 0, b'u') => self.restore_cursor(),
+            _ => {},
+        }
+    }
+
+    /// Set or reset an ANSI mode, or a DEC private mode after `CSI ?`.
+    fn set_mode(&mut self, mode: u16, on: bool) {
+        if self.private == 0 {
+            if mode == 4 {
+                self.modes.set(Modes::INSERT, on);
+            }
+            return;
+        }
+        match mode {
+            1 => self.modes.set(Modes::APPLICATION_CURSOR, on),
+            6 => {
+                self.cursor.origin = on;
+                self.goto(0, if on { self.top } else { 0 });
+            },
+            7 => self.modes.set(Modes::AUTOWRAP, on),
+            25 => self.modes.set(Modes::HIDE_CURSOR, !on),
+            47 | 1047 => self.set_alternate(on),
+            1048 if on => self.saved = self.cursor,
+            1048 => self.restore_cursor(),
+            1049 if on => {
+                self.saved = self.cursor;
+                self.set_alternate(true);
+            },
+            1049 => {
+                self.set_alternate(false);
+                self.restore_cursor();
+            },
+            2004 => self.modes.set(Modes::BRACKETED_PASTE, on),
+            _ => {},
+        }
+    }
+
+    /// Switch between the primary and the alternate screen.
+    ///
+    /// The alternate screen starts out blank each time it's entered.
+    fn set_alternate(&mut self, on: bool) {
+        if on == self.alternate_screen() {
+            return;
+        }
+        std::mem::swap(&mut self.grid, &mut self.other);
+        if on {
+            self.grid.clear();
+        }
+        self.modes.set(Modes::ALTERNATE, on);
+        self.damage.fill(true);
+    }
+
+    /// Answer a device status request.
+    fn report(&mut self, code: u16) {
+        match code {
+            5 => self.responses.extend_from_slice(b"\x1b[0n"),
+            6 => {
+                let origin_top = if self.cursor.origin { self.top } else { 0 };
+                let row = self.cursor.y.saturating_sub(origin_top) + 1;
+                let _ = write!(self.responses, "\x1b[{row};{}R", self.cursor.x + 1);
+            },
+            _ => {},
+        }
+    }
+
+    /// Set the scroll region from the parameters of DECSTBM.
+    fn set_scroll_region(&mut self) {
+        let height = self.grid.height();
+        let top = self.param(0, 1) - 1;
+        let bottom = self.param(1, height).min(height) - 1;
+        if top < bottom {
+            self.top = top;
+            self.bottom = bottom;
+            self.goto(0, if self.cursor.origin { top } else { 0 });
+        }
+    }
+
+    /// Handle an OSC string once it ends.
+    fn osc_dispatch(&mut self) {
+        let osc = String::from_utf8_lossy(&self.osc);
+        if let Some(("0" | "2", title)) = osc.split_once(';') {
+            self.title = title.to_string();
+        }
+    }
+
+    /// Restore the cursor saved by DECSC, clamped to the screen, or to the
+    /// scroll region in origin mode.
+    fn restore_cursor(&mut self) {
+        self.cursor = self.saved;
+        self.cursor.x = self.cursor.x.min(self.grid.width() - 1);
+        self.cursor.y = if self.cursor.origin {
+            self.cursor.y.clamp(self.top, self.bottom)
+        } else {
+            self.cursor.y.min(self.grid.height() - 1)
+        };
+    }
+
+    /// Move the cursor to a column and absolute row, clamped to the screen,
+    /// or to the scroll region in origin mode.
+    fn goto(&mut self, x: u16, y: u16) {
+        let (min_y, max_y) = if self.cursor.origin {
+            (self.top, self.bottom)
+        } else {
+            (0, self.grid.height() - 1)
+        };
+        self.cursor.y = y.clamp(min_y, max_y);
+        self.set_x(x);
+    }
+
+    /// Move the cursor to a column on its row.
+    fn set_x(&mut self, x: u16) {
+        self.cursor.x = x.min(self.grid.width() - 1);
+        self.cursor.wrap_pending = false;
+    }
+
+    /// Move the cursor up, stopping at the top of the scroll region.
+    fn cursor_up(&mut self, n: u16) {
+        let min_y = if self.cursor.y >= self.top {
+            self.top
+        } else {
+            0
+        };
+        self.cursor.y = self.cursor.y.saturating_sub(n).max(min_y);
+        self.cursor.wrap_pending = false;
+    }
+
+    /// Move the cursor down, stopping at the bottom of the scroll region.
+    fn cursor_down(&mut self, n: u16) {
+        let max_y = if self.cursor.y <= self.bottom {
+            self.bottom
+        } else {
+            self.grid.height() - 1
+        };
+        self.cursor.y = self.cursor.y.saturating_add(n).min(max_y);
+        self.cursor.wrap_pending = false;
+    }
+
+    /// Move to the next tab stops.
+    fn tab_forward(&mut self, n: u16) {
+        let last = self.grid.width() - 1;
+        let mut x = self.cursor.x;
+        for _ in 0..n {
+            x = (x + 1..last)
+                .find(|&x| self.tabs[usize::from(x)])
+                .unwrap_or(last);
+        }
+        self.set_x(x);
+    }
+
+    /// Move to the previous tab stops.
+    fn tab_backward(&mut self, n: u16) {
+        let mut x = self.cursor.x;
+        for _ in 0..n {
+            x = (0..x)
+                .rev()
+                .find(|&x| self.tabs[usize::from(x)])
+                .unwrap_or(0);
+        }
+        self.set_x(x);
+    }
+
+    /// Move down a line, scrolling at the bottom of the scroll region.
+    fn index(&mut self) {
+        if self.cursor.y == self.bottom {
+            self.scroll_up_from(self.top, 1);
+        } else if self.cursor.y + 1 < self.grid.height() {
+            self.cursor.y += 1;
+        }
+        self.cursor.wrap_pending = false;
+    }
+
+    /// Move up a line, scrolling at the top of the scroll region.
+    fn reverse_index(&mut self) {
+        if self.cursor.y == self.top {
+            self.scroll_down_from(self.top, 1);
+        } else {
+            self.cursor.y = self.cursor.y.saturating_sub(1);
+        }
+        self.cursor.wrap_pending = false;
+    }
+
+    /// A blank cell in the current background color.
+    const fn blank(&self) -> Cell {
+        Cell::EMPTY.with_bg(self.cursor.pen.bg)
+    }
+
+    /// Scroll rows `top` to the bottom of the scroll region up by `n`.
+    ///
+    /// Rows leaving the top of the primary screen go to the history.
+    fn scroll_up_from(&mut self, top: u16, n: u16) {
+        let bottom = self.bottom + 1;
+        let n = n.min(bottom - top);
+        if top == 0 && self.history_limit > 0 && !self.alternate_screen() {
+            for y in 0..n {
+                self.save_row(y);
+            }
+        }
+        self.grid.scroll_up(top, bottom, n, self.blank());
+        self.damage[usize::from(top)..usize::from(bottom)].fill(true);
+    }
+
+    /// Keep a display row in the history as a compact line.
+    ///
+    /// Trailing blanks and the right halves of wide characters are dropped,
+    /// and graphemes too long for a cell are cut to their first character,
+    /// since history lines have no overflow storage.
+    fn save_row(&mut self, y: u16) {
+        let row = self.grid.row(y);
+        let len = row.iter().rposition(|cell| *cell != Cell::EMPTY).map_or(0, |x| x + 1);
+        let cells = row[..len]
+            .iter()
+            .filter(|cell| !cell.is_wide_continuation())
+            .map(|cell| {
+                if !cell.is_overflow() {
+                    return *cell;
+                }
+                let c = cell
+                    .overflow_index()
+                    .and_then(|index| self.grid.get_overflow(index))
+                    .and_then(|grapheme| grapheme.chars().next())
+                    .unwrap_or(' ');
+                Cell::from_char(c)
+                    .with_fg(cell.fg())
+                    .with_bg(cell.bg())
+                    .with_modifiers(cell.modifiers())
+            })
+            .collect();
+        if self.history.len() >= self.history_limit {
+            self.history.pop_front();
+        }
+        self.history.push_back(ChunkedLine::new(cells, false));
+    }
+
+    /// Scroll rows `top` to the bottom of the scroll region down by `n`.
+    fn scroll_down_from(&mut self, top: u16, n: u16) {
+        let bottom = self.bottom + 1;
+        self.grid.scroll_down(top, bottom, n.min(bottom - top), self.blank());
+        self.damage[usize::from(top)..usize::from(bottom)].fill(true);
+    }
+
+    /// Get a row of the screen for writing, marking it as changed.
+    fn row_mut(&mut self, y: u16) -> &mut [Cell] {
+        self.damage[usize::from(y)] = true;
+        self.grid.row_mut(y)
+    }
+
+    /// Blank columns `x0..x1` of a row.
+    fn erase(&mut self, y: u16, x0: u16, x1: u16) {
+        let blank = self.blank();
+        self.row_mut(y)[usize::from(x0)..usize::from(x1)].fill(blank);
+    }
+
+    /// Erase in display (ED).
+    fn erase_display(&mut self, mode: u16) {
+        let (x, y) = (self.cursor.x, self.cursor.y);
+        let (width, height) = (self.grid.width(), self.grid.height());
+        let (rows, line) = match mode {
+            0 => (y + 1..height, (x, width)),
+            1 => (0..y, (0, x + 1)),
+            2 => (0..height, (0, 0)),
+            // Erase the scrollback, leaving the screen alone
+            3 => {
+                self.history.clear();
+                self.history_erased = true;
+                return;
+            },
+            _ => return,
+        };
+        for row in rows {
+            self.erase(row, 0, width);
+        }
+        self.erase(y, line.0, line.1);
+    }
+
+    /// Erase in line (EL).
+    fn erase_line(&mut self, mode: u16) {
+        let (x, y) = (self.cursor.x, self.cursor.y);
+        match mode {
+            0 => self.erase(y, x, self.grid.width()),
+            1 => self.erase(y, 0, x + 1),
+            2 => self.erase(y, 0, self.grid.width()),
+            _ => {},
+        }
+    }
+
+    /// Insert blanks at the cursor, shifting the rest of the row right.
+    fn insert_blanks(&mut self, n: u16) {
+        let x = usize::from(self.cursor.x);
+        let blank = self.blank();
+        let row = self.row_mut(self.cursor.y);
+        let n = usize::from(n).min(row.len() - x);
+        let end = row.len() - n;
+        row.copy_within(x..end, x + n);
+        row[x..x + n].fill(blank);
+    }
+
+    /// Delete characters at the cursor, shifting the rest of the row left.
+    fn delete_chars(&mut self, n: u16) {
+        let x = usize::from(self.cursor.x);
+        let blank = self.blank();
+        let row = self.row_mut(self.cursor.y);
+        let n = usize::from(n).min(row.len() - x);
+        let end = row.len() - n;
+        row.copy_within(x + n.., x);
+        row[end..].fill(blank);
+    }
+
+    /// Print the last printed character `n` more times (REP).
+    fn repeat(&mut self, n: u16) {
+        if let Some(c) = self.last {
+            for _ in 0..n {
+                self.print_char(c);
+            }
+        }
+    }
+
+    /// Blank the halves of wide characters that writing columns `x0..x1`
+    /// of a row would split.
+    fn split_wide(&mut self, x0: u16, x1: u16, y: u16) {
+        let row = self.row_mut(y);
+        let (x0, x1) = (usize::from(x0), usize::from(x1));
+        if x0 > 0 && row[x0].is_wide_continuation() {
+            row[x0 - 1] = Cell::EMPTY.with_bg(row[x0 - 1].bg());
+        }
+        if let Some(cell) = row.get_mut(x1).filter(|cell| cell.is_wide_continuation()) {
+            *cell = Cell::EMPTY.with_bg(cell.bg());
+        }
+    }
+
+    /// Wrap to the start of the next line.
+    fn wrap(&mut self) {
+        self.set_x(0);
+        self.index();
+    }
+
+    /// Advance the cursor past `n` printed columns.
+    const fn advance_cursor(&mut self, n: u16) {
+        let last = self.grid.width() - 1;
+        if self.cursor.x + n > last {
+            self.cursor.x = last;
+            self.cursor.wrap_pending = self.modes.contains(Modes::AUTOWRAP);
+        } else {
+            self.cursor.x += n;
+        }
+    }
+
+    /// Print a run of printable ASCII.
+    #[allow(clippy::cast_possible_truncation)] // Runs are clipped to the row
+    fn print_ascii(&mut self, mut run: &[u8]) {
+        if self.cursor.charsets[self.cursor.shift] != Charset::Ascii {
+            for &b in run {
+                self.print_char(char::from(b));
+            }
+            return;
+        }
+
+        let pen = self.cursor.pen;
+        let template = Cell::EMPTY
+            .with_fg(pen.fg)
+            .with_bg(pen.bg)
+            .with_modifiers(pen.modifiers);
+        while !run.is_empty() {
+            if self.cursor.wrap_pending && self.modes.contains(Modes::AUTOWRAP) {
+                self.wrap();
+            }
+            let (x, y) = (self.cursor.x, self.cursor.y);
+            let n = run.len().min(usize::from(self.grid.width() - x));
+            if self.modes.contains(Modes::INSERT) {
+                self.insert_blanks(n as u16);
+            }
+            self.split_wide(x, x + n as u16, y);
+            let row = self.row_mut(y);
+            for (cell, &b) in row[usize::from(x)..].iter_mut().zip(&run[..n]) {
+                *cell = template.with_ascii(b);
+            }
+            self.last = Some(char::from(run[n - 1]));
+            self.advance_cursor(n as u16);
+            run = &run[n..];
+        }
+    }
+
+    /// Print UTF-8 text, keeping an incomplete trailing sequence for the
+    /// next call.
+    fn print_utf8(&mut self, mut bytes: &[u8]) {
+        loop {
+            let (valid, error) = match std::str::from_utf8(bytes) {
+                Ok(text) => (text, None),
+                Err(e) => {
+                    let valid = std::str::from_utf8(&bytes[..e.valid_up_to()]).unwrap_or_default();
+                    (valid, Some(e))
+                },
+            };
+            for c in valid.chars() {
+                self.print_char(c);
+            }
+            let Some(e) = error else { return };
+            let rest = &bytes[e.valid_up_to()..];
+            if let Some(len) = e.error_len() {
+                self.print_char(char::REPLACEMENT_CHARACTER);
+                bytes = &rest[len..];
+            } else {
+                self.utf8[..rest.len()].copy_from_slice(rest);
+                self.utf8_len = rest.len();
+                return;
+            }
+        }
+    }
+
+    /// Continue a UTF-8 sequence split across calls to `feed`.
+    ///
+    /// Returns whether the byte was consumed.
+    fn continue_utf8(&mut self, b: u8) -> bool {
+        if !(0x80..0xC0).contains(&b) {
+            self.utf8_len = 0;
+            self.print_char(char::REPLACEMENT_CHARACTER);
+            return false;
+        }
+        self.utf8[self.utf8_len] = b;
+        self.utf8_len += 1;
+        let decoded = match std::str::from_utf8(&self.utf8[..self.utf8_len]) {
+            Ok(text) => text.chars().next(),
+            Err(e) if e.error_len().is_none() => return true,
+            Err(_) => Some(char::REPLACEMENT_CHARACTER),
+        };
+        self.utf8_len = 0;
+        if let Some(c) = decoded {
+            self.print_char(c);
+        }
+        true
+    }
+
+    /// Print one character.
+    fn print_char(&mut self, c: char) {
+        let c = match (self.cursor.charsets[self.cursor.shift], c) {
+            (Charset::DecGraphics, '\x5F'..='\x7E') => DEC_GRAPHICS[c as usize - 0x5F],
+            _ => c,
+        };
+        let width = char_width(c);
+        let previous = self.previous_cell();
+        let joins = previous
+            .and_then(|(x, y)| self.grid.get_grapheme(x, y))
+            .is_some_and(|grapheme| grapheme.ends_with('\u{200D}'));
+        if width == 0 || joins {
+            if let Some((x, y)) = previous {
+                self.combine(x, y, c);
+            }
+            return;
+        }
+        self.last = Some(c);
+        self.put(c, u16::from(width));
+    }
+
+    /// Get the cell the last character was printed into.
+    fn previous_cell(&self) -> Option<(u16, u16)> {
+        let (x, y) = (self.cursor.x, self.cursor.y);
+        let x = if self.cursor.wrap_pending {
+            x
+        } else {
+            x.checked_sub(1)?
+        };
+        // Step back over the right half of a wide character
+        if self.grid.get(x, y)?.is_wide_continuation() {
+            x.checked_sub(1).map(|x| (x, y))
+        } else {
+            Some((x, y))
+        }
+    }
+
+    /// Append a combining or joined character to a cell's grapheme, up to
+    /// [`MAX_GRAPHEME_LEN`] bytes.
+    fn combine(&mut self, x: u16, y: u16, c: char) {
+        let Some(&cell) = self.grid.get(x, y) else {
+            return;
+        };
+        let mut grapheme = self.grid.get_grapheme(x, y).unwrap_or_default().to_string();
+        if grapheme.len() + c.len_utf8() > MAX_GRAPHEME_LEN {
+            return;
+        }
+        grapheme.push(c);
+        self.grid
+            .set_grapheme(x, y, &grapheme, cell.fg(), cell.bg());
+        if let Some(target) = self.grid.get_mut(x, y) {
+            target.set_modifiers(cell.modifiers());
+        }
+        self.damage[usize::from(y)] = true;
+    }
+
+    /// Put a character of the given width at the cursor.
+    ///
+    /// A character wider than the screen is dropped.
+    fn put(&mut self, c: char, width: u16) {
+        if width > self.grid.width() {
+            return;
+        }
+        let autowrap = self.modes.contains(Modes::AUTOWRAP);
+        if self.cursor.wrap_pending && autowrap {
+            self.wrap();
+        }
+        if self.cursor.x + width > self.grid.width() {
+            // A wide character doesn't fit in the last column
+            if !autowrap {
+                return;
+            }
+            let (x, blank) = (usize::from(self.cursor.x), self.blank());
+            self.row_mut(self.cursor.y)[x] = blank;
+            self.wrap();
+        }
+
+        let (x, y) = (self.cursor.x, self.cursor.y);
+        if self.modes.contains(Modes::INSERT) {
+            self.insert_blanks(width);
+        }
+        self.split_wide(x, x + width, y);
+        let pen = self.cursor.pen;
+        let cell = Cell::from_char(c)
+            .with_fg(pen.fg)
+            .with_bg(pen.bg)
+            .with_modifiers(pen.modifiers);
+        let row = self.row_mut(y);
+        row[usize::from(x)] = cell;
+        if width == 2 {
+            row[usize::from(x) + 1] = Cell::wide_continuation().with_bg(pen.bg);
+        }
+        self.advance_cursor(width);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Get a row of the screen as text.
+    fn row_text(vt: &Vt, y: u16) -> String {
+        (0..vt.screen().width())
+            .filter_map(|x| vt.screen().get_grapheme(x, y))
+            .collect()
+    }
+
+    #[test]
+    fn test_vt_text_wrap_and_scroll() {
+        let mut vt = Vt::new(5, 3);
+        vt.clear_damage();
+        vt.feed(b"abcdefg\r\nxy\tz");
+        assert_eq!(row_text(&vt, 0), "abcde");
+        assert_eq!(row_text(&vt, 1), "fg   ");
+        assert_eq!(row_text(&vt, 2), "xy  z");
+        assert_eq!(vt.damage(), [true, true, true]);
+
+        // The bottom line scrolls the screen up
+        vt.feed(b"\r\n12");
+        assert_eq!(row_text(&vt, 0), "fg   ");
+        assert_eq!(row_text(&vt, 2), "12   ");
+        assert_eq!(vt.cursor(), (2, 2));
+
+        // Split UTF-8, a wide character and a combining mark
+        vt.feed(b"\x1b[H\xe6\xbc");
+        vt.feed(b"\xa2e\xcc\x81");
+        assert_eq!(vt.screen().get_grapheme(0, 0), Some("漢"));
+        assert_eq!(vt.screen().get_grapheme(2, 0), Some("e\u{301}"));
+        assert_eq!(vt.cursor(), (3, 0));
+
+        // Combining marks stop accumulating at the grapheme limit
+        let mut marks = Vt::new(4, 1);
+        marks.feed(b"e");
+        marks.feed("\u{301}".repeat(100).as_bytes());
+        let grapheme = marks.screen().get_grapheme(0, 0).unwrap_or_default();
+        assert_eq!(grapheme.len(), 1 + (MAX_GRAPHEME_LEN - 1) / 2 * 2);
+
+        // A wide character can't fit on a one-column screen
+        let mut vt = Vt::new(1, 2);
+        vt.feed("字a".as_bytes());
+        assert_eq!(row_text(&vt, 0), "a");
+    }
+
+    #[test]
+    fn test_vt_csi_editing_and_sgr() {
+        let mut vt = Vt::new(6, 4);
+        vt.feed(b"aaaaaa\r\nbbbbbb\r\ncccccc\r\ndddddd");
+        vt.feed(b"\x1b[2;3H\x1b[K\x1b[3;1H\x1b[2P\x1b[4;2H\x1b[1@");
+        assert_eq!(row_text(&vt, 1), "bb    ");
+        assert_eq!(row_text(&vt, 2), "cccc  ");
+        assert_eq!(row_text(&vt, 3), "d dddd");
+
+        // Scroll region: a line deleted inside it pulls up the rows below
+        vt.feed(b"\x1b[2;3r\x1b[2;1H\x1b[M");
+        assert_eq!(row_text(&vt, 0), "aaaaaa");
+        assert_eq!(row_text(&vt, 1), "cccc  ");
+        assert_eq!(row_text(&vt, 2), "      ");
+        assert_eq!(row_text(&vt, 3), "d dddd");
+
+        vt.feed(b"\x1b[r\x1b[1;31;44mX\x1b[0mY");
+        let cell = vt.screen().get(0, 0).copied().unwrap_or_default();
+        assert_eq!(cell.fg(), Rgb::from_ansi_index(1));
+        assert_eq!(cell.bg(), Rgb::from_ansi_index(4));
+        assert_eq!(cell.modifiers(), Modifiers::BOLD);
+        assert_eq!(vt.screen().get(1, 0).map(Cell::fg), Some(Rgb::DEFAULT_FG));
+    }
+
+    #[test]
+    fn test_vt_modes_and_reports() {
+        let mut vt = Vt::new(8, 2);
+        vt.feed(b"shell\x1b[?1049h\x1b[?1h\x1b[?25l\x1b]0;title\x07vim");
+        assert!(vt.alternate_screen() && vt.application_cursor() && vt.hide_cursor());
+        assert_eq!(vt.title(), "title");
+        assert_eq!(row_text(&vt, 0), "     vim");
+
+        vt.feed(b"\x1b[?1049l\x1b[6n\x1b[c\x1b(0q\x1b(B");
+        assert!(!vt.alternate_screen());
+        assert_eq!(row_text(&vt, 0), "shell─  ");
+        assert_eq!(vt.take_responses(), b"\x1b[1;6R\x1b[?62;22c");
+        assert!(vt.take_responses().is_empty());
+
+        // A cursor saved above a later scroll region is restored into it
+        let mut vt = Vt::new(10, 20);
+        vt.feed(b"\x1b[?6h\x1b7\x1b[5;10r\x1b8\x1b[6n");
+        assert_eq!(vt.cursor(), (0, 4));
+        assert_eq!(vt.take_responses(), b"\x1b[1;1R");
+    }
+
+    #[test]
+    fn test_vt_history() {
+        let mut vt = Vt::with_history(4, 2, 100);
+        let mut scrollback = RopeBuffer::new(100);
+        vt.feed(b"one\r\n\x1b[32mtwo\x1b[0m\r\nxx\r\nfour");
+        assert!(vt.has_history());
+        vt.drain_history(&mut scrollback);
+        assert!(!vt.has_history());
+
+        // Scrolled-off rows are trimmed; the rope's last line stays open
+        assert_eq!(scrollback.len(), 3);
+        assert_eq!(scrollback.get_line(0).map(ChunkedLine::len), Some(3));
+        let two = scrollback.get_line(1).map(|line| line.content[0]).unwrap_or_default();
+        assert_eq!(two.fg(), Rgb::from_ansi_index(2));
+        assert_eq!(row_text(&vt, 0), "xx  ");
+
+        // The alternate screen keeps nothing; `CSI 3 J` erases the scrollback
+        vt.feed(b"\x1b[?1049h\r\n\r\n\r\n\x1b[?1049l");
+        assert!(!vt.has_history());
+        vt.feed(b"\x1b[3J");
+        vt.drain_history(&mut scrollback);
+        assert_eq!(scrollback.len(), 1);
+        assert_eq!(row_text(&vt, 1), "four");
+
+        // The open line doesn't count against the history limit
+        let mut vt = Vt::with_history(4, 1, 100);
+        let mut scrollback = history_buffer(2);
+        vt.feed(b"a\r\nb\r\nc\r\nd");
+        vt.drain_history(&mut scrollback);
+        assert_eq!(scrollback.len(), 3);
+        assert_eq!(scrollback.get_line(0).map(|line| line.content[0].grapheme()), Some(Some("b")));
+    }
+}
@@ -0,0 +1,109 @@
+//! Stream Writer: Append handle for feeding a [`StreamWidget`] from other threads.
+//!
+//! Network and agent threads hold a [`StreamWriter`] and write tokens
+//! straight into a bounded ring owned by the widget. The UI thread takes
+//! everything waiting in the ring once per frame and ingests it as one
+//! batch, so a token crosses threads exactly once and is never copied on
+//! the way:
+//!
+//! ```text
+//! ┌────────────────┐  write(String)  ┌──────┐  append_pending  ┌────────┐
+//! │ Network Thread │ ──────────────▶ │ ring │ ───────────────▶ │ Stream │
+//! └────────────────┘   (lock-free)   └──────┘   (per frame)    └────────┘
+//! ```
+//!
+//! [`StreamWidget`]: super::StreamWidget
+
+use crossbeam_channel::{bounded, Receiver, SendError, Sender, TrySendError};
+
+/// Tokens the ring holds before writers have to wait.
+pub const WRITER_CAPACITY: usize = 4096;
+
+/// Cloneable, thread-safe handle for appending to a [`StreamWidget`].
+///
+/// Get one from [`StreamWidget::writer`]. Writes never take a lock: the
+/// ring is a fixed array claimed slot by slot with atomic operations.
+/// Once the widget is dropped, every write fails and hands the token back.
+///
+/// [`StreamWidget`]: super::StreamWidget
+/// [`StreamWidget::writer`]: super::StreamWidget::writer
+#[derive(Debug, Clone)]
+pub struct StreamWriter {
+    /// Sending side of the widget's ring.
+    tx: Sender<String>,
+}
+
+impl StreamWriter {
+    /// Queue a token, waiting while the ring is full.
+    ///
+    /// Blocking applies backpressure to the producer when the UI thread
+    /// falls behind, rather than buffering without limit.
+    ///
+    /// # Errors
+    /// Returns the token if the widget has been dropped.
+    pub fn write(&self, token: impl Into<String>) -> Result<(), String> {
+        self.tx.send(token.into()).map_err(|SendError(token)| token)
+    }
+
+    /// Queue a token without waiting.
+    ///
+    /// # Errors
+    /// Returns the token if the ring is full or the widget has been dropped.
+    pub fn try_write(&self, token: impl Into<String>) -> Result<(), String> {
+        self.tx.try_send(token.into()).map_err(|err| match err {
+            TrySendError::Full(token) | TrySendError::Disconnected(token) => token,
+        })
+    }
+}
+
+/// Receiving end of the writer ring, owned by the widget.
+#[derive(Debug)]
+pub(super) struct Inbox {
+    /// Sending side, cloned into new writers.
+    tx: Sender<String>,
+    /// Receiving side, drained at frame time.
+    rx: Receiver<String>,
+    /// Tokens taken in the current drain, reused across frames.
+    tokens: Vec<String>,
+}
+
+impl Inbox {
+    /// Create an empty ring.
+    pub(super) fn new() -> Self {
+        let (tx, rx) = bounded(WRITER_CAPACITY);
+        Self {
+            tx,
+            rx,
+            tokens: Vec::new(),
+        }
+    }
+
+    /// Create a writer for this ring.
+    pub(super) fn writer(&self) -> StreamWriter {
+        StreamWriter {
+            tx: self.tx.clone(),
+        }
+    }
+
+    /// Check if tokens are waiting.
+    pub(super) fn is_empty(&self) -> bool {
+        self.rx.is_empty()
+    }
+
+    /// Take the tokens waiting in the ring.
+    ///
+    /// At most one ring's worth is taken, so writers that keep up with the
+    /// drain can't hold the UI thread in it forever. The returned vector
+    /// should be handed back through [`restore`](Self::restore).
+    pub(super) fn take(&mut self) -> Vec<String> {
+        let mut tokens = std::mem::take(&mut self.tokens);
+        tokens.extend(self.rx.try_iter().take(WRITER_CAPACITY));
+        tokens
+    }
+
+    /// Return the vector from [`take`](Self::take) for reuse.
+    pub(super) fn restore(&mut self, mut tokens: Vec<String>) {
+        tokens.clear();
+        self.tokens = tokens;
+    }
+}